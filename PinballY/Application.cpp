@@ -47,6 +47,8 @@
 #include "TextureShader.h"
 #include "I420Shader.h"
 #include "DMDShader.h"
+#include "TextShader.h"
+#include "SpriteBatchShader.h"
 #include "PinscapeDevice.h"
 #include "MonitorCheck.h"
 #include "HighScores.h"
@@ -110,6 +112,8 @@ namespace ConfigVars
 	static const TCHAR *MouseHideCoors = _T("Mouse.HideCoords");
 	static const TCHAR *KeepDMDInFront = _T("DMDWindow.KeepInFrontOfBg");
 	static const TCHAR *UseInternalSWFRenderer = _T("UseInternalSWFRenderer");
+	static const TCHAR *SWFSoftwareRenderer = _T("SWFSoftwareRenderer");
+	static const TCHAR *TableMetadataScan = _T("TableMetadata.BackgroundScan");
 }
 
 // include the capture-related variables
@@ -288,6 +292,17 @@ int Application::EventLoop(int nCmdShow)
 			gameStatsPath = m[1].str();
 		}
 
+		// Audio output sink
+		else if (std::regex_match(argp, m, std::basic_regex<TCHAR>(_T("/audiosink:(.+)"), std::regex_constants::icase)))
+		{
+			// /AudioSink:null
+			// /AudioSink:file=<path>
+			//
+			// Replaces the sound hardware with a null sink or a WAV file
+			// writer, for measuring button sound latency
+			audioSink = m[1].str();
+		}
+
 		// Javascript Debug mode
 		else if (std::regex_match(argp, m, std::basic_regex<TCHAR>(_T("/jsdebug(:(.*))?"), std::regex_constants::icase)))
 		{
@@ -510,6 +525,17 @@ int Application::EventLoop(int nCmdShow)
 	// launch the watchdog process
 	watchdog.Launch();
 
+	// set up the background encoder queue for batch captures
+	captureEncoderQueue.reset(new CaptureEncoderQueue());
+
+	// Load the table metadata cache, and start extracting metadata for
+	// any table files that aren't in the cache yet.  This runs in the
+	// background, at low priority.
+	tableMetadataCache.reset(new TableMetadataCache());
+	tableMetadataCache->Load();
+	if (ConfigManager::GetInstance()->GetBool(ConfigVars::TableMetadataScan, true))
+		tableMetadataCache->ScanGameList();
+
 	// run the main window's message loop
 	int retcode = D3DView::MessageLoop();
 
@@ -520,6 +546,14 @@ int Application::EventLoop(int nCmdShow)
 		gameMonitor->Shutdown(eh, 5000, true);
 		gameMonitor = nullptr;
 	}
+
+	// stop any background capture encoders
+	if (captureEncoderQueue != nullptr)
+		captureEncoderQueue->Shutdown(5000);
+
+	// stop the table metadata workers
+	if (tableMetadataCache != nullptr)
+		tableMetadataCache->Shutdown(5000);
 	
 	// Delete any queued launches.  The only reason we have to do this
 	// explicitly (rather than letting the destructor take care of it) is
@@ -737,6 +771,16 @@ bool Application::Init()
 	if (!dmdShader->Init())
 		return false;
 
+	// create the sprite text shader (for glyph atlas text in sprite lists)
+	spriteTextShader.reset(new SpriteTextShader());
+	if (!spriteTextShader->Init())
+		return false;
+
+	// create the sprite batch shader (for instanced sprite drawing)
+	spriteBatchShader.reset(new SpriteBatchShader());
+	if (!spriteBatchShader->Init())
+		return false;
+
 	// create the I420 shader (YUV format, for videos)
 	i420Shader.reset(new I420Shader());
 	if (!i420Shader->Init())
@@ -752,8 +796,15 @@ bool Application::Init()
 	if (!i444A10Shader->Init())
 		return false;
 
-	// initialize the audio manager
-	AudioManager::Init();
+	// initialize the audio manager, using the sink selected on the
+	// command line, if any
+	AudioBackend *audioBackend = nullptr;
+	std::match_results<TSTRING::const_iterator> m;
+	if (_tcsicmp(audioSink.c_str(), _T("null")) == 0)
+		audioBackend = new NullAudioSink();
+	else if (std::regex_match(audioSink, m, std::basic_regex<TCHAR>(_T("file=(.+)"), std::regex_constants::icase)))
+		audioBackend = new FileAudioSink(m[1].str().c_str());
+	AudioManager::Init(audioBackend);
 
 	// start Media Foundation
 	MFStartup(MF_VERSION, MFSTARTUP_NOSOCKET);
@@ -888,6 +939,10 @@ bool Application::ReloadConfig()
 	if (auto pfv = GetPlayfieldView(); pfv != nullptr)
 		pfv->OnGameListRebuild();
 
+	// the table list might have changed, so rescan for table metadata
+	if (tableMetadataCache != nullptr && ConfigManager::GetInstance()->GetBool(ConfigVars::TableMetadataScan, true))
+		tableMetadataCache->ScanGameList();
+
 	// reload DMD support
 	GetPlayfieldView()->InitRealDMD(uieh);
 
@@ -910,6 +965,7 @@ void Application::OnConfigChange()
 	muteAttractMode = cfg->GetBool(ConfigVars::MuteAttractMode, true);
 	hideUnconfiguredGames = cfg->GetBool(ConfigVars::HideUnconfiguredGames, false);
 	useInternalSWFRenderer = cfg->GetBool(ConfigVars::UseInternalSWFRenderer, true);
+	useSoftwareSWFRenderer = cfg->GetBool(ConfigVars::SWFSoftwareRenderer, false);
 
 	// update the video sync mode
 	D3DWin::vsyncMode = cfg->GetBool(ConfigVars::VSyncLock, false) ? 1 : 0;
@@ -965,6 +1021,10 @@ void Application::SaveFiles()
 	// save change to game database XML files
 	GameList::Get()->SaveGameListFiles();
 
+	// save the table metadata cache
+	if (inst->tableMetadataCache != nullptr)
+		inst->tableMetadataCache->Save();
+
 	// save any config setting updates
 	ConfigManager::GetInstance()->SaveIfDirty();
 }
@@ -2361,6 +2421,22 @@ bool Application::GameMonitorThread::Launch(
 	return Launch(eh);
 }
 
+// Can a capture item be included in a combined multi-window capture?
+// Only timed videos qualify, since the combined capture starts and
+// stops all of its outputs together.  The custom command options are
+// templates for a single window's capture, so we can't use them to
+// build the combined command; if any of those are in use, we fall back
+// on capturing the windows individually.
+static bool IsCombinableCaptureItem(const CaptureInfo &capture, const CaptureItemDesc &item)
+{
+	return item.mediaType.IsVideo()
+		&& !item.manualStart && !item.manualStop
+		&& capture.customVideoSource.length() == 0
+		&& capture.customVideoCodec.length() == 0
+		&& capture.customAudioSource.length() == 0
+		&& capture.customGlobalOptions.length() == 0;
+}
+
 void Application::GameMonitorThread::Prepare(
 	int cmd, DWORD launchFlags, GameListItem *game,
 	GameSystem *system,
@@ -2423,6 +2499,19 @@ void Application::GameMonitorThread::Prepare(
 		// remember the two-pass encoding option
 		capture.twoPassEncoding = cfg->GetBool(ConfigVars::CaptureTwoPassEncoding, false);
 
+		// If this is part of a batch, check for background encoding.  In
+		// this mode, we capture video in two passes regardless of the
+		// two-pass setting, but only the first (capture) pass runs while
+		// the game is running.  The second (encoding) pass goes to the
+		// background encoder queue, so that it can overlap with the
+		// capture of the next game in the batch.
+		capture.backgroundEncode = bci != nullptr
+			&& cfg->GetBool(ConfigVars::CaptureBatchBackgroundEncoding, true)
+			&& Application::Get()->GetCaptureEncoderQueue() != nullptr;
+
+		// remember the combined capture option
+		capture.combinedCapture = cfg->GetBool(ConfigVars::CaptureCombinedVideo, false);
+
 		// remember the video codec for pass 1 of a two-pass recording
 		capture.vcodecPass1 = cfg->Get(ConfigVars::CaptureVideoCodecPass1, _T(""));
 		if (capture.vcodecPass1.length() == 0)
@@ -2479,7 +2568,10 @@ void Application::GameMonitorThread::Prepare(
 			// decent upper bound.  And of course we've already established that 
 			// a factor of one is a good lower bound if we're using this mode.
 			// So let's just split the difference and call it 1.5x.
-			if (capture.twoPassEncoding
+			//
+			// In background encoding mode, the second pass happens after
+			// we're done with the game, so it doesn't count here.
+			if (capture.twoPassEncoding && !capture.backgroundEncode
 				&& (item.mediaType.format == MediaType::Format::SilentVideo
 					|| item.mediaType.format == MediaType::Format::VideoWithAudio))
 				capture.totalTime += item.captureTime * 3 / 2;
@@ -2510,6 +2602,25 @@ void Application::GameMonitorThread::Prepare(
 				audioNeeded = true;
 		}
 
+		// In combined capture mode, the timed video items all run at the
+		// same time, so they only take as long as the longest one.
+		if (capture.combinedCapture)
+		{
+			int nCombined = 0;
+			DWORD sumTime = 0, maxTime = 0;
+			for (auto &item : capture.items)
+			{
+				if (IsCombinableCaptureItem(capture, item))
+				{
+					++nCombined;
+					sumTime += item.captureTime + 2000;
+					maxTime = max(maxTime, item.captureTime + 2000);
+				}
+			}
+			if (nCombined >= 2)
+				capture.totalTime -= sumTime - maxTime;
+		}
+
 		// If audio is required, figure the audio device
 		if (audioNeeded)
 		{
@@ -2816,6 +2927,168 @@ bool Application::GameMonitorThread::GetLaunchParamBool(const CHAR *propname, bo
 		return defaultVal;
 }
 
+// Figure the ffmpeg video filter transforms for a capture item.  This
+// returns a comma-separated filter list, suitable for an ffmpeg -vf
+// option, or an empty string if no transforms are required.
+static TSTRING GetCaptureVideoTransforms(const CaptureInfo &capture, const CaptureItemDesc &item)
+{
+	// Figure the ffmpeg transforms to apply to the captured screen
+	// images to get the final video in the correct orientation.  We
+	// need to invert the transformations we apply to our display
+	// images, so that an image captured from a screen that appears
+	// as we display it gets stored in a format that yields that same
+	// screen display appearance after applying our display transforms.
+	// We apply our mirror/flip transforms last, so apply the reverse
+	// mirror/flip transforms first in the capture.  (The mirror/flip
+	// transforms are mutually commutative, so it doesn't matter
+	// which one goes first.)
+	TSTRING transforms;
+	auto AddTransform = [&transforms, &item](const TCHAR *t)
+	{
+		// add visual transforms for visual media only
+		if (item.mediaType.format != MediaType::Audio)
+		{
+			// add commas between items items
+			if (transforms.length() != 0)
+				transforms += _T(",");
+
+			// add the new transform
+			transforms += t;
+		}
+	};
+	if (item.windowMirrorVert)
+		AddTransform(_T("vflip"));
+	if (item.windowMirrorHorz)
+		AddTransform(_T("hflip"));
+
+	// Now add the rotation transform.  We need to figure the total
+	// rotation as the difference between the normal rotation for the
+	// media type and the window rotation.  And then we have to apply
+	// that rotation in the opposite direction.  Our display transforms
+	// are all clockwise, so we need counter-clockwise rotations for
+	// the reversals.  Note that we normalize to 0..359 degrees.
+	int rotate = ((item.mediaRotation - item.windowRotation) + 360) % 360;
+	switch (rotate)
+	{
+	case 90:
+		AddTransform(_T("transpose=2"));  // 90 degrees counter-clockwise
+		break;
+
+	case 180:
+		AddTransform(_T("transpose=1,transpose=1"));  // 90 degrees twice -> 180 degrees
+		break;
+
+	case 270:
+		AddTransform(_T("transpose=1"));  // 90 degrees clockwise
+		break;
+	}
+
+	// limit the video resolution if desired
+	if (item.mediaType.IsVideo())
+	{
+		// presume both dimensions are free (i.e., no resolution limit by default)
+		int xScale = -2, yScale = -2;
+
+		// figure the capture dimensions
+		int width = item.rc.right - item.rc.left;
+		int height = item.rc.bottom - item.rc.top;
+
+		// assume the limit will be the natural size
+		int maxWidth = width, maxHeight = height;
+
+		// check the resolution limit type
+		switch (capture.videoResLimit)
+		{
+		case CaptureInfo::ResLimitHD:
+			// HD limit
+			maxWidth = 1920;
+			maxHeight = 1080;
+			break;
+
+		case CaptureInfo::ResLimitNone:
+			// no limit - no scaling transform
+			break;
+		}
+
+		// if we're rotating the video, rotate the dimensions accordingly
+		if (rotate == 90 || rotate == 270)
+		{
+			// rotate the screen width to get the video width
+			int t = width;
+			width = height;
+			height = t;
+
+			// also rotate the limits
+			t = maxWidth;
+			maxWidth = maxHeight;
+			maxHeight = t;
+		}
+
+		// if we exceed the maximum width, limit the width
+		if (width > maxWidth)
+		{
+			// figure the scaling transform width
+			xScale = maxWidth;
+
+			// figure the new width height that results from applying the new width
+			// and maintaining the aspect ration
+			height = height * maxWidth / width;
+			width = maxWidth;
+		}
+
+		// If we exceed the maximum height, limit the height.  Note that the height
+		// has already been adjusted to match the width limit, if we had to limit
+		// the width, so the height limit will only apply if we have to further
+		// reduce the height to fit in an HD frame.  This can happen if we have
+		// a narrow aspect ratio than 16:9.
+		if (height > maxHeight)
+		{
+			// the height limit is stricter than the width limit, so apply it
+			// instead of the width limit
+			yScale = maxHeight;
+			xScale = -2;
+		}
+
+		// if we limited one of the dimensions, set the transform
+		if (xScale > 0 || yScale > 0)
+			AddTransform(MsgFmt(_T("scale=%d:%d"), xScale, yScale));
+	}
+
+	// return the filter list
+	return transforms;
+}
+
+// Get the name of the temporary file for the first pass of a two-pass
+// video capture.  The name has to be unique per job, not just per output
+// file: with background encoding, a queued second pass can still be
+// reading its temp file while the next item's first pass runs, and when
+// all of the temp files go in a common temp folder, the table video and
+// backglass video for a game would otherwise both map to the same
+// <Title>.tmp.mkv.  So we add the media type ID and a serial number.
+static TSTRING GetCaptureTempFile(const CaptureInfo &capture, const CaptureItemDesc &item)
+{
+	// start with the output file name, and replace the suffix with
+	// .<media type>.<serial>.tmp.mkv
+	static volatile LONG serial = 0;
+	TSTRING suffix = MsgFmt(_T(".%s.%ld.tmp.mkv"), item.mediaType.configId, InterlockedIncrement(&serial)).Get();
+	TSTRING tmpfile = std::regex_replace(item.filename, std::basic_regex<TCHAR>(_T("\\.([^.]+)$")), suffix);
+
+	// If there's a temp folder specified in the settings, replace
+	// the path to the temp file with the temp folder.
+	if (capture.tempFolder.length() != 0)
+	{
+		// combine the temp folder with the base file name from
+		// the current temp file to get the full path
+		TCHAR buf[MAX_PATH];
+		PathCombine(buf, capture.tempFolder.c_str(), PathFindFileName(tmpfile.c_str()));
+
+		// replace the original temp file name
+		tmpfile = buf;
+	}
+
+	return tmpfile;
+}
+
 DWORD Application::GameMonitorThread::Main()
 {
 	// Get the game filename from the database, and build the full path
@@ -4187,9 +4460,11 @@ DWORD Application::GameMonitorThread::Main()
 		TSTRINGEx curStatus;
 		int overallStatusMsgId = 0;
 
-		// count of media items attempted/succeeded
+		// count of media items attempted/succeeded, and the number of
+		// items handed off to the background encoder
 		int nMediaItemsAttempted = 0;
 		int nMediaItemsOk = 0;
+		int nEncodesQueued = 0;
 
 		// do the initial startup wait, to allow the game to boot up
 		{
@@ -4216,6 +4491,676 @@ DWORD Application::GameMonitorThread::Main()
 		TCHAR ffmpeg[MAX_PATH];
 		GetDeployedFilePath(ffmpeg, _T("ffmpeg\\ffmpeg.exe"), _T("$(SolutionDir)ffmpeg$(64)\\ffmpeg.exe"));
 
+		// Run the capture.  'logSuccess' indicates whether or not we'll log
+		// a successful completion; this should be false until the last pass
+		// if we're doing a multi-pass capture, so that we don't roll out the
+		// "mission accomplished" banner prematurely.  'isCapturePass' is true
+		// on the first pass where we actually the capture, and false on
+		// subsequent passes.  This is used for Manual Stop mode: we only pay 
+		// attention to Manual Stop mode on the actual capture pass, not on
+		// subsequent encoding passes.
+		auto RunFFMPEG = [this, &statusList, &curStatus, &captureOkay, &abortCapture, &nMediaItemsOk]
+		(CaptureItemDesc &item, const TSTRING &itemDesc, TSTRINGEx &cmdline, bool logSuccess, bool isCapturePass)
+		{
+			// presume failure
+			bool result = false;
+
+			// Log the command for debugging purposes, as there's a lot that
+			// can go wrong here and little information back from ffmpeg that
+			// we can analyze mechanically.
+			auto LogCommandLine = [&curStatus, &cmdline](bool log)
+			{
+				if (log)
+				{
+					LogFile::Get()->Group();
+					LogFile::Get()->Write(_T("Media capture: %s: launching ffmpeg with command line:\n> %s\n"),
+						curStatus.c_str(), cmdline.c_str());
+				}
+			};
+
+			// give Javascript a crack at customizing the command line
+			PlayfieldView::PreCaptureReport report(gameId, capture, item, isCapturePass, cmdline.c_str());
+			playfieldView->SendMessage(PFVMsgPreCapture, 0, reinterpret_cast<LPARAM>(&report));
+
+			// if Javascript canceled the item or batch, stop here
+			if (report.cancelBatch) 
+			{
+				// cancel the whole rest of the batch, including this item
+				LogFile::Get()->Write(LogFile::CaptureLogging,
+					_T("Media capture: %s: remainder of batch canceled by Javascript precapture event\n"),
+					curStatus.c_str());
+
+				// set the abort-all flag, and return false to cancel remaining work on the current item
+				abortCapture = true;
+				return false;
+			}
+			else if (report.cancelItem)
+			{
+				// cancel the current item only
+				LogFile::Get()->Write(LogFile::CaptureLogging,
+					_T("Media capture: %s: item canceled by Javascript precapture event\n"),
+					curStatus.c_str());
+
+				// return false to cancel remaining work on this item
+				return false;
+			}
+
+			// retrieve the updated command line from the javascript
+			cmdline = report.ffmpegCommandLine;
+
+			// log the command line information if logging is enabled
+			LogCommandLine(LogFile::Get()->IsFeatureEnabled(LogFile::CaptureLogging));
+
+			// Set up an "inheritable handle" security attributes struct,
+			// for creating the stdin and stdout/stderr handles for the
+			// child process.  These need to be inheritable so that we 
+			// can open the files and pass the handles to the child.
+			SECURITY_ATTRIBUTES sa;
+			sa.nLength = sizeof(sa);
+			sa.lpSecurityDescriptor = NULL;
+			sa.bInheritHandle = TRUE;
+
+			// Create a pipe for the ffmpeg stdin.  This will let us send
+			// a "q" key to cancel the capture prematurely if necessary.
+			HandleHolder hStdinRead, hStdinWrite;
+			if (CreatePipe(&hStdinRead, &hStdinWrite, &sa, 1024))
+			{
+				// don't let the child inherit our end of the pipe
+				SetHandleInformation(hStdinWrite, HANDLE_FLAG_INHERIT, 0);
+			}
+			else
+			{
+				// failed to create the pipe - just pass the NUL device
+				hStdinRead = CreateFile(_T("NUL"), GENERIC_READ, 0, &sa, OPEN_EXISTING, 0, NULL);
+
+				// we absolutely need the pipe in Manual Stop mode, since it's
+				// the way we tell ffmpeg to stop the capture
+				if (item.manualStop && isCapturePass)
+				{
+					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_MANUAL_STOP_NO_PIPE).c_str()));
+					LogFile::Get()->Write(LogFile::CaptureLogging,
+						_T("+ Manual Stop isn't possible for this item because an error occurred\n")
+						_T("  trying to create a pipe to send the stop command to ffmpeg; capture aborted\n"));
+					captureOkay = false;
+					abortCapture = true;
+					return false;
+				}
+			}
+
+			// Set up a temp file to capture output from FFmpeg, so that we can
+			// copy it to the log file after the capture is done.  Do this whether
+			// or not capture logging is enabled; if the capture fails due to an
+			// FFmpeg error, we'll log the FFmpeg output regardless of the log
+			// settings, to give the user a chance to see what went wrong even
+			// if they weren't anticipating anything going wrong.
+			HandleHolder hStdOut;
+			TSTRING fnameStdOut;
+			{
+				// create the temp file
+				TCHAR tmpPath[MAX_PATH] = _T("<no temp path>"), tmpName[MAX_PATH] = _T("<no temp name>");
+				GetTempPath(countof(tmpPath), tmpPath);
+				GetTempFileName(tmpPath, _T("PBYCap"), 0, tmpName);
+				hStdOut = CreateFile(tmpName, GENERIC_WRITE, 0, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+				// log an error if that failed, but continue with the capture
+				if (hStdOut == NULL)
+				{
+					// log the error
+					WindowsErrorMessage err;
+					LogFile::Get()->Write(LogFile::CaptureLogging,
+						_T("+ Unable to log FFMPEG output: error opening temp file %s (error %d: %s)\n"),
+						tmpName, err.GetCode(), err.Get());
+
+					// direct FFmpeg output to NUL
+					hStdOut = CreateFile(_T("NUL"), GENERIC_WRITE, 0, &sa, OPEN_EXISTING, 0, NULL);
+				}
+				else
+				{
+					// successfully opened the file - remember its name
+					fnameStdOut = tmpName;
+				}
+			}
+
+			// Set up the startup info.  Use Show-No-Activate to try to keep
+			// the game window activated and in the foreground, since VP (and
+			// probably others) stop animations when in the background.
+			STARTUPINFO startupInfo;
+			ZeroMemory(&startupInfo, sizeof(startupInfo));
+			startupInfo.cb = sizeof(startupInfo);
+			startupInfo.dwFlags = STARTF_USESHOWWINDOW | STARTF_USESTDHANDLES;
+			startupInfo.wShowWindow = SW_SHOWNOACTIVATE;
+			startupInfo.hStdInput = hStdinRead;
+			startupInfo.hStdOutput = hStdOut;
+			startupInfo.hStdError = hStdOut;
+
+			// launch the process
+			PROCESS_INFORMATION procInfo;
+			if (CreateProcess(NULL, cmdline.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW,
+				NULL, NULL, &startupInfo, &procInfo))
+			{
+				// ffmpeg launched successfully.  Put the handles in holders
+				// so that we auto-close the handles when done with them.
+				HandleHolder hFfmpegProc(procInfo.hProcess);
+				HandleHolder hFfmpegThread(procInfo.hThread);
+
+				// close our copy of the child's stdin read handle
+				hStdinRead = NULL;
+
+				// copy the ffmpeg output log file to our log, if capturing a log
+				auto CopyOutputToLog = [&hStdOut, &fnameStdOut, &LogCommandLine](bool force)
+				{
+					// close our copy of the output file handle to make sure the
+					// file is really closed
+					hStdOut = nullptr;
+
+					// check if we're include capture logging
+					if (!LogFile::Get()->IsFeatureEnabled(LogFile::CaptureLogging))
+					{
+						// Capture logging is disabled, so we're not logging this by
+						// default.  Check for a 'force' override.
+						if (force)
+						{
+							// We're forcing the output, due to an error in the capture.
+							// In this case, we won't have logged the command line earlier,
+							// so do so now.
+							LogCommandLine(true);
+						}
+						else
+						{
+							// capture logging disabled, not forcing it; don't copy the output
+							return;
+						}
+					}
+
+					// if there's a log file, copy it
+					if (fnameStdOut.length() != 0)
+					{
+						// read the file
+						long len;
+						std::unique_ptr<BYTE> txt(ReadFileAsStr(fnameStdOut.c_str(), SilentErrorHandler(),
+							len, ReadFileAsStr_NewlineTerm | ReadFileAsStr_NullTerm));
+
+						// copy it to the log file
+						if (txt != nullptr)
+						{
+							// in case the log file contains null bytes, write it piecewise
+							// in null-terminated chunks
+							const BYTE *endp = txt.get() + len;
+							for (const BYTE *p = txt.get(); p < endp; )
+							{
+								// find the end of this null-terminated chunk
+								const BYTE *q;
+								for (q = p; q != endp && *q != 0; ++q);
+
+								// write this chunk
+								LogFile::Get()->WriteStrA((const char *)p);
+
+								// skip the null byte
+								p = q + 1;
+							}
+						}
+
+						// delete the temp file
+						DeleteFile(fnameStdOut.c_str());
+					}
+				};
+
+				// Wait for the process to finish, or for a shutdown or
+				// close-game event to interrupt it.  Also include the
+				// start/stop event as the last handle, but don't count
+				// it just yet - we'll only include it in the actual wait
+				// if we're in manual stop mode.
+				HANDLE h[] = { hFfmpegProc, hGameProc, shutdownEvent, closeEvent, startStopEvent };
+				static const TCHAR *waitName[] = {
+					_T("ffmpeg exited"), _T("game exited"), _T("app shutdown"), _T("user Exit Game command"), _T("Manual Stop")
+				};
+				DWORD nWaitHandles = countof(h) - 1;
+
+				// Check for Manual Stop mode.  This only applies on the
+				// capture pass (not on subsequent encode/compress passes).
+				if (item.manualStop && isCapturePass)
+				{
+					// include the manual stop event in the wait list
+					nWaitHandles += 1;
+
+					// set the capture status window to reflect manual stop mode
+					capture.statusWin->SetManualStopMode(true);
+
+					// clear any past manual start/stop signal
+					ResetEvent(startStopEvent);
+				}
+
+			WaitForFfmpeg:
+				// wait for the capture to finish
+				const TCHAR *waitResultName = nullptr;
+				switch (DWORD waitResult = WaitForMultipleObjects(nWaitHandles, h, FALSE, INFINITE))
+				{
+				case WAIT_OBJECT_0 + 4:
+					// The user pressed the Manual Stop button to terminate a manually
+					// timed capture.  Send ffmpeg the "Q" key on its stdin to stop
+					// the capture.
+					if (hStdinWrite != NULL)
+					{
+						static const char msg[] = "q\n";
+						DWORD actual;
+						WriteFile(hStdinWrite, msg, sizeof(msg) - 1, &actual, NULL);
+					}
+
+					// Now go back for another wait pass, this time removing the
+					// Manual Stop event from the wait list.  This gives ffmpeg a
+					// chance to exit before we proceed.
+					nWaitHandles -= 1;
+					goto WaitForFfmpeg;
+
+				case WAIT_OBJECT_0:
+					// The ffmpeg process finished successfully
+					{
+						// retrieve the process exit code
+						DWORD exitCode;
+						GetExitCodeProcess(hFfmpegProc, &exitCode);
+
+						// Copy the output to the log.  If the FFmpeg exit code was non-zero,
+						// log it even if capture logging is turned off in the options, since
+						// the error information is too useful to discard just because the
+						// user wasn't anticipating an error.
+						CopyOutputToLog(exitCode != 0);
+
+						// log the process exit code
+						LogFile::Get()->Write(LogFile::CaptureLogging,
+							_T("\n+ FFMPEG completed: process exit code %d\n"), (int)exitCode);
+
+						// consider this a success if the exit code was 0, otherwise consider
+						// it an error
+						if (exitCode == 0)
+						{
+							// success
+							result = true;
+
+							// log successful completion if desired
+							if (logSuccess)
+							{
+								// log the success
+								statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_OK).c_str()));
+
+								// count the success
+								nMediaItemsOk += 1;
+							}
+						}
+						else
+						{
+							// log the error
+							statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(),
+								MsgFmt(IDS_ERR_CAP_ITEM_FFMPEG_ERR_LOGGED, (int)exitCode).Get()));
+							captureOkay = false;
+						}
+					}
+					break;
+
+				default:
+					// Error/unexpected wait result
+					waitResultName = _T("Error waiting for ffmpeg to exit");
+					goto Interruption;
+
+				case WAIT_OBJECT_0 + 1:
+				case WAIT_OBJECT_0 + 2:
+				case WAIT_OBJECT_0 + 3:
+					waitResultName = waitName[waitResult - WAIT_OBJECT_0];
+
+				Interruption:
+					// Shutdown event, close event, or premature game termination,
+					// or another error.  Count this as an interrupted capture.
+					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_INTERRUPTED).c_str()));
+					captureOkay = false;
+					abortCapture = true;
+
+					// log it
+					CopyOutputToLog(false);
+					LogFile::Get()->Write(LogFile::CaptureLogging, _T("\n+ capture interrupted (%s)\n"), waitResultName);
+
+					// Send ffmpeg a "Q" key press on its stdin to try to shut
+					// it down immediately
+					if (hStdinWrite != NULL)
+					{
+						static const char msg[] = "q\n";
+						DWORD actual;
+						WriteFile(hStdinWrite, msg, sizeof(msg) - 1, &actual, NULL);
+					}
+					break;
+				}
+			}
+			else
+			{
+				// Error launching ffmpeg.  It's likely that all subsequent
+				// ffmpeg launch attempts will fail, because the problem is
+				// probably something permanent (e.g., ffmpeg.exe isn't
+				// installed where we expect it to be installed, or there's
+				// a file permissions problem).  So skip any remaining items
+				// by setting the 'abort' flag.
+				WindowsErrorMessage err;
+				LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ FFMPEG launch failed: Win32 error %d, %s\n"), err.GetCode(), err.Get());
+				statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), MsgFmt(IDS_ERR_CAP_ITEM_FFMPEG_LAUNCH, err.Get()).Get()));
+				captureOkay = false;
+				abortCapture = true;
+			}
+
+			// add a blank line to the log after the FFMPEG output, for readability 
+			LogFile::Get()->Group(LogFile::CaptureLogging);
+
+			// we're done with manual stop mode, if it was ever in effect
+			capture.statusWin->SetManualStopMode(false);
+
+			// return the operation status
+			return result;
+		};
+
+		// Set up the output file for an item.  This saves any existing file of
+		// the same type as a backup, and creates the media folder if necessary.
+		// On failure, logs the error to the status list and returns false.
+		auto PrepareOutputFile = [&statusList, &captureOkay](CaptureItemDesc &item, const TSTRING &itemDesc)
+		{
+			// save (by renaming) any existing files of the type we're about to capture
+			TSTRING oldName;
+			if (FileExists(item.filename.c_str())
+				&& !item.mediaType.SaveBackup(item.filename.c_str(), oldName, statusList))
+			{
+				// backup rename failed - skip this file
+				captureOkay = false;
+				return false;
+			}
+
+			// if the file still exists, skip the item
+			if (FileExists(item.filename.c_str()))
+			{
+				statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_EXISTS).c_str()));
+				captureOkay = false;
+				return false;
+			}
+
+			// if the directory doesn't exist, try creating it
+			TCHAR dir[MAX_PATH];
+			_tcscpy_s(dir, item.filename.c_str());
+			PathRemoveFileSpec(dir);
+			if (!DirectoryExists(dir))
+			{
+				LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ Media folder doesn't exist, creating it: %s\n"), dir);
+				if (!CreateSubDirectory(dir, _T(""), NULL))
+				{
+					WindowsErrorMessage winErr;
+					LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ Media folder creation failed: %s, error %s\n"), dir, winErr.Get());
+					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), winErr.Get()));
+					captureOkay = false;
+					return false;
+				}
+			}
+
+			// ready to go
+			return true;
+		};
+
+		// Hand off the second pass of a two-pass video capture to the
+		// background encoder queue.  We give Javascript its crack at the
+		// encoding pass command line now, while the game information is
+		// still current.  On success, the queue takes ownership of the temp
+		// file, so we clear 'tmpfile' to keep the caller from deleting it.
+		auto QueueBackgroundEncode = [this, &statusList, &curStatus, &abortCapture, &nMediaItemsOk, &nEncodesQueued]
+		(CaptureItemDesc &item, const TSTRING &itemDesc, TSTRINGEx &cmdline2, TSTRINGEx &tmpfile)
+		{
+			PlayfieldView::PreCaptureReport report(gameId, capture, item, false, cmdline2.c_str());
+			playfieldView->SendMessage(PFVMsgPreCapture, 0, reinterpret_cast<LPARAM>(&report));
+			if (report.cancelBatch || report.cancelItem)
+			{
+				LogFile::Get()->Write(LogFile::CaptureLogging,
+					_T("Media capture: %s: %s canceled by Javascript precapture event\n"),
+					curStatus.c_str(), report.cancelBatch ? _T("remainder of batch") : _T("item"));
+				if (report.cancelBatch)
+					abortCapture = true;
+			}
+			else
+			{
+				// set up the job
+				auto job = new CaptureEncoderQueue::Job();
+				job->gameId = gameId;
+				job->itemDesc = MsgFmt(_T("%s: %s"), game.title.c_str(), itemDesc.c_str()).Get();
+				job->cmdline = report.ffmpegCommandLine;
+				job->tmpfile = tmpfile;
+				job->filename = item.filename;
+				job->mediaTime = item.captureTime;
+				job->hwndNotify = playfieldView->GetHWnd();
+
+				// The queue owns the temp file now, so forget it here to
+				// keep the caller from deleting it.
+				tmpfile.clear();
+
+				// Count the item as successful for now.  If the encoding
+				// fails, the playfield view will adjust its batch totals
+				// when it gets the completion report.
+				statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_ENCODE_QUEUED).c_str()));
+				nMediaItemsOk += 1;
+
+				// queue it
+				Application::Get()->GetCaptureEncoderQueue()->Enqueue(job);
+				nEncodesQueued += 1;
+			}
+		};
+
+		// In combined capture mode, capture all of the timed video items
+		// in a single ffmpeg pass.  We grab the bounding rectangle of all
+		// of the windows from the desktop once per frame, and split each
+		// frame into per-window crops with an ffmpeg filter graph, with
+		// each window's rotation, mirroring, and scaling transforms applied
+		// on its own branch of the graph.  This takes a fraction of the time
+		// of capturing the windows one after another, and keeps the videos
+		// for the different windows frame-synchronized.
+		std::list<CaptureItemDesc*> combinedItems;
+		if (capture.combinedCapture && !abortCapture)
+		{
+			// collect the eligible items
+			for (auto &item : capture.items)
+			{
+				if (IsCombinableCaptureItem(capture, item))
+					combinedItems.push_back(&item);
+			}
+
+			// It's not worth the trouble unless there are at least two.  If
+			// there are, we're going to be capturing more than one window, so
+			// there might not be any safe place to put the status window; so
+			// exclude it from the capture instead.  If that's not possible on
+			// this version of Windows, capture the windows individually.
+			if (combinedItems.size() < 2)
+				combinedItems.clear();
+			else if (!capture.statusWin->SetExcludeFromCapture(true))
+			{
+				LogFile::Get()->Write(LogFile::CaptureLogging,
+					_T("Media capture: combined capture isn't available (the capture status window can't be\n")
+					_T("  excluded from the capture on this version of Windows); capturing windows individually\n"));
+				combinedItems.clear();
+			}
+		}
+		if (combinedItems.size() != 0)
+		{
+			// If the game has already exited, or a shutdown or close event
+			// is already pending, don't start
+			HANDLE h[] = { hGameProc, shutdownEvent, closeEvent };
+			if (WaitForMultipleObjects(countof(h), h, FALSE, 0) != WAIT_TIMEOUT)
+				combinedItems.clear();
+
+			// check audio, and set up the output files
+			for (auto it = combinedItems.begin(); it != combinedItems.end(); )
+			{
+				auto item = *it;
+				const TSTRING &itemDesc = item->mediaType.nameStr;
+
+				// If audio is required, but there's no audio device, capture
+				// silent video, noting the error.
+				if (item->mediaType.format == MediaType::VideoWithAudio && item->enableAudio && audioCaptureDevice.length() == 0)
+				{
+					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_NO_AUDIO_DEV_VIDEO).c_str()));
+					item->enableAudio = false;
+					captureOkay = false;
+				}
+
+				// Set up the output file.  If that fails, the item is done;
+				// mark it as handled so that the individual capture loop
+				// doesn't try again.
+				if (!PrepareOutputFile(*item, itemDesc))
+				{
+					item->combined = true;
+					it = combinedItems.erase(it);
+				}
+				else
+					++it;
+			}
+
+			// if we're not going ahead with the combined capture after all,
+			// restore the status window's normal visibility
+			if (combinedItems.size() == 0)
+				capture.statusWin->SetExcludeFromCapture(false);
+		}
+		if (combinedItems.size() != 0)
+		{
+			// figure the bounding rectangle of all of the windows
+			RECT rcAll = combinedItems.front()->rc;
+			for (auto item : combinedItems)
+				UnionRect(&rcAll, &rcAll, &item->rc);
+
+			// two-pass mode applies to the combined capture just as it does to
+			// the individual captures
+			bool twoPass = capture.twoPassEncoding || capture.backgroundEncode;
+
+			// Build the filter graph and the output options.  The graph splits
+			// the captured desktop area into one stream per window, crops each
+			// stream to its window, and applies the window transforms.  In
+			// two-pass mode, the transforms wait for the second pass, as they
+			// do in individual captures.
+			struct CombinedOutput
+			{
+				CombinedOutput(CaptureItemDesc *item) : item(item) { }
+				CaptureItemDesc *item;
+				TSTRINGEx tmpfile;
+				TSTRINGEx cmdline2;
+			};
+			std::list<CombinedOutput> outputs;
+			TSTRINGEx graph, outputOpts, itemNames;
+			DWORD maxTime = 0;
+			bool audioNeeded = false;
+			graph.Format(_T("[0:v]split=%d"), (int)combinedItems.size());
+			for (int i = 0; i < (int)combinedItems.size(); ++i)
+				graph += MsgFmt(_T("[s%d]"), i).Get();
+			int i = 0;
+			for (auto item : combinedItems)
+			{
+				auto &o = outputs.emplace_back(item);
+
+				// add this window's branch to the graph
+				TSTRING transforms = twoPass ? _T("") : GetCaptureVideoTransforms(capture, *item);
+				graph += MsgFmt(_T(";[s%d]crop=%d:%d:%d:%d%s%s[v%d]"),
+					i, item->rc.right - item->rc.left, item->rc.bottom - item->rc.top,
+					item->rc.left - rcAll.left, item->rc.top - rcAll.top,
+					transforms.length() != 0 ? _T(",") : _T(""), transforms.c_str(), i).Get();
+
+				// add the output options
+				bool hasAudio = item->mediaType.format == MediaType::VideoWithAudio && item->enableAudio;
+				audioNeeded |= hasAudio;
+				const TCHAR *audioCodecOpts = capture.customAudioCodec.length() != 0 ?
+					capture.customAudioCodec.c_str() : _T("-c:a aac -b:a 128k -ac 2");
+				if (twoPass)
+				{
+					// Capture to the temp file with the first-pass codec.  All of
+					// the outputs are written by the same ffmpeg process, so each
+					// one needs its own temp file; GetCaptureTempFile() makes the
+					// name unique per item even when the outputs share a common
+					// temp folder.
+					o.tmpfile = GetCaptureTempFile(capture, *item);
+					outputOpts += MsgFmt(_T(" -map \"[v%d]\" %s%s %s -t %.2lf \"%s\""),
+						i, hasAudio ? _T("-map 1:a ") : _T(""), hasAudio ? audioCodecOpts : _T(""),
+						capture.vcodecPass1.c_str(), static_cast<double>(item->captureTime) / 1000.0, o.tmpfile.c_str()).Get();
+
+					// Build the second pass, the same way we would for an individual capture
+					TSTRING transforms2 = GetCaptureVideoTransforms(capture, *item);
+					TSTRINGEx videoFilters;
+					if (transforms2.length() != 0)
+						videoFilters.Format(_T("-vf \"%s\""), transforms2.c_str());
+					o.cmdline2.Format(
+						_T("\"%s\" -y -loglevel warning -i \"%s\" %s -c:a copy -max_muxing_queue_size 1024 \"%s\""),
+						ffmpeg, o.tmpfile.c_str(), videoFilters.c_str(), item->filename.c_str());
+				}
+				else
+				{
+					// capture directly to the output file
+					outputOpts += MsgFmt(_T(" -map \"[v%d]\" %s%s -t %.2lf \"%s\""),
+						i, hasAudio ? _T("-map 1:a ") : _T(""), hasAudio ? audioCodecOpts : _T(""),
+						static_cast<double>(item->captureTime) / 1000.0, item->filename.c_str()).Get();
+				}
+
+				// add it to the description and the time
+				if (itemNames.length() != 0)
+					itemNames += _T(", ");
+				itemNames += item->mediaType.nameStr;
+				maxTime = max(maxTime, item->captureTime);
+				++i;
+			}
+
+			// set up the audio source, if any of the items need audio
+			TSTRINGEx audioSourceOpts;
+			if (audioNeeded)
+				audioSourceOpts.Format(_T("-f dshow -i audio=\"%s\""), audioCaptureDevice.c_str());
+
+			// build the command line
+			TSTRINGEx cmdline;
+			cmdline.Format(
+				_T("\"%s\"")		// ffmpeg
+				_T(" -y -loglevel warning -thread_queue_size 32 -probesize 30M") IF_32_64(_T(""), _T(" -rtbufsize 2000M"))
+				_T(" -f gdigrab -framerate 30 -offset_x %d -offset_y %d -video_size %dx%d -i desktop")
+				_T(" %s")			// audio source
+				_T(" -filter_complex \"%s\"")
+				_T("%s"),			// outputs
+				ffmpeg,
+				rcAll.left, rcAll.top, rcAll.right - rcAll.left, rcAll.bottom - rcAll.top,
+				audioSourceOpts.c_str(), graph.c_str(), outputOpts.c_str());
+
+			// Run the capture.  This goes through the Javascript precapture
+			// event as the first item, since the event is designed around a
+			// single item; the command line passed to the event covers all of
+			// the windows.
+			curStatus.Format(LoadStringT(IDS_CAPSTAT_ITEM), itemNames.c_str());
+			capture.statusWin->SetCaptureStatus(curStatus, maxTime);
+			capture.statusWin->SetManualStartMode(false);
+			capture.statusWin->PositionOver(Application::Get()->GetPlayfieldWin());
+			bool ok = RunFFMPEG(*combinedItems.front(), itemNames, cmdline, false, true);
+			capture.statusWin->SetExcludeFromCapture(false);
+
+			// finish each item
+			for (auto &o : outputs)
+			{
+				const TSTRING &itemDesc = o.item->mediaType.nameStr;
+				if (ok && !twoPass)
+				{
+					// single pass - the item is done
+					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_OK).c_str()));
+					nMediaItemsOk += 1;
+				}
+				else if (ok && capture.backgroundEncode)
+				{
+					// hand off the second pass to the background encoder
+					QueueBackgroundEncode(*o.item, itemDesc, o.cmdline2, o.tmpfile);
+				}
+				else if (ok)
+				{
+					// run the second pass
+					curStatus.Format(LoadStringT(IDS_CAPSTAT_ENCODING_ITEM), itemDesc.c_str());
+					capture.statusWin->SetCaptureStatus(curStatus.c_str(), o.item->captureTime * 3 / 2);
+					RunFFMPEG(*o.item, itemDesc, o.cmdline2, true, false);
+				}
+
+				// if there's a temp file, delete it
+				if (o.tmpfile.length() != 0 && FileExists(o.tmpfile.c_str()))
+					DeleteFile(o.tmpfile.c_str());
+
+				// the item is finished
+				o.item->combined = true;
+			}
+		}
+
 		// Capture one item.  Returns true to continue capturing
 		// additional items, false to end the capture process.
 		// A true return doesn't necessarily mean that the 
@@ -4230,6 +5175,10 @@ DWORD Application::GameMonitorThread::Main()
 			// get the descriptor for the item, for status messages
 			const TSTRING &itemDesc = item.mediaType.nameStr;
 
+			// skip items that we already handled in the combined capture
+			if (item.combined)
+				continue;
+
 			// If the game has already exited, or a shutdown or close event
 			// is already pending, abort this capture before it starts
 			{
@@ -4361,162 +5310,13 @@ DWORD Application::GameMonitorThread::Main()
 			else
 				capture.statusWin->PositionOver(Application::Get()->GetPlayfieldWin());
 
-			// save (by renaming) any existing files of the type we're about to capture
-			TSTRING oldName;
-			if (FileExists(item.filename.c_str())
-				&& !item.mediaType.SaveBackup(item.filename.c_str(), oldName, statusList))
-			{
-				// backup rename failed - skip this file
-				captureOkay = false;
+			// set up the output file
+			if (!PrepareOutputFile(item, itemDesc))
 				continue;
-			}
-
-			// if the file still exists, skip the item
-			if (FileExists(item.filename.c_str()))
-			{
-				statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_EXISTS).c_str()));
-				captureOkay = false;
-				continue;
-			}
-
-			// if the directory doesn't exist, try creating it
-			TCHAR dir[MAX_PATH];
-			_tcscpy_s(dir, item.filename.c_str());
-			PathRemoveFileSpec(dir);
-			if (!DirectoryExists(dir))
-			{
-				LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ Media folder doesn't exist, creating it: %s\n"), dir);
-				if (!CreateSubDirectory(dir, _T(""), NULL))
-				{
-					WindowsErrorMessage winErr;
-					LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ Media folder creation failed: %s, error %s\n"), dir, winErr.Get());
-					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), winErr.Get()));
-					captureOkay = false;
-					continue;
-				}
-			}
 
 			// Figure the ffmpeg transforms to apply to the captured screen
-			// images to get the final video in the correct orientation.  We
-			// need to invert the transformations we apply to our display
-			// images, so that an image captured from a screen that appears
-			// as we display it gets stored in a format that yields that same
-			// screen display appearance after applying our display transforms.
-			// We apply our mirror/flip transforms last, so apply the reverse
-			// mirror/flip transforms first in the capture.  (The mirror/flip
-			// transforms are mutually commutative, so it doesn't matter
-			// which one goes first.)
-			TSTRING transforms;
-			auto AddTransform = [&transforms, &item](const TCHAR *t)
-			{
-				// add visual transforms for visual media only
-				if (item.mediaType.format != MediaType::Audio)
-				{
-					// add commas between items items
-					if (transforms.length() != 0)
-						transforms += _T(",");
-
-					// add the new transform
-					transforms += t;
-				}
-			};
-			if (item.windowMirrorVert)
-				AddTransform(_T("vflip"));
-			if (item.windowMirrorHorz)
-				AddTransform(_T("hflip"));
-
-			// Now add the rotation transform.  We need to figure the total
-			// rotation as the difference between the normal rotation for the
-			// media type and the window rotation.  And then we have to apply
-			// that rotation in the opposite direction.  Our display transforms
-			// are all clockwise, so we need counter-clockwise rotations for
-			// the reversals.  Note that we normalize to 0..359 degrees.
-			int rotate = ((item.mediaRotation - item.windowRotation) + 360) % 360;
-			switch (rotate)
-			{
-			case 90:
-				AddTransform(_T("transpose=2"));  // 90 degrees counter-clockwise
-				break;
-
-			case 180:
-				AddTransform(_T("transpose=1,transpose=1"));  // 90 degrees twice -> 180 degrees
-				break;
-
-			case 270:
-				AddTransform(_T("transpose=1"));  // 90 degrees clockwise
-				break;
-			}
-
-			// limit the video resolution if desired
-			if (item.mediaType.IsVideo())
-			{
-				// presume both dimensions are free (i.e., no resolution limit by default)
-				int xScale = -2, yScale = -2;
-
-				// figure the capture dimensions
-				int width = item.rc.right - item.rc.left;
-				int height = item.rc.bottom - item.rc.top;
-
-				// assume the limit will be the natural size
-				int maxWidth = width, maxHeight = height;
-
-				// check the resolution limit type
-				switch (capture.videoResLimit)
-				{
-				case CaptureInfo::ResLimitHD:
-					// HD limit
-					maxWidth = 1920;
-					maxHeight = 1080;
-					break;
-
-				case CaptureInfo::ResLimitNone:
-					// no limit - no scaling transform
-					break;
-				}
-
-				// if we're rotating the video, rotate the dimensions accordingly
-				if (rotate == 90 || rotate == 270)
-				{
-					// rotate the screen width to get the video width
-					int t = width;
-					width = height;
-					height = t;
-
-					// also rotate the limits
-					t = maxWidth;
-					maxWidth = maxHeight;
-					maxHeight = t;
-				}
-
-				// if we exceed the maximum width, limit the width
-				if (width > maxWidth)
-				{
-					// figure the scaling transform width
-					xScale = maxWidth;
-
-					// figure the new width height that results from applying the new width
-					// and maintaining the aspect ration
-					height = height * maxWidth / width;
-					width = maxWidth;
-				}
-
-				// If we exceed the maximum height, limit the height.  Note that the height
-				// has already been adjusted to match the width limit, if we had to limit
-				// the width, so the height limit will only apply if we have to further
-				// reduce the height to fit in an HD frame.  This can happen if we have
-				// a narrow aspect ratio than 16:9.
-				if (height > maxHeight)
-				{
-					// the height limit is stricter than the width limit, so apply it
-					// instead of the width limit
-					yScale = maxHeight;
-					xScale = -2;
-				}
-
-				// if we limited one of the dimensions, set the transform
-				if (xScale > 0 || yScale > 0)
-					AddTransform(MsgFmt(_T("scale=%d:%d"), xScale, yScale));
-			}
+			// images to get the final video in the correct orientation
+			TSTRING transforms = GetCaptureVideoTransforms(capture, item);
 
 			// Set up the global options
 			const TCHAR *globalOpts = _T("");
@@ -4673,29 +5473,15 @@ DWORD Application::GameMonitorThread::Main()
 			TSTRINGEx cmdline1;
 			TSTRINGEx cmdline2;
 			TSTRINGEx tmpfile;
-			if (isVideo && capture.twoPassEncoding)
+			if (isVideo && (capture.twoPassEncoding || capture.backgroundEncode))
 			{
 				// Two-pass encoding.  Capture the video with the lossless h264
 				// code in the fastest mode, with no rotation, to a temp file.
 				// We'll re-encode to the actual output file and apply rotations
 				// in the second pass.
 
-				// generate the temp file name - start with the output file name,
-				// and replace the suffix with .tmp.mkv
-				tmpfile = std::regex_replace(item.filename, std::basic_regex<TCHAR>(_T("\\.([^.]+)$")), _T(".tmp.mkv"));
-
-				// If there's a temp folder specified in the settings, replace
-				// the path to the temp file with the temp folder.
-				if (capture.tempFolder.length() != 0)
-				{
-					// combine the temp folder with the base file name from
-					// the current temp file to get the full path
-					TCHAR buf[MAX_PATH];
-					PathCombine(buf, capture.tempFolder.c_str(), PathFindFileName(tmpfile.c_str()));
-
-					// replace the original temp file name
-					tmpfile = buf;
-				}
+				// generate the temp file name
+				tmpfile = GetCaptureTempFile(capture, item);
 
 				// First pass.  This captures video and encodes it using a
 				// minimal compression codec, saving the result to a temporary file.
@@ -4745,368 +5531,6 @@ DWORD Application::GameMonitorThread::Main()
 					item.filename.c_str());
 			}
 
-			// Run the capture.  'logSuccess' indicates whether or not we'll log
-			// a successful completion; this should be false until the last pass
-			// if we're doing a multi-pass capture, so that we don't roll out the
-			// "mission accomplished" banner prematurely.  'isCapturePass' is true
-			// on the first pass where we actually the capture, and false on
-			// subsequent passes.  This is used for Manual Stop mode: we only pay 
-			// attention to Manual Stop mode on the actual capture pass, not on
-			// subsequent encoding passes.
-			auto RunFFMPEG = [this, &statusList, &curStatus, &item, &itemDesc, &captureOkay, &abortCapture, &nMediaItemsOk]
-			(TSTRINGEx &cmdline, bool logSuccess, bool isCapturePass)
-			{
-				// presume failure
-				bool result = false;
-
-				// Log the command for debugging purposes, as there's a lot that
-				// can go wrong here and little information back from ffmpeg that
-				// we can analyze mechanically.
-				auto LogCommandLine = [&curStatus, &cmdline](bool log)
-				{
-					if (log)
-					{
-						LogFile::Get()->Group();
-						LogFile::Get()->Write(_T("Media capture: %s: launching ffmpeg with command line:\n> %s\n"),
-							curStatus.c_str(), cmdline.c_str());
-					}
-				};
-
-				// give Javascript a crack at customizing the command line
-				PlayfieldView::PreCaptureReport report(gameId, capture, item, isCapturePass, cmdline.c_str());
-				playfieldView->SendMessage(PFVMsgPreCapture, 0, reinterpret_cast<LPARAM>(&report));
-
-				// if Javascript canceled the item or batch, stop here
-				if (report.cancelBatch) 
-				{
-					// cancel the whole rest of the batch, including this item
-					LogFile::Get()->Write(LogFile::CaptureLogging,
-						_T("Media capture: %s: remainder of batch canceled by Javascript precapture event\n"),
-						curStatus.c_str());
-
-					// set the abort-all flag, and return false to cancel remaining work on the current item
-					abortCapture = true;
-					return false;
-				}
-				else if (report.cancelItem)
-				{
-					// cancel the current item only
-					LogFile::Get()->Write(LogFile::CaptureLogging,
-						_T("Media capture: %s: item canceled by Javascript precapture event\n"),
-						curStatus.c_str());
-
-					// return false to cancel remaining work on this item
-					return false;
-				}
-
-				// retrieve the updated command line from the javascript
-				cmdline = report.ffmpegCommandLine;
-
-				// log the command line information if logging is enabled
-				LogCommandLine(LogFile::Get()->IsFeatureEnabled(LogFile::CaptureLogging));
-
-				// Set up an "inheritable handle" security attributes struct,
-				// for creating the stdin and stdout/stderr handles for the
-				// child process.  These need to be inheritable so that we 
-				// can open the files and pass the handles to the child.
-				SECURITY_ATTRIBUTES sa;
-				sa.nLength = sizeof(sa);
-				sa.lpSecurityDescriptor = NULL;
-				sa.bInheritHandle = TRUE;
-
-				// Create a pipe for the ffmpeg stdin.  This will let us send
-				// a "q" key to cancel the capture prematurely if necessary.
-				HandleHolder hStdinRead, hStdinWrite;
-				if (CreatePipe(&hStdinRead, &hStdinWrite, &sa, 1024))
-				{
-					// don't let the child inherit our end of the pipe
-					SetHandleInformation(hStdinWrite, HANDLE_FLAG_INHERIT, 0);
-				}
-				else
-				{
-					// failed to create the pipe - just pass the NUL device
-					hStdinRead = CreateFile(_T("NUL"), GENERIC_READ, 0, &sa, OPEN_EXISTING, 0, NULL);
-
-					// we absolutely need the pipe in Manual Stop mode, since it's
-					// the way we tell ffmpeg to stop the capture
-					if (item.manualStop && isCapturePass)
-					{
-						statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_MANUAL_STOP_NO_PIPE).c_str()));
-						LogFile::Get()->Write(LogFile::CaptureLogging,
-							_T("+ Manual Stop isn't possible for this item because an error occurred\n")
-							_T("  trying to create a pipe to send the stop command to ffmpeg; capture aborted\n"));
-						captureOkay = false;
-						abortCapture = true;
-						return false;
-					}
-				}
-
-				// Set up a temp file to capture output from FFmpeg, so that we can
-				// copy it to the log file after the capture is done.  Do this whether
-				// or not capture logging is enabled; if the capture fails due to an
-				// FFmpeg error, we'll log the FFmpeg output regardless of the log
-				// settings, to give the user a chance to see what went wrong even
-				// if they weren't anticipating anything going wrong.
-				HandleHolder hStdOut;
-				TSTRING fnameStdOut;
-				{
-					// create the temp file
-					TCHAR tmpPath[MAX_PATH] = _T("<no temp path>"), tmpName[MAX_PATH] = _T("<no temp name>");
-					GetTempPath(countof(tmpPath), tmpPath);
-					GetTempFileName(tmpPath, _T("PBYCap"), 0, tmpName);
-					hStdOut = CreateFile(tmpName, GENERIC_WRITE, 0, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-
-					// log an error if that failed, but continue with the capture
-					if (hStdOut == NULL)
-					{
-						// log the error
-						WindowsErrorMessage err;
-						LogFile::Get()->Write(LogFile::CaptureLogging,
-							_T("+ Unable to log FFMPEG output: error opening temp file %s (error %d: %s)\n"),
-							tmpName, err.GetCode(), err.Get());
-
-						// direct FFmpeg output to NUL
-						hStdOut = CreateFile(_T("NUL"), GENERIC_WRITE, 0, &sa, OPEN_EXISTING, 0, NULL);
-					}
-					else
-					{
-						// successfully opened the file - remember its name
-						fnameStdOut = tmpName;
-					}
-				}
-
-				// Set up the startup info.  Use Show-No-Activate to try to keep
-				// the game window activated and in the foreground, since VP (and
-				// probably others) stop animations when in the background.
-				STARTUPINFO startupInfo;
-				ZeroMemory(&startupInfo, sizeof(startupInfo));
-				startupInfo.cb = sizeof(startupInfo);
-				startupInfo.dwFlags = STARTF_USESHOWWINDOW | STARTF_USESTDHANDLES;
-				startupInfo.wShowWindow = SW_SHOWNOACTIVATE;
-				startupInfo.hStdInput = hStdinRead;
-				startupInfo.hStdOutput = hStdOut;
-				startupInfo.hStdError = hStdOut;
-
-				// launch the process
-				PROCESS_INFORMATION procInfo;
-				if (CreateProcess(NULL, cmdline.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW,
-					NULL, NULL, &startupInfo, &procInfo))
-				{
-					// ffmpeg launched successfully.  Put the handles in holders
-					// so that we auto-close the handles when done with them.
-					HandleHolder hFfmpegProc(procInfo.hProcess);
-					HandleHolder hFfmpegThread(procInfo.hThread);
-
-					// close our copy of the child's stdin read handle
-					hStdinRead = NULL;
-
-					// copy the ffmpeg output log file to our log, if capturing a log
-					auto CopyOutputToLog = [&hStdOut, &fnameStdOut, &LogCommandLine](bool force)
-					{
-						// close our copy of the output file handle to make sure the
-						// file is really closed
-						hStdOut = nullptr;
-
-						// check if we're include capture logging
-						if (!LogFile::Get()->IsFeatureEnabled(LogFile::CaptureLogging))
-						{
-							// Capture logging is disabled, so we're not logging this by
-							// default.  Check for a 'force' override.
-							if (force)
-							{
-								// We're forcing the output, due to an error in the capture.
-								// In this case, we won't have logged the command line earlier,
-								// so do so now.
-								LogCommandLine(true);
-							}
-							else
-							{
-								// capture logging disabled, not forcing it; don't copy the output
-								return;
-							}
-						}
-
-						// if there's a log file, copy it
-						if (fnameStdOut.length() != 0)
-						{
-							// read the file
-							long len;
-							std::unique_ptr<BYTE> txt(ReadFileAsStr(fnameStdOut.c_str(), SilentErrorHandler(),
-								len, ReadFileAsStr_NewlineTerm | ReadFileAsStr_NullTerm));
-
-							// copy it to the log file
-							if (txt != nullptr)
-							{
-								// in case the log file contains null bytes, write it piecewise
-								// in null-terminated chunks
-								const BYTE *endp = txt.get() + len;
-								for (const BYTE *p = txt.get(); p < endp; )
-								{
-									// find the end of this null-terminated chunk
-									const BYTE *q;
-									for (q = p; q != endp && *q != 0; ++q);
-
-									// write this chunk
-									LogFile::Get()->WriteStrA((const char *)p);
-
-									// skip the null byte
-									p = q + 1;
-								}
-							}
-
-							// delete the temp file
-							DeleteFile(fnameStdOut.c_str());
-						}
-					};
-
-					// Wait for the process to finish, or for a shutdown or
-					// close-game event to interrupt it.  Also include the
-					// start/stop event as the last handle, but don't count
-					// it just yet - we'll only include it in the actual wait
-					// if we're in manual stop mode.
-					HANDLE h[] = { hFfmpegProc, hGameProc, shutdownEvent, closeEvent, startStopEvent };
-					static const TCHAR *waitName[] = {
-						_T("ffmpeg exited"), _T("game exited"), _T("app shutdown"), _T("user Exit Game command"), _T("Manual Stop")
-					};
-					DWORD nWaitHandles = countof(h) - 1;
-
-					// Check for Manual Stop mode.  This only applies on the
-					// capture pass (not on subsequent encode/compress passes).
-					if (item.manualStop && isCapturePass)
-					{
-						// include the manual stop event in the wait list
-						nWaitHandles += 1;
-
-						// set the capture status window to reflect manual stop mode
-						capture.statusWin->SetManualStopMode(true);
-
-						// clear any past manual start/stop signal
-						ResetEvent(startStopEvent);
-					}
-
-				WaitForFfmpeg:
-					// wait for the capture to finish
-					const TCHAR *waitResultName = nullptr;
-					switch (DWORD waitResult = WaitForMultipleObjects(nWaitHandles, h, FALSE, INFINITE))
-					{
-					case WAIT_OBJECT_0 + 4:
-						// The user pressed the Manual Stop button to terminate a manually
-						// timed capture.  Send ffmpeg the "Q" key on its stdin to stop
-						// the capture.
-						if (hStdinWrite != NULL)
-						{
-							static const char msg[] = "q\n";
-							DWORD actual;
-							WriteFile(hStdinWrite, msg, sizeof(msg) - 1, &actual, NULL);
-						}
-
-						// Now go back for another wait pass, this time removing the
-						// Manual Stop event from the wait list.  This gives ffmpeg a
-						// chance to exit before we proceed.
-						nWaitHandles -= 1;
-						goto WaitForFfmpeg;
-
-					case WAIT_OBJECT_0:
-						// The ffmpeg process finished successfully
-						{
-							// retrieve the process exit code
-							DWORD exitCode;
-							GetExitCodeProcess(hFfmpegProc, &exitCode);
-
-							// Copy the output to the log.  If the FFmpeg exit code was non-zero,
-							// log it even if capture logging is turned off in the options, since
-							// the error information is too useful to discard just because the
-							// user wasn't anticipating an error.
-							CopyOutputToLog(exitCode != 0);
-
-							// log the process exit code
-							LogFile::Get()->Write(LogFile::CaptureLogging,
-								_T("\n+ FFMPEG completed: process exit code %d\n"), (int)exitCode);
-
-							// consider this a success if the exit code was 0, otherwise consider
-							// it an error
-							if (exitCode == 0)
-							{
-								// success
-								result = true;
-
-								// log successful completion if desired
-								if (logSuccess)
-								{
-									// log the success
-									statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_OK).c_str()));
-
-									// count the success
-									nMediaItemsOk += 1;
-								}
-							}
-							else
-							{
-								// log the error
-								statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(),
-									MsgFmt(IDS_ERR_CAP_ITEM_FFMPEG_ERR_LOGGED, (int)exitCode).Get()));
-								captureOkay = false;
-							}
-						}
-						break;
-
-					default:
-						// Error/unexpected wait result
-						waitResultName = _T("Error waiting for ffmpeg to exit");
-						goto Interruption;
-
-					case WAIT_OBJECT_0 + 1:
-					case WAIT_OBJECT_0 + 2:
-					case WAIT_OBJECT_0 + 3:
-						waitResultName = waitName[waitResult - WAIT_OBJECT_0];
-
-					Interruption:
-						// Shutdown event, close event, or premature game termination,
-						// or another error.  Count this as an interrupted capture.
-						statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_INTERRUPTED).c_str()));
-						captureOkay = false;
-						abortCapture = true;
-
-						// log it
-						CopyOutputToLog(false);
-						LogFile::Get()->Write(LogFile::CaptureLogging, _T("\n+ capture interrupted (%s)\n"), waitResultName);
-
-						// Send ffmpeg a "Q" key press on its stdin to try to shut
-						// it down immediately
-						if (hStdinWrite != NULL)
-						{
-							static const char msg[] = "q\n";
-							DWORD actual;
-							WriteFile(hStdinWrite, msg, sizeof(msg) - 1, &actual, NULL);
-						}
-						break;
-					}
-				}
-				else
-				{
-					// Error launching ffmpeg.  It's likely that all subsequent
-					// ffmpeg launch attempts will fail, because the problem is
-					// probably something permanent (e.g., ffmpeg.exe isn't
-					// installed where we expect it to be installed, or there's
-					// a file permissions problem).  So skip any remaining items
-					// by setting the 'abort' flag.
-					WindowsErrorMessage err;
-					LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ FFMPEG launch failed: Win32 error %d, %s\n"), err.GetCode(), err.Get());
-					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), MsgFmt(IDS_ERR_CAP_ITEM_FFMPEG_LAUNCH, err.Get()).Get()));
-					captureOkay = false;
-					abortCapture = true;
-				}
-
-				// add a blank line to the log after the FFMPEG output, for readability 
-				LogFile::Get()->Group(LogFile::CaptureLogging);
-
-				// we're done with manual stop mode, if it was ever in effect
-				capture.statusWin->SetManualStopMode(false);
-
-				// return the operation status
-				return result;
-			};
-
 			// Run the first pass.  Only show the success status for the first pass
 			// if there will be no second pass, since we won't know if the overall
 			// operation is successful until after the second pass, if there is one.
@@ -5114,14 +5538,16 @@ DWORD Application::GameMonitorThread::Main()
 			// screen capture phase, regardless of whether we're doing the capture 
 			// in one pass or two.
 			bool twoPass = (cmdline2.length() != 0);
-			if (RunFFMPEG(cmdline1, !twoPass, true))
+			if (RunFFMPEG(item, itemDesc, cmdline1, !twoPass, true))
 			{
-				// success - if there's a second pass, run it
-				if (twoPass)
+				// success - if there's a second pass, run it or queue it
+				if (twoPass && capture.backgroundEncode)
+					QueueBackgroundEncode(item, itemDesc, cmdline2, tmpfile);
+				else if (twoPass)
 				{
 					curStatus.Format(LoadStringT(IDS_CAPSTAT_ENCODING_ITEM), itemDesc.c_str());
 					capture.statusWin->SetCaptureStatus(curStatus.c_str(), item.captureTime*3/2);
-					RunFFMPEG(cmdline2, true, false);
+					RunFFMPEG(item, itemDesc, cmdline2, true, false);
 				}
 			}
 
@@ -5150,7 +5576,7 @@ DWORD Application::GameMonitorThread::Main()
 
 			// notify the playfield window of the capture status
 			PlayfieldView::CaptureDoneReport report(gameId, captureOkay, IsCloseEventSet(),
-				overallStatusMsgId, statusList, nMediaItemsAttempted, nMediaItemsOk);
+				overallStatusMsgId, statusList, nMediaItemsAttempted, nMediaItemsOk, nEncodesQueued);
 			playfieldView->SendMessage(PFVMsgCaptureDone, reinterpret_cast<WPARAM>(&report));
 		}
 	}
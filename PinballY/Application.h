@@ -13,12 +13,16 @@
 #include "TopperWin.h"
 #include "Capture.h"
 #include "CaptureStatusWin.h"
+#include "CaptureEncoderQueue.h"
+#include "TableMetadataCache.h"
 #include "../Utilities/DateUtil.h"
 #include "JavascriptEngine.h"
 
 struct ConfigFileDesc;
 class TextureShader;
 class DMDShader;
+class SpriteTextShader;
+class SpriteBatchShader;
 class I420Shader;
 class I420AShader;
 class I444A10Shader;
@@ -53,6 +57,10 @@ public:
 	// Path to GameStats.cvs, as set in the command-line options
 	TSTRING gameStatsPath;
 
+	// Audio output sink, as set in the command-line options.  This is
+	// empty for the normal sound hardware output.
+	TSTRING audioSink;
+
 	// Explicitly reload the configuration.  This reloads the settings
 	// file and rebuilds all game list data.
 	bool ReloadConfig();
@@ -112,6 +120,11 @@ public:
 	// to invoke the Flash Player ActiveX control.
 	bool useInternalSWFRenderer = true;
 
+	// Use the software rasterizer for the internal SWF renderer, instead
+	// of Direct2D.  The software rasterizer doesn't need a device context,
+	// and it also renders gradient fills, which the D2D path doesn't yet.
+	bool useSoftwareSWFRenderer = false;
+
 	// Update secondary windows for a change in the selected game.
 	// This notifies the backglass and DMD windows when a new game
 	// is selected in the playfield window.
@@ -148,6 +161,8 @@ public:
 	// Global shared shader instances
 	std::unique_ptr<TextureShader> textureShader;
 	std::unique_ptr<DMDShader> dmdShader;
+	std::unique_ptr<SpriteTextShader> spriteTextShader;
+	std::unique_ptr<SpriteBatchShader> spriteBatchShader;
 	std::unique_ptr<I420Shader> i420Shader;
 	std::unique_ptr<I420AShader> i420AShader;
 	std::unique_ptr<I444A10Shader> i444A10Shader;
@@ -313,6 +328,13 @@ public:
 	// are any games queued?
 	bool IsGameQueuedForLaunch() const { return queuedLaunches.size() != 0; }
 
+	// Get the background encoder queue for batch captures
+	CaptureEncoderQueue *GetCaptureEncoderQueue() const { return captureEncoderQueue.get(); }
+
+	// Get the table metadata cache.  This is null until the main event
+	// loop starts.
+	TableMetadataCache *GetTableMetadataCache() const { return tableMetadataCache.get(); }
+
 	// Kill the running game, if any
 	void KillGame();
 
@@ -1101,6 +1123,13 @@ protected:
 	}
 	adminHost;
 
+	// Background encoder queue, for the second pass of two-pass video
+	// captures during batch capture
+	std::unique_ptr<CaptureEncoderQueue> captureEncoderQueue;
+
+	// Table metadata cache, for the embedded metadata in VP table files
+	std::unique_ptr<TableMetadataCache> tableMetadataCache;
+
 	// Is the application the foreground?
 	static bool isInForeground;
 
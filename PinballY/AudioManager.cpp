@@ -4,15 +4,396 @@
 #include "stdafx.h"
 #include "AudioManager.h"
 #include "GameList.h"
+#include "LogFile.h"
 
 // statics
 AudioManager *AudioManager::inst;
 
+// Size of the basic PCM format descriptor, which is the portion of
+// WAVEFORMATEX before the cbSize field
+static const DWORD PCMFormatSize = offsetof(WAVEFORMATEX, cbSize);
+
+// -----------------------------------------------------------------------
+//
+// XAudio2 backend, via the DirectXTK audio engine.  This is the
+// normal backend for live playback.
+//
+class XAudio2Backend : public AudioBackend
+{
+public:
+	XAudio2Backend()
+	{
+		// create the DXTK audio engine object
+		DirectX::AUDIO_ENGINE_FLAGS aeFlags =
+			DirectX::AudioEngine_Default
+			IF_DEBUG(| DirectX::AudioEngine_Debug);
+		engine.reset(new DirectX::AudioEngine(aeFlags));
+	}
+
+	class XSound : public Sound
+	{
+	public:
+		XSound(DirectX::SoundEffect *effect) : effect(effect) { sizeInBytes = effect->GetSampleSizeInBytes(); }
+		virtual bool IsInUse() override { return effect->IsInUse(); }
+		std::unique_ptr<DirectX::SoundEffect> effect;
+	};
+
+	class XVoice : public Voice
+	{
+	public:
+		virtual void Play(Sound *sound, float volume, int64_t /*eventTicks*/) override
+		{
+			// If the voice is already bound to this sound, we can simply
+			// restart the existing instance.  Otherwise, release the old
+			// instance and create a new one for the new sound.
+			auto xs = static_cast<XSound*>(sound);
+			if (xs != curSound || instance == nullptr)
+			{
+				instance.reset();
+				instance = xs->effect->CreateInstance();
+				curSound = xs;
+			}
+			else
+				instance->Stop(true);
+
+			// start it playing
+			instance->SetVolume(volume);
+			instance->Play(false);
+		}
+
+		virtual void Stop() override
+		{
+			if (instance != nullptr)
+				instance->Stop(true);
+		}
+
+		virtual bool IsPlaying() override
+		{
+			return instance != nullptr && instance->GetState() == DirectX::PLAYING;
+		}
+
+		// current sound effect instance, and the sound it belongs to
+		std::unique_ptr<DirectX::SoundEffectInstance> instance;
+		XSound *curSound = nullptr;
+	};
+
+	virtual Sound *CreateSound(PCMSound &pcm) override
+	{
+		// create the DXTK sound effect; this takes ownership of the
+		// buffer, and throws if the format isn't playable.  Note the
+		// format tag first, since the buffer might be gone on failure.
+		WORD tag = pcm.wfx->wFormatTag;
+		try
+		{
+			if (pcm.seekTable != nullptr)
+				return new XSound(new DirectX::SoundEffect(engine.get(), pcm.data, pcm.wfx, pcm.samples, pcm.sampleBytes, pcm.seekTable, pcm.seekCount));
+			else
+				return new XSound(new DirectX::SoundEffect(engine.get(), pcm.data, pcm.wfx, pcm.samples, pcm.sampleBytes));
+		}
+		catch (std::exception &exc)
+		{
+			LogFile::Get()->Write(_T("Audio: unable to create sound effect (wave format tag 0x%04x): %hs\n"),
+				tag, exc.what());
+			return nullptr;
+		}
+	}
+
+	virtual Voice *CreateVoice() override { return new XVoice(); }
+
+	virtual void PlayOneShot(Sound *sound, float volume) override
+	{
+		static_cast<XSound*>(sound)->effect->Play(volume, 0.0f, 0.0f);
+	}
+
+	virtual bool Update() override
+	{
+		// update the engine
+		return engine->Update() || !engine->IsCriticalError();
+	}
+
+protected:
+	// DirectXTK audio engine object
+	std::unique_ptr<DirectX::AudioEngine> engine;
+};
+
+// -----------------------------------------------------------------------
+//
+// Decoded PCM sound
+//
+
+bool PCMSound::Load(const TCHAR *filename)
+{
+	// load the file
+	SilentErrorHandler eh;
+	long len;
+	std::unique_ptr<uint8_t[]> buf(ReadFileAsStr(filename, eh, len, 0));
+	if (buf == nullptr)
+		return false;
+
+	// check the RIFF WAVE header
+	if (len < 12 || memcmp(buf.get(), "RIFF", 4) != 0 || memcmp(buf.get() + 8, "WAVE", 4) != 0)
+		return false;
+
+	// scan the chunks for the format descriptor and the sample data
+	const uint8_t *p = buf.get() + 12, *end = buf.get() + len;
+	const WAVEFORMATEX *fmt = nullptr;
+	const uint8_t *samp = nullptr;
+	size_t sampLen = 0;
+	const uint32_t *seek = nullptr;
+	size_t seekLen = 0;
+	while (end - p >= 8)
+	{
+		// read the chunk size, limiting it to the data actually present
+		DWORD ckSize;
+		memcpy(&ckSize, p + 4, sizeof(ckSize));
+		const uint8_t *ckData = p + 8;
+		size_t avail = static_cast<size_t>(end - ckData);
+		if (ckSize > avail)
+			ckSize = static_cast<DWORD>(avail);
+
+		// note the chunks we're interested in
+		if (memcmp(p, "fmt ", 4) == 0 && ckSize >= PCMFormatSize)
+			fmt = reinterpret_cast<const WAVEFORMATEX*>(ckData);
+		else if (memcmp(p, "data", 4) == 0)
+			samp = ckData, sampLen = ckSize;
+		else if (memcmp(p, "dpds", 4) == 0)
+			seek = reinterpret_cast<const uint32_t*>(ckData), seekLen = ckSize / sizeof(uint32_t);
+
+		// advance to the next chunk; chunks are padded to WORD boundaries
+		size_t adv = ckSize + (ckSize & 1);
+		if (adv >= avail)
+			break;
+		p = ckData + adv;
+	}
+
+	// we need both a format and sample data
+	if (fmt == nullptr || samp == nullptr || sampLen == 0 || fmt->nAvgBytesPerSec == 0)
+	{
+		LogFile::Get()->Write(_T("Audio: %s: missing or invalid wave format/data chunks\n"), filename);
+		return false;
+	}
+
+	// check for a format we can play
+	switch (fmt->wFormatTag)
+	{
+	case WAVE_FORMAT_PCM:
+	case WAVE_FORMAT_IEEE_FLOAT:
+	case WAVE_FORMAT_ADPCM:
+	case WAVE_FORMAT_EXTENSIBLE:
+		// no seek table needed for these formats
+		seek = nullptr, seekLen = 0;
+		break;
+
+	case WAVE_FORMAT_WMAUDIO2:
+	case WAVE_FORMAT_WMAUDIO3:
+		// xWMA requires the packet seek table
+		if (seek == nullptr || seekLen == 0)
+		{
+			LogFile::Get()->Write(_T("Audio: %s: xWMA file is missing its seek table ('dpds' chunk)\n"), filename);
+			return false;
+		}
+		break;
+
+	default:
+		LogFile::Get()->Write(_T("Audio: %s: unsupported wave format tag 0x%04x\n"), filename, fmt->wFormatTag);
+		return false;
+	}
+
+	// success - take ownership of the buffer
+	data = std::move(buf);
+	dataLen = static_cast<size_t>(len);
+	wfx = fmt;
+	samples = samp;
+	sampleBytes = sampLen;
+	seekTable = seek;
+	seekCount = seekLen;
+	return true;
+}
+
+// -----------------------------------------------------------------------
+//
+// Null audio sink
+//
+
+class NullAudioSink::NullSound : public Sound
+{
+public:
+	NullSound(PCMSound &pcm) : pcm(std::move(pcm))
+	{
+		sizeInBytes = this->pcm.sampleBytes;
+		durationMs = static_cast<UINT64>(this->pcm.sampleBytes * 1000ULL / this->pcm.wfx->nAvgBytesPerSec);
+	}
+
+	virtual bool IsInUse() override { return GetTickCount64() < busyUntil; }
+
+	// decoded sound
+	PCMSound pcm;
+
+	// nominal playback duration in milliseconds
+	UINT64 durationMs;
+
+	// system tick time at which the last voice playing this sound ends
+	UINT64 busyUntil = 0;
+};
+
+class NullAudioSink::NullVoice : public Voice
+{
+public:
+	NullVoice(NullAudioSink *sink) : sink(sink) { }
+
+	virtual void Play(Sound *sound, float volume, int64_t eventTicks) override
+	{
+		// The first sample is delivered right now, so the latency is
+		// simply the time elapsed since the triggering event
+		double latencyUs = sink->timer.TicksToUs(sink->timer.GetTime_ticks() - eventTicks);
+		sink->CountLatency(latencyUs);
+
+		// deliver the samples
+		auto ns = static_cast<NullSound*>(sound);
+		sink->OnDeliver(ns, volume, latencyUs);
+
+		// the voice is busy for the nominal duration of the sound
+		endTime = GetTickCount64() + ns->durationMs;
+		ns->busyUntil = max(ns->busyUntil, endTime);
+	}
+
+	virtual void Stop() override { endTime = 0; }
+	virtual bool IsPlaying() override { return GetTickCount64() < endTime; }
+
+	NullAudioSink *sink;
+	UINT64 endTime = 0;
+};
+
+AudioBackend::Sound *NullAudioSink::CreateSound(PCMSound &pcm)
+{
+	return new NullSound(pcm);
+}
+
+AudioBackend::Voice *NullAudioSink::CreateVoice()
+{
+	return new NullVoice(this);
+}
+
+void NullAudioSink::PlayOneShot(Sound *sound, float volume)
+{
+	// play through a temporary voice; one-shot sounds have no
+	// triggering event time, so measure from the moment of the call
+	NullVoice voice(this);
+	voice.Play(sound, volume, timer.GetTime_ticks());
+}
+
+void NullAudioSink::CountLatency(double us)
+{
+	latency.n += 1;
+	latency.totalUs += us;
+	latency.maxUs = max(latency.maxUs, us);
+}
+
+// -----------------------------------------------------------------------
+//
+// File audio sink
+//
+
+FileAudioSink::FileAudioSink(const TCHAR *filename)
+{
+	// open the WAV output file and the log file
+	TSTRING logName = filename;
+	logName += _T(".csv");
+	if (_tfopen_s(&wavFp, filename, _T("wb")) != 0)
+		wavFp = nullptr;
+	if (_tfopen_s(&logFp, logName.c_str(), _T("w")) != 0)
+		logFp = nullptr;
+
+	// write the log header
+	if (logFp != nullptr)
+		fprintf(logFp, "time_ms,latency_us,bytes,volume,written\n");
+
+	// note the start time
+	t0 = timer.GetTime_ticks();
+}
+
+FileAudioSink::~FileAudioSink()
+{
+	if (wavFp != nullptr)
+	{
+		UpdateHeader();
+		fclose(wavFp);
+	}
+	if (logFp != nullptr)
+		fclose(logFp);
+}
+
+void FileAudioSink::OnDeliver(NullSound *sound, float volume, double latencyUs)
+{
+	const WAVEFORMATEX *wfx = sound->pcm.wfx;
+
+	// if this is the first sound, adopt its format for the output file
+	if (!outFmtSet && wavFp != nullptr)
+	{
+		// copy the basic PCM fields only
+		memset(&outFmt, 0, sizeof(outFmt));
+		memcpy(&outFmt, wfx, PCMFormatSize);
+		outFmtSet = true;
+
+		// write the header, with placeholder sizes for now
+		DWORD zero = 0;
+		fwrite("RIFF", 1, 4, wavFp);
+		fwrite(&zero, sizeof(zero), 1, wavFp);
+		fwrite("WAVEfmt ", 1, 8, wavFp);
+		fwrite(&PCMFormatSize, sizeof(PCMFormatSize), 1, wavFp);
+		fwrite(&outFmt, PCMFormatSize, 1, wavFp);
+		fwrite("data", 1, 4, wavFp);
+		fwrite(&zero, sizeof(zero), 1, wavFp);
+	}
+
+	// write the samples if the format matches the output format
+	bool written = false;
+	if (outFmtSet
+		&& wfx->wFormatTag == outFmt.wFormatTag
+		&& wfx->nChannels == outFmt.nChannels
+		&& wfx->nSamplesPerSec == outFmt.nSamplesPerSec
+		&& wfx->wBitsPerSample == outFmt.wBitsPerSample)
+	{
+		fwrite(sound->pcm.samples, 1, sound->pcm.sampleBytes, wavFp);
+		dataBytes += static_cast<DWORD>(sound->pcm.sampleBytes);
+		written = true;
+	}
+
+	// log it
+	if (logFp != nullptr)
+	{
+		fprintf(logFp, "%.3f,%.1f,%u,%.3f,%d\n",
+			timer.TicksToUs(timer.GetTime_ticks() - t0) / 1000.0, latencyUs,
+			static_cast<unsigned int>(sound->pcm.sampleBytes), volume, written ? 1 : 0);
+	}
+}
+
+void FileAudioSink::UpdateHeader()
+{
+	if (!outFmtSet)
+		return;
+
+	// fill in the RIFF and data chunk sizes
+	DWORD riffSize = 4 + 8 + PCMFormatSize + 8 + dataBytes;
+	fseek(wavFp, 4, SEEK_SET);
+	fwrite(&riffSize, sizeof(riffSize), 1, wavFp);
+	fseek(wavFp, 12 + 8 + PCMFormatSize + 4, SEEK_SET);
+	fwrite(&dataBytes, sizeof(dataBytes), 1, wavFp);
+	fseek(wavFp, 0, SEEK_END);
+}
+
+// -----------------------------------------------------------------------
+//
+// Audio manager
+//
+
 // initialize
-void AudioManager::Init()
+void AudioManager::Init(AudioBackend *backend)
 {
 	if (inst == 0)
-		inst = new AudioManager();
+		inst = new AudioManager(backend != nullptr ? backend : new XAudio2Backend());
+	else
+		delete backend;
 }
 
 // terminate
@@ -22,37 +403,55 @@ void AudioManager::Shutdown()
 	inst = 0;
 }
 
-AudioManager::AudioManager()
+AudioManager::AudioManager(AudioBackend *backend) : backend(backend)
 {
 	// no error yet
 	criticalError = false;
 
-	// create the DXTK audio engine object
-	DirectX::AUDIO_ENGINE_FLAGS aeFlags =
-		DirectX::AudioEngine_Default
-		IF_DEBUG(| DirectX::AudioEngine_Debug);
-	engine = new DirectX::AudioEngine(aeFlags);
+	// create the voice pool
+	for (auto &v : voicePool)
+		v.voice.reset(backend->CreateVoice());
 }
 
 AudioManager::~AudioManager()
 {
-	// Go through the cached sounds to check for items that are
-	// still playing.  Move each item that's actively playing to
-	// a separate pending list.
-	std::list<std::unique_ptr<DirectX::SoundEffect>> pending;
-	for (auto &s : cache)
+	// Stop and release the pooled voices first.  A voice holds an
+	// effect instance on the last sound it played, which keeps that
+	// sound "in use" for as long as the voice exists, whether or not
+	// it's actually playing.  Button sounds are short, so there's no
+	// reason to wait for them to finish.
+	for (auto &v : voicePool)
 	{
-		// if it hasn't been updated, transfer it to the pending list
-		if (s.second->IsInUse())
-			pending.emplace_back(s.second.release());
+		v.voice->Stop();
+		v.voice.reset();
 	}
 
-	// Anything left in the cache can now be deleted, as we 
+	// Go through the cached and pooled sounds to check for items that
+	// are still playing one-shots.  Move each item that's actively
+	// playing to a separate pending list.
+	std::list<std::unique_ptr<AudioBackend::Sound>> pending;
+	auto Transfer = [&pending](std::unique_ptr<AudioBackend::Sound> &s)
+	{
+		// if it's still playing, transfer it to the pending list
+		if (s != nullptr && s->IsInUse())
+			pending.emplace_back(s.release());
+	};
+	for (auto &s : cache)
+		Transfer(s.second.sound);
+	for (auto &s : pooledSounds)
+		Transfer(s.second);
+	for (auto &s : evicted)
+		Transfer(s);
+
+	// Anything left in the caches can now be deleted, as we
 	// transferred all active items over to 'pending'.  We don't
-	// actually have to clear the cache manually, as the map
-	// destructor would do that anyway, but we might as well
+	// actually have to clear the caches manually, as the map
+	// destructors would do that anyway, but we might as well
 	// do that work while we're waiting for sounds to finish.
 	cache.clear();
+	lru.clear();
+	evicted.clear();
+	pooledSounds.clear();
 
 	// Now wait for the remaining sounds to finish, within reason
 	UINT64 t0 = GetTickCount64();
@@ -62,14 +461,11 @@ AudioManager::~AudioManager()
 		Sleep(15);
 
 		// do engine housekeeping
-		engine->Update();
+		backend->Update();
 
 		// clean the pending list
 		CleanSoundList(pending);
 	}
-
-	// delete the DXTK audio engine object
-	delete engine;
 }
 
 void AudioManager::PlayFile(const TCHAR *path, float volume)
@@ -77,32 +473,149 @@ void AudioManager::PlayFile(const TCHAR *path, float volume)
 	// look for an existing instance in our cache
 	if (auto it = cache.find(path); it != cache.end())
 	{
-		// got it - simply reuse the existing effect
-		it->second->Play(volume, 0.0f, 0.0f);
+		// got it - move it to the front of the LRU list, and simply
+		// reuse the existing effect
+		lru.splice(lru.begin(), lru, it->second.lruPos);
+		backend->PlayOneShot(it->second.sound.get(), volume);
 	}
 	else
 	{
-		// load the effect 
-		auto sound = std::make_unique<DirectX::SoundEffect>(engine, path);
-		if (sound->GetFormat() != nullptr)
+		// load the effect
+		PCMSound pcm;
+		AudioBackend::Sound *sound;
+		if (pcm.Load(path) && (sound = backend->CreateSound(pcm)) != nullptr)
 		{
 			// start it playing
-			sound->Play(volume, 0.0f, 0.0f);
+			backend->PlayOneShot(sound, volume);
+
+			// add it to the cache, at the front of the LRU list
+			lru.emplace_front(path);
+			auto &entry = cache[path];
+			entry.sound.reset(sound);
+			entry.lruPos = lru.begin();
 
-			// add it to the cache
-			cache.emplace(path, sound.release());
+			// trim the cache if it's grown past the limit
+			TrimCache();
 		}
 	}
 }
 
+void AudioManager::TrimCache()
+{
+	while (cache.size() > MaxCacheEntries && lru.size() != 0)
+	{
+		// evict the least recently used item
+		if (auto it = cache.find(lru.back()); it != cache.end())
+		{
+			// if it's still playing, keep it around until it finishes
+			if (it->second.sound->IsInUse())
+				evicted.emplace_back(it->second.sound.release());
+
+			cache.erase(it);
+		}
+		lru.pop_back();
+	}
+}
+
+bool AudioManager::LoadPooledSound(const TCHAR *name, const TCHAR *filename)
+{
+	// load and decode the file
+	PCMSound pcm;
+	if (!pcm.Load(filename))
+		return false;
+
+	// create the backend sound
+	std::unique_ptr<AudioBackend::Sound> sound(backend->CreateSound(pcm));
+	if (sound == nullptr)
+		return false;
+
+	// if we're replacing an existing sound, release any voices bound to it
+	if (auto it = pooledSounds.find(name); it != pooledSounds.end())
+	{
+		for (auto &v : voicePool)
+		{
+			if (v.sound == it->second.get())
+			{
+				v.voice.reset(backend->CreateVoice());
+				v.sound = nullptr;
+				v.startTime = 0;
+			}
+		}
+	}
+
+	// store it
+	pooledSounds[name] = std::move(sound);
+	return true;
+}
+
+void AudioManager::ClearPooledSounds()
+{
+	// release the voices, since they can refer to the pooled sounds
+	for (auto &v : voicePool)
+	{
+		v.voice.reset(backend->CreateVoice());
+		v.sound = nullptr;
+		v.startTime = 0;
+	}
+
+	// clear the sound table
+	pooledSounds.clear();
+}
+
+bool AudioManager::PlayPooledSound(const TCHAR *name, float volume, int64_t eventTicks)
+{
+	// look up the sound
+	auto it = pooledSounds.find(name);
+	if (it == pooledSounds.end())
+		return false;
+	AudioBackend::Sound *sound = it->second.get();
+
+	// if the caller didn't provide an event time, use the current time
+	if (eventTicks == 0)
+		eventTicks = timer.GetTime_ticks();
+
+	// Choose a voice.  Our first choice is an idle voice that's already
+	// bound to this sound, since we can restart it without any new
+	// allocation.  Next is the idle voice that's been idle longest.  If
+	// all voices are busy, steal the one that's been playing longest.
+	PoolVoice *idleSame = nullptr, *idleOther = nullptr, *oldest = nullptr;
+	for (auto &v : voicePool)
+	{
+		if (!v.voice->IsPlaying())
+		{
+			if (v.sound == sound)
+			{
+				idleSame = &v;
+				break;
+			}
+			if (idleOther == nullptr || v.startTime < idleOther->startTime)
+				idleOther = &v;
+		}
+		else if (oldest == nullptr || v.startTime < oldest->startTime)
+			oldest = &v;
+	}
+	PoolVoice *v = idleSame != nullptr ? idleSame : idleOther != nullptr ? idleOther : oldest;
+	if (v == oldest)
+		++voicesStolen;
+
+	// start it playing
+	v->voice->Play(sound, volume, eventTicks);
+	v->sound = sound;
+	v->startTime = timer.GetTime_ticks();
+	return true;
+}
+
 void AudioManager::Update()
 {
 	// update the engine
-	if (!engine->Update() && engine->IsCriticalError())
+	if (!backend->Update())
 		criticalError = true;
+
+	// clean up evicted cache entries that have finished playing
+	CleanSoundList(evicted);
 }
 
-void AudioManager::CleanSoundList(std::list<std::unique_ptr<DirectX::SoundEffect>> &list)
+void AudioManager::CleanSoundList(std::list<std::unique_ptr<AudioBackend::Sound>> &list)
 {
 	for (auto it = list.begin(); it != list.end(); )
 	{
@@ -2,17 +2,198 @@
 // Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
 //
 // Audio manager.  This is a wrapper for the DirectXTK audio objects.
+//
+// We handle two kinds of sound effects.  "Pooled" sounds are the
+// button sound set (Next, Prev, Select, etc).  These fire on every
+// wheel step and every auto-repeat key event, so they're the most
+// latency-sensitive sounds we play.  We decode these into memory once,
+// up front, and play them through a fixed set of voices that we
+// create at startup, so that playing one never requires a file system
+// search, a file load, or a voice allocation.  If all of the voices
+// are busy when a new sound comes in, we steal the voice that's been
+// playing longest.  Everything else goes through PlayFile(), which
+// loads files on demand into a bounded LRU cache.
+//
+// The actual output is handled by an AudioBackend.  The normal backend
+// plays through XAudio2 via DirectXTK.  For timing measurements, the
+// null and file sinks stand in for the sound hardware: they consume
+// the samples synchronously and record the time from the triggering
+// event (usually a key press) to the delivery of the first sample.
 
 #pragma once
 #include <Audio.h>
 #include <memory>
 #include <unordered_map>
+#include <list>
+#include <vector>
+#include "HiResTimer.h"
+
+// Decoded PCM sound.  This holds the full contents of a WAV file in
+// memory, with the format descriptor and sample pointers referring
+// into the file image.
+struct PCMSound
+{
+	// Load a WAV file.  Returns true on success, false if the file
+	// can't be read or isn't a valid RIFF WAVE file.  Accepts PCM,
+	// IEEE float, ADPCM, and xWMA encodings; rejected formats are
+	// noted in the log file.
+	bool Load(const TCHAR *filename);
+
+	// file contents
+	std::unique_ptr<uint8_t[]> data;
+	size_t dataLen = 0;
+
+	// wave format descriptor and sample data, pointing into 'data'
+	const WAVEFORMATEX *wfx = nullptr;
+	const uint8_t *samples = nullptr;
+	size_t sampleBytes = 0;
+
+	// xWMA seek table ('dpds' chunk), pointing into 'data'; null for
+	// other formats
+	const uint32_t *seekTable = nullptr;
+	size_t seekCount = 0;
+};
+
+// Audio output backend
+class AudioBackend
+{
+public:
+	virtual ~AudioBackend() { }
+
+	// Backend sound object.  This represents a decoded sound that's
+	// ready to play through a voice.
+	class Sound
+	{
+	public:
+		virtual ~Sound() { }
+
+		// Is the sound still in use by any voice?
+		virtual bool IsInUse() = 0;
+
+		// memory footprint of the decoded sample data
+		size_t sizeInBytes = 0;
+	};
+
+	// Voice.  A voice plays one sound at a time, and can be rebound
+	// to a different sound on each play.
+	class Voice
+	{
+	public:
+		virtual ~Voice() { }
+
+		// Start playing a sound, stopping anything that's currently
+		// playing on the voice.  'eventTicks' is the HiResTimer time
+		// of the event that triggered the sound, for latency stats.
+		virtual void Play(Sound *sound, float volume, int64_t eventTicks) = 0;
+
+		// stop playback
+		virtual void Stop() = 0;
+
+		// is the voice currently playing?
+		virtual bool IsPlaying() = 0;
+	};
+
+	// Create a sound from a decoded PCM buffer.  The backend takes
+	// ownership of the buffer.  Returns null on failure.
+	virtual Sound *CreateSound(PCMSound &pcm) = 0;
+
+	// Create a voice
+	virtual Voice *CreateVoice() = 0;
+
+	// Play a sound in fire-and-forget mode.  This is for sounds that
+	// don't go through the voice pool.
+	virtual void PlayOneShot(Sound *sound, float volume) = 0;
+
+	// Do periodic housekeeping.  Returns false if a critical error
+	// has occurred.
+	virtual bool Update() = 0;
+
+	// Latency statistics.  Backends that can observe the delivery
+	// of the first sample of a sound record the time from the
+	// triggering event to that point.
+	struct LatencyStats
+	{
+		int64_t n = 0;            // number of sounds measured
+		double totalUs = 0.0;     // total latency in microseconds
+		double maxUs = 0.0;       // maximum latency
+		double AvgUs() const { return n != 0 ? totalUs / n : 0.0; }
+	};
+	virtual const LatencyStats *GetLatencyStats() const { return nullptr; }
+};
+
+// Null audio sink.  This accepts sounds and discards the samples,
+// marking each voice as playing for the nominal duration of its
+// sound.  The first sample is considered delivered at the moment the
+// voice starts, so the recorded latency is the time spent in our own
+// event handling and sound lookup.
+class NullAudioSink : public AudioBackend
+{
+public:
+	virtual Sound *CreateSound(PCMSound &pcm) override;
+	virtual Voice *CreateVoice() override;
+	virtual void PlayOneShot(Sound *sound, float volume) override;
+	virtual bool Update() override { return true; }
+	virtual const LatencyStats *GetLatencyStats() const override { return &latency; }
+
+protected:
+	class NullSound;
+	class NullVoice;
+
+	// Deliver a sound's samples.  The base null sink simply discards
+	// them; subclasses can override to capture the output.
+	virtual void OnDeliver(NullSound *sound, float volume, double latencyUs) { }
+
+	// record a latency measurement
+	void CountLatency(double us);
+
+	// latency statistics
+	LatencyStats latency;
+
+	// timer
+	HiResTimer timer;
+};
+
+// File audio sink.  This writes the samples for each sound played to
+// a WAV file, back to back, and writes a CSV log with the latency of
+// each sound.  The WAV output uses the format of the first sound
+// played; sounds in other formats are noted in the log but omitted
+// from the WAV.
+class FileAudioSink : public NullAudioSink
+{
+public:
+	// 'filename' is the WAV output file; the log is written to the
+	// same name with ".csv" appended
+	FileAudioSink(const TCHAR *filename);
+	~FileAudioSink();
+
+protected:
+	virtual void OnDeliver(NullSound *sound, float volume, double latencyUs) override;
+
+	// finalize the RIFF header sizes
+	void UpdateHeader();
+
+	// output files
+	FILE *wavFp = nullptr;
+	FILE *logFp = nullptr;
+
+	// output format, taken from the first sound played
+	WAVEFORMATEX outFmt;
+	bool outFmtSet = false;
+
+	// sample data bytes written so far
+	DWORD dataBytes = 0;
+
+	// start time, for the log timestamps
+	int64_t t0;
+};
 
 class AudioManager
 {
 public:
-	// initialize the global singleton
-	static void Init();
+	// Initialize the global singleton.  If a backend is provided, we
+	// take ownership of it; otherwise we create the standard XAudio2
+	// backend.
+	static void Init(AudioBackend *backend = nullptr);
 
 	// shut down and delete the global singleton
 	static void Shutdown();
@@ -23,6 +204,26 @@ public:
 	// Play a sound file.  The file is given as a full path.
 	void PlayFile(const TCHAR *filename, float volume = 1.0f);
 
+	// Load a pooled sound.  This decodes the file into memory and adds
+	// it to the pooled sound table under the given name, replacing any
+	// existing sound with the same name.  Returns true on success.
+	bool LoadPooledSound(const TCHAR *name, const TCHAR *filename);
+
+	// Is the named sound loaded in the pool?
+	bool IsPooledSoundLoaded(const TCHAR *name) const { return pooledSounds.find(name) != pooledSounds.end(); }
+
+	// Clear the pooled sounds.  This stops all pooled voices.
+	void ClearPooledSounds();
+
+	// Play a pooled sound by name.  Returns false if there's no such
+	// sound loaded.  'eventTicks' is the HiResTimer time of the event
+	// that triggered the sound, for latency measurements; if this is
+	// zero, we use the current time.
+	bool PlayPooledSound(const TCHAR *name, float volume = 1.0f, int64_t eventTicks = 0);
+
+	// Get the current HiResTimer time, for passing as an event time
+	int64_t GetEventTicks() { return timer.GetTime_ticks(); }
+
 	// Update.  This takes care of timed housekeeping work in the DXTK
 	// engine.  This must be called regularly, typically at the same
 	// time that we render a D3D frame.
@@ -32,26 +233,70 @@ public:
 	// Update() processing, we set an internal flag.  This can be
 	// interrogated periodically to report errors in the UI.
 
+	// get the backend's latency statistics, if available
+	const AudioBackend::LatencyStats *GetLatencyStats() const { return backend->GetLatencyStats(); }
+
+	// number of voices stolen so far
+	int64_t GetVoicesStolen() const { return voicesStolen; }
+
 protected:
 	// global singleton instance
 	static AudioManager *inst;
 
-	// DirectXTK audio engine object
-	DirectX::AudioEngine *engine;
+	// audio output backend
+	std::unique_ptr<AudioBackend> backend;
 
 	// Critical audio engine error detected
 	bool criticalError;
 
+	// hi-res timer, for event timestamps
+	HiResTimer timer;
+
+	// Pooled sounds, indexed by name
+	std::unordered_map<TSTRING, std::unique_ptr<AudioBackend::Sound>> pooledSounds;
+
+	// Voice pool.  This is a fixed set of voices created at startup.
+	// Each voice remembers the time it last started playing, so that
+	// we can find the oldest voice to steal when they're all busy.
+	static const int VoicePoolSize = 8;
+	struct PoolVoice
+	{
+		std::unique_ptr<AudioBackend::Voice> voice;
+		AudioBackend::Sound *sound = nullptr;
+		int64_t startTime = 0;
+	};
+	PoolVoice voicePool[VoicePoolSize];
+
+	// number of voices stolen
+	int64_t voicesStolen = 0;
+
 	// Sound cache.  This is a table of reusable sound effects,
-	// indexed by filename.  
-	std::unordered_map<TSTRING, std::unique_ptr<DirectX::SoundEffect>> cache;
+	// indexed by filename, for sounds played through PlayFile().
+	// The cache is bounded: when it grows past the limit, we evict
+	// the least recently used entries.  'lru' lists the entries in
+	// order of use, most recent first.
+	static const size_t MaxCacheEntries = 32;
+	struct CacheEntry
+	{
+		std::unique_ptr<AudioBackend::Sound> sound;
+		std::list<TSTRING>::iterator lruPos;
+	};
+	std::unordered_map<TSTRING, CacheEntry> cache;
+	std::list<TSTRING> lru;
+
+	// Evicted sounds that were still playing when evicted.  We keep
+	// these until they finish.
+	std::list<std::unique_ptr<AudioBackend::Sound>> evicted;
+
+	// trim the cache to the size limit
+	void TrimCache();
 
-	// Clean up a play list.  This takes a list of SoundEffect objects, scans
+	// Clean up a play list.  This takes a list of sound objects, scans
 	// it for finished items, and erases each item that's no longer playing.
-	void CleanSoundList(std::list<std::unique_ptr<DirectX::SoundEffect>> &list);
+	void CleanSoundList(std::list<std::unique_ptr<AudioBackend::Sound>> &list);
 
 	// construction and destruction are handled through our own static methods,
 	// so they're protected
-	AudioManager();
+	AudioManager(AudioBackend *backend);
 	~AudioManager();
 };
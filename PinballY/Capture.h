@@ -73,6 +73,11 @@ struct CaptureItemDesc
 	// manual start/stop mode
 	bool manualStart;
 	bool manualStop;
+
+	// Captured as part of a combined multi-window capture.  The
+	// combined pass handles all of the work for the item, so the
+	// individual item capture loop skips it.
+	bool combined = false;
 };
 
 // Capture information.  This stores the settings for a capture run, common
@@ -91,6 +96,19 @@ struct CaptureInfo
 	// two-pass encoding mode
 	bool twoPassEncoding = false;
 
+	// Background encoding mode.  This is used in batch captures: video
+	// items are captured in two passes, and the second (encoding) pass
+	// is handed off to the background encoder queue, so that it can run
+	// while the batch moves on to the next game.
+	bool backgroundEncode = false;
+
+	// Combined capture mode.  In this mode, we capture all of the
+	// timed video items with a single ffmpeg process, grabbing the
+	// desktop once and splitting it into per-window outputs.  This
+	// takes less time than capturing the windows one after another,
+	// and keeps the videos for the different windows in sync.
+	bool combinedCapture = false;
+
 	// video codec options for pass 1 of a two-pass recording
 	TSTRING vcodecPass1;
 
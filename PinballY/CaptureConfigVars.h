@@ -42,6 +42,9 @@ namespace ConfigVars
 	static const TCHAR *CaptureTwoPassEncoding = _T("Capture.TwoPassEncoding");
 	static const TCHAR *CaptureVideoCodecPass1 = _T("Capture.VideoCodecPass1");
 	static const TCHAR *CaptureTempFolder = _T("Capture.TempFolder");
+	static const TCHAR *CaptureBatchBackgroundEncoding = _T("Capture.BatchBackgroundEncoding");
+	static const TCHAR *CaptureBackgroundEncoders = _T("Capture.BackgroundEncoders");
+	static const TCHAR *CaptureCombinedVideo = _T("Capture.CombinedVideo");
 	static const TCHAR *CaptureVideoResLimit = _T("Capture.VideoResolutionLimit");
 	static const TCHAR *CaptureUseCustomCommandOptions = _T("Capture.UseCustomCommandOptions");
 	static const TCHAR *CaptureCustomVideoSource = _T("Capture.CustomVideoSource");
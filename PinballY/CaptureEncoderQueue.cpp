@@ -0,0 +1,365 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+#include "stdafx.h"
+#include "../Utilities/Config.h"
+#include "CaptureEncoderQueue.h"
+#include "CaptureConfigVars.h"
+#include "PrivateWindowMessages.h"
+#include "LogFile.h"
+
+
+CaptureEncoderQueue::CaptureEncoderQueue()
+{
+	// create the shutdown event
+	shutdownEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	// Figure the maximum number of concurrent encoders.  If the config
+	// doesn't say, use half of the logical processors.  ffmpeg's encoders
+	// are multi-threaded on their own, so running one per core would just
+	// oversubscribe the CPU, and we want to leave some headroom for the
+	// game being captured in the foreground.
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	int nCores = max(static_cast<int>(si.dwNumberOfProcessors), 1);
+	maxWorkers = ConfigManager::GetInstance()->GetInt(ConfigVars::CaptureBackgroundEncoders, 0);
+	if (maxWorkers <= 0)
+		maxWorkers = max(nCores / 2, 1);
+	else
+		maxWorkers = min(maxWorkers, nCores);
+}
+
+CaptureEncoderQueue::~CaptureEncoderQueue()
+{
+	// Make sure the worker threads have exited.  If any are still
+	// running after the shutdown timeout, keep waiting, since they're
+	// using this object.  They've been told to stop at this point, and
+	// they'll terminate their ffmpeg processes if necessary, so this
+	// won't take much longer.
+	if (!Shutdown(5000))
+		WaitForWorkers(INFINITE);
+}
+
+void CaptureEncoderQueue::Enqueue(Job *job)
+{
+	CriticalSectionLocker locker(lock);
+
+	// add the job
+	job->tQueued = GetTickCount64();
+	pending.emplace_back(job);
+	status.nQueued += 1;
+
+	// log the queue status
+	LogFile::Get()->Write(LogFile::CaptureLogging,
+		_T("Background encoder: queued %s; %d running, %d waiting\n"),
+		job->itemDesc.c_str(), status.nRunning, status.nQueued);
+
+	// start a new worker if we're below the concurrency limit
+	if (nWorkers < maxWorkers)
+	{
+		// forget any threads that have already exited
+		threads.remove_if([](const HandleHolder &h) { return WaitForSingleObject(h, 0) == WAIT_OBJECT_0; });
+
+		// launch the thread
+		DWORD tid;
+		if (HANDLE hThread = CreateThread(NULL, 0, &SWorkerMain, this, 0, &tid); hThread != NULL)
+		{
+			threads.emplace_back(hThread);
+			nWorkers += 1;
+		}
+		else
+		{
+			// If we couldn't create the thread, and there are no workers
+			// running, the job will never be picked up, so fail it now.
+			WindowsErrorMessage err;
+			LogFile::Get()->Write(LogFile::CaptureLogging,
+				_T("Background encoder: unable to start worker thread (error %d: %s)\n"), err.GetCode(), err.Get());
+			if (nWorkers == 0)
+			{
+				locker.Unlock();
+				CancelPending();
+			}
+		}
+	}
+}
+
+void CaptureEncoderQueue::CancelPending()
+{
+	// pull the pending jobs out of the queue
+	std::list<std::unique_ptr<Job>> canceled;
+	{
+		CriticalSectionLocker locker(lock);
+		canceled.swap(pending);
+		status.nQueued = 0;
+	}
+
+	// delete their temp files and report the cancellations
+	for (auto &job : canceled)
+	{
+		LogFile::Get()->Write(LogFile::CaptureLogging, _T("Background encoder: %s canceled\n"), job->itemDesc.c_str());
+		DeleteFile(job->tmpfile.c_str());
+		Notify(std::move(job), false, true, 0, 0);
+	}
+}
+
+bool CaptureEncoderQueue::Shutdown(DWORD timeout)
+{
+	// tell the workers to stop, and discard anything that hasn't started
+	SetEvent(shutdownEvent);
+	CancelPending();
+
+	// wait for the worker threads to exit, but not too long
+	return WaitForWorkers(timeout);
+}
+
+bool CaptureEncoderQueue::WaitForWorkers(DWORD timeout)
+{
+	// Get the thread handles.  We leave the handles in the list, so
+	// that a later wait can pick up any threads that outlast this one.
+	std::vector<HANDLE> h;
+	{
+		CriticalSectionLocker locker(lock);
+		for (auto &t : threads)
+			h.push_back(t);
+	}
+
+	// wait for the threads to exit
+	ULONGLONG tEnd = GetTickCount64() + timeout;
+	bool allExited = true;
+	for (auto t : h)
+	{
+		ULONGLONG now = GetTickCount64();
+		DWORD wait = timeout == INFINITE ? INFINITE : now < tEnd ? static_cast<DWORD>(tEnd - now) : 0;
+		if (WaitForSingleObject(t, wait) != WAIT_OBJECT_0)
+			allExited = false;
+	}
+
+	return allExited;
+}
+
+CaptureEncoderQueue::Status CaptureEncoderQueue::GetStatus()
+{
+	CriticalSectionLocker locker(lock);
+	return status;
+}
+
+bool CaptureEncoderQueue::IsIdle()
+{
+	CriticalSectionLocker locker(lock);
+	return status.nQueued == 0 && status.nRunning == 0;
+}
+
+void CaptureEncoderQueue::ResetStats()
+{
+	CriticalSectionLocker locker(lock);
+	status.nDone = status.nOk = 0;
+	status.mediaTime = status.encodeTime = 0;
+}
+
+DWORD WINAPI CaptureEncoderQueue::SWorkerMain(LPVOID lParam)
+{
+	return reinterpret_cast<CaptureEncoderQueue*>(lParam)->WorkerMain();
+}
+
+DWORD CaptureEncoderQueue::WorkerMain()
+{
+	for (;;)
+	{
+		// get the next job; exit the thread if the queue is empty
+		std::unique_ptr<Job> job;
+		{
+			CriticalSectionLocker locker(lock);
+			if (pending.size() == 0 || WaitForSingleObject(shutdownEvent, 0) == WAIT_OBJECT_0)
+			{
+				nWorkers -= 1;
+				return 0;
+			}
+
+			job.reset(pending.front().release());
+			pending.pop_front();
+			status.nQueued -= 1;
+			status.nRunning += 1;
+		}
+
+		// run the job, timing it
+		ULONGLONG tStart = GetTickCount64();
+		bool ok = RunJob(job.get());
+		double encodeTime = static_cast<double>(GetTickCount64() - tStart) / 1000.0;
+		double waitTime = static_cast<double>(tStart - job->tQueued) / 1000.0;
+		double mediaTime = static_cast<double>(job->mediaTime) / 1000.0;
+
+		// update the statistics
+		Status s;
+		{
+			CriticalSectionLocker locker(lock);
+			status.nRunning -= 1;
+			status.nDone += 1;
+			if (ok)
+			{
+				status.nOk += 1;
+				status.mediaTime += mediaTime;
+				status.encodeTime += encodeTime;
+			}
+			s = status;
+		}
+
+		// log the throughput
+		LogFile::Get()->Write(LogFile::CaptureLogging,
+			_T("Background encoder: %s %s; %.1fs of media encoded in %.1fs (%.2fx real time) after %.1fs in queue; ")
+			_T("%d running, %d waiting, %d of %d done OK, overall %.2fx real time\n"),
+			job->itemDesc.c_str(), ok ? _T("finished") : _T("failed"),
+			mediaTime, encodeTime, encodeTime != 0 ? mediaTime / encodeTime : 0, waitTime,
+			s.nRunning, s.nQueued, s.nOk, s.nDone, s.Speed());
+
+		// notify the UI
+		Notify(std::move(job), ok, false, encodeTime, waitTime);
+	}
+}
+
+bool CaptureEncoderQueue::RunJob(Job *job)
+{
+	// presume failure
+	bool result = false;
+
+	// inheritable handle attributes, for the child's stdin and stdout
+	SECURITY_ATTRIBUTES sa;
+	sa.nLength = sizeof(sa);
+	sa.lpSecurityDescriptor = NULL;
+	sa.bInheritHandle = TRUE;
+
+	// Create a pipe for the ffmpeg stdin, so that we can send it a "q"
+	// key to stop it if we have to shut down while it's running.
+	HandleHolder hStdinRead, hStdinWrite;
+	if (CreatePipe(&hStdinRead, &hStdinWrite, &sa, 1024))
+		SetHandleInformation(hStdinWrite, HANDLE_FLAG_INHERIT, 0);
+	else
+		hStdinRead = CreateFile(_T("NUL"), GENERIC_READ, 0, &sa, OPEN_EXISTING, 0, NULL);
+
+	// Capture the ffmpeg output to a temp file.  We only copy this to
+	// the log on failure, since the full output of several concurrent
+	// encoders would be hard to read interleaved with the foreground
+	// capture's log output.
+	HandleHolder hStdOut;
+	TCHAR tmpPath[MAX_PATH] = _T(""), tmpName[MAX_PATH] = _T("");
+	GetTempPath(countof(tmpPath), tmpPath);
+	if (GetTempFileName(tmpPath, _T("PBYEnc"), 0, tmpName) != 0)
+		hStdOut = CreateFile(tmpName, GENERIC_WRITE, 0, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hStdOut == NULL || hStdOut == INVALID_HANDLE_VALUE)
+	{
+		hStdOut = CreateFile(_T("NUL"), GENERIC_WRITE, 0, &sa, OPEN_EXISTING, 0, NULL);
+		tmpName[0] = 0;
+	}
+
+	// set up the startup info
+	STARTUPINFO startupInfo;
+	ZeroMemory(&startupInfo, sizeof(startupInfo));
+	startupInfo.cb = sizeof(startupInfo);
+	startupInfo.dwFlags = STARTF_USESHOWWINDOW | STARTF_USESTDHANDLES;
+	startupInfo.wShowWindow = SW_SHOWNOACTIVATE;
+	startupInfo.hStdInput = hStdinRead;
+	startupInfo.hStdOutput = hStdOut;
+	startupInfo.hStdError = hStdOut;
+
+	// Launch the process.  Run it at below-normal priority, so that it
+	// doesn't compete with the game running in the foreground.
+	LogFile::Get()->Write(LogFile::CaptureLogging,
+		_T("Background encoder: %s: launching ffmpeg with command line:\n> %s\n"),
+		job->itemDesc.c_str(), job->cmdline.c_str());
+	PROCESS_INFORMATION procInfo;
+	if (CreateProcess(NULL, job->cmdline.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW | BELOW_NORMAL_PRIORITY_CLASS,
+		NULL, NULL, &startupInfo, &procInfo))
+	{
+		HandleHolder hProc(procInfo.hProcess);
+		HandleHolder hThread(procInfo.hThread);
+		hStdinRead = NULL;
+
+		// wait for the process to exit or for a shutdown signal
+		HANDLE h[] = { hProc, shutdownEvent };
+		DWORD exitCode = 1;
+		switch (WaitForMultipleObjects(countof(h), h, FALSE, INFINITE))
+		{
+		case WAIT_OBJECT_0:
+			// ffmpeg finished - it's a success if the exit code is zero
+			GetExitCodeProcess(hProc, &exitCode);
+			result = (exitCode == 0);
+			break;
+
+		default:
+			// Shutdown or wait error.  Send ffmpeg a "q" to tell it to stop,
+			// and give it a moment to comply before terminating it.
+			if (hStdinWrite != NULL)
+			{
+				static const char msg[] = "q\n";
+				DWORD actual;
+				WriteFile(hStdinWrite, msg, sizeof(msg) - 1, &actual, NULL);
+			}
+			if (WaitForSingleObject(hProc, 2000) != WAIT_OBJECT_0)
+				TerminateProcess(hProc, 1);
+			LogFile::Get()->Write(LogFile::CaptureLogging, _T("Background encoder: %s: interrupted\n"), job->itemDesc.c_str());
+			break;
+		}
+
+		// close our copy of the output file
+		hStdOut = NULL;
+
+		// on failure, copy the ffmpeg output to the log, if capture
+		// logging is enabled
+		if (!result && tmpName[0] != 0 && LogFile::Get()->IsFeatureEnabled(LogFile::CaptureLogging))
+		{
+			LogFile::Get()->Write(LogFile::CaptureLogging, _T("Background encoder: %s: ffmpeg exit code %d; output follows\n"),
+				job->itemDesc.c_str(), (int)exitCode);
+
+			long len;
+			std::unique_ptr<BYTE> txt(ReadFileAsStr(tmpName, SilentErrorHandler(),
+				len, ReadFileAsStr_NewlineTerm | ReadFileAsStr_NullTerm));
+			if (txt != nullptr)
+			{
+				// write the text in null-terminated chunks, in case it
+				// contains null bytes
+				const BYTE *endp = txt.get() + len;
+				for (const BYTE *p = txt.get(); p < endp; )
+				{
+					const BYTE *q;
+					for (q = p; q != endp && *q != 0; ++q);
+					LogFile::Get()->WriteStrA((const char *)p);
+					p = q + 1;
+				}
+			}
+			LogFile::Get()->Group(LogFile::CaptureLogging);
+		}
+	}
+	else
+	{
+		WindowsErrorMessage err;
+		LogFile::Get()->Write(LogFile::CaptureLogging, _T("Background encoder: %s: ffmpeg launch failed: Win32 error %d, %s\n"),
+			job->itemDesc.c_str(), err.GetCode(), err.Get());
+	}
+
+	// clean up the output log and the first-pass temp file
+	hStdOut = NULL;
+	if (tmpName[0] != 0)
+		DeleteFile(tmpName);
+	DeleteFile(job->tmpfile.c_str());
+
+	// return the result
+	return result;
+}
+
+void CaptureEncoderQueue::Notify(std::unique_ptr<Job> job, bool ok, bool canceled, double encodeTime, double waitTime)
+{
+	// Skip the notification if we're shutting down.  The UI is going
+	// away, so there's no one left to care about the result.
+	if (WaitForSingleObject(shutdownEvent, 0) == WAIT_OBJECT_0)
+		return;
+
+	// Post the report to the window.  This has to be a post rather than
+	// a send, since the UI thread might be blocked waiting for us to
+	// exit.  The window takes ownership of the report if the post
+	// succeeds; otherwise we have to delete it here.
+	if (HWND hwnd = job->hwndNotify; hwnd != NULL && IsWindow(hwnd))
+	{
+		std::unique_ptr<Report> report(new Report(std::move(job), ok, canceled, encodeTime, waitTime));
+		if (::PostMessage(hwnd, PFVMsgCaptureEncodeDone, 0, reinterpret_cast<LPARAM>(report.get())))
+			report.release();
+	}
+}
@@ -0,0 +1,159 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Background encoder queue for batch media capture.
+//
+// In a two-pass capture, the first pass records the screen to a
+// temporary file using a lossless, minimal-compression codec, and the
+// second pass compresses the temp file into the final media file.  The
+// second pass doesn't need the game to be running, so during a batch
+// capture, we hand it off to this queue instead of running it inline.
+// That lets the encoding for one game overlap with launching and
+// capturing the next game, rather than holding up the whole batch.
+//
+// The queue runs each job as an ffmpeg child process on a worker
+// thread.  The number of concurrent jobs is bounded (by default, to
+// half of the logical CPU cores), since each ffmpeg encoder is itself
+// multi-threaded, and we don't want to starve the game that's being
+// captured in the meantime.  Encoder processes run at below-normal
+// priority for the same reason.
+//
+// When a job finishes, we notify the window designated in the job
+// by posting a PFVMsgCaptureEncodeDone message.  We post rather than
+// send so that a worker thread never waits on the UI thread; the UI
+// thread in turn waits for the workers to exit at shutdown.
+
+#pragma once
+#include <list>
+#include <memory>
+#include "../Utilities/WinUtil.h"
+
+class CaptureEncoderQueue
+{
+public:
+	CaptureEncoderQueue();
+	~CaptureEncoderQueue();
+
+	// Encoding job
+	struct Job
+	{
+		// internal ID of the game the media item belongs to
+		LONG gameId = 0;
+
+		// item description, for status reporting
+		TSTRING itemDesc;
+
+		// ffmpeg command line for the encoding pass
+		TSTRING cmdline;
+
+		// temporary input file; we delete this when the job finishes
+		TSTRING tmpfile;
+
+		// final output file
+		TSTRING filename;
+
+		// running time of the captured media, in milliseconds, for
+		// throughput statistics
+		DWORD mediaTime = 0;
+
+		// window to notify on completion
+		HWND hwndNotify = NULL;
+
+		// time the job was queued (GetTickCount64 time)
+		ULONGLONG tQueued = 0;
+	};
+
+	// Completion report, posted to the job's notification window with
+	// PFVMsgCaptureEncodeDone (LPARAM = Report*).  The report is allocated
+	// with 'new', and the recipient takes ownership of it.
+	struct Report
+	{
+		Report(std::unique_ptr<Job> job, bool ok, bool canceled, double encodeTime, double waitTime) :
+			job(std::move(job)), ok(ok), canceled(canceled), encodeTime(encodeTime), waitTime(waitTime) { }
+
+		// the completed job
+		std::unique_ptr<Job> job;
+
+		// success/failure
+		bool ok;
+
+		// the job was canceled before it started
+		bool canceled;
+
+		// time spent encoding, and time spent waiting in the queue
+		// before the encoder started, in seconds
+		double encodeTime;
+		double waitTime;
+	};
+
+	// Add a job to the queue.  The queue takes ownership of the job,
+	// including the temp file.
+	void Enqueue(Job *job);
+
+	// Cancel all jobs that haven't started yet.  This deletes their temp
+	// files and sends a 'canceled' completion report for each one.  Jobs
+	// that are already running are left to finish.
+	void CancelPending();
+
+	// Shut down.  This cancels pending jobs, stops any running encoders,
+	// and waits (up to the timeout) for the worker threads to exit.
+	// Returns true if all of the workers have exited.
+	bool Shutdown(DWORD timeout);
+
+	// Queue status snapshot
+	struct Status
+	{
+		int nQueued = 0;          // jobs waiting to start
+		int nRunning = 0;         // jobs in progress
+		int nDone = 0;            // jobs finished since the last ResetStats()
+		int nOk = 0;              // jobs finished successfully
+		double mediaTime = 0;     // total media running time of successful jobs, in seconds
+		double encodeTime = 0;    // total encoding time of successful jobs, in seconds
+
+		// overall encoding speed, as a multiple of real time
+		double Speed() const { return encodeTime != 0 ? mediaTime / encodeTime : 0; }
+	};
+	Status GetStatus();
+
+	// are all jobs finished?
+	bool IsIdle();
+
+	// reset the completion statistics
+	void ResetStats();
+
+protected:
+	// worker thread entrypoint
+	static DWORD WINAPI SWorkerMain(LPVOID lParam);
+	DWORD WorkerMain();
+
+	// run a job; returns true on success
+	bool RunJob(Job *job);
+
+	// send the completion notification for a job; takes ownership of the job
+	void Notify(std::unique_ptr<Job> job, bool ok, bool canceled, double encodeTime, double waitTime);
+
+	// wait (up to the timeout) for the worker threads to exit; returns
+	// true if they've all exited
+	bool WaitForWorkers(DWORD timeout);
+
+	// maximum number of concurrent encoders
+	int maxWorkers;
+
+	// number of worker threads currently running
+	int nWorkers = 0;
+
+	// worker thread handles
+	std::list<HandleHolder> threads;
+
+	// pending jobs
+	std::list<std::unique_ptr<Job>> pending;
+
+	// current status
+	Status status;
+
+	// shutdown event
+	HandleHolder shutdownEvent;
+
+	// lock for the queue and status
+	CriticalSection lock;
+};
@@ -154,6 +154,16 @@ RECT CaptureStatusWin::GetCreateWindowPos(int &nCmdShow)
 	return { x, y, x + cx, y + cy };
 }
 
+bool CaptureStatusWin::SetExcludeFromCapture(bool exclude)
+{
+	// WDA_EXCLUDEFROMCAPTURE isn't in older SDK headers
+#ifndef WDA_EXCLUDEFROMCAPTURE
+	const DWORD WDA_EXCLUDEFROMCAPTURE = 0x00000011;
+#endif
+
+	return SetWindowDisplayAffinity(hWnd, exclude ? WDA_EXCLUDEFROMCAPTURE : WDA_NONE) != 0;
+}
+
 void CaptureStatusWin::PositionOver(FrameWin *win)
 {
 	int x = 0, y = 0;
@@ -34,6 +34,13 @@ public:
 	// position the window over the given frame window
 	void PositionOver(FrameWin *win);
 
+	// Exclude the window from screen captures.  This is used when
+	// capturing several windows at once, where there's no other
+	// window to move the status box over.  Returns false if the
+	// system doesn't support capture exclusion (it requires Windows
+	// 10 version 2004 or later).
+	bool SetExcludeFromCapture(bool exclude);
+
 	// Set the estimated total time for the capture process.  For
 	// a batch capture, this represents the time for the current
 	// game only.
@@ -374,6 +374,10 @@ void D3D::RenderFullScreenQuad()
 	ctx->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
 	ctx->VSSetShader(vsFullScreenQuad, nullptr, 0);
 	ctx->Draw(4, 0);
+
+	// count it
+	renderStats.stateChanges += 2;
+	++renderStats.drawCalls;
 }
 
 // Start stencil masking
@@ -408,6 +412,7 @@ void D3D::UpdateWorldTransform(const XMMATRIX &matrix)
 	cbw.world = matrix;
 
 	// update the resource
+	++renderStats.stateChanges;
 	DeviceContextLocker ctx;
 	ctx->UpdateSubresource(cbWorld, 0, nullptr, &cbw, 0, 0);
 }
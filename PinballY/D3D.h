@@ -161,10 +161,18 @@ public:
 	// update a resource
 	inline void UpdateResource(ID3D11Resource *resource, const void *srcData)
 	{
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->UpdateSubresource(resource, 0, nullptr, srcData, 0, 0); 
 	}
 
+	// update a region of a texture resource
+	inline void UpdateResource(ID3D11Resource *resource, const D3D11_BOX &box, const void *srcData, UINT rowPitch)
+	{
+		DeviceContextLocker ctx;
+		ctx->UpdateSubresource(resource, 0, &box, srcData, rowPitch, 0);
+	}
+
 	// create a vertex shader
 	inline HRESULT CreateVertexShader(const void *byteCode, SIZE_T byteCodeLength, ID3D11VertexShader **vs)
 		{ return device->CreateVertexShader(byteCode, byteCodeLength, nullptr, vs); }
@@ -186,6 +194,7 @@ public:
 	// set the input layout
 	inline void SetInputLayout(ID3D11InputLayout *layout)
 	{
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->IASetInputLayout(layout);
 	}
@@ -193,6 +202,7 @@ public:
 	// set the primitive topology to triangle list
 	inline void SetTriangleTopology()
 	{
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST); 
 	}
@@ -200,6 +210,7 @@ public:
 	// load a resource view into the pixel shader
 	inline void PSSetShaderResources(int startSlot, int numResources, ID3D11ShaderResourceView *const *resources)
 	{
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->PSSetShaderResources(startSlot, numResources, resources); 
 	}
@@ -215,16 +226,19 @@ public:
 	// set shaders
 	inline void VSSetShader(ID3D11VertexShader *vs)
 	{
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->VSSetShader(vs, nullptr, 0); 
 	}
 	inline void PSSetShader(ID3D11PixelShader *ps)
 	{
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->PSSetShader(ps, nullptr, 0);
 	}
 	inline void GSSetShader(ID3D11GeometryShader *gs)
 	{
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->GSSetShader(gs, nullptr, 0);
 	}
@@ -232,16 +246,19 @@ public:
 	// set shader constant buffers
 	inline void VSSetConstantBuffers(int startIdx, int numBuffers, ID3D11Buffer *const *buffers)
 	{
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->VSSetConstantBuffers(startIdx, numBuffers, buffers); 
 	}
 	inline void PSSetConstantBuffers(int startIdx, int numBuffers, ID3D11Buffer *const *buffers)
 	{ 
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->PSSetConstantBuffers(startIdx, numBuffers, buffers); 
 	}
 	inline void GSSetConstantBuffers(int startIdx, int numBuffers, ID3D11Buffer *const *buffers)
 	{ 
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->GSSetConstantBuffers(startIdx, numBuffers, buffers); 
 	}
@@ -249,14 +266,25 @@ public:
 	// set the input assembler vertex buffer
 	inline void IASetVertexBuffer(ID3D11Buffer *buffer, UINT stride)
 	{
+		++renderStats.stateChanges;
 		UINT offset = 0;
 		DeviceContextLocker ctx;
 		ctx->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
 	}
 
+	// set multiple input assembler vertex buffers, starting at slot 0
+	inline void IASetVertexBuffers(int numBuffers, ID3D11Buffer *const *buffers, const UINT *strides)
+	{
+		++renderStats.stateChanges;
+		static const UINT offsets[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT] = { 0 };
+		DeviceContextLocker ctx;
+		ctx->IASetVertexBuffers(0, numBuffers, buffers, strides, offsets);
+	}
+
 	// set the index buffer using WORD (16-bit unsigned int) format
 	inline void IASetIndexBuffer(ID3D11Buffer *buffer)
 	{
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->IASetIndexBuffer(buffer, DXGI_FORMAT_R16_UINT, 0); 
 	}
@@ -267,11 +295,13 @@ public:
 	// set the world constant buffer in a shader
 	inline void VSSetWorldConstantBuffer(int startIdx)
 	{
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->VSSetConstantBuffers(startIdx, 1, &cbWorld); 
 	}
 	inline void PSSetWorldConstantBuffer(int startIdx)
 	{
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->PSSetConstantBuffers(startIdx, 1, &cbWorld);
 	}
@@ -280,6 +310,7 @@ public:
 	// wrapping (default) or clamping when outside the 0..1 range.
 	inline void PSSetSampler(bool wrap = true)
 	{ 
+		++renderStats.stateChanges;
 		DeviceContextLocker ctx;
 		ctx->PSSetSamplers(0, 1, wrap ? &linearWrapSamplerState : &linearNoWrapSamplerState); 
 	}
@@ -294,10 +325,31 @@ public:
 	// draw
 	inline void DrawIndexed(INT indexCount)
 	{
+		++renderStats.drawCalls;
 		DeviceContextLocker ctx;
 		ctx->DrawIndexed(indexCount, 0, 0);
 	}
 
+	// draw instances
+	inline void DrawIndexedInstanced(INT indexCount, UINT instanceCount, UINT startInstance)
+	{
+		++renderStats.drawCalls;
+		DeviceContextLocker ctx;
+		ctx->DrawIndexedInstanced(indexCount, instanceCount, 0, 0, startInstance);
+	}
+
+	// Rendering statistics.  The drawing and state-setting wrappers
+	// above count their calls here, so that the frame counter overlay
+	// can show what each frame costs.  Windows reset the counters at
+	// the start of each frame.
+	struct RenderStats
+	{
+		int drawCalls = 0;		// draw calls
+		int stateChanges = 0;	// shader, input, resource, and constant buffer changes
+	};
+	const RenderStats &GetRenderStats() const { return renderStats; }
+	void ResetRenderStats() { renderStats = RenderStats(); }
+
 	// turn the depth stencil on or off
 	void SetUseDepthStencil(bool useDepth);
 
@@ -394,4 +446,7 @@ protected:
 
 	// special vertex shader to render a full-screen quad
 	ID3D11VertexShader *vsFullScreenQuad;
+
+	// rendering statistics for the current frame
+	RenderStats renderStats;
 };
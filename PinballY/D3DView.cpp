@@ -11,6 +11,7 @@
 #include "AudioManager.h"
 #include "Sprite.h"
 #include "VideoSprite.h"
+#include "Profiler.h"
 
 using namespace DirectX;
 
@@ -25,6 +26,7 @@ namespace ConfigVars
 // statics
 std::list<D3DView*> D3DView::activeD3DViews;
 std::list<D3DView::IdleEventSubscriber*> D3DView::idleEventSubscribers;
+FrameClock D3DView::frameClock;
 
 // construction
 D3DView::D3DView(int contextMenuId, const TCHAR *configVarPrefix) 
@@ -68,8 +70,9 @@ void D3DView::SetRotation(int rotation)
 
 void D3DView::SetMirrorHorz(bool f)
 {
-	// set the mirroring in the camera
+	// set the mirroring in the camera, and redraw
 	camera->SetMirrorHorz(f);
+	InvalidateFrame();
 
 	// save the change to the configuration
 	ConfigManager::GetInstance()->SetBool(configVarMirrorHorz.c_str(), camera->IsMirrorHorz());
@@ -77,8 +80,9 @@ void D3DView::SetMirrorHorz(bool f)
 
 void D3DView::SetMirrorVert(bool f)
 {
-	// set the mirroring in the camera
+	// set the mirroring in the camera, and redraw
 	camera->SetMirrorVert(f);
+	InvalidateFrame();
 
 	// save the change to the configuration
 	ConfigManager::GetInstance()->SetBool(configVarMirrorVert.c_str(), camera->IsMirrorVert());
@@ -216,12 +220,17 @@ void D3DView::RenderFrame()
 	if (IsIconic(hWnd) || !IsWindowVisible(hWnd))
 		return;
 
-	// count the frame
+	PROFILE_ZONE("D3DView::RenderFrame");
+
+	// count the frame, and start timing the work of issuing it
 	perfMon.CountFrame();
+	perfMon.BeginFrameCost();
 
-	// make sure I'm the active window in D3D
+	// make sure I'm the active window in D3D, and reset its statistics
+	// counters for the new frame
 	D3D *d3d = D3D::Get();
 	d3d->SetWin(d3dwin);
+	d3d->ResetRenderStats();
 
 	// prepare D3D for a new frame
 	d3dwin->BeginFrame();
@@ -237,14 +246,83 @@ void D3DView::RenderFrame()
 	d3d->SetMirroredRasterizerState(camera->IsMirrorHorz() ^ camera->IsMirrorVert());
 
 	// render the sprite list
-	for (auto &s : sprites)
-		s->Render(camera);
+	{
+		PROFILE_ZONE("SpriteBatch::Render");
+		spriteBatch.Render(camera, sprites);
+	}
 
 	// draw any text overlay
-	textDraw->Render(camera);
+	{
+		PROFILE_ZONE("TextDraw::Render");
+		textDraw->Render(camera);
+	}
+
+	// Record the frame cost.  Do this before closing out the frame,
+	// since Present() can block waiting for vsync.
+	auto &rs = d3d->GetRenderStats();
+	perfMon.EndFrameCost(rs.drawCalls, rs.stateChanges);
 
 	// close out the frame
-	d3dwin->EndFrame();
+	{
+		PROFILE_ZONE("D3DWin::EndFrame");
+		d3dwin->EndFrame();
+	}
+
+	// remember the sprite state as of this frame, for damage tracking
+	SnapshotDrawState();
+	lastDrawState.swap(curDrawState);
+	frameInvalid = false;
+	++framesRendered;
+}
+
+bool D3DView::RenderFrameIfChanged()
+{
+	// skip hidden and minimized windows
+	if (IsIconic(hWnd) || !IsWindowVisible(hWnd))
+		return false;
+
+	// Check for changes.  We have to render if the frame was explicitly
+	// invalidated, if the sprite list changed, or if any sprite moved,
+	// faded, or got new content.  We also have to render if anything in
+	// the current list is live, since it can change on its own, and if
+	// anything was live as of the last frame, so that we get one more
+	// frame to show the final state after the live content stops.
+	bool changed = frameInvalid;
+	if (!changed)
+	{
+		SnapshotDrawState();
+		if (curDrawState.size() != lastDrawState.size())
+			changed = true;
+		else
+		{
+			for (size_t i = 0; i < curDrawState.size() && !changed; ++i)
+			{
+				auto &cur = curDrawState[i], &last = lastDrawState[i];
+				changed = cur.live || last.live || !cur.SameAs(last);
+			}
+		}
+	}
+
+	// if nothing changed, the frame on screen is still current
+	if (!changed)
+	{
+		++framesSkipped;
+		return false;
+	}
+
+	// render the frame
+	RenderFrame();
+	return true;
+}
+
+void D3DView::SnapshotDrawState()
+{
+	curDrawState.clear();
+	for (auto &s : sprites)
+	{
+		if (s != nullptr)
+			curDrawState.emplace_back(s->GetDrawState());
+	}
 }
 
 void D3DView::ScaleSprite(Sprite *sprite, float span, bool maintainAspect)
@@ -355,6 +433,16 @@ void D3DView::ToggleFrameCounter()
 		// stop the timer
 		KillTimer(hWnd, fpsTimerID);
 		fpsDisplay = false;
+
+		// In profiling builds, save a trace of the recent profiler zones
+		// when the frame counter is turned off, so that the frame counter
+		// key doubles as the trace capture key: turn the counter on, do
+		// whatever's slow, and turn it off again.
+		if (Profiler::IsEnabled())
+		{
+			TSTRING traceFile;
+			Profiler::SaveTrace(traceFile);
+		}
 	}
 
 	// update the text display
@@ -503,8 +591,9 @@ void D3DView::MouseDragBegin(int button, POINT pt)
 // Update the text display
 void D3DView::UpdateText()
 {
-	// clear old text
+	// clear old text, and redraw with the new text on the next pass
 	textDraw->Clear();
+	InvalidateFrame();
 
 	// starting x and y offset
 	float x = 10;
@@ -538,6 +627,33 @@ void D3DView::UpdateText()
 			textDraw->Add(buf, dmdFont, color, x, y, 0);
 			y += lineHeight;
 		}
+
+		// add the frame cost display
+		auto &fc = perfMon.GetFrameCost();
+		auto &bs = spriteBatch.GetStats();
+		_stprintf_s(buf, _T("Frame: %d draws, %d state changes, CPU %.2f ms (avg %.2f) | Sprites: %d, %d batched in %d draws"),
+			fc.drawCalls, fc.stateChanges, fc.cpuMs, fc.avgCpuMs, bs.sprites, bs.batched, bs.batches);
+		textDraw->Add(buf, dmdFont, color, x, y, 0);
+		y += lineHeight;
+
+		// add the damage tracking counters
+		_stprintf_s(buf, _T("Frames: %I64u rendered, %I64u skipped as unchanged"),
+			framesRendered, framesSkipped);
+		textDraw->Add(buf, dmdFont, color, x, y, 0);
+		y += lineHeight;
+
+		// add the animated GIF memory display, if any GIFs are loaded
+		auto gif = Sprite::GetGIFMemoryStats();
+		if (gif.cachedFrames + gif.streamedFrames != 0)
+		{
+			_stprintf_s(buf, _T("GIF memory: canvas %.1f MB | frames %.1f MB (%I64d cached, %I64d streamed)"),
+				gif.canvasBytes / 1048576.0f, gif.frameBytes / 1048576.0f, gif.cachedFrames, gif.streamedFrames);
+			textDraw->Add(buf, dmdFont, color, x, y, 0);
+			y += lineHeight;
+		}
+
+		// add any subclass statistics
+		AddFrameCounterText(x, y, lineHeight, color);
 	}
 }
 
@@ -593,12 +709,15 @@ void D3DView::OnResizeCameraView()
 	// Update the drawing list, to account for any changes in scaling
 	// for the new layout
 	ScaleSprites();
+
+	// the camera view changed, so the next frame has to be redrawn
+	InvalidateFrame();
 }
 
 void D3DView::RenderAll()
 {
 	for (auto it : activeD3DViews)
-		it->RenderFrame();
+		it->RenderFrameIfChanged();
 }
 
 int D3DView::MessageLoop()
@@ -609,32 +728,44 @@ int D3DView::MessageLoop()
 	// idle processing
 	DWORD lastIdleTime = GetTickCount();
 	int curRenderWinIndex = 0;
-	auto DoIdle = [&lastIdleTime, audioManager, &curRenderWinIndex](bool inForeground)
+	int renderPending = 0;
+	auto DoIdle = [&lastIdleTime, audioManager, &curRenderWinIndex, &renderPending](bool inForeground)
 	{
+		// On each frame clock tick, give every window one chance to render.
+		// This paces rendering to the display refresh, so that we don't burn
+		// CPU and GPU time drawing frames that will never be presented.
+		if (frameClock.Tick())
+			renderPending = (int)activeD3DViews.size();
+
 		// Do graphics rendering in one D3D view when the message queue is idle.
 		// We work through the windows round-robin on each idle pass.  We only
 		// render one window per idle pass so that we can get right back to the
 		// event loop, to minimize event processing latency.  We don't want key
 		// presses to feel laggy by forcing them to wait for every window to
-		// render.
-		int n = 0;
-		for (auto it : activeD3DViews)
+		// render.  Windows whose content hasn't changed since their last frame
+		// skip the render entirely.
+		if (renderPending > 0)
 		{
-			if (n++ == curRenderWinIndex)
+			int n = 0;
+			for (auto it : activeD3DViews)
 			{
-				// Render the frame, unless the application is in the background
-				// and this window has background rendering frozen.
-				if (inForeground || !it->freezeBackgroundRendering)
-					it->RenderFrame();
-
-				// only render one window per idle pass
-				break;
+				if (n++ == curRenderWinIndex)
+				{
+					// Render the frame, unless the application is in the background
+					// and this window has background rendering frozen.
+					if (inForeground || !it->freezeBackgroundRendering)
+						it->RenderFrameIfChanged();
+
+					// only render one window per idle pass
+					break;
+				}
 			}
-		}
 
-		// advance to the next render window for the next pass
-		if (++curRenderWinIndex >= (int)activeD3DViews.size())
-			curRenderWinIndex = 0;
+			// advance to the next render window for the next pass
+			if (++curRenderWinIndex >= (int)activeD3DViews.size())
+				curRenderWinIndex = 0;
+			--renderPending;
+		}
 
 		// call idle event subscribers
 		for (auto it = idleEventSubscribers.begin(); it != idleEventSubscribers.end(); )
@@ -705,6 +836,15 @@ int D3DView::MessageLoop()
 			{
 				// Do idle processing
 				DoIdle(true);
+
+				// If all of the windows have had their turn for this frame clock
+				// tick, sleep until the next tick or until a message arrives,
+				// rather than spinning through idle passes with nothing to draw.
+				if (renderPending == 0)
+				{
+					MsgWaitForMultipleObjectsEx(0, nullptr, frameClock.GetMsToNextTick(),
+						QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+				}
 			}
 		}
 		else
@@ -21,6 +21,9 @@ class Sprite;
 #include "Camera.h"
 #include "TextDraw.h"
 #include "PerfMon.h"
+#include "SpriteBatch.h"
+#include "Sprite.h"
+#include "FrameClock.h"
 #include "BaseWin.h"
 #include "ViewWin.h"
 
@@ -35,6 +38,19 @@ public:
 	// render a frame
 	void RenderFrame();
 
+	// Render a frame if anything has changed since the last frame:
+	// a sprite was added, removed, moved, or faded, its content was
+	// replaced, or it's showing live content (video, animation, or a
+	// fade in progress).  Returns true if a frame was rendered.  This
+	// lets idle rendering skip frames that would be identical to the
+	// one already on screen.
+	bool RenderFrameIfChanged();
+
+	// Invalidate the current frame, to force a render on the next idle
+	// pass.  This is for changes that the sprite state snapshot doesn't
+	// capture, such as text overlay and camera changes.
+	void InvalidateFrame() { frameInvalid = true; }
+
 	// get/set monitor rotation in degrees
 	int GetRotation() const { return camera->GetMonitorRotation(); }
 	void SetRotation(int rotation);
@@ -47,7 +63,9 @@ public:
 
 	// Windows message loop.  This can be used to process messages
 	// when D3D windows are displayed.  This does D3D rendering to
-	// all D3D windows whenever the message loop is idle.
+	// all D3D windows whenever the message loop is idle, paced by
+	// the shared frame clock so that each window renders at most
+	// once per display refresh.
 	static int MessageLoop();
 
 	// Render all D3D windows.  This can be explicitly called in nested
@@ -107,6 +125,10 @@ protected:
 	// update the text overlay
 	void UpdateText();
 
+	// Add subclass-specific lines to the frame counter display.  Each
+	// line goes at (x, y), advancing y by the line height.
+	virtual void AddFrameCounterText(float x, float &y, float lineHeight, const DirectX::XMFLOAT4 &color) { }
+
 	// Scale a sprite according to the window size.  'span' is the fraction
 	// of the window's width and/or height to fill, where 1.0 means we scale
 	// the sprite to exactly fill the width or height.  
@@ -220,9 +242,29 @@ protected:
 			sprites.emplace_back(sprite, RefCounted::DoAddRef); 
 	}
 
+	// sprite batcher, for drawing the sprite list
+	SpriteBatch spriteBatch;
+
 	// performance monitor for this window
 	PerfMon perfMon;
 
+	// Damage tracking.  'frameInvalid' forces the next idle render.
+	// 'lastDrawState' is the sprite state snapshot as of the last frame
+	// rendered, for comparison against the current state to determine
+	// if anything has changed; 'curDrawState' is scratch space for
+	// building the current snapshot, kept as a member to avoid
+	// reallocating it on every pass.
+	bool frameInvalid = true;
+	std::vector<Sprite::DrawState> lastDrawState;
+	std::vector<Sprite::DrawState> curDrawState;
+
+	// take a snapshot of the current sprite drawing state into 'curDrawState'
+	void SnapshotDrawState();
+
+	// frames rendered and skipped as unchanged during idle rendering
+	UINT64 framesRendered = 0;
+	UINT64 framesSkipped = 0;
+
 	// display the FPS counters?
 	bool fpsDisplay;
 
@@ -238,6 +280,10 @@ protected:
 	// global list of active D3D windows
 	static std::list<D3DView*> activeD3DViews;
 
+	// Shared frame clock.  This ticks once per display refresh, and
+	// paces idle rendering for all of the D3D windows.
+	static FrameClock frameClock;
+
 	// global list idle event subscribers
 	static std::list<IdleEventSubscriber*> idleEventSubscribers;
 };
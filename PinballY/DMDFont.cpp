@@ -2,6 +2,7 @@
 // Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
 //
 #include "stdafx.h"
+#include <emmintrin.h>
 #include "DMDFont.h"
 
 // include the generated font data to instantiate the fonts
@@ -22,6 +23,37 @@ DMDFont::DMDFont(const BYTE *pix, int pixWidth, int cellHeight, const BYTE *char
 	charWidths(charWidths),
 	charOffsets(charOffsets)
 {
+	// Compile the pixel array into the run tables.  Visit each row of
+	// each glyph, and break it into runs of pixels at the same level.
+	rowRuns.reserve(95 * cellHeight + 1);
+	for (int g = 0; g < 95; ++g)
+	{
+		const BYTE *srcRow = pix + charOffsets[g];
+		for (int row = 0; row < cellHeight; ++row, srcRow += pixWidth)
+		{
+			// note the start of the row's runs
+			rowRuns.push_back(static_cast<UINT32>(runs.size()));
+
+			// scan the row
+			const BYTE *src = srcRow;
+			for (int colRem = charWidths[g]; colRem != 0; )
+			{
+				// count pixels at the same level, up to the BYTE limit
+				BYTE level = *src & 0x0f;
+				int n = 1;
+				while (n < colRem && n < 255 && (src[n] & 0x0f) == level)
+					++n;
+
+				// add the run
+				runs.push_back({ level, static_cast<BYTE>(n) });
+				src += n;
+				colRem -= n;
+			}
+		}
+	}
+
+	// add the end sentinel for the last row
+	rowRuns.push_back(static_cast<UINT32>(runs.size()));
 }
 
 DMDFont::~DMDFont()
@@ -29,6 +61,17 @@ DMDFont::~DMDFont()
 
 }
 
+inline int DMDFont::GlyphIndex(TCHAR c) const
+{
+	// if it's a lower-case character, and the font doesn't contain
+	// this character, convert to upper-case
+	if (c >= 'a' && c <= 'z' && charWidths[c - 32] == 0)
+		c = c - 'a' + 'A';
+
+	// if it's in range, return the data index
+	return c >= 32 && c <= 126 ? c - 32 : -1;
+}
+
 SIZE DMDFont::MeasureString(const TCHAR *str) const
 {
 	// start with the font height and zero width
@@ -37,117 +80,93 @@ SIZE DMDFont::MeasureString(const TCHAR *str) const
 	// add up the character widths
 	for (const TCHAR *p = str; *p != 0; ++p)
 	{
-		// get the next character
-		TCHAR c = *p;
-
-		// if it's a lower-case character, and the font doesn't contain
-		// this character, convert to upper-case
-		if (c >= 'a' && c <= 'z' && charWidths[c] == 0)
-			c = c - 'a' + 'A';
-
-		// if it's in range, add its width
-		if (c >= 32 && c <= 126)
-			s.cx += charWidths[c - 32];
+		if (int g = GlyphIndex(*p); g >= 0)
+			s.cx += charWidths[g];
 	}
 
 	// return the tally
 	return s;
 }
 
-// fixed DMD height and width
-const int dmdHeight = 32;
-const int dmdWidth = 128;
-
-// draw in 32-bit RGBA, four bytes per pixel
-void DMDFont::DrawString32(const TCHAR *str, BYTE *dmdPix, int x, int y, const Color *colors) const
+template<typename FillFunc>
+void DMDFont::DrawString(const TCHAR *str, int x, int y, int dstWidth, int dstHeight, FillFunc fill) const
 {
-	// get a pointer to the starting row positions
-	BYTE *dstRow = dmdPix + (y*dmdWidth*4) + x*4;
-	const BYTE *srcRow = pix;
-
-	// work across each row
-	for (int row = 0, ycur = y; row < cellHeight; ++row, dstRow += dmdWidth*4, srcRow += pixWidth, ++ycur)
+	// Figure the visible row range for the whole string.  The glyphs
+	// all have the same height, so the vertical clipping is the same
+	// for every glyph.
+	int rowStart = max(0, -y);
+	int rowEnd = min(cellHeight, dstHeight - y);
+	if (rowStart >= rowEnd)
+		return;
+
+	// draw a glyph at a time
+	for (const TCHAR *p = str; *p != 0 && x < dstWidth; ++p)
 	{
-		// start at the current row position
-		BYTE *dst = dstRow;
-		int xcur = x;
-
-		// visit each character
-		for (const TCHAR *p = str; *p != 0; ++p)
+		// look up the glyph
+		int g = GlyphIndex(*p);
+		if (g < 0)
+			continue;
+
+		// skip it if it's entirely left of the target
+		int width = charWidths[g];
+		if (x + width <= 0)
 		{
-			// get the next character
-			TCHAR c = *p;
+			x += width;
+			continue;
+		}
 
-			// if it's a lower-case character, and the font doesn't contain
-			// this character, convert to upper-case
-			if (c >= 'a' && c <= 'z' && charWidths[c] == 0)
-				c = c - 'a' + 'A';
+		// figure the visible column range within the glyph
+		int colStart = max(0, -x);
+		int colEnd = min(width, dstWidth - x);
 
-			// if it's in range, draw it
-			if (c >= 32 && c <= 126)
+		// draw the visible rows
+		const UINT32 *rr = &rowRuns[g * cellHeight + rowStart];
+		for (int row = rowStart; row < rowEnd; ++row, ++rr)
+		{
+			// draw the runs in this row, clipped to the visible columns
+			int dstRow = (y + row) * dstWidth + x;
+			int col = 0;
+			for (const Run *run = runs.data() + rr[0], *runEnd = runs.data() + rr[1]; run != runEnd && col < colEnd; ++run)
 			{
-				// convert the character code point to a data index
-				c -= 32;
-
-				// get the first byte of this row of this character in the
-				// font data
-				const BYTE *src = srcRow + charOffsets[c];
-
-				// copy the pixels
-				for (int colRem = charWidths[c]; colRem != 0; --colRem, ++xcur, ++src, dst += 4)
-				{
-					// clip to 128x32
-					if (xcur >= 0 && xcur < dmdWidth && ycur >= 0 && ycur < dmdHeight)
-						memcpy(dst, &colors[*src & 0xf].c, 4);
-				}
+				int l = max(col, colStart);
+				int r = min(col + run->count, colEnd);
+				if (l < r)
+					fill(dstRow + l, run->level, r - l);
+				col += run->count;
 			}
 		}
+
+		// advance past the glyph
+		x += width;
 	}
 }
 
-// draw in 4-bit grayscale, one byte per pixel
-void DMDFont::DrawString4(const TCHAR *str, BYTE *dmdPix, int x, int y) const
+// draw in 32-bit RGBA, four bytes per pixel
+void DMDFont::DrawString32(const TCHAR *str, BYTE *dmdPix, int x, int y, const Color *colors, int dstWidth, int dstHeight) const
 {
-	// get a pointer to the starting row positions
-	BYTE *dstRow = dmdPix + (y*dmdWidth) + x;
-	const BYTE *srcRow = pix;
-
-	// work across each row
-	for (int row = 0, ycur = y; row < cellHeight; ++row, dstRow += dmdWidth, srcRow += pixWidth, ++ycur)
+	// fill runs with the palette color for the run's level
+	DrawString(str, x, y, dstWidth, dstHeight, [dmdPix, colors](int dst, int level, int n)
 	{
-		// start at the current row position
-		BYTE *dst = dstRow;
-		int xcur = x;
-
-		// visit each character
-		for (const TCHAR *p = str; *p != 0; ++p)
-		{
-			// get the next character
-			TCHAR c = *p;
-
-			// if it's a lower-case character, and the font doesn't contain
-			// this character, convert to upper-case
-			if (c >= 'a' && c <= 'z' && charWidths[c] == 0)
-				c = c - 'a' + 'A';
+		// fill four pixels at a time with SSE2 stores
+		BYTE *p = dmdPix + dst*4;
+		DWORD c;
+		memcpy(&c, colors[level].c, 4);
+		__m128i c4 = _mm_set1_epi32(static_cast<int>(c));
+		for ( ; n >= 4; n -= 4, p += 16)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p), c4);
+
+		// fill the remainder individually
+		for ( ; n != 0; --n, p += 4)
+			memcpy(p, &c, 4);
+	});
+}
 
-			// if it's in range, draw it
-			if (c >= 32 && c <= 126)
-			{
-				// convert the character code point to a data index
-				c -= 32;
-
-				// get the first byte of this row of this character in the
-				// font data
-				const BYTE *src = srcRow + charOffsets[c];
-
-				// copy the pixels
-				for (int colRem = charWidths[c]; colRem != 0; --colRem, ++xcur, ++dst, ++src)
-				{
-					// clip to 128x32
-					if (xcur >= 0 && xcur < dmdWidth && ycur >= 0 && ycur < dmdHeight)
-						*dst = *src & 0x0f;
-				}
-			}
-		}
-	}
+// draw in 4-bit grayscale, one byte per pixel
+void DMDFont::DrawString4(const TCHAR *str, BYTE *dmdPix, int x, int y, int dstWidth, int dstHeight) const
+{
+	// fill runs with the level value
+	DrawString(str, x, y, dstWidth, dstHeight, [dmdPix](int dst, int level, int n)
+	{
+		memset(dmdPix + dst, level, n);
+	});
 }
@@ -14,6 +14,15 @@
 // arrays.  These are in turn generated from DMD font layout data from
 // other open-source pinball projects.  See the DMDFontTool subproject
 // for details on how the font data sets are generated.
+//
+// The generated pixel array is a convenient form for the font tool to
+// produce, but it's an awkward form for drawing, since each glyph row
+// is scattered across the array.  So on construction, we compile the
+// pixel array into per-glyph run tables, which describe each row of
+// each glyph as a series of runs of a single gray level.  The DMD fonts
+// are almost entirely made of long runs of fully on and fully off
+// pixels, so the drawing routines can fill whole runs at a time rather
+// than converting individual pixels.
 
 #pragma once
 
@@ -59,16 +68,19 @@ public:
 		BYTE c[4];  // B, G, R, A
 	};
 	
-	// Draw a string into a 128x32 pixel array, with 32 bits per pixel,
-	// using the given color table.  The color table entries give the
-	// RGB values for grayscale values 0..15, where 0 is fully off and
-	// 15 is fully on.
-	void DrawString32(const TCHAR *str, BYTE *pix, int x, int y, const Color *colors) const;
+	// Draw a string into a pixel array, with 32 bits per pixel, using
+	// the given color table.  The color table entries give the RGB values
+	// for grayscale values 0..15, where 0 is fully off and 15 is fully on.
+	// The pixel array is dstWidth x dstHeight pixels, with the rows
+	// packed; the text is clipped to the array bounds.
+	void DrawString32(const TCHAR *str, BYTE *pix, int x, int y, const Color *colors,
+		int dstWidth = 128, int dstHeight = 32) const;
 
-	// Draw a string into a 128x32 pixel array, in 4-bit grayscale.
-	// Each pixel is represented by one byte.  We only store 4-bit
-	// values, so every byte written will have a value 0..15.
-	void DrawString4(const TCHAR *str, BYTE *pix, int x, int y) const;
+	// Draw a string into a pixel array, in 4-bit grayscale.  Each pixel
+	// is represented by one byte.  We only store 4-bit values, so every
+	// byte written will have a value 0..15.
+	void DrawString4(const TCHAR *str, BYTE *pix, int x, int y,
+		int dstWidth = 128, int dstHeight = 32) const;
 
 	// cell height
 	int cellHeight;
@@ -90,6 +102,30 @@ public:
 
 	// character offsets, for ASCII code points 32..126
 	const int *charOffsets;
+
+protected:
+	// Get the glyph index (0..94) for a character, or -1 if the font
+	// doesn't have a glyph for it.  If the character is lower-case, and
+	// the font doesn't contain it, we substitute the upper-case glyph.
+	inline int GlyphIndex(TCHAR c) const;
+
+	// Draw a string, calling fill(dst, level, n) to fill each run of n
+	// pixels starting at pixel index dst
+	template<typename FillFunc>
+	void DrawString(const TCHAR *str, int x, int y, int dstWidth, int dstHeight, FillFunc fill) const;
+
+	// Run of pixels at a single gray level, within a glyph row
+	struct Run
+	{
+		BYTE level;     // gray level 0..15
+		BYTE count;     // number of pixels
+	};
+
+	// Run table.  runs[] holds the runs for all glyph rows, in order of
+	// glyph index, then row.  Row r of glyph g consists of the runs from
+	// rowRuns[g*cellHeight + r] up to rowRuns[g*cellHeight + r + 1].
+	std::vector<Run> runs;
+	std::vector<UINT32> rowRuns;
 };
 
 // predefined fonts
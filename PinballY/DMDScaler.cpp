@@ -0,0 +1,402 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// DMD frame scaler
+
+#include "stdafx.h"
+#include "DMDScaler.h"
+#include "HiResTimer.h"
+#include "LogFile.h"
+
+// SSE2 is part of the base instruction set on x64, and we build the
+// x86 version with /arch:SSE2 (the compiler default), so we can use
+// the SSE2 intrinsics unconditionally on Intel platforms.  Other
+// platforms get the portable loops.
+#if defined(_M_IX86) || defined(_M_X64)
+#define DMDSCALER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Largest source frame we accept, in each dimension.  The area
+	// pooling row sums are 16 bits, which limits the vertical block
+	// height to 257 rows; this keeps us comfortably inside that for
+	// any device size.
+	const int MaxSrcDim = 4096;
+
+	// YUV -> RGB conversion terms, in base-65536 fixed point, using
+	// the standard formula:
+	//
+	//  Y' = 1.164*(Y-16)
+	//  U' = U - 128
+	//  V' = V - 128
+	//
+	//  R = Y' + 1.596*V'
+	//  G = Y' - 0.813*V' - 0.391*U'
+	//  B = Y' + 2.018*U'
+	//
+	struct YUVTables
+	{
+		YUVTables()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				y[i] = (i - 16) * 76284;
+				rv[i] = (i - 128) * 104595;
+				gu[i] = (i - 128) * -25625;
+				gv[i] = (i - 128) * -53281;
+				bu[i] = (i - 128) * 132252;
+			}
+		}
+
+		int y[256];
+		int rv[256];
+		int gu[256];
+		int gv[256];
+		int bu[256];
+	};
+
+	const YUVTables &GetYUVTables()
+	{
+		static const YUVTables tables;
+		return tables;
+	}
+
+	// clamp a fixed-point color component to 0..255
+	inline BYTE Clamp8(int c)
+	{
+		c >>= 16;
+		return static_cast<BYTE>(c < 0 ? 0 : c > 255 ? 255 : c);
+	}
+}
+
+DMDScaler::DMDScaler()
+{
+	// start with an identity gamma map
+	for (int i = 0; i < 256; ++i)
+		level4[i] = static_cast<BYTE>(i >> 4);
+}
+
+DMDScaler::~DMDScaler()
+{
+}
+
+DMDScaler::Filter DMDScaler::ParseFilter(const TCHAR *name)
+{
+	if (name != nullptr && _tcsicmp(name, _T("area")) == 0)
+		return Filter::Area;
+	else if (name != nullptr && _tcsicmp(name, _T("max")) == 0)
+		return Filter::Max;
+	else
+		return Filter::Auto;
+}
+
+void DMDScaler::SetGammaMap(const BYTE gammaMap[256])
+{
+	for (int i = 0; i < 256; ++i)
+		level4[i] = (gammaMap[i] >> 4) & 0x0F;
+}
+
+bool DMDScaler::SetFormat(const Format &f)
+{
+	// if the format hasn't changed, keep the current tables
+	if (f == fmt)
+		return valid;
+
+	// remember the new format; it's invalid until we finish setting up
+	fmt = f;
+	valid = false;
+
+	// check the dimensions
+	if (f.srcWidth <= 0 || f.srcHeight <= 0 || f.dstWidth <= 0 || f.dstHeight <= 0
+		|| f.srcWidth > MaxSrcDim || f.srcHeight > MaxSrcDim
+		|| (f.srcHeight + f.dstHeight - 1) / f.dstHeight > 257)
+		return false;
+
+	// Choose the filter.  If the source is the same size as the device,
+	// there's no pooling at all, and the max pooling path handles that
+	// without any intermediate copying, so use it regardless of the
+	// filter setting.  Otherwise, for Auto, use max pooling for sources
+	// that are integer multiples of the device size, per the DMD pixel
+	// structure convention.
+	if (f.srcWidth == f.dstWidth && f.srcHeight == f.dstHeight)
+		maxPool = true;
+	else if (f.filter == Filter::Auto)
+		maxPool = f.srcWidth >= f.dstWidth * 2 && f.srcHeight >= f.dstHeight * 2
+			&& f.srcWidth % f.dstWidth == 0 && f.srcHeight % f.dstHeight == 0;
+	else
+		maxPool = (f.filter == Filter::Max);
+
+	// Figure the source spans.  Each device pixel covers the source
+	// pixels from floor(i*src/dst) up to floor((i+1)*src/dst).  When the
+	// source is smaller than the device, that can be empty, in which
+	// case we use the single pixel at the start.
+	auto MakeSpans = [](std::vector<Span> &spans, int src, int dst)
+	{
+		spans.resize(dst);
+		for (int i = 0; i < dst; ++i)
+		{
+			int a = static_cast<int>(static_cast<INT64>(i) * src / dst);
+			int b = static_cast<int>(static_cast<INT64>(i + 1) * src / dst);
+			spans[i] = { a, max(b - a, 1) };
+		}
+	};
+	MakeSpans(rowSpan, f.srcHeight, f.dstHeight);
+	MakeSpans(colSpan, f.srcWidth, f.dstWidth);
+
+	// Figure the output offsets, applying the mirroring
+	rowOut.resize(f.dstHeight);
+	for (int i = 0; i < f.dstHeight; ++i)
+		rowOut[i] = (f.mirrorVert ? f.dstHeight - 1 - i : i) * f.dstWidth;
+
+	colOut.resize(f.dstWidth);
+	for (int i = 0; i < f.dstWidth; ++i)
+		colOut[i] = f.mirrorHorz ? f.dstWidth - 1 - i : i;
+
+	// figure the chroma sample positions, at the center of each block
+	uvRow.resize(f.dstHeight);
+	for (int i = 0; i < f.dstHeight; ++i)
+		uvRow[i] = (rowSpan[i].start + (rowSpan[i].count - 1) / 2) / 2;
+
+	uvCol.resize(f.dstWidth);
+	for (int i = 0; i < f.dstWidth; ++i)
+		uvCol[i] = (colSpan[i].start + (colSpan[i].count - 1) / 2) / 2;
+
+	// figure the area pooling scale factors
+	areaRecip.clear();
+	if (!maxPool)
+	{
+		areaRecip.resize(f.dstWidth * f.dstHeight);
+		UINT32 *p = areaRecip.data();
+		for (int dy = 0; dy < f.dstHeight; ++dy)
+		{
+			for (int dx = 0; dx < f.dstWidth; ++dx)
+			{
+				UINT32 n = rowSpan[dy].count * colSpan[dx].count;
+				*p++ = (65536 + n/2) / n;
+			}
+		}
+	}
+
+	// allocate the pooled row buffers
+	rowBuf.resize(maxPool ? f.srcWidth : 0);
+	rowSum.resize(maxPool ? 0 : f.srcWidth);
+
+	// success
+	valid = true;
+	return true;
+}
+
+void DMDScaler::PoolRows(const BYTE *y, int yPitch, int dy)
+{
+	const Span &rs = rowSpan[dy];
+	const BYTE *src = y + rs.start * yPitch;
+	const int w = fmt.srcWidth;
+
+	if (maxPool)
+	{
+		// If there's only one row in the block, use it directly from
+		// the source buffer.  This is the usual case for a source at
+		// the native device size.
+		if (rs.count == 1)
+		{
+			pooledRow = src;
+			return;
+		}
+
+		// start with the first row, then take the maximum with each
+		// additional row
+		BYTE *buf = rowBuf.data();
+		memcpy(buf, src, w);
+		for (int r = 1; r < rs.count; ++r)
+		{
+			src += yPitch;
+			int x = 0;
+
+#ifdef DMDSCALER_SSE2
+			for (; x + 16 <= w; x += 16)
+			{
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + x));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(buf + x), _mm_max_epu8(a, b));
+			}
+#endif
+			for (; x < w; ++x)
+			{
+				if (src[x] > buf[x])
+					buf[x] = src[x];
+			}
+		}
+
+		pooledRow = buf;
+	}
+	else
+	{
+		// sum the rows into 16-bit column totals
+		UINT16 *sum = rowSum.data();
+		memset(sum, 0, w * sizeof(UINT16));
+		for (int r = 0; r < rs.count; ++r, src += yPitch)
+		{
+			int x = 0;
+
+#ifdef DMDSCALER_SSE2
+			const __m128i zero = _mm_setzero_si128();
+			for (; x + 16 <= w; x += 16)
+			{
+				// widen 16 source bytes to two vectors of 8 words each,
+				// and add them to the running totals
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+				__m128i *s = reinterpret_cast<__m128i*>(sum + x);
+				__m128i lo = _mm_add_epi16(_mm_loadu_si128(s), _mm_unpacklo_epi8(b, zero));
+				__m128i hi = _mm_add_epi16(_mm_loadu_si128(s + 1), _mm_unpackhi_epi8(b, zero));
+				_mm_storeu_si128(s, lo);
+				_mm_storeu_si128(s + 1, hi);
+			}
+#endif
+			for (; x < w; ++x)
+				sum[x] += src[x];
+		}
+	}
+}
+
+inline int DMDScaler::PooledLuma(int dx, int dy) const
+{
+	const Span &cs = colSpan[dx];
+	if (maxPool)
+	{
+		const BYTE *p = pooledRow + cs.start;
+		int l = *p;
+		for (int i = 1; i < cs.count; ++i)
+		{
+			if (p[i] > l)
+				l = p[i];
+		}
+		return l;
+	}
+	else
+	{
+		const UINT16 *p = rowSum.data() + cs.start;
+		UINT32 s = 0;
+		for (int i = 0; i < cs.count; ++i)
+			s += p[i];
+
+		UINT32 l = (s * areaRecip[dy * fmt.dstWidth + dx] + 0x8000) >> 16;
+		return l > 255 ? 255 : static_cast<int>(l);
+	}
+}
+
+void DMDScaler::RenderGray16(const BYTE *y, int yPitch, BYTE *dst)
+{
+	if (!valid)
+		return;
+
+	for (int dy = 0; dy < fmt.dstHeight; ++dy)
+	{
+		PoolRows(y, yPitch, dy);
+		BYTE *out = dst + rowOut[dy];
+		for (int dx = 0; dx < fmt.dstWidth; ++dx)
+			out[colOut[dx]] = level4[PooledLuma(dx, dy)];
+	}
+}
+
+void DMDScaler::RenderRGB24(const BYTE *y, int yPitch, const BYTE *u, const BYTE *v, int uvPitch, BYTE *dst)
+{
+	if (!valid)
+		return;
+
+	const YUVTables &t = GetYUVTables();
+	for (int dy = 0; dy < fmt.dstHeight; ++dy)
+	{
+		PoolRows(y, yPitch, dy);
+		const BYTE *uRow = u + uvRow[dy] * uvPitch;
+		const BYTE *vRow = v + uvRow[dy] * uvPitch;
+		BYTE *out = dst + rowOut[dy] * 3;
+		for (int dx = 0; dx < fmt.dstWidth; ++dx)
+		{
+			int yy = t.y[PooledLuma(dx, dy)];
+			int uu = uRow[uvCol[dx]];
+			int vv = vRow[uvCol[dx]];
+
+			BYTE *p = out + colOut[dx] * 3;
+			p[0] = Clamp8(yy + t.rv[vv]);
+			p[1] = Clamp8(yy + t.gu[uu] + t.gv[vv]);
+			p[2] = Clamp8(yy + t.bu[uu]);
+		}
+	}
+}
+
+void DMDScaler::Benchmark(int dstWidth, int dstHeight)
+{
+	// Typical DMD video sizes: native, the 2x and 4x pixel structure
+	// formats, the 1024x256 "HD" format, and some ordinary video sizes
+	// that don't match the DMD aspect ratio.
+	static const struct { int cx, cy; } sizes[] = {
+		{ 128, 32 }, { 256, 64 }, { 512, 128 }, { 1024, 256 },
+		{ 640, 160 }, { 640, 480 }, { 1280, 720 }, { 1920, 1080 }
+	};
+
+	static const struct { Filter filter; const TCHAR *name; } filters[] = {
+		{ Filter::Area, _T("area") },
+		{ Filter::Max, _T("max") }
+	};
+
+	LogFile::Get()->Group(LogFile::DmdLogging);
+	LogFile::Get()->Write(LogFile::DmdLogging, _T("DMD video scaler benchmark, device size %dx%d\n"), dstWidth, dstHeight);
+
+	HiResTimer timer;
+	std::unique_ptr<BYTE[]> out(new BYTE[dstWidth * dstHeight * 3]);
+	for (auto &sz : sizes)
+	{
+		// build a test frame with a noise pattern, so that the pooling
+		// comparisons don't all go the same way
+		int uvWidth = (sz.cx + 1) / 2, uvHeight = (sz.cy + 1) / 2;
+		std::vector<BYTE> frame(sz.cx * sz.cy + uvWidth * uvHeight * 2);
+		UINT32 seed = 12345;
+		for (auto &b : frame)
+		{
+			seed = seed * 1103515245 + 12345;
+			b = static_cast<BYTE>(seed >> 16);
+		}
+		const BYTE *y = frame.data();
+		const BYTE *u = y + sz.cx * sz.cy;
+		const BYTE *v = u + uvWidth * uvHeight;
+
+		for (auto &f : filters)
+		{
+			DMDScaler scaler;
+			Format fmt;
+			fmt.srcWidth = sz.cx;
+			fmt.srcHeight = sz.cy;
+			fmt.dstWidth = dstWidth;
+			fmt.dstHeight = dstHeight;
+			fmt.filter = f.filter;
+			if (!scaler.SetFormat(fmt))
+			{
+				LogFile::Get()->Write(LogFile::DmdLogging, _T("+ %dx%d: format not supported\n"), sz.cx, sz.cy);
+				continue;
+			}
+
+			// time each output format; run each test for at least 100ms
+			// and at least 10 iterations, so that the timer resolution
+			// doesn't matter
+			auto Time = [&timer](std::function<void()> render)
+			{
+				int n = 0;
+				int64_t t0 = timer.GetTime_ticks(), t1;
+				do
+				{
+					render();
+					++n;
+					t1 = timer.GetTime_ticks();
+				} while (n < 10 || timer.TicksToUs(t1 - t0) < 100000.0);
+				return timer.TicksToUs(t1 - t0) / n;
+			};
+			double tGray = Time([&]() { scaler.RenderGray16(y, sz.cx, out.get()); });
+			double tRGB = Time([&]() { scaler.RenderRGB24(y, sz.cx, u, v, uvWidth, out.get()); });
+
+			LogFile::Get()->Write(LogFile::DmdLogging, _T("+ %dx%d, %s pooling: gray16 %.1f us/frame, rgb24 %.1f us/frame\n"),
+				sz.cx, sz.cy, f.name, tGray, tRGB);
+		}
+	}
+}
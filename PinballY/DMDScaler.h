@@ -0,0 +1,172 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// DMD frame scaler
+//
+// This class converts decoded video frames, in I420 format, to the
+// pixel formats that real DMD devices accept: 4-bit grayscale (one
+// byte per pixel, values 0..15) or 24-bit RGB.  The source frame can
+// be any size, and the device frame can be any size.  Each device
+// pixel is computed from the rectangular block of source pixels that
+// maps onto it, using one of two pooling filters:
+//
+// - Max pooling takes the brightest pixel in each block.  This is
+//   the right filter for videos that use the "DMD pixel structure"
+//   convention, where each DMD dot is drawn as one lit pixel in an
+//   NxN block, with the rest of the block black to represent the gap
+//   between dots.  Averaging those blocks would dim the whole image
+//   by a factor of N*N.
+//
+// - Area pooling averages the pixels in each block.  This is the
+//   right filter for ordinary video content.
+//
+// In the default Auto mode, we use max pooling when the source frame
+// is an exact integer multiple (2x or more) of the device size in
+// both dimensions, since that's the signature of the pixel structure
+// convention, and area pooling otherwise.
+//
+// The work is split into a vertical pass, which reduces the block of
+// source rows for each device row to a single row, and a horizontal
+// pass, which reduces each block of columns in that row to a single
+// device pixel.  The vertical pass touches every source pixel, so
+// that's where the time goes for any source larger than the device;
+// it's written with SSE2 kernels that process 16 pixels at a time.
+// The horizontal pass runs once per device pixel, and uses tables,
+// computed when the format is set, for the column spans, the output
+// positions (with mirroring folded in, so that mirroring costs
+// nothing per frame), the gamma-corrected 4-bit levels, and the
+// YUV-to-RGB conversion terms.
+
+#pragma once
+
+class DMDScaler
+{
+public:
+	DMDScaler();
+	~DMDScaler();
+
+	// pooling filter
+	enum class Filter
+	{
+		Auto,       // Max for integer-multiple sources, Area otherwise
+		Area,       // average each block
+		Max         // take the brightest pixel in each block
+	};
+
+	// parse a filter name from the config ("auto", "area", "max")
+	static Filter ParseFilter(const TCHAR *name);
+
+	// Frame format.  The source dimensions give the size of the Y
+	// plane; the U and V planes are subsampled in 2x2 blocks, per the
+	// usual I420 layout, so they're ((w+1)/2)x((h+1)/2).
+	struct Format
+	{
+		int srcWidth = 0, srcHeight = 0;
+		int dstWidth = 0, dstHeight = 0;
+		Filter filter = Filter::Auto;
+		bool mirrorHorz = false;
+		bool mirrorVert = false;
+
+		bool operator==(const Format &f) const
+		{
+			return srcWidth == f.srcWidth && srcHeight == f.srcHeight
+				&& dstWidth == f.dstWidth && dstHeight == f.dstHeight
+				&& filter == f.filter && mirrorHorz == f.mirrorHorz && mirrorVert == f.mirrorVert;
+		}
+		bool operator!=(const Format &f) const { return !(*this == f); }
+	};
+
+	// Set the frame format.  This rebuilds the index tables if the
+	// format has changed since the last call, so it's cheap to call
+	// on every frame.  Returns false if the format isn't usable, in
+	// which case the Render functions do nothing.
+	bool SetFormat(const Format &fmt);
+
+	// get the current format
+	const Format &GetFormat() const { return fmt; }
+
+	// Is the current format valid?
+	bool IsValid() const { return valid; }
+
+	// Which filter is in effect?  This resolves Auto to the concrete
+	// filter selected for the current format.
+	Filter GetEffectiveFilter() const { return maxPool ? Filter::Max : Filter::Area; }
+
+	// Set the grayscale gamma map.  This maps each 8-bit linear luma
+	// level to a gamma-corrected 8-bit level.  The grayscale renderer
+	// applies this before reducing the result to 4 bits.  The default
+	// is the identity map.
+	void SetGammaMap(const BYTE gammaMap[256]);
+
+	// Render the Y plane to 4-bit grayscale, one byte per pixel, with
+	// the device rows packed (dstWidth bytes per row).  'yPitch' is the
+	// byte distance between source rows.
+	void RenderGray16(const BYTE *y, int yPitch, BYTE *dst);
+
+	// Render the frame to 24-bit RGB, as R,G,B byte triplets, with the
+	// device rows packed (dstWidth*3 bytes per row).
+	void RenderRGB24(const BYTE *y, int yPitch, const BYTE *u, const BYTE *v, int uvPitch, BYTE *dst);
+
+	// Run a timing benchmark over a set of typical DMD video frame
+	// sizes, for both filters and both output formats, and write the
+	// results to the DMD log.
+	static void Benchmark(int dstWidth, int dstHeight);
+
+protected:
+	// Reduce the source rows for device row 'dy' into rowBuf (for max
+	// pooling) or rowSum (for area pooling).
+	void PoolRows(const BYTE *y, int yPitch, int dy);
+
+	// Get the pooled luma value for logical device pixel (dx, dy),
+	// from the row pooled by PoolRows(dy)
+	inline int PooledLuma(int dx, int dy) const;
+
+	// current format
+	Format fmt;
+
+	// is the format valid?
+	bool valid = false;
+
+	// are we using max pooling (vs area pooling)?
+	bool maxPool = false;
+
+	// Source span for each device row and column, in logical (not
+	// mirrored) device order.  The span is [start, start+count).  When
+	// the source is smaller than the device in a dimension, the spans
+	// overlap, with one source pixel each, which amounts to nearest-
+	// neighbor upscaling.
+	struct Span
+	{
+		int start;
+		int count;
+	};
+	std::vector<Span> rowSpan;
+	std::vector<Span> colSpan;
+
+	// Output offsets for each logical device row and column, with the
+	// mirroring folded in.  The output pixel index for logical pixel
+	// (dx, dy) is rowOut[dy] + colOut[dx].
+	std::vector<int> rowOut;
+	std::vector<int> colOut;
+
+	// U/V plane row and column for each logical device row and column.
+	// We take the chroma sample at the center of each block.
+	std::vector<int> uvRow;
+	std::vector<int> uvCol;
+
+	// Area pooling scale factors for each logical device pixel, as
+	// 16.16 fixed-point reciprocals of the block's pixel count, so
+	// that the average is a multiply and shift rather than a divide.
+	std::vector<UINT32> areaRecip;
+
+	// pooled row buffers (max pooling and area pooling)
+	std::vector<BYTE> rowBuf;
+	std::vector<UINT16> rowSum;
+
+	// Current pooled row for max pooling.  This points to rowBuf, or
+	// directly into the source frame when the block is one row high.
+	const BYTE *pooledRow = nullptr;
+
+	// gamma-corrected 4-bit level for each 8-bit luma level
+	BYTE level4[256];
+};
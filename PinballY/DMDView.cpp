@@ -63,6 +63,7 @@
 #include "MouseButtons.h"
 #include "VPinMAMEIfc.h"
 #include "DMDFont.h"
+#include "HighScoreImageCache.h"
 
 using namespace DirectX;
 
@@ -83,7 +84,8 @@ namespace ConfigVars
 
 // construction
 DMDView::DMDView() : SecondaryView(IDR_DMD_CONTEXT_MENU, ConfigVars::DMDWinVarPrefix),
-	highScorePos(highScoreImages.end())
+	highScorePos(highScoreImages.end()),
+	highScoreCache(new HighScoreImageCache())
 {
 	// process the initial configuration settings
 	OnConfigChange();
@@ -98,6 +100,12 @@ void DMDView::OnConfigChange()
 	ttHighScoreFont.ParseConfig(ConfigVars::TTHighScoreFont, _T("Courier New"));
 	ttHighScoreTextColor = cfg->GetColor(ConfigVars::TTHighScoreTextColor, RGB(0x20, 0x20, 0x20));
 	dotsFixedAspectRatio = cfg->GetBool(ConfigVars::DotsFixedAspectRatio, false);
+
+	// Update the high score image cache settings.  The images themselves
+	// depend on some of the settings above, but those are all part of
+	// the cache key, so there's no need to discard the cached images.
+	if (highScoreCache != nullptr)
+		highScoreCache->OnConfigChange();
 }
 
 // get the background media info
@@ -620,6 +628,130 @@ struct HighScoreGraphicsGenThread
 	// Generated images
 	std::list<HighScoreImage> images;
 
+	// Image cache, and the cache key for this request.  If the cache is
+	// null, we render the images without consulting the cache.
+	std::shared_ptr<HighScoreImageCache> cache;
+	TSTRING cacheKey;
+
+	// Build the cache key.  This has to capture everything that goes
+	// into the rendering, so that a cached image set is only reused
+	// when rendering it again would produce the same pixels.
+	TSTRING CacheKey() const
+	{
+		TSTRING key;
+		TCHAR buf[64];
+		auto AddStr = [&key, &buf](const TSTRING &s)
+		{
+			// length-prefix the string, so that adjacent strings can't run together
+			_stprintf_s(buf, _T("%u:"), static_cast<unsigned int>(s.length()));
+			key += buf;
+			key += s;
+		};
+		auto AddInt = [&key, &buf](INT64 i)
+		{
+			_stprintf_s(buf, _T("%I64d;"), i);
+			key += buf;
+		};
+		auto AddColor = [&AddInt](const RGBQUAD &c) { AddInt((c.rgbRed << 16) | (c.rgbGreen << 8) | c.rgbBlue); };
+
+		// add the style (which we match insensitive to case) and font
+		TSTRING lcStyle = style;
+		std::transform(lcStyle.begin(), lcStyle.end(), lcStyle.begin(), ::_totlower);
+		AddStr(lcStyle);
+		AddStr(fontName);
+
+		// add the colors
+		for (auto &c : palette.color)
+			AddColor(c);
+		AddColor(bgColor);
+		AddInt(bgAlpha);
+
+		// add the style-specific options
+		if (lcStyle == _T("alpha"))
+		{
+			// alphanumeric options
+			AddInt(alphanumOptions.slant);
+			for (auto l : { &alphanumOptions.lit, &alphanumOptions.glow1, &alphanumOptions.glow2, &alphanumOptions.unlit })
+			{
+				AddInt(l->color.GetValue());
+				AddInt(l->dilationx);
+				AddInt(l->dilationy);
+				AddInt(l->blur);
+			}
+
+			// the alphanumeric style renders at the window layout size
+			SIZE sz = view->GetLayoutSize();
+			AddInt(sz.cx);
+			AddInt(sz.cy);
+		}
+		else if (lcStyle == _T("tt"))
+		{
+			// typewriter font and color
+			AddStr(ttHighScoreFont.family);
+			AddInt(ttHighScoreFont.ptSize);
+			AddInt(ttHighScoreFont.weight);
+			AddInt(ttHighScoreFont.italic);
+			AddInt(ttHighScoreTextColor);
+
+			// Background image.  Include the file's modification time, so
+			// that we'll notice if the user replaces the file.
+			AddStr(ttBkgImageFile);
+			WIN32_FILE_ATTRIBUTE_DATA attrs;
+			if (ttBkgImageFile.length() != 0 && GetFileAttributesEx(ttBkgImageFile.c_str(), GetFileExInfoStandard, &attrs))
+				AddInt((static_cast<INT64>(attrs.ftLastWriteTime.dwHighDateTime) << 32) | attrs.ftLastWriteTime.dwLowDateTime);
+		}
+
+		// add the slides
+		for (auto &s : slides)
+		{
+			AddInt(s.displayTime);
+			AddInt(s.messages.size());
+			for (auto &m : s.messages)
+				AddStr(m);
+		}
+
+		return key;
+	}
+
+	// Copy a generated image list into a cache image set
+	static std::shared_ptr<HighScoreImageCache::ImageSet> ToCache(const std::list<HighScoreImage> &images)
+	{
+		auto set = std::make_shared<HighScoreImageCache::ImageSet>();
+		for (auto &i : images)
+		{
+			// only bitmap images can be cached
+			if (i.dibits == nullptr)
+				return nullptr;
+
+			auto &c = set->emplace_back();
+			c.spriteType = i.spriteType;
+			c.bmih = i.bmi.bmiHeader;
+			const BYTE *p = static_cast<const BYTE*>(i.dibits);
+			c.pix.assign(p, p + HighScoreImageCache::DIBSize(c.bmih));
+			c.displayTime = i.displayTime;
+			c.bgColor = i.bgColor;
+			c.bgAlpha = i.bgAlpha;
+		}
+		return set;
+	}
+
+	// Expand a cached image set into a generated image list.  Each image
+	// gets its own copy of the pixels, since the list takes ownership of
+	// the DIB arrays.
+	static void FromCache(std::list<HighScoreImage> &images, const HighScoreImageCache::ImageSet &set)
+	{
+		for (auto &c : set)
+		{
+			BITMAPINFO bmi;
+			ZeroMemory(&bmi, sizeof(bmi));
+			bmi.bmiHeader = c.bmih;
+			BYTE *pix = new BYTE[c.pix.size()];
+			memcpy(pix, c.pix.data(), c.pix.size());
+			images.emplace_back(static_cast<HighScoreImage::SpriteType>(c.spriteType), bmi, pix,
+				c.displayTime, c.bgColor, c.bgAlpha);
+		}
+	}
+
 	// launch the thread
 	void Launch()
 	{
@@ -641,8 +773,14 @@ struct HighScoreGraphicsGenThread
 		// so make sure we delete the object on exiting the thread routine.
 		std::unique_ptr<HighScoreGraphicsGenThread> thisptr(this);
 
-		// create the graphics according to the style
-		if (_tcsicmp(style.c_str(), _T("alpha")) == 0)
+		// check the disk cache first
+		std::shared_ptr<const HighScoreImageCache::ImageSet> cached;
+		if (cache != nullptr && (cached = cache->FindOnDisk(cacheKey)) != nullptr)
+		{
+			// got it - use the cached images
+			FromCache(images, *cached);
+		}
+		else if (_tcsicmp(style.c_str(), _T("alpha")) == 0)
 		{
 			// Alphanumeric segmented display style
 			RenderAlphanum();
@@ -659,6 +797,13 @@ struct HighScoreGraphicsGenThread
 			RenderDots();
 		}
 
+		// if we rendered new images, add them to the cache
+		if (cache != nullptr && cached == nullptr)
+		{
+			if (auto set = ToCache(images); set != nullptr)
+				cache->Add(cacheKey, set);
+		}
+
 		// Send the sprite list back to the window
 		view->SendMessage(BVMsgDMDImageReady, seqno, reinterpret_cast<LPARAM>(&images));
 
@@ -1388,7 +1533,21 @@ void DMDView::GenerateHighScoreImages()
 		if (th->slides.size() == 1)
 			th->slides.begin()->displayTime += 2000;
 
-		// launch the thread
+		// Check the image cache.  If we've already generated images for
+		// the same text in the same style, install them directly, without
+		// launching a thread at all.
+		th->cacheKey = th->CacheKey();
+		if (auto cached = highScoreCache->Find(th->cacheKey); cached != nullptr)
+		{
+			std::list<HighScoreImage> images;
+			HighScoreGraphicsGenThread::FromCache(images, *cached);
+			delete th;
+			SetHighScoreImages(pendingImageRequestSeqNo, &images);
+			return;
+		}
+
+		// not cached - launch the thread, letting it add its results to the cache
+		th->cache = highScoreCache;
 		th->Launch();
 	}
 }
@@ -22,6 +22,7 @@ class Sprite;
 class VideoSprite;
 class GameListItem;
 class DMDFont;
+class HighScoreImageCache;
 
 // DMD sprite.  This is a simple subclass of the basic sprite
 // that uses the special DMD shader, which renders a simulation
@@ -334,6 +335,10 @@ protected:
 	// as possible while maintaining the original aspect ratio).
 	bool dotsFixedAspectRatio = false;
 
+	// High score image cache.  This is shared with the generator threads,
+	// which add their results to the cache when they finish.
+	std::shared_ptr<HighScoreImageCache> highScoreCache;
+
 	// Set the high score image list.  When we switch to a new game, we kick
 	// off a thread to generate the high score images.  We use a thread rather
 	// than generating them on the main thread, because it can take long enough
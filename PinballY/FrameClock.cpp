@@ -0,0 +1,69 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+#include "stdafx.h"
+#include <dwmapi.h>
+#include "FrameClock.h"
+
+#pragma comment(lib, "Dwmapi.lib")
+
+FrameClock::FrameClock()
+{
+	// start with a 60 Hz clock, phased at the current time, until we
+	// get the real timing from the compositor
+	int64_t now = timer.GetTime_ticks();
+	period = static_cast<int64_t>(1.0 / 60.0 / timer.GetTickTime_sec());
+	vblank = now;
+	nextTick = now;
+	nextTimingUpdate = now;
+}
+
+void FrameClock::UpdateTiming(int64_t now)
+{
+	// Get the compositor timing.  The DWM times are in QPC units, the
+	// same as our timer, as long as the high-resolution counter is in
+	// use (which it always is on any system recent enough to run DWM).
+	DWM_TIMING_INFO ti;
+	ZeroMemory(&ti, sizeof(ti));
+	ti.cbSize = sizeof(ti);
+	if (SUCCEEDED(DwmGetCompositionTimingInfo(NULL, &ti)) && ti.qpcRefreshPeriod != 0)
+	{
+		period = static_cast<int64_t>(ti.qpcRefreshPeriod);
+		vblank = static_cast<int64_t>(ti.qpcVBlank);
+	}
+
+	// The refresh rate rarely changes, so check again in a second or
+	// so.  That keeps the phase from drifting without calling into DWM
+	// on every frame.
+	nextTimingUpdate = now + static_cast<int64_t>(1.0 / timer.GetTickTime_sec());
+}
+
+bool FrameClock::Tick()
+{
+	// if the next tick hasn't arrived yet, there's nothing to do
+	int64_t now = timer.GetTime_ticks();
+	if (now < nextTick)
+		return false;
+
+	// refresh the timing if it's been a while
+	if (now >= nextTimingUpdate)
+		UpdateTiming(now);
+
+	// Advance to the next vblank after the current time.  If we fell
+	// behind by more than one period, skip the missed ticks rather than
+	// trying to catch up on them.
+	int64_t phase = (now - vblank) % period;
+	if (phase < 0)
+		phase += period;
+	nextTick = now - phase + period;
+	return true;
+}
+
+DWORD FrameClock::GetMsToNextTick()
+{
+	int64_t now = timer.GetTime_ticks();
+	if (now >= nextTick)
+		return 0;
+
+	return static_cast<DWORD>(timer.TicksToUs(nextTick - now) / 1000.0);
+}
@@ -0,0 +1,49 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Frame clock.  This is a shared clock that paces rendering across
+// all of the D3D windows.  It ticks once per display refresh, aligned
+// to the desktop compositor's vertical blank timing, so that each
+// window renders at most one frame per refresh, and the message loop
+// can sleep between ticks instead of spinning when there's nothing
+// to draw.
+//
+// The refresh period and vblank phase come from the DWM composition
+// timing.  If that's not available, we fall back on a 60 Hz clock
+// with an arbitrary phase.
+
+#pragma once
+#include "HiResTimer.h"
+
+class FrameClock
+{
+public:
+	FrameClock();
+
+	// Check for a new tick.  If the next tick time has arrived, this
+	// advances to the following tick and returns true.  Otherwise it
+	// returns false.
+	bool Tick();
+
+	// Get the time remaining until the next tick, in milliseconds, for
+	// use as a wait timeout.  This rounds down, so that a wait with the
+	// result as the timeout won't overshoot the tick.
+	DWORD GetMsToNextTick();
+
+protected:
+	// update the refresh timing from the compositor
+	void UpdateTiming(int64_t now);
+
+	// timer
+	HiResTimer timer;
+
+	// refresh period, and a reference vblank time, in timer ticks
+	int64_t period;
+	int64_t vblank;
+
+	// time of the next tick
+	int64_t nextTick;
+
+	// time of the next compositor timing update
+	int64_t nextTimingUpdate;
+};
@@ -13,6 +13,7 @@
 #include "../Utilities/DateUtil.h"
 #include "../Utilities/GraphicsUtil.h"
 #include "GameList.h"
+#include "Profiler.h"
 #include "Application.h"
 #include "LogFile.h"
 #include "DialogResource.h"
@@ -717,6 +718,8 @@ int GameList::FindPrevLetter()
 
 void GameList::SetGame(int n)
 {
+	PROFILE_ZONE("GameList::SetGame");
+
 	// do nothing if there's no active game or the filter is empty
 	int cnt = (int)byTitleFiltered.size();
 	if (curGame < 0 || cnt == 0)
@@ -760,6 +763,8 @@ GameListFilter *GameList::GetFilterByCommand(int cmdID)
 
 bool GameList::RefreshFilter()
 {
+	PROFILE_ZONE("GameList::RefreshFilter");
+
 	// Remember the current selection, if any
 	const GameListItem *oldSel = GetNthGame(0);
 
@@ -1704,6 +1709,8 @@ bool GameList::InitFromConfig(ErrorHandler &eh)
 
 bool GameList::Load(ErrorHandler &eh)
 {
+	PROFILE_ZONE("GameList::Load");
+
 	// initialize from the configuration variables
 	if (!InitFromConfig(eh))
 		return false;
@@ -4335,7 +4342,7 @@ TSTRING GameListItem::GetDisplayName() const
 	return s;
 }
 
-void GameListItem::ResolveFile(ResolvedFile &rf)
+void GameListItem::ResolveFile(ResolvedFile &rf) const
 {
 	// The treatment depends on where the file entry came from
 	TCHAR fullPath[MAX_PATH];
@@ -4524,6 +4531,8 @@ bool GameListItem::UpdateMediaName(std::list<std::pair<TSTRING, TSTRING>> *media
 bool GameListItem::GetMediaItem(TSTRING &filename,
 	const MediaType &mediaType, bool forCapture, bool enableSwf, int desiredIndex) const
 {
+	PROFILE_ZONE("GameListItem::GetMediaItem");
+
 	// If we're getting a name for capture purposes, the file doesn't
 	// have to exist; otherwise, we're looking for an extant file.
 	// And since we're only able to return one file through this
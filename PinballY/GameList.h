@@ -362,7 +362,7 @@ public:
 		// file spec (no path, includes extension)
 		TSTRING file;
 	};
-	void ResolveFile(ResolvedFile &rf);
+	void ResolveFile(ResolvedFile &rf) const;
 
 	// Get the formatted display name, "Title (Manufacturer Year)".
 	TSTRING GetDisplayName() const;
@@ -0,0 +1,380 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// High score image cache
+
+#include "stdafx.h"
+#include "../Utilities/Config.h"
+#include "HighScoreImageCache.h"
+#include "Application.h"
+#include "LogFile.h"
+
+namespace ConfigVars
+{
+	static const TCHAR *MemoryLimit = _T("DMDWindow.HighScoreCache.MemoryLimit");
+	static const TCHAR *Disk = _T("DMDWindow.HighScoreCache.Disk");
+	static const TCHAR *DiskLimit = _T("DMDWindow.HighScoreCache.DiskLimit");
+}
+
+// Disk file format signature and version.  Bump the version if the
+// layout changes, or if the renderer changes in a way that makes
+// existing images obsolete.
+static const DWORD DiskFileSignature = 'PBHS';
+static const DWORD DiskFileVersion = 1;
+
+HighScoreImageCache::HighScoreImageCache()
+{
+	// Figure the disk folder.  This goes in the same folder as the
+	// game stats database.
+	auto const &gameStatsPath = Application::Get()->gameStatsPath;
+	const TCHAR *subdir = _T("HighScoreImageCache");
+	TCHAR path[MAX_PATH];
+	if (gameStatsPath.length() != 0)
+		PathCombine(path, gameStatsPath.c_str(), subdir);
+	else
+		GetDeployedFilePath(path, subdir, _T(""));
+	diskFolder = path;
+
+	// load the settings
+	OnConfigChange();
+}
+
+HighScoreImageCache::~HighScoreImageCache()
+{
+}
+
+void HighScoreImageCache::OnConfigChange()
+{
+	auto cfg = ConfigManager::GetInstance();
+	CriticalSectionLocker locker(lock);
+
+	// get the limits, in MB
+	memoryLimit = static_cast<size_t>(max(cfg->GetInt(ConfigVars::MemoryLimit, 32), 0)) * 1024 * 1024;
+	diskEnabled = cfg->GetBool(ConfigVars::Disk, false);
+	diskLimit = static_cast<UINT64>(max(cfg->GetInt(ConfigVars::DiskLimit, 128), 0)) * 1024 * 1024;
+
+	// if the memory tier is now over the limit, trim it
+	while (memoryBytes > memoryLimit && lru.size() != 0)
+	{
+		auto it = entries.find(lru.back());
+		memoryBytes -= it->second.bytes;
+		entries.erase(it);
+		lru.pop_back();
+	}
+}
+
+size_t HighScoreImageCache::DIBSize(const BITMAPINFOHEADER &bmih)
+{
+	// DIB rows are padded to DWORD boundaries
+	size_t stride = ((static_cast<size_t>(bmih.biWidth) * bmih.biBitCount + 31) / 32) * 4;
+	return stride * static_cast<size_t>(abs(bmih.biHeight));
+}
+
+std::shared_ptr<const HighScoreImageCache::ImageSet> HighScoreImageCache::Find(const TSTRING &key)
+{
+	CriticalSectionLocker locker(lock);
+	if (auto it = entries.find(key); it != entries.end())
+	{
+		// move it to the front of the LRU list
+		lru.splice(lru.begin(), lru, it->second.lruPos);
+		return it->second.images;
+	}
+
+	// not found
+	return nullptr;
+}
+
+std::shared_ptr<const HighScoreImageCache::ImageSet> HighScoreImageCache::FindOnDisk(const TSTRING &key)
+{
+	// check if the disk tier is enabled
+	{
+		CriticalSectionLocker locker(lock);
+		if (!diskEnabled)
+			return nullptr;
+	}
+
+	// try reading the file
+	std::shared_ptr<const ImageSet> images;
+	{
+		CriticalSectionLocker diskLocker(diskLock);
+		images = ReadDiskFile(DiskFile(key).c_str(), key);
+	}
+
+	// if we found it, add it to the memory tier
+	if (images != nullptr)
+	{
+		CriticalSectionLocker locker(lock);
+		AddToMemory(key, images);
+	}
+
+	return images;
+}
+
+void HighScoreImageCache::Add(const TSTRING &key, std::shared_ptr<const ImageSet> images)
+{
+	// add it to the memory tier
+	bool disk;
+	{
+		CriticalSectionLocker locker(lock);
+		AddToMemory(key, images);
+		disk = diskEnabled;
+	}
+
+	// write it to the disk tier, if enabled
+	if (disk)
+	{
+		CriticalSectionLocker diskLocker(diskLock);
+		CreateSubDirectory(diskFolder.c_str(), _T(""), NULL);
+		if (WriteDiskFile(DiskFile(key).c_str(), key, *images))
+			PruneDisk();
+	}
+}
+
+void HighScoreImageCache::Clear()
+{
+	CriticalSectionLocker locker(lock);
+	entries.clear();
+	lru.clear();
+	memoryBytes = 0;
+}
+
+void HighScoreImageCache::AddToMemory(const TSTRING &key, const std::shared_ptr<const ImageSet> &images)
+{
+	// figure the size
+	size_t bytes = key.length() * sizeof(TCHAR);
+	for (auto &i : *images)
+		bytes += sizeof(i) + i.pix.size();
+
+	// don't bother caching anything that won't fit at all
+	if (bytes > memoryLimit)
+		return;
+
+	// remove any existing entry for the key
+	if (auto it = entries.find(key); it != entries.end())
+	{
+		memoryBytes -= it->second.bytes;
+		lru.erase(it->second.lruPos);
+		entries.erase(it);
+	}
+
+	// make room by discarding least recently used entries
+	while (memoryBytes + bytes > memoryLimit && lru.size() != 0)
+	{
+		auto it = entries.find(lru.back());
+		memoryBytes -= it->second.bytes;
+		entries.erase(it);
+		lru.pop_back();
+	}
+
+	// add the new entry at the front of the LRU list
+	lru.emplace_front(key);
+	entries.emplace(key, Entry{ images, bytes, lru.begin() });
+	memoryBytes += bytes;
+}
+
+TSTRING HighScoreImageCache::DiskFile(const TSTRING &key) const
+{
+	// Name the file after a 64-bit FNV-1a hash of the key.  The file
+	// stores the full key, so a hash collision is detected on reading
+	// and just counts as a miss.
+	UINT64 h = 14695981039346656037ULL;
+	for (TCHAR c : key)
+	{
+		h ^= static_cast<UINT64>(c);
+		h *= 1099511628211ULL;
+	}
+
+	TCHAR fname[32];
+	_stprintf_s(fname, _T("%016I64x.dat"), h);
+
+	TCHAR path[MAX_PATH];
+	PathCombine(path, diskFolder.c_str(), fname);
+	return path;
+}
+
+std::shared_ptr<const HighScoreImageCache::ImageSet> HighScoreImageCache::ReadDiskFile(
+	const TCHAR *filename, const TSTRING &key)
+{
+	// Load the file into memory.  Open it with write-attributes access
+	// as well, so that we can update the modification time, which
+	// serves as the last-used time for pruning.
+	HandleHolder hFile = CreateFile(filename, GENERIC_READ | FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == NULL || hFile == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart > 256 * 1024 * 1024)
+		return nullptr;
+
+	std::vector<BYTE> buf(static_cast<size_t>(fileSize.QuadPart));
+	DWORD actual;
+	if (buf.size() != 0 && (!ReadFile(hFile, buf.data(), static_cast<DWORD>(buf.size()), &actual, NULL) || actual != buf.size()))
+		return nullptr;
+
+	// set up a bounds-checked reader
+	const BYTE *p = buf.data(), *endp = p + buf.size();
+	auto Read = [&p, endp](void *dst, size_t len)
+	{
+		if (static_cast<size_t>(endp - p) < len)
+			return false;
+		memcpy(dst, p, len);
+		p += len;
+		return true;
+	};
+	auto ReadDWORD = [&Read](DWORD &d) { return Read(&d, sizeof(d)); };
+
+	// check the signature and version
+	DWORD sig, ver;
+	if (!ReadDWORD(sig) || !ReadDWORD(ver) || sig != DiskFileSignature || ver != DiskFileVersion)
+		return nullptr;
+
+	// check the key
+	DWORD keyLen;
+	if (!ReadDWORD(keyLen) || keyLen != key.length())
+		return nullptr;
+	if (static_cast<size_t>(endp - p) < keyLen * sizeof(TCHAR)
+		|| memcmp(p, key.c_str(), keyLen * sizeof(TCHAR)) != 0)
+		return nullptr;
+	p += keyLen * sizeof(TCHAR);
+
+	// read the images
+	DWORD nImages;
+	if (!ReadDWORD(nImages) || nImages > 1000)
+		return nullptr;
+
+	auto images = std::make_shared<ImageSet>(nImages);
+	for (auto &i : *images)
+	{
+		DWORD spriteType, bgAlpha, pixLen;
+		if (!ReadDWORD(spriteType)
+			|| !ReadDWORD(i.displayTime)
+			|| !Read(&i.bgColor, sizeof(i.bgColor))
+			|| !ReadDWORD(bgAlpha)
+			|| !Read(&i.bmih, sizeof(i.bmih))
+			|| !ReadDWORD(pixLen)
+			|| pixLen != DIBSize(i.bmih)
+			|| static_cast<size_t>(endp - p) < pixLen)
+			return nullptr;
+
+		i.spriteType = static_cast<int>(spriteType);
+		i.bgAlpha = static_cast<BYTE>(bgAlpha);
+		i.pix.assign(p, p + pixLen);
+		p += pixLen;
+	}
+
+	// mark the file as recently used
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	SetFileTime(hFile, NULL, NULL, &now);
+
+	return images;
+}
+
+bool HighScoreImageCache::WriteDiskFile(const TCHAR *filename, const TSTRING &key, const ImageSet &images)
+{
+	// build the file contents in memory
+	std::vector<BYTE> buf;
+	auto Write = [&buf](const void *src, size_t len)
+	{
+		const BYTE *b = static_cast<const BYTE*>(src);
+		buf.insert(buf.end(), b, b + len);
+	};
+	auto WriteDWORD = [&Write](DWORD d) { Write(&d, sizeof(d)); };
+
+	WriteDWORD(DiskFileSignature);
+	WriteDWORD(DiskFileVersion);
+	WriteDWORD(static_cast<DWORD>(key.length()));
+	Write(key.c_str(), key.length() * sizeof(TCHAR));
+	WriteDWORD(static_cast<DWORD>(images.size()));
+	for (auto &i : images)
+	{
+		WriteDWORD(static_cast<DWORD>(i.spriteType));
+		WriteDWORD(i.displayTime);
+		Write(&i.bgColor, sizeof(i.bgColor));
+		WriteDWORD(i.bgAlpha);
+		Write(&i.bmih, sizeof(i.bmih));
+		WriteDWORD(static_cast<DWORD>(i.pix.size()));
+		Write(i.pix.data(), i.pix.size());
+	}
+
+	// Write it to a temporary file, then move it into place, so that a
+	// reader never sees a partially written file
+	TSTRING tmpname = TSTRING(filename) + _T(".tmp");
+	{
+		HandleHolder hFile = CreateFile(tmpname.c_str(), GENERIC_WRITE, 0, NULL,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (hFile == NULL || hFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		DWORD actual;
+		if (!WriteFile(hFile, buf.data(), static_cast<DWORD>(buf.size()), &actual, NULL) || actual != buf.size())
+		{
+			hFile = NULL;
+			DeleteFile(tmpname.c_str());
+			return false;
+		}
+	}
+
+	if (!MoveFileEx(tmpname.c_str(), filename, MOVEFILE_REPLACE_EXISTING))
+	{
+		WindowsErrorMessage err;
+		LogFile::Get()->Write(LogFile::DmdLogging, _T("High score image cache: error writing %s: %s\n"),
+			filename, err.Get());
+		DeleteFile(tmpname.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void HighScoreImageCache::PruneDisk()
+{
+	// gather the cache files
+	struct FileInfo
+	{
+		TSTRING name;
+		UINT64 size;
+		UINT64 modTime;
+	};
+	std::vector<FileInfo> files;
+	UINT64 total = 0;
+
+	TCHAR pat[MAX_PATH];
+	PathCombine(pat, diskFolder.c_str(), _T("*.dat"));
+	WIN32_FIND_DATA fd;
+	HANDLE hFind = FindFirstFile(pat, &fd);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+		{
+			UINT64 size = (static_cast<UINT64>(fd.nFileSizeHigh) << 32) | fd.nFileSizeLow;
+			UINT64 modTime = (static_cast<UINT64>(fd.ftLastWriteTime.dwHighDateTime) << 32) | fd.ftLastWriteTime.dwLowDateTime;
+			files.push_back({ fd.cFileName, size, modTime });
+			total += size;
+		}
+	} while (FindNextFile(hFind, &fd));
+	FindClose(hFind);
+
+	// if we're within the limit, there's nothing to do
+	if (total <= diskLimit)
+		return;
+
+	// Delete the least recently used files until we're comfortably
+	// under the limit, so that we don't have to do this again on the
+	// very next write.
+	std::sort(files.begin(), files.end(), [](const FileInfo &a, const FileInfo &b) { return a.modTime < b.modTime; });
+	UINT64 target = diskLimit / 10 * 9;
+	for (auto &f : files)
+	{
+		if (total <= target)
+			break;
+
+		TCHAR path[MAX_PATH];
+		PathCombine(path, diskFolder.c_str(), f.name.c_str());
+		if (DeleteFile(path))
+			total -= f.size;
+	}
+}
@@ -0,0 +1,117 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// High score image cache
+//
+// The DMD window generates a set of "slides" showing the high scores
+// for the selected game, in the dots, alphanumeric, or typewriter
+// style.  Rendering these takes a noticeable amount of time (the
+// alphanumeric style in particular runs several GDI+ blur and dilation
+// passes per slide), so it's done on a background thread.  But the
+// results only depend on the score text and the style settings, and
+// during attract mode and ordinary browsing, the same games come up
+// over and over with the same scores.
+//
+// This cache keeps the generated slide bitmaps, keyed by a string that
+// captures everything that goes into the rendering: the style, font,
+// palette, style options, slide timing, and the score text itself.
+// When the DMD window selects a game whose key is in the memory tier,
+// it installs the cached images directly, without launching a thread.
+// The memory tier is bounded by a byte limit, discarding the least
+// recently used entries first.
+//
+// There's also an optional disk tier, which persists the image sets
+// across sessions in a folder alongside GameStats.csv.  Disk lookups
+// and writes happen on the generator thread, never on the UI thread.
+// Any change to the inputs yields a different key, so stale entries
+// are never used; they just age out of the disk tier's size limit.
+
+#pragma once
+#include <list>
+#include <memory>
+#include <vector>
+
+class HighScoreImageCache
+{
+public:
+	HighScoreImageCache();
+	~HighScoreImageCache();
+
+	// Cached image.  This holds a private copy of a generated DIB,
+	// plus the parameters for creating a sprite from it.
+	struct Image
+	{
+		int spriteType = 0;
+		BITMAPINFOHEADER bmih;
+		std::vector<BYTE> pix;
+		DWORD displayTime = 0;
+		RGBQUAD bgColor = { 0, 0, 0, 0 };
+		BYTE bgAlpha = 255;
+	};
+	typedef std::vector<Image> ImageSet;
+
+	// load the settings from the configuration
+	void OnConfigChange();
+
+	// Look up an image set in the memory tier.  Returns null if the
+	// key isn't cached.  This is fast enough for the UI thread.
+	std::shared_ptr<const ImageSet> Find(const TSTRING &key);
+
+	// Look up an image set in the disk tier.  On success, the set is
+	// also added to the memory tier.  Returns null if the disk tier is
+	// disabled or doesn't have the key.  This does file I/O, so it
+	// should only be called from background threads.
+	std::shared_ptr<const ImageSet> FindOnDisk(const TSTRING &key);
+
+	// Add an image set to the cache.  If the disk tier is enabled, this
+	// also writes it to disk, so it should only be called from
+	// background threads.
+	void Add(const TSTRING &key, std::shared_ptr<const ImageSet> images);
+
+	// discard the memory tier
+	void Clear();
+
+	// get the byte size of a DIB's pixel array
+	static size_t DIBSize(const BITMAPINFOHEADER &bmih);
+
+protected:
+	// add an entry to the memory tier; must be called with the lock held
+	void AddToMemory(const TSTRING &key, const std::shared_ptr<const ImageSet> &images);
+
+	// get the disk file name for a key
+	TSTRING DiskFile(const TSTRING &key) const;
+
+	// read/write a disk file
+	std::shared_ptr<const ImageSet> ReadDiskFile(const TCHAR *filename, const TSTRING &key);
+	bool WriteDiskFile(const TCHAR *filename, const TSTRING &key, const ImageSet &images);
+
+	// delete the oldest disk files, if the disk tier is over its size limit
+	void PruneDisk();
+
+	// memory tier entry
+	struct Entry
+	{
+		std::shared_ptr<const ImageSet> images;
+		size_t bytes;
+		std::list<TSTRING>::iterator lruPos;
+	};
+	std::unordered_map<TSTRING, Entry> entries;
+
+	// LRU list of keys, most recently used first
+	std::list<TSTRING> lru;
+
+	// total bytes in the memory tier, and the limit
+	size_t memoryBytes = 0;
+	size_t memoryLimit = 0;
+
+	// disk tier settings
+	bool diskEnabled = false;
+	UINT64 diskLimit = 0;
+	TSTRING diskFolder;
+
+	// lock for the memory tier and settings
+	CriticalSection lock;
+
+	// lock for disk file operations
+	CriticalSection diskLock;
+};
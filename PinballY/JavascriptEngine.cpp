@@ -404,6 +404,8 @@ void JavascriptEngine::OnDebugMessageQueued()
 
 bool JavascriptEngine::EvalScript(const WCHAR *scriptText, const WCHAR *url, JsValueRef *returnVal, ErrorHandler &eh)
 {
+	PROFILE_ZONE("JavascriptEngine::EvalScript");
+
 	// we're entering Javascript scope
 	JavascriptScope jsc;
 
@@ -1412,6 +1414,8 @@ ULONGLONG JavascriptEngine::GetNextTaskTime()
 
 bool JavascriptEngine::RunTasks() 
 {
+	PROFILE_ZONE("JavascriptEngine::RunTasks");
+
 	// no tasks have been executed yet
 	bool tasksExecuted = false;
 
@@ -13,6 +13,7 @@
 #include "../ChakraCore/include/ChakraDebugProtocolHandler.h"
 #include "../Utilities/DateUtil.h"
 #include "../Utilities/ComUtil.h"
+#include "Profiler.h"
 
 extern "C" UINT64 JavascriptEngine_CallCallback(void *wrapper, void *argv);
 
@@ -978,6 +979,7 @@ public:
 	template<typename... ArgTypes>
 	bool FireAndReturnEvent(JsValueRef &eventObj, JsValueRef eventTarget, JsValueRef eventType, ArgTypes... args)
 	{
+		PROFILE_ZONE("JavascriptEngine::FireEvent");
 		try
 		{
 			// create the object, providing the reference to the caller
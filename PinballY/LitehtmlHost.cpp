@@ -6,6 +6,7 @@
 
 #include "stdafx.h"
 #include "LitehtmlHost.h"
+#include "LogFile.h"
 
 // HRGN holder, for automatically deleting regions as they go out of scope
 struct HRGNHolder
@@ -46,6 +47,9 @@ LitehtmlHost::LitehtmlHost()
 // Destructor
 LitehtmlHost::~LitehtmlHost()
 {
+	// log the text measurement statistics
+	LogTextMeasureStats();
+
 	// delete any remaining clip regions
 	while (clipRegionStack.size() != 0)
 	{
@@ -155,26 +159,71 @@ litehtml::uint_ptr LitehtmlHost::create_font(
 
 void LitehtmlHost::delete_font(litehtml::uint_ptr hFont)
 {
+	// discard the font's cached text widths, since the handle might be
+	// reused for a new font
+	if (auto it = textWidthCache.find(hFont); it != textWidthCache.end())
+	{
+		textWidthCacheEntries -= it->second.size();
+		textWidthCache.erase(it);
+	}
+
 	// reinterpret the font handle as a Gdiplus::Font pointer, and delete the object
 	delete reinterpret_cast<Gdiplus::Font*>(hFont);
 }
 
 int LitehtmlHost::text_width(const litehtml::tchar_t* text, litehtml::uint_ptr hFont)
 {
+	// check the cache
+	++textMeasureStats.calls;
+	auto &fontCache = textWidthCache[hFont];
+	if (auto it = fontCache.find(text); it != fontCache.end())
+	{
+		++textMeasureStats.hits;
+		return it->second;
+	}
+
 	// get the font
 	auto pFont = reinterpret_cast<Gdiplus::Font*>(hFont);
 
-	// set up a Gdiplus context on a memory DC
-	MemoryDC memdc;
-	Gdiplus::Graphics g(memdc);
+	// set up the Gdiplus measuring context if we haven't already
+	if (measuringGraphics == nullptr)
+		measuringGraphics.reset(new Gdiplus::Graphics(measuringDC));
 
 	// measure the bounding box of the string with origin 0,0
+	int64_t t0 = measureTimer.GetTime_ticks();
 	Gdiplus::PointF origin(0.0f, 0.0f);
 	Gdiplus::RectF bbox;
-	g.MeasureString(text, static_cast<INT>(_tcslen(text)), pFont, origin, measuringFormat.get(), &bbox);
+	measuringGraphics->MeasureString(text, static_cast<INT>(_tcslen(text)), pFont, origin, measuringFormat.get(), &bbox);
+	textMeasureStats.measureTicks += measureTimer.GetTime_ticks() - t0;
 
-	// return the width of the bounding box
-	return static_cast<int>(bbox.Width);
+	// the width is the width of the bounding box
+	int width = static_cast<int>(bbox.Width);
+
+	// If the cache is full, start over.  Note that this discards the
+	// table we're about to add to, so look it up again afterwards.
+	if (textWidthCacheEntries >= MaxTextWidthCacheEntries)
+	{
+		textWidthCache.clear();
+		textWidthCacheEntries = 0;
+		textWidthCache[hFont].emplace(text, width);
+	}
+	else
+		fontCache.emplace(text, width);
+
+	// count the new entry and return the width
+	++textWidthCacheEntries;
+	return width;
+}
+
+void LitehtmlHost::LogTextMeasureStats()
+{
+	auto &s = textMeasureStats;
+	if (auto log = LogFile::Get(); log != nullptr && s.calls != 0)
+	{
+		log->Write(LogFile::JSLogging,
+			_T("HTML layout text measurement: %I64u calls, %I64u cache hits (%.1f%%), %.1f ms measuring\n"),
+			s.calls, s.hits, 100.0 * s.hits / s.calls, GetTextMeasureMs());
+	}
 }
 
 void LitehtmlHost::draw_text(litehtml::uint_ptr hdc, const litehtml::tchar_t* text, litehtml::uint_ptr hFont, litehtml::web_color color, const litehtml::position& pos)
@@ -16,6 +16,7 @@
 #pragma once
 
 #include "../litehtml/include/litehtml.h"
+#include "HiResTimer.h"
 
 class LitehtmlHost : public litehtml::document_container
 {
@@ -78,6 +79,24 @@ public:
 
 	virtual void draw_list_marker(litehtml::uint_ptr hdc, const litehtml::list_marker& marker);
 
+	// Text measurement statistics.  'calls' counts text_width() calls,
+	// 'hits' counts the calls answered from the width cache, and
+	// 'measureTicks' is the HiResTimer time spent in Gdiplus measuring
+	// the misses.
+	struct TextMeasureStats
+	{
+		UINT64 calls = 0;
+		UINT64 hits = 0;
+		int64_t measureTicks = 0;
+	};
+	const TextMeasureStats &GetTextMeasureStats() const { return textMeasureStats; }
+
+	// get the total measuring time from the statistics, in milliseconds
+	double GetTextMeasureMs() const { return measureTimer.TicksToUs(textMeasureStats.measureTicks) / 1000.0; }
+
+	// write the text measurement statistics to the log file
+	void LogTextMeasureStats();
+
 	//
 	// The following all relate to full browser functionality that we don't support.
 	// We're only interested in using the HTML engine for its layout capabilities,
@@ -104,6 +123,29 @@ protected:
 	// StringFormat for measuring text
 	std::unique_ptr<Gdiplus::StringFormat> measuringFormat;
 
+	// Measuring context.  litehtml calls text_width() for every word
+	// during layout, so we keep one memory DC and Gdiplus context for
+	// all measurements rather than setting one up on every call.  The
+	// Gdiplus context is created on first use.
+	MemoryDC measuringDC;
+	std::unique_ptr<Gdiplus::Graphics> measuringGraphics;
+
+	// Text width cache.  This maps each font handle to a table of the
+	// widths of the strings measured in that font.  The same words
+	// tend to come up over and over in a document, and each layout of
+	// a document measures all of its words again, so most calls can be
+	// answered from the table.  A font's table is discarded when the
+	// font is deleted, since litehtml could reuse the handle for a
+	// different font.  To bound the memory use, we discard all of the
+	// tables when the total entry count reaches the limit.
+	std::unordered_map<litehtml::uint_ptr, std::unordered_map<TSTRING, int>> textWidthCache;
+	size_t textWidthCacheEntries = 0;
+	static const size_t MaxTextWidthCacheEntries = 16384;
+
+	// text measurement statistics, and the timer for collecting them
+	TextMeasureStats textMeasureStats;
+	HiResTimer measureTimer;
+
 	// Do we have any non-zero corner radii in a border_radiuses descriptor?
 	static bool IsNonZeroCornerRadii(const litehtml::border_radiuses &br)
 	{
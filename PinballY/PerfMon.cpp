@@ -118,6 +118,17 @@ bool PerfMon::GetCurFPS(float &result, float min_time_sec)
 	return true;
 }
 
+void PerfMon::EndFrameCost(int drawCalls, int stateChanges)
+{
+	// record the counts
+	frameCost.drawCalls = drawCalls;
+	frameCost.stateChanges = stateChanges;
+
+	// figure the elapsed time, and fold it into the running average
+	frameCost.cpuMs = float(timer.TicksToUs(timer.GetTime_ticks() - frameCostT0) / 1000.0);
+	frameCost.avgCpuMs = frameCost.avgCpuMs == 0.0f ? frameCost.cpuMs : frameCost.avgCpuMs * 0.95f + frameCost.cpuMs * 0.05f;
+}
+
 float PerfMon::GetRollingFPS()
 {
 	// get the elapsed time on the current rolling timer
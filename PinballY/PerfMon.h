@@ -41,6 +41,22 @@ public:
 	// Get CPU performance metrics
 	bool GetCPUMetrics(CPUMetrics &metrics);
 
+	// Frame cost statistics.  The window calls BeginFrameCost() before
+	// issuing a frame's drawing commands, and EndFrameCost() after the
+	// last one, before Present() (which can block waiting for vsync).
+	// We keep the last frame's counts, plus a running average of the
+	// CPU time.
+	struct FrameCost
+	{
+		int drawCalls = 0;			// draw calls
+		int stateChanges = 0;		// pipeline state changes
+		float cpuMs = 0.0f;			// CPU time issuing the frame, in milliseconds
+		float avgCpuMs = 0.0f;		// running average CPU time
+	};
+	inline void BeginFrameCost() { frameCostT0 = timer.GetTime_ticks(); }
+	void EndFrameCost(int drawCalls, int stateChanges);
+	const FrameCost &GetFrameCost() const { return frameCost; }
+
 protected:
 	// Hi-res timer
 	HiResTimer timer;
@@ -86,4 +102,8 @@ protected:
 	// per-core CPU performance counters
 	int nCpuCores;
 	HCOUNTER hCoreCounter[16];
+
+	// frame cost statistics, and the start time of the current frame
+	FrameCost frameCost;
+	int64_t frameCostT0 = 0;
 };
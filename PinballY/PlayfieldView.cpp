@@ -22,6 +22,7 @@
 #include "../Utilities/DirectWriteUtil.h"
 #include "../Utilities/std_filesystem.h"
 #include "LitehtmlHost.h"
+#include "TextRasterCache.h"
 #include "PlayfieldView.h"
 #include "SecondaryView.h"
 #include "CustomView.h"
@@ -38,6 +39,7 @@
 #include "TextDraw.h"
 #include "VersionInfo.h"
 #include "Sprite.h"
+#include "TextSprite.h"
 #include "Application.h"
 #include "MouseButtons.h"
 #include "AudioManager.h"
@@ -55,6 +57,7 @@
 #include "LogFile.h"
 #include "../OptionsDialog/OptionsDialogExports.h"
 #include "JavascriptEngine.h"
+#include "Profiler.h"
 
 // Option setting: should we notify PinVol (if running) when we select
 // a new game in the wheel UI?
@@ -916,7 +919,8 @@ void PlayfieldView::InitJavascript()
 				|| !js->DefineObjPropFunc(jsMainWindow, "mainWindow", "DOFPulse", &PlayfieldView::JsDOFPulse, this, eh)
 				|| !js->DefineObjPropFunc(jsMainWindow, "mainWindow", "DOFSet", &PlayfieldView::JsDOFSet, this, eh)
 				|| !js->DefineObjPropFunc(jsMainWindow, "mainWindow", "createMediaWindow", &PlayfieldView::JsCreateMediaWindow, this, eh)
-				|| !js->DefineObjPropFunc(jsMainWindow, "mainWindow", "setWheelAutoRepeatRate", &PlayfieldView::JsSetWheelAutoRepeatRate, this, eh))
+				|| !js->DefineObjPropFunc(jsMainWindow, "mainWindow", "setWheelAutoRepeatRate", &PlayfieldView::JsSetWheelAutoRepeatRate, this, eh)
+				|| !js->DefineObjPropFunc(jsMainWindow, "mainWindow", "saveProfileTrace", &PlayfieldView::JsSaveProfileTrace, this, eh))
 				return;
 
 			// Get the status lines
@@ -1008,7 +1012,9 @@ void PlayfieldView::InitJavascript()
 				|| (err = js->GetProp(htmlLayoutConstructor, js->GetGlobalObject(), "HtmlLayout", where)) != JsNoError
 				|| (err = js->GetProp(jsHtmlLayoutProto, htmlLayoutConstructor, "prototype", where)) != JsNoError
 				|| !js->DefineObjMethod(jsHtmlLayoutProto, "HtmlLayout", "draw", &PlayfieldView::JsHtmlLayoutDraw, this, eh)
-				|| !js->DefineObjMethod(jsHtmlLayoutProto, "HtmlLayout", "measure", &PlayfieldView::JsHtmlLayoutMeasure, this, eh))
+				|| !js->DefineObjMethod(jsHtmlLayoutProto, "HtmlLayout", "measure", &PlayfieldView::JsHtmlLayoutMeasure, this, eh)
+				|| !js->DefineObjMethod(jsHtmlLayoutProto, "HtmlLayout", "setContent", &PlayfieldView::JsHtmlLayoutSetContent, this, eh)
+				|| !js->DefineObjMethod(jsHtmlLayoutProto, "HtmlLayout", "setText", &PlayfieldView::JsHtmlLayoutSetText, this, eh))
 			{
 				LogFile::Get()->Write(LogFile::JSLogging, _T(". error initializing HtmlLayout: js error code %d, %s\n"), err, where);
 				return;
@@ -1051,6 +1057,7 @@ void PlayfieldView::InitJavascript()
 			// Set up the GameInfo methods
 			if (!js->DefineObjMethod(jsGameInfo, "GameInfo", "getHighScores", &PlayfieldView::JsGetHighScores, this, eh)
 				|| !js->DefineObjMethod(jsGameInfo, "GameInfo", "setHighScores", &PlayfieldView::JsSetHighScores, this, eh)
+				|| !js->DefineObjMethod(jsGameInfo, "GameInfo", "getTableMetadata", &PlayfieldView::JsGetTableMetadata, this, eh)
 				|| !js->DefineObjMethod(jsGameInfo, "GameInfo", "resolveGameFile", &PlayfieldView::JsResolveGameFile, this, eh)
 				|| !js->DefineObjMethod(jsGameInfo, "GameInfo", "resolveMedia", &PlayfieldView::JsResolveGameMediaFile, this, eh)
 				|| !js->DefineObjMethod(jsGameInfo, "GameInfo", "resolveROM", &PlayfieldView::JsResolveROM, this, eh)
@@ -2853,6 +2860,53 @@ JsValueRef PlayfieldView::JsResolveROM(JsValueRef self)
 	}
 }
 
+JsValueRef PlayfieldView::JsGetTableMetadata(JsValueRef self)
+{
+	auto js = JavascriptEngine::Get();
+	auto gl = GameList::Get();
+
+	try
+	{
+		// get the game from the ID in self.id
+		JavascriptEngine::JsObj selfobj(self);
+		auto id = selfobj.Get<int>("id");
+		auto game = gl->GetByInternalID(id);
+		if (game == nullptr)
+			return js->Throw(_T("Invalid game ID"));
+
+		// Look up the cached metadata.  If it's not in the cache yet, this
+		// queues the file for extraction, and we return undefined.
+		TableMetadataCache::Entry md;
+		auto tmc = Application::Get()->GetTableMetadataCache();
+		if (tmc == nullptr || !tmc->Get(game, md) || !md.ok)
+			return js->GetUndefVal();
+
+		// create an object for the result
+		auto obj = JavascriptEngine::JsObj::CreateObject();
+
+		// populate it with the non-empty fields
+		auto Set = [&obj](const CHAR *prop, const TSTRING &val) { if (val.length() != 0) obj.Set(prop, val); };
+		obj.Set("fileVersion", static_cast<int>(md.fileVersion));
+		Set("tableName", md.tableName);
+		Set("tableVersion", md.tableVersion);
+		Set("releaseDate", md.releaseDate);
+		Set("authorName", md.authorName);
+		Set("authorEmail", md.authorEmail);
+		Set("authorWebSite", md.authorWebSite);
+		Set("blurb", md.blurb);
+		Set("description", md.description);
+		Set("rules", md.rules);
+		Set("scriptRom", md.scriptRom);
+
+		// return the object
+		return obj.jsobj;
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		return js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+	}
+}
+
 // Descriptor value encapsulation for JsGameInfoUpdate.  This
 // captures a property value and whether or not it's present at
 // all in the descriptor.
@@ -4163,6 +4217,9 @@ bool PlayfieldView::OnTimer(WPARAM timer, LPARAM callback)
 	case startupTimerID:
 		// done with the startup timer
 		KillTimer(hWnd, timer);
+
+		// preload the button sounds
+		PreloadButtonSounds();
 		return true;
 
 	case launchFocusTimerID:
@@ -5174,6 +5231,9 @@ bool PlayfieldView::HandleKeyEvent(BaseWin *win, UINT msg, WPARAM wParam, LPARAM
 	if (wParam == VK_SHIFT)
 		return false;
 
+	// note the event time, for latency measurements
+	int64_t eventTicks = GetInputEventTicks();
+
 	// update the attract mode key event timer
 	attractMode.OnKeyEvent(this);
 
@@ -5230,7 +5290,7 @@ bool PlayfieldView::HandleKeyEvent(BaseWin *win, UINT msg, WPARAM wParam, LPARAM
 	if (auto it = vkeyToCommand.find(vkey); it != vkeyToCommand.end())
 	{
 		// We found a handler for the key.  Process the key press.
-		ProcessKeyPress(win->GetHWnd(), button, mode, 0, false, false, it->second);
+		ProcessKeyPress(win->GetHWnd(), button, mode, 0, false, false, it->second, eventTicks);
 
 		// the key event was handled
 		return true;
@@ -5240,14 +5300,26 @@ bool PlayfieldView::HandleKeyEvent(BaseWin *win, UINT msg, WPARAM wParam, LPARAM
 	return false;
 }
 
+int64_t PlayfieldView::GetInputEventTicks()
+{
+	// use the audio manager's timer, so that the event times are
+	// directly comparable to the audio latency timestamps
+	AudioManager *am = AudioManager::Get();
+	return am != nullptr ? am->GetEventTicks() : 0;
+}
+
 // Add a key press to the queue and process it
 void PlayfieldView::ProcessKeyPress(
 	HWND hwndSrc, InputManager::Button physButton, KeyPressType mode, int repeatCount, 
-	bool bg, bool scripted, std::list<const KeyCommand*> cmds)
+	bool bg, bool scripted, std::list<const KeyCommand*> cmds, int64_t eventTicks)
 {
+	// if the caller didn't stamp the event, use the current time
+	if (eventTicks == 0)
+		eventTicks = GetInputEventTicks();
+
 	// add each command to the key queue
 	for (auto c : cmds)
-		keyQueue.emplace_back(hwndSrc, physButton, mode, repeatCount, bg, scripted, c);
+		keyQueue.emplace_back(hwndSrc, physButton, mode, repeatCount, bg, scripted, c, eventTicks);
 
 	// If a wheel animation is in progress, skip directly to the end
 	// of the animation on any new key-down event.  This makes the
@@ -6627,6 +6699,14 @@ void PlayfieldView::JsDrawingContext::InitFont()
 		textBrush.reset(new Gdiplus::SolidBrush(textColor));
 }
 
+TextRasterCache *PlayfieldView::GetTextRasterCache()
+{
+	if (textRasterCache == nullptr)
+		textRasterCache.reset(new TextRasterCache());
+
+	return textRasterCache.get();
+}
+
 void PlayfieldView::JsDrawDrawText(TSTRING text)
 {
 	// validate the drawing context
@@ -6659,15 +6739,71 @@ void PlayfieldView::JsDrawDrawText(TSTRING text)
 	if ((newline = (len > 0 && text[static_cast<size_t>(len) - 1] == '\n')) != false)
 		--len;
 
-	// draw the text
-	jsDC->g.DrawString(text.c_str(), len, jsDC->font.get(), rcLayout, &f, jsDC->textBrush.get());
+	// Look up the text in the raster cache.  The key covers everything
+	// that affects the rendering, including the canvas size, since the
+	// raster area is clipped to the canvas.  Skip the cache entirely if
+	// the context renders text with ClearType, since we can't reproduce
+	// that on the cache's transparent surface.
+	auto cache = GetTextRasterCache();
+	auto hint = TextRasterCache::ResolveTextRenderingHint(jsDC->g.GetTextRenderingHint());
+	bool cacheable = TextRasterCache::IsCacheableHint(hint);
+	TSTRING key;
+	if (cacheable)
+	{
+		auto argb = jsDC->textColor.GetValue();
+		key = MsgFmt(_T("text|%s|%d|%d|%d|%08lx|%d|%d|%d|%d,%d|%g,%g,%g,%g|"),
+			jsDC->fontName.c_str(), jsDC->fontPtSize, jsDC->fontWeight, jsDC->fontItalic ? 1 : 0,
+			static_cast<unsigned long>(argb), static_cast<int>(jsDC->textAlignHorz), static_cast<int>(jsDC->textAlignVert),
+			static_cast<int>(hint), static_cast<int>(jsDC->width), static_cast<int>(jsDC->height),
+			rcLayout.X, rcLayout.Y, rcLayout.Width, rcLayout.Height).Get();
+		key.append(text.c_str(), len);
+	}
+
+	// draw the text, from the cache if possible
+	Gdiplus::RectF bbox;
+	if (auto raster = cacheable ? cache->Find(key) : nullptr; raster != nullptr)
+	{
+		raster->Draw(jsDC->g);
+		bbox = raster->bbox;
+	}
+	else if (!cacheable)
+	{
+		// draw directly
+		jsDC->g.MeasureString(text.c_str(), len, jsDC->font.get(), rcLayout, &bbox);
+		jsDC->g.DrawString(text.c_str(), len, jsDC->font.get(), rcLayout, &f, jsDC->textBrush.get());
+	}
+	else
+	{
+		// Measure the text.  'bbox' is the extent for advancing the origin;
+		// 'rcInk' is where the text actually lands with the current
+		// alignment.  Rasterize the area it covers, with a margin of a
+		// line height all around for overhangs (italics, accents) that
+		// extend past the layout box.  Clip it to the drawing area.
+		Gdiplus::RectF rcInk;
+		jsDC->g.MeasureString(text.c_str(), len, jsDC->font.get(), rcLayout, &bbox);
+		jsDC->g.MeasureString(text.c_str(), len, jsDC->font.get(), rcLayout, &f, &rcInk);
+		float margin = jsDC->font->GetHeight(&jsDC->g);
+		int x0 = max(static_cast<int>(floorf(rcInk.X - margin)), 0);
+		int y0 = max(static_cast<int>(floorf(rcInk.Y - margin)), 0);
+		int x1 = min(static_cast<int>(ceilf(rcInk.GetRight() + margin)), static_cast<int>(jsDC->width));
+		int y1 = min(static_cast<int>(ceilf(rcInk.GetBottom() + margin)), static_cast<int>(jsDC->height));
+		Gdiplus::Rect rcRaster(x0, y0, x1 - x0, y1 - y0);
+		auto Render = [this, &text, len, &rcLayout, &f, &rcRaster, hint](Gdiplus::Graphics &g)
+		{
+			g.SetTextRenderingHint(hint);
+			Gdiplus::RectF rc(rcLayout.X - rcRaster.X, rcLayout.Y - rcRaster.Y, rcLayout.Width, rcLayout.Height);
+			g.DrawString(text.c_str(), len, jsDC->font.get(), rc, &f, jsDC->textBrush.get());
+		};
+		if ((raster = cache->Add(key, rcRaster, bbox, TextRasterCache::Surface::Bitmap, Render)) != nullptr)
+			raster->Draw(jsDC->g);
+		else
+			jsDC->g.DrawString(text.c_str(), len, jsDC->font.get(), rcLayout, &f, jsDC->textBrush.get());
+	}
 
 	// Advance the text origin.  If the text ended in a newline, advance the
 	// vertical offset by the line height and move the horizontal offset to
 	// the left of the text layout box.  Otherwise, advance the horizontal
 	// offset by the text width.
-	Gdiplus::RectF bbox;
-	jsDC->g.MeasureString(text.c_str(), len, jsDC->font.get(), rcLayout, &bbox);
 	if (newline)
 	{
 		jsDC->textOrigin.X = jsDC->textBounds.X;
@@ -7198,6 +7334,16 @@ public:
 
 	// the styled text collection
 	DirectWriteUtils::StyledText st;
+
+	// Content ID, for the text raster cache.  This is unique across all
+	// StyledText objects, and we assign a new one on every change to the
+	// contents, so a cached rendering keyed on it is never stale.
+	UINT64 contentId = NextContentId();
+	static UINT64 NextContentId()
+	{
+		static UINT64 nextId = 1;
+		return nextId++;
+	}
 };
 
 
@@ -7281,6 +7427,9 @@ JsValueRef CALLBACK PlayfieldView::JsStyledTextAdd(JsValueRef callee, bool isCon
 		for (unsigned short i = 1; i < argc; ++i)
 			st->ParseArg(argv[i], st->baseStyle);
 
+		// the contents have changed, so any cached rendering is obsolete
+		st->contentId = JsStyledText::NextContentId();
+
 		// return 'this'
 		return argv[0];
 	}
@@ -7320,9 +7469,35 @@ void PlayfieldView::JsStyledTextDraw(JsValueRef self, JsValueRef dc, JavascriptE
 		GetRect(rcLayout, jsrcLayout);
 		GetRect(rcClip, jsrcClip);
 
-		// draw it
-		auto dw = DirectWriteUtils::Get();
-		dw->RenderStyledText(jsDC->g, &st->st, rcLayout, rcClip, LogFileErrorHandler());
+		// Look up the rendering in the raster cache.  The content ID
+		// identifies the text and its styles.
+		auto cache = GetTextRasterCache();
+		TSTRING key = MsgFmt(_T("styled|%I64u|%g,%g,%g,%g|%g,%g,%g,%g"), st->contentId,
+			rcLayout.X, rcLayout.Y, rcLayout.Width, rcLayout.Height,
+			rcClip.X, rcClip.Y, rcClip.Width, rcClip.Height).Get();
+		auto raster = cache->Find(key);
+		if (raster == nullptr)
+		{
+			// Rasterize the clipping area.  The renderer truncates the clip
+			// rectangle to whole pixels, so do the same here, to get the
+			// same pixel alignment when we offset everything to the origin
+			// of the off-screen surface.
+			int x0 = static_cast<int>(rcClip.X), y0 = static_cast<int>(rcClip.Y);
+			Gdiplus::Rect rcRaster(x0, y0,
+				static_cast<int>(rcClip.GetRight()) - x0, static_cast<int>(rcClip.GetBottom()) - y0);
+			raster = cache->Add(key, rcRaster, rcLayout, TextRasterCache::Surface::DC, [st, &rcLayout, &rcClip, x0, y0](Gdiplus::Graphics &g)
+			{
+				Gdiplus::RectF rcl(rcLayout.X - x0, rcLayout.Y - y0, rcLayout.Width, rcLayout.Height);
+				Gdiplus::RectF rcc(rcClip.X - x0, rcClip.Y - y0, rcClip.Width, rcClip.Height);
+				DirectWriteUtils::Get()->RenderStyledText(g, &st->st, rcl, rcc, LogFileErrorHandler());
+			});
+		}
+
+		// draw it, directly if it was too large to cache
+		if (raster != nullptr)
+			raster->Draw(jsDC->g);
+		else
+			DirectWriteUtils::Get()->RenderStyledText(jsDC->g, &st->st, rcLayout, rcClip, LogFileErrorHandler());
 	}
 	catch (JavascriptEngine::CallException exc)
 	{
@@ -7391,12 +7566,37 @@ JsValueRef PlayfieldView::JsStyledTextMeasure(JsValueRef self, float width)
 class JsHtmlLayout : public JavascriptEngine::ExternalObject 
 {
 public:
-	JsHtmlLayout(std::shared_ptr<litehtml::document> &doc) : doc(doc) { }
+	JsHtmlLayout(std::shared_ptr<litehtml::document> &doc) : doc(doc), styles(doc->styles()) { }
 
 	// Litehtml document.  This contains the parsed HTML and layout information.
 	std::shared_ptr<litehtml::document> doc;
+
+	// Compiled style sheet from the <style> sections of the original
+	// HTML source.  setContent() applies this to the new content, so
+	// that a script can reuse one layout template for a series of
+	// contents without re-parsing the styles each time.  litehtml
+	// shares compiled style sheets, so this is never modified.
+	litehtml::css::ptr styles;
 };
 
+void PlayfieldView::AddFrameCounterText(float x, float &y, float lineHeight, const XMFLOAT4 &color)
+{
+	// show the text measurement cache statistics, if any HTML layouts
+	// have measured text yet
+	if (litehtmlHost == nullptr)
+		return;
+
+	auto &s = litehtmlHost->GetTextMeasureStats();
+	if (s.calls != 0)
+	{
+		TCHAR buf[256];
+		_stprintf_s(buf, _T("HTML text measurement: %I64u calls, %I64u cache hits (%.1f%%), %.1f ms measuring"),
+			s.calls, s.hits, 100.0 * s.hits / s.calls, litehtmlHost->GetTextMeasureMs());
+		textDraw->Add(buf, dmdFont, color, x, y, 0);
+		y += lineHeight;
+	}
+}
+
 
 JsValueRef CALLBACK PlayfieldView::JsHtmlLayoutConstructor(
 	JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx)
@@ -7533,6 +7733,46 @@ JsValueRef PlayfieldView::JsHtmlLayoutMeasure(JsValueRef self, int width)
 	}
 }
 
+void PlayfieldView::JsHtmlLayoutSetContent(JsValueRef self, WSTRING txt)
+{
+	auto js = JavascriptEngine::Get();
+
+	// recover the external object from Javascript
+	auto layout = JsHtmlLayout::Recover<JsHtmlLayout>(self, _T("HtmlLayout.setContent"));
+	if (layout == nullptr)
+		return;
+
+	// Parse the new content, applying the original source's compiled
+	// styles on top of any styles in the new text.  This skips the
+	// style sheet parsing and selector sorting for the template.
+	auto doc = litehtml::document::createFromString(txt.c_str(), litehtmlHost, &litehtmlHost->litehtmlContext, layout->styles.get());
+	if (doc == nullptr)
+		return js->Throw(_T("Error parsing HTML")), static_cast<void>(0);
+
+	// replace the old document
+	layout->doc = doc;
+}
+
+bool PlayfieldView::JsHtmlLayoutSetText(JsValueRef self, WSTRING selector, WSTRING txt)
+{
+	// recover the external object from Javascript
+	auto layout = JsHtmlLayout::Recover<JsHtmlLayout>(self, _T("HtmlLayout.setText"));
+	if (layout == nullptr || layout->doc == nullptr)
+		return false;
+
+	// find the target element
+	auto root = layout->doc->root();
+	auto ele = root != nullptr ? root->select_one(selector) : nullptr;
+	if (ele == nullptr)
+		return false;
+
+	// Replace its contents.  This only invalidates the layout of the
+	// element and its ancestors, so the next draw or measure reuses
+	// the saved layout of everything else in the document.
+	layout->doc->set_element_text(ele, txt.c_str());
+	return true;
+}
+
 
 // -----------------------------------------------------------------------
 
@@ -8542,8 +8782,11 @@ void PlayfieldView::ProcessKeyQueue()
 		// a script in the first place.
 		if (key.scripted || FireCommandButtonEvent(key))
 		{
-			// process the command
+			// process the command, noting the input event time for
+			// any button sounds it plays
+			curKeyEventTicks = key.eventTicks;
 			(this->*key.cmd->func)(key);
+			curKeyEventTicks = 0;
 		}
 
 		// this counts as a key event for attract mode idle purposes
@@ -8561,11 +8804,16 @@ bool PlayfieldView::IsGameValid(const GameListItem *game)
 
 void PlayfieldView::OnGameListRebuild()
 {
+	// reload the button sounds, in case the media folders changed
+	PreloadButtonSounds();
+
 	UpdateSelection(true);
 }
 
 void PlayfieldView::UpdateSelection(bool fireEvents)
 {
+	PROFILE_ZONE("PlayfieldView::UpdateSelection");
+
 	// Get the current selection
 	GameListItem *curGame = GameList::Get()->GetNthGame(0);
 
@@ -8598,6 +8846,8 @@ void PlayfieldView::UpdateSelection(bool fireEvents)
 
 void PlayfieldView::LoadIncomingPlayfieldMedia(GameListItem *game)
 {
+	PROFILE_ZONE("PlayfieldView::LoadIncomingPlayfieldMedia");
+
 	// Send a MediaSyncBegin event
 	FireMediaSyncBeginEvent(this, game);
 
@@ -9688,6 +9938,8 @@ void PlayfieldView::SetWheelImagePos(Sprite *image, int n, float progress)
 
 void PlayfieldView::SwitchToGame(int n, bool fast, bool byUserCommand, bool fireEvent)
 {
+	PROFILE_ZONE("PlayfieldView::SwitchToGame");
+
 	// ignore switches to the same game
 	if (n == 0)
 		return;
@@ -9837,6 +10089,8 @@ void PlayfieldView::SwitchToGame(int n, bool fast, bool byUserCommand, bool fire
 // Start a wheel animation
 void PlayfieldView::StartWheelAnimation(bool fast)
 {
+	PROFILE_ZONE("PlayfieldView::StartWheelAnimation");
+
 	// if an info box is showing, hide it
 	HideInfoBox();
 
@@ -10524,6 +10778,14 @@ bool PlayfieldView::OnUserMessage(UINT msg, WPARAM wParam, LPARAM lParam)
 		OnCaptureDone(reinterpret_cast<const CaptureDoneReport*>(wParam));
 		return true;
 
+	case PFVMsgCaptureEncodeDone:
+		// background encoding done report; we take ownership of the report
+		{
+			std::unique_ptr<CaptureEncoderQueue::Report> report(reinterpret_cast<CaptureEncoderQueue::Report*>(lParam));
+			OnCaptureEncodeDone(report.get());
+		}
+		return true;
+
 	case PFVMsgGameLaunchError:
 		// game launch failed
 		{
@@ -11733,6 +11995,8 @@ void PlayfieldView::UpdatePopupAnimation(bool opening, float progress)
 
 void PlayfieldView::SyncPlayfield(SyncPlayfieldMode mode)
 {
+	PROFILE_ZONE("PlayfieldView::SyncPlayfield");
+
 	// if an animation is in progress, or a startup video is in progress,
 	// or if there's anything in the key command queue, defer this until later
 	if (isAnimTimerRunning
@@ -11993,6 +12257,8 @@ void PlayfieldView::StartAnimTimer()
 
 void PlayfieldView::UpdateInfoBox()
 {
+	PROFILE_ZONE("PlayfieldView::UpdateInfoBox");
+
 	// start the timer to check for an update
 	SetTimer(hWnd, infoBoxSyncTimerID, 250, 0);
 
@@ -12612,6 +12878,8 @@ void PlayfieldView::UpdateAudioFadeout()
 // Update the animation
 void PlayfieldView::UpdateAnimation()
 {
+	PROFILE_ZONE("PlayfieldView::UpdateAnimation");
+
 	// presume no sprite update will be needed
 	bool updateDrawingList = false;
 
@@ -12951,6 +13219,9 @@ void PlayfieldView::UpdateMenu(HMENU hMenu, BaseWin *fromWin)
 
 bool PlayfieldView::OnRawInputEvent(UINT rawInputCode, RAWINPUT *raw, DWORD dwSize)
 {
+	// note the event time, for latency measurements
+	int64_t eventTicks = GetInputEventTicks();
+
 	// If this is a keyboard event, translate the virtual key and
 	// keep track of shift key changes.
 	USHORT vkey = 0;
@@ -13079,7 +13350,7 @@ bool PlayfieldView::OnRawInputEvent(UINT rawInputCode, RAWINPUT *raw, DWORD dwSi
 				{
 					// process the key press
 					InputManager::Button button(InputManager::Button::DevType::TypeKB, 0, vkey);
-					ProcessKeyPress(hWnd, button, keyType, rawInputRepeat.repeatCount, true, false, it->second);
+					ProcessKeyPress(hWnd, button, keyType, rawInputRepeat.repeatCount, true, false, it->second, eventTicks);
 				}
 			}
 		}
@@ -13102,6 +13373,7 @@ bool PlayfieldView::OnJoystickButtonChange(
 {
 	// note the time of the event
 	lastInputEventTime = GetTickCount64();
+	int64_t eventTicks = GetInputEventTicks();
 
 	// figure the key press mode
 	KeyPressType mode = pressed ? (foreground ? KeyPressType::KeyDown : KeyPressType::KeyBgDown) : KeyPressType::KeyUp;
@@ -13115,7 +13387,7 @@ bool PlayfieldView::OnJoystickButtonChange(
 	{
 		// process the key press
 		InputManager::Button physButton(InputManager::Button::DevType::TypeJS, js->logjs->index, button);
-		ProcessKeyPress(hWnd, physButton, mode, 0, !foreground, false, it->second);
+		ProcessKeyPress(hWnd, physButton, mode, 0, !foreground, false, it->second, eventTicks);
 
 		// if it's a key-press event, start auto-repeat; otherwise cancel
 		// any existing auto-repeat
@@ -13415,6 +13687,17 @@ void PlayfieldView::JsSetWheelAutoRepeatRate(int ms)
 	}
 }
 
+JsValueRef PlayfieldView::JsSaveProfileTrace(WSTRING filename)
+{
+	// Save to the given file, or to a time-stamped file in the program
+	// folder if no name was given.  Return the name of the file saved,
+	// or null if the profiler isn't enabled in this build or the file
+	// couldn't be written.
+	TSTRING saved = WSTRINGToTSTRING(filename);
+	bool ok = saved.length() != 0 ? Profiler::SaveTrace(saved.c_str()) : Profiler::SaveTrace(saved);
+	return ok ? JavascriptEngine::NativeToJs(saved) : JavascriptEngine::Get()->GetNullVal();
+}
+
 void PlayfieldView::StopAutoRepeat()
 {
 	// stop joystick auto-repeat
@@ -13538,6 +13821,10 @@ void PlayfieldView::OnConfigChange()
 	infoBoxDetailFont.ParseConfig(ConfigVars::InfoBoxDetailFont, defaultFontFamily.c_str());
 	launchStatusFont.ParseConfig(ConfigVars::LaunchStatusFont, defaultFontFamily.c_str());
 
+	// discard any glyph atlases built for the old font settings
+	if (textDraw != nullptr)
+		textDraw->ClearAtlasFonts();
+
 	// load the font color settings
 	menuTextColor = cfg->GetColor(ConfigVars::MenuTextColor, RGB(0xff, 0xff, 0xff));
 	menuBackgroundColor = cfg->GetColor(ConfigVars::MenuBackgroundColor, RGB(0x00, 0x00, 0x00));
@@ -14525,17 +14812,64 @@ void PlayfieldView::PlayButtonSound(const TCHAR *effectName, float volume)
 {
 	if (!muteButtons)
 	{
-		// look up the effect file
-		TCHAR path[MAX_PATH];
-		if (auto gl = GameList::Get(); gl != nullptr && gl->FindGlobalWaveFile(path, _T("Button Sounds"), effectName))
+		// Use the input event time for latency measurements if we're
+		// executing a command from a key or joystick button press;
+		// otherwise use the current time.
+		AudioManager *am = AudioManager::Get();
+		int64_t eventTicks = curKeyEventTicks != 0 ? curKeyEventTicks : am->GetEventTicks();
+
+		// combine the caller's volume level and the global button volume setting
+		volume = volume * buttonVolume / 100;
+
+		// If the sound isn't already in the pool, load it.  This normally
+		// only happens for sounds outside of the standard set that we
+		// preload, such as custom sounds played from Javascript.  Skip
+		// sounds that we've already failed to load.
+		if (!am->IsPooledSoundLoaded(effectName))
 		{
-			// play back the file, combining the caller's volume level and the global
-			// button volume setting
-			AudioManager::Get()->PlayFile(path, volume*buttonVolume / 100);
+			if (missingButtonSounds.find(effectName) != missingButtonSounds.end()
+				|| !LoadButtonSound(effectName))
+				return;
 		}
+
+		// play it through the voice pool
+		am->PlayPooledSound(effectName, volume, eventTicks);
 	}
 }
 
+bool PlayfieldView::LoadButtonSound(const TCHAR *effectName)
+{
+	// look up the effect file, and load it into the audio manager's pool
+	TCHAR path[MAX_PATH];
+	if (GameList::Get() != nullptr
+		&& GameList::Get()->FindGlobalWaveFile(path, _T("Button Sounds"), effectName)
+		&& AudioManager::Get()->LoadPooledSound(effectName, path))
+		return true;
+
+	// note the failure, so that we don't keep retrying it
+	missingButtonSounds.emplace(effectName);
+	return false;
+}
+
+void PlayfieldView::PreloadButtonSounds()
+{
+	// Clear any sounds loaded previously, along with the list of
+	// sounds we couldn't find, since the media folder locations might
+	// have changed
+	AudioManager::Get()->ClearPooledSounds();
+	missingButtonSounds.clear();
+
+	// Load the standard button sound set.  These are played on every
+	// wheel step and key repeat, so we want them decoded and ready to
+	// go before the first key press.
+	static const TCHAR *const names[] = {
+		_T("Next"), _T("Prev"), _T("Select"), _T("Deselect"),
+		_T("Launch"), _T("AddCredit"), _T("CoinIn")
+	};
+	for (auto name : names)
+		LoadButtonSound(name);
+}
+
 void PlayfieldView::PlayButtonSoundRpt(const TCHAR *effectName, int repeatCount, float volume)
 {
 	// If the "mute auto repeat button sounds" option is in effect, 
@@ -16643,22 +16977,39 @@ void PlayfieldView::EditGameInfo()
 				// the time to fill in the field properly, it's a much more
 				// reliable way to identify the game than a fuzzy filename
 				// match.
-				VPFileReader vpr;
-				if (tstriEndsWith(gamePath, _T(".vpt")) || tstriEndsWith(gamePath, _T(".vpx")))
+				//
+				// Check the table metadata cache first.  If the background
+				// scan has already read the file, this saves us from reopening
+				// it.  If not, the lookup moves the file to the front of the
+				// scan queue, and we read just the metadata here, skipping the
+				// table script, which can take much longer to read in full.
+				TableMetadataCache::Entry md;
+				TSTRING tableName;
+				if (TableMetadataCache::IsTableFile(gamePath))
 				{
-					// read the VP file
-					if (SUCCEEDED(vpr.Read(gamePath, false)))
+					auto tmc = Application::Get()->GetTableMetadataCache();
+					if (tmc != nullptr && tmc->Get(gamePath, md))
 					{
-						// We successfully loaded the file.  If there's a "Table
-						// Name" field in the metadata, use that as the name to
-						// match.  Not all table authors bother to fill in the
-						// metadata, so this might be missing even if we were
-						// able to read the file.
-						if (vpr.tableName != nullptr)
-						{
-							nameToMatch = vpr.tableName.get();
-							isFilename = false;
-						}
+						// cache hit
+						if (md.ok)
+							tableName = md.tableName;
+					}
+					else
+					{
+						// read the VP file metadata
+						VPFileReader vpr;
+						if (SUCCEEDED(vpr.Read(gamePath, false)) && vpr.tableName != nullptr)
+							tableName = vpr.tableName.get();
+					}
+
+					// If there's a "Table Name" field in the metadata, use that
+					// as the name to match.  Not all table authors bother to fill
+					// in the metadata, so this might be missing even if we were
+					// able to read the file.
+					if (tableName.length() != 0)
+					{
+						nameToMatch = tableName.c_str();
+						isFilename = false;
 					}
 				}
 
@@ -18196,8 +18547,23 @@ int PlayfieldView::EstimateCaptureTime(GameListItem *game)
 	// account for the overhead of launching ffmpeg.
 	auto config = ConfigManager::GetInstance();
 	bool twoPass = config->GetInt(ConfigVars::CaptureTwoPassEncoding, false);
+	bool backgroundEncode = captureMenuMode != CaptureMenuMode::Single
+		&& config->GetBool(ConfigVars::CaptureBatchBackgroundEncoding, true);
 	const int imageTime = 2;
 	const int defaultVideoTime = 30;
+
+	// In combined capture mode, timed videos are captured concurrently,
+	// so they only take as long as the longest one.  Keep track of the
+	// total and maximum time of the eligible items, so that we can
+	// replace the one with the other at the end.  (This must agree with
+	// the rules in the capture code about which items can be combined.)
+	bool combined = config->GetBool(ConfigVars::CaptureCombinedVideo, false)
+		&& config->Get(ConfigVars::CaptureCustomVideoSource, _T(""))[0] == 0
+		&& config->Get(ConfigVars::CaptureCustomVideoCodec, _T(""))[0] == 0
+		&& config->Get(ConfigVars::CaptureCustomAudioSource, _T(""))[0] == 0
+		&& config->Get(ConfigVars::CaptureCustomGlobalOptions, _T(""))[0] == 0;
+	int nCombined = 0, combinedSum = 0, combinedMax = 0;
+
 	for (auto &cap : captureList)
 	{
 		// If a game was specified, and we're in batch capture mode, check
@@ -18233,6 +18599,16 @@ int PlayfieldView::EstimateCaptureTime(GameListItem *game)
 				int videoTime = config->GetInt(cfgvar, defaultVideoTime);
 				timeEst += videoTime;
 
+				// note it for combined capture if it's a timed video
+				auto IsManual = [config](const TCHAR *var) { return var != nullptr && _tcsicmp(config->Get(var, _T("auto")), _T("manual")) == 0; };
+				if (combined && cap.mediaType.IsVideo()
+					&& !IsManual(cap.mediaType.captureStartConfigVar) && !IsManual(cap.mediaType.captureStopConfigVar))
+				{
+					++nCombined;
+					combinedSum += videoTime;
+					combinedMax = max(combinedMax, videoTime);
+				}
+
 				// If we're using two-pass encoding, add time for the second
 				// pass.  Use a factor of 1.5 of the video running time as a
 				// wild guess.  The actual time depends on the hardware, but 
@@ -18245,7 +18621,11 @@ int PlayfieldView::EstimateCaptureTime(GameListItem *game)
 				// any of the common pinball software, so probably isn't
 				// running PinballY).  So we'll take the middle of that
 				// band (1x to 2x) as our estimate.
-				if (twoPass)
+				//
+				// In a batch capture with background encoding, the second
+				// pass overlaps with the next game, so it doesn't add to
+				// the time.
+				if (twoPass && !backgroundEncode)
 					timeEst += videoTime * 3 / 2;
 			}
 			else
@@ -18263,6 +18643,10 @@ int PlayfieldView::EstimateCaptureTime(GameListItem *game)
 		}
 	}
 
+	// apply the combined capture overlap
+	if (nCombined >= 2)
+		timeEst -= combinedSum - combinedMax;
+
 	// If the time estimate is non-zero, add a few seconds for the game
 	// launch.  Don't do this if the estimate is exactly zero, as it means
 	// that nothing is selected, so we can skip the entire capture process
@@ -18455,6 +18839,7 @@ void PlayfieldView::OnCaptureDone(const CaptureDoneReport *report)
 		if (report->ok)	batchCaptureMode.nGamesOk += 1;
 		batchCaptureMode.nMediaItemsAttempted += report->nMediaItemsAttempted;
 		batchCaptureMode.nMediaItemsOk += report->nMediaItemsOk;
+		batchCaptureMode.nEncodesPending += report->nEncodesQueued;
 	}
 	else
 	{
@@ -18464,6 +18849,44 @@ void PlayfieldView::OnCaptureDone(const CaptureDoneReport *report)
 	}
 }
 
+void PlayfieldView::OnCaptureEncodeDone(const CaptureEncoderQueue::Report *report)
+{
+	// Note if the job belongs to the current batch.  Jobs left over from
+	// an earlier capture weren't counted in this batch's totals.
+	bool inBatch = batchCaptureMode.active && report->job->tQueued >= batchCaptureMode.tStart;
+	if (inBatch)
+		batchCaptureMode.nEncodesPending -= 1;
+
+	// The monitor thread counted the item as successful when it queued
+	// the encoding job, so we only have to adjust the books on failure.
+	if (!report->ok)
+	{
+		// the game still needs capturing, so put back its capture mark
+		if (auto game = GameList::Get()->GetByInternalID(report->job->gameId); game != nullptr)
+			GameList::Get()->MarkForCapture(game, true);
+
+		// update the batch statistics
+		if (inBatch)
+		{
+			// take back the media item success
+			batchCaptureMode.nMediaItemsOk -= 1;
+
+			// If this is the first failure for this game, take back the
+			// game success.  (If the capture itself had failed for some
+			// other item, the game wasn't counted as a success in the first
+			// place, but we can't tell that from here, so just keep the
+			// count from going below zero.)
+			if (batchCaptureMode.gamesEncodeFailed.emplace(report->job->gameId).second && batchCaptureMode.nGamesOk > 0)
+				batchCaptureMode.nGamesOk -= 1;
+		}
+	}
+
+	// if we're waiting for the encoder to drain at the end of the batch,
+	// and that was the last job, wrap up the batch
+	if (batchCaptureMode.active && batchCaptureMode.awaitingEncoder && batchCaptureMode.nEncodesPending <= 0)
+		ExitBatchCapture();
+}
+
 void PlayfieldView::ShowMediaSearchMenu()
 {
 	// The game has to be configured before we can add media items
@@ -19770,9 +20193,32 @@ void PlayfieldView::BatchCaptureNextGame()
 	// if we haven't canceled the whole operation, and the application
 	// still has more queued games, launch the next one
 	if (!batchCaptureMode.cancel && Application::Get()->IsGameQueuedForLaunch())
+	{
 		LaunchQueuedGame();
-	else
-		ExitBatchCapture();
+		return;
+	}
+
+	// If the background encoder is still working on items from the batch,
+	// wait for it to finish before showing the results.  If the batch was
+	// canceled, discard any items that haven't started encoding yet.
+	if (auto q = Application::Get()->GetCaptureEncoderQueue(); q != nullptr)
+	{
+		if (batchCaptureMode.cancel)
+			q->CancelPending();
+
+		if (batchCaptureMode.nEncodesPending > 0)
+		{
+			batchCaptureMode.awaitingEncoder = true;
+			ShowError(ErrorIconType::EIT_Information, MsgFmt(IDS_BATCH_CAPTURE_ENCODING, batchCaptureMode.nEncodesPending));
+			LogFile::Get()->Write(LogFile::CaptureLogging,
+				_T("Batch capture: all games done; waiting for %d background encoding job(s) to finish\n"),
+				batchCaptureMode.nEncodesPending);
+			return;
+		}
+	}
+
+	// the batch is finished
+	ExitBatchCapture();
 }
 
 void PlayfieldView::EnterBatchCapture()
@@ -19780,6 +20226,10 @@ void PlayfieldView::EnterBatchCapture()
 	// note that we're in batch capture mode
 	batchCaptureMode.Enter();
 
+	// reset the background encoder statistics for the new batch
+	if (auto q = Application::Get()->GetCaptureEncoderQueue(); q != nullptr)
+		q->ResetStats();
+
 	// temporarily enable capture logging
 	auto lf = LogFile::Get();
 	lf->EnableTempFeature(LogFile::CaptureLogging);
@@ -19863,6 +20313,16 @@ void PlayfieldView::ExitBatchCapture()
 	lf->Write(_T("  Games succeeded: %d\n"), batchCaptureMode.nGamesOk);
 	lf->Write(_T("  Media items attempted: %d\n"), batchCaptureMode.nMediaItemsAttempted);
 	lf->Write(_T("  Media items succeeded: %d\n"), batchCaptureMode.nMediaItemsOk);
+	if (auto q = Application::Get()->GetCaptureEncoderQueue(); q != nullptr)
+	{
+		if (auto s = q->GetStatus(); s.nDone != 0)
+		{
+			lf->Write(_T("  Background encoding jobs succeeded: %d of %d\n"), s.nOk, s.nDone);
+			lf->Write(_T("  Background encoding throughput: %.1fs of video in %.1fs of encoder time (%.2fx real time)\n"),
+				s.mediaTime, s.encodeTime, s.Speed());
+		}
+	}
+	lf->Write(_T("  Total batch time: %.1f minutes\n"), static_cast<double>(GetTickCount64() - batchCaptureMode.tStart) / 60000.0);
 	lf->Group();
 
 	// turn off the temporary capture logging override
@@ -20611,33 +21071,59 @@ void PlayfieldView::StatusItem::Update(PlayfieldView *pfv, StatusLine *sl, float
 	// store the new expanded text
 	dispText = newDispText;
 
-	// create the new sprite
-	sprite.Attach(new Sprite());
+	// Create the new sprite.  If the status font is available as a glyph
+	// atlas font, draw through a text sprite, which only has to build a
+	// small vertex buffer for the new text.  Otherwise, fall back on
+	// rendering the text into a new texture through GDI+.
 	const int width = 1080, height = 75;
 	Application::InUiErrorHandler eh;
-	sprite->Load(width, height, [this, pfv, width, height](HDC hdc, HBITMAP)
+	LogFileErrorHandler fontErr(_T("Status line glyph atlas: "));
+	if (TextDrawFont *font = pfv->textDraw->GetFont(pfv->statusFont, fontErr); font != nullptr)
+	{
+		// set up the text sprite
+		TextSprite *ts = new TextSprite();
+		sprite.Attach(ts);
+		ts->SetSize(width, height);
+
+		// measure the text and center it
+		POINTF size = font->MeasureText(dispText.c_str());
+		float tx = (float(width) - size.x) / 2.0f;
+		float ty = (float(height) - font->GetLineHeight()) / 2.0f;
+
+		// add the shadow, then the text over it
+		auto Color = [](COLORREF c) {
+			return XMFLOAT4(GetRValue(c) / 255.0f, GetGValue(c) / 255.0f, GetBValue(c) / 255.0f, 1.0f);
+		};
+		ts->AddText(dispText.c_str(), font, Color(pfv->statusLineShadowColor), tx + 2, ty + 2);
+		ts->AddText(dispText.c_str(), font, Color(pfv->statusLineTextColor), tx, ty);
+	}
+	else
 	{
-		// set up a drawing context
-		Gdiplus::Graphics g(hdc);
+		sprite.Attach(new Sprite());
+		sprite->Load(width, height, [this, pfv, width, height](HDC hdc, HBITMAP)
+		{
+			// set up a drawing context
+			Gdiplus::Graphics g(hdc);
 
-		// measure the text
-		Gdiplus::RectF bbox;
-		FontPref &font = pfv->statusFont;
-		g.MeasureString(dispText.c_str(), -1, font, Gdiplus::PointF(0, 0), &bbox);
+			// measure the text
+			Gdiplus::RectF bbox;
+			FontPref &font = pfv->statusFont;
+			g.MeasureString(dispText.c_str(), -1, font, Gdiplus::PointF(0, 0), &bbox);
 
-		// center it
-		float x = (float(width) - bbox.Width) / 2.0f;
-		float y = (float(height) - bbox.Height) / 2.0f;
+			// center it
+			float x = (float(width) - bbox.Width) / 2.0f;
+			float y = (float(height) - bbox.Height) / 2.0f;
 
-		// draw it centered
-		Gdiplus::SolidBrush txt(GPColorFromCOLORREF(pfv->statusLineTextColor));
-		Gdiplus::SolidBrush shadow(GPColorFromCOLORREF(pfv->statusLineShadowColor));
-		g.DrawString(dispText.c_str(), -1, font, Gdiplus::PointF(x+2, y+2), &shadow);
-		g.DrawString(dispText.c_str(), -1, font, Gdiplus::PointF(x, y), &txt);
+			// draw it centered
+			Gdiplus::SolidBrush txt(GPColorFromCOLORREF(pfv->statusLineTextColor));
+			Gdiplus::SolidBrush shadow(GPColorFromCOLORREF(pfv->statusLineShadowColor));
+			g.DrawString(dispText.c_str(), -1, font, Gdiplus::PointF(x+2, y+2), &shadow);
+			g.DrawString(dispText.c_str(), -1, font, Gdiplus::PointF(x, y), &txt);
 
-		// flush the drawing context to the bitmap
-		g.Flush();
-	}, eh, _T("Status Message"));
+			// flush the drawing context to the bitmap
+			g.Flush();
+		}, eh, _T("Status Message"));
+	}
 
 	// set it up in the proper location
 	sprite->offset.y = -0.5f + float(height/2)/1920.f + y;
@@ -28,6 +28,7 @@
 #include "JavascriptEngine.h"
 #include "FontPref.h"
 #include "Capture.h"
+#include "CaptureEncoderQueue.h"
 
 class Sprite;
 class TextureShader;
@@ -37,6 +38,7 @@ class MediaDropTarget;
 class RealDMD;
 class FrameWin;
 class LitehtmlHost;
+class TextRasterCache;
 
 
 // Playfield view
@@ -305,14 +307,15 @@ public:
 	{
 		CaptureDoneReport(LONG gameInternalID, bool ok, bool cancel,
 			int overallStatusMsgId, CapturingErrorHandler &statusList,
-			int nMediaItemsAttempted, int nMediaItemsOk) :
+			int nMediaItemsAttempted, int nMediaItemsOk, int nEncodesQueued) :
 			gameId(gameInternalID), 
 			ok(ok),
 			cancel(cancel),
 			overallStatusMsgId(overallStatusMsgId),
 			statusList(statusList),
 			nMediaItemsAttempted(nMediaItemsAttempted),
-			nMediaItemsOk(nMediaItemsOk)
+			nMediaItemsOk(nMediaItemsOk),
+			nEncodesQueued(nEncodesQueued)
 		{ }
 
 		// internal ID of the game we're capturing
@@ -333,6 +336,9 @@ public:
 		// number of media items attempted/succeeded during this operation
 		int nMediaItemsAttempted;
 		int nMediaItemsOk;
+
+		// number of items handed off to the background encoder queue
+		int nEncodesQueued;
 	};
 
 	// Get the string resource ID for the name of the Manual Go button
@@ -465,6 +471,9 @@ protected:
 	// Scale sprites that vary by window size
 	virtual void ScaleSprites() override;
 
+	// add the HTML layout statistics to the frame counter display
+	virtual void AddFrameCounterText(float x, float &y, float lineHeight, const DirectX::XMFLOAT4 &color) override;
+
 	// idle event handler
 	virtual void OnIdleEvent() override;
 
@@ -865,6 +874,9 @@ protected:
 	// process a capture done report from the launch thread
 	void OnCaptureDone(const CaptureDoneReport *report);
 
+	// background encoding completion handler, for PFVMsgCaptureEncodeDone
+	void OnCaptureEncodeDone(const CaptureEncoderQueue::Report *report);
+
 	// Media capture list.  This represents the items selected for
 	// screen-shot capture in the menu UI.
 	struct CaptureItem
@@ -1190,6 +1202,10 @@ protected:
 			nMediaItemsAttempted = 0;
 			nMediaItemsOk = 0;
 			cancelPending = cancel = false;
+			awaitingEncoder = false;
+			nEncodesPending = 0;
+			gamesEncodeFailed.clear();
+			tStart = GetTickCount64();
 		}
 
 		void Exit()
@@ -1216,6 +1232,26 @@ protected:
 		int nMediaItemsPlanned;
 		int nMediaItemsAttempted;
 		int nMediaItemsOk;
+
+		// We've launched all of the games, and we're waiting for the
+		// background encoder queue to finish the last items
+		bool awaitingEncoder;
+
+		// Number of background encoding jobs queued during this batch
+		// that we haven't yet received completion reports for.  We keep
+		// our own count rather than asking the queue whether it's idle,
+		// since the queue's running count drops before the completion
+		// report is delivered, so with several encoders running, the
+		// queue can look idle while a failure report is still on the
+		// way.  This can go negative briefly, since a short job can
+		// finish before the capture report that counts it arrives.
+		int nEncodesPending;
+
+		// games with one or more failed background encodes
+		std::unordered_set<LONG> gamesEncodeFailed;
+
+		// batch start time (GetTickCount64 time)
+		ULONGLONG tStart;
 		
 	} batchCaptureMode;
 
@@ -2249,6 +2285,18 @@ protected:
 	// Play a button or event sound effect
 	void PlayButtonSound(const TCHAR *effectName, float volume = 1.0f);
 
+	// Load a button sound into the audio manager's voice pool
+	bool LoadButtonSound(const TCHAR *effectName);
+
+	// Button sounds that we couldn't find or load.  We remember these so
+	// that we don't search the media folders (and log the failure) again
+	// on every button press.  This is cleared when we reload the button
+	// sounds, since the media folder locations might have changed.
+	std::unordered_set<TSTRING> missingButtonSounds;
+
+	// Preload the standard button sound set into the voice pool
+	void PreloadButtonSounds();
+
 	// Play a button or event sound effect, respecting the auto-repeat-mute
 	// option if this is a repeated key.
 	void PlayButtonSoundRpt(const TCHAR *effectName, int repeatCount, float volume = 1.0f);
@@ -2652,9 +2700,10 @@ protected:
 			hWndSrc(NULL), physButton(InputManager::Button::DevType::TypeNone, 0, 0), 
 			mode(KeyPressType::KeyUp), cmd(&NoCommand), scripted(false) { }
 
-		QueuedKey(HWND hWndSrc, InputManager::Button physButton, KeyPressType mode, int repeatCount, bool bg, bool scripted, const KeyCommand *cmd)
+		QueuedKey(HWND hWndSrc, InputManager::Button physButton, KeyPressType mode, int repeatCount, bool bg, bool scripted, const KeyCommand *cmd,
+			int64_t eventTicks = 0)
 			: hWndSrc(hWndSrc), physButton(physButton), mode(mode), repeatCount(repeatCount),
-			bg(bg), cmd(cmd), scripted(scripted) { }
+			bg(bg), cmd(cmd), scripted(scripted), eventTicks(eventTicks) { }
 
 		HWND hWndSrc;           // source window
 		InputManager::Button physButton;	// physical button that initiated the event (keyboard or joystick; None for scripted events)
@@ -2663,13 +2712,25 @@ protected:
 		bool bg;                // background mode
 		bool scripted;          // originated from a script
 		const KeyCommand *cmd;  // command
+		int64_t eventTicks = 0; // HiResTimer time of the input event, for latency measurements
 	};
 	std::list<QueuedKey> keyQueue;
 
-	// Add a key press to the queue and process it
+	// HiResTimer time of the input event for the command currently
+	// being executed from the key queue, or 0 if we're not executing
+	// a queued command.  PlayButtonSound() uses this as the event
+	// time for the sound, so that the latency measurement covers the
+	// whole path from the physical input to the audio output.
+	int64_t curKeyEventTicks = 0;
+
+	// Get the current HiResTimer time, for stamping input events
+	static int64_t GetInputEventTicks();
+
+	// Add a key press to the queue and process it.  'eventTicks' is
+	// the HiResTimer time of the input event; 0 means the current time.
 	void ProcessKeyPress(
 		HWND hwndSrc, InputManager::Button physicalButton, KeyPressType mode, int repeatCount,
-		bool bg, bool scripted, std::list<const KeyCommand*> cmds);
+		bool bg, bool scripted, std::list<const KeyCommand*> cmds, int64_t eventTicks = 0);
 
 	// Process the key queue.  On a keyboard event, we add the key
 	// to the queue and call this routine; we also call it whenever
@@ -3157,6 +3218,9 @@ protected:
 	// set the wheel auto-repeat rate
 	void JsSetWheelAutoRepeatRate(int ms);
 
+	// save a profiler trace file
+	JsValueRef JsSaveProfileTrace(WSTRING filename);
+
 	// Insert a menu command into the main window's context menu for a new custom window
 	void AddShowWindowCmdForCustomWindow(int serial);
 
@@ -3247,6 +3311,11 @@ protected:
 	};
 	std::unique_ptr<JsDrawingContext> jsDC;
 
+	// Raster cache for text drawn through the drawing context and
+	// StyledText objects.  Created on first use.
+	std::unique_ptr<TextRasterCache> textRasterCache;
+	TextRasterCache *GetTextRasterCache();
+
 	// Javascript StyledText objects
 	JsValueRef jsStyledTextProto;
 	static JsValueRef CALLBACK JsStyledTextConstructor(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx);
@@ -3259,6 +3328,8 @@ protected:
 	static JsValueRef CALLBACK JsHtmlLayoutConstructor(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx);
 	void JsHtmlLayoutDraw(JsValueRef self, JsValueRef jsdc, JavascriptEngine::JsObj rcLayout, JavascriptEngine::JsObj rcClip);
 	JsValueRef JsHtmlLayoutMeasure(JsValueRef self, int width);
+	void JsHtmlLayoutSetContent(JsValueRef self, WSTRING txt);
+	bool JsHtmlLayoutSetText(JsValueRef self, WSTRING selector, WSTRING txt);
 
 	// litehtml host interface
 	std::shared_ptr<LitehtmlHost> litehtmlHost;
@@ -3325,6 +3396,7 @@ protected:
 	JsValueRef JsResolveGameFile(JsValueRef self);
 	JsValueRef JsResolveGameMediaFile(JsValueRef self, WSTRING type, bool mustExist);
 	JsValueRef JsResolveROM(JsValueRef self);
+	JsValueRef JsGetTableMetadata(JsValueRef self);
 
 	// Javascript GameCategory access
 	JsValueRef JsGetAllCategories();
@@ -57,6 +57,7 @@ const UINT PFVMsgJsDebugMessage = WM_USER + 212;    // Javascript debug request
 const UINT PFVMsgTakeFocusPostLaunch = WM_USER + 213; // take focus after game launch exits
 const UINT PFVMsgAdminExitGame = WM_USER + 214;     // Exit Game event from Admin Host
 const UINT PFVMsgPreCapture = WM_USER + 215;        // LPARAM = LONG_PTR(&PlayfieldView::PreCaptureReport)
+const UINT PFVMsgCaptureEncodeDone = WM_USER + 216; // LPARAM = LONG_PTR(new CaptureEncoderQueue::Report); recipient deletes
 
 
 // PFVShowMessage parameters struct
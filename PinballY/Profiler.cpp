@@ -0,0 +1,117 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Scoped-zone profiler
+
+#include "stdafx.h"
+#include "../Utilities/FileUtil.h"
+#include "Profiler.h"
+#include "LogFile.h"
+
+// statics
+HiResTimer Profiler::timer;
+std::list<std::unique_ptr<Profiler::ThreadBuffer>> Profiler::threadBuffers;
+CriticalSection Profiler::threadBufferLock;
+
+Profiler::ThreadBuffer *Profiler::GetThreadBuffer()
+{
+	// if this thread already has a buffer, use it
+	static thread_local ThreadBuffer *buffer = nullptr;
+	if (buffer != nullptr)
+		return buffer;
+
+	// create a buffer for the thread and add it to the global list
+	buffer = new ThreadBuffer();
+	CriticalSectionLocker locker(threadBufferLock);
+	threadBuffers.emplace_back(buffer);
+	return buffer;
+}
+
+void Profiler::Record(const char *name, int64_t start, int64_t end)
+{
+	// fill in the next slot, then publish it by advancing the count
+	ThreadBuffer *b = GetThreadBuffer();
+	Event &e = b->events[static_cast<size_t>(b->count % BufferSize)];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+	InterlockedIncrement64(&b->count);
+}
+
+bool Profiler::SaveTrace(TSTRING &filename)
+{
+	// build a time-stamped name in the program folder
+	SYSTEMTIME st;
+	GetLocalTime(&st);
+	TCHAR relName[MAX_PATH];
+	_stprintf_s(relName, _T("PinballY-trace-%04d%02d%02d-%02d%02d%02d.json"),
+		st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+
+	TCHAR path[MAX_PATH];
+	GetDeployedFilePath(path, relName, _T(""));
+	filename = path;
+
+	// save it
+	return SaveTrace(path);
+}
+
+bool Profiler::SaveTrace(const TCHAR *filename)
+{
+	// there's nothing to save if the profiler isn't compiled in
+	if (!IsEnabled())
+		return false;
+
+	// open the file
+	FILE *fp = nullptr;
+	if (int err = _tfopen_s(&fp, filename, _T("w")); err != 0 || fp == nullptr)
+	{
+		LogFile::Get()->Write(_T("Profiler: error %d opening trace file %s\n"), err, filename);
+		return false;
+	}
+
+	// Write the events from each thread.  Chrome trace timestamps are
+	// in microseconds; use the earliest event still buffered on any
+	// thread as the zero point, to keep the numbers readable.
+	CriticalSectionLocker locker(threadBufferLock);
+	int64_t t0 = INT64_MAX;
+	for (auto &b : threadBuffers)
+	{
+		LONG64 count = b->count;
+		LONG64 first = count > (LONG64)BufferSize ? count - (LONG64)BufferSize : 0;
+		for (LONG64 i = first; i < count; ++i)
+			t0 = (std::min)(t0, b->events[static_cast<size_t>(i % BufferSize)].start);
+	}
+
+	fputs("{\"traceEvents\":[\n", fp);
+	const char *sep = "";
+	UINT64 nEvents = 0;
+	DWORD pid = GetCurrentProcessId();
+	for (auto &b : threadBuffers)
+	{
+		// Write the complete ("X") event for each zone.  Zones nest by
+		// time, so the viewer reconstructs the call structure on its own.
+		LONG64 count = b->count;
+		LONG64 first = count > (LONG64)BufferSize ? count - (LONG64)BufferSize : 0;
+		for (LONG64 i = first; i < count; ++i)
+		{
+			const Event &e = b->events[static_cast<size_t>(i % BufferSize)];
+			fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%lu,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}",
+				sep, e.name, pid, b->tid, timer.TicksToUs(e.start - t0), timer.TicksToUs(e.end - e.start));
+			sep = ",\n";
+			++nEvents;
+		}
+	}
+	fputs("\n]}\n", fp);
+
+	// check for write errors
+	bool ok = !ferror(fp);
+	fclose(fp);
+
+	// log the result
+	if (ok)
+		LogFile::Get()->Write(_T("Profiler: saved %I64u events to %s\n"), nEvents, filename);
+	else
+		LogFile::Get()->Write(_T("Profiler: error writing trace file %s\n"), filename);
+
+	return ok;
+}
@@ -0,0 +1,112 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Scoped-zone profiler
+//
+// This is a lightweight instrumenting profiler for finding out where
+// the time goes on the UI thread during things like wheel navigation,
+// where a stutter could come from any of media lookup, sprite loading,
+// Javascript event handlers, filter refreshes, or rendering.  Code
+// marks interesting regions with PROFILE_ZONE("name") at the top of a
+// block; the zone records its start and end times, on the HiResTimer
+// clock, when the block exits.
+//
+// Each thread that records zones gets its own fixed-size ring buffer,
+// so recording never takes a lock or allocates memory after the first
+// zone on a thread, and the buffer always holds the most recent events.
+// SaveTrace() writes the buffered events in Chrome trace event format
+// (JSON), which can be loaded into chrome://tracing or Perfetto for a
+// timeline view.
+//
+// The profiler is compiled out entirely unless PINBALLY_PROFILE is
+// defined as non-zero in the build (add PINBALLY_PROFILE=1 to the
+// preprocessor definitions).  When it's disabled, PROFILE_ZONE()
+// expands to nothing, and SaveTrace() simply returns false.
+
+#pragma once
+#include "../Utilities/WinUtil.h"
+#include "HiResTimer.h"
+
+#ifndef PINBALLY_PROFILE
+#define PINBALLY_PROFILE 0
+#endif
+
+#if PINBALLY_PROFILE
+#define PROFILE_ZONE_CONCAT2(a, b) a##b
+#define PROFILE_ZONE_CONCAT(a, b) PROFILE_ZONE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) Profiler::Zone PROFILE_ZONE_CONCAT(profileZone_, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#endif
+
+class Profiler
+{
+public:
+	// is the profiler compiled in?
+	static constexpr bool IsEnabled() { return PINBALLY_PROFILE != 0; }
+
+	// Scoped zone.  The name must be a string literal (or otherwise
+	// have static storage duration), since we only store the pointer.
+	class Zone
+	{
+	public:
+		Zone(const char *name) : name(name), start(timer.GetTime_ticks()) { }
+		~Zone() { Record(name, start, timer.GetTime_ticks()); }
+
+	protected:
+		const char *name;
+		int64_t start;
+	};
+
+	// Save the buffered events to a file in Chrome trace event format.
+	// Returns true on success.  Logs any error.
+	static bool SaveTrace(const TCHAR *filename);
+
+	// Save the buffered events to a time-stamped file in the program
+	// folder, returning the name of the file in 'filename'.
+	static bool SaveTrace(TSTRING &filename);
+
+	// Record a completed zone on the current thread
+	static void Record(const char *name, int64_t start, int64_t end);
+
+	// ring buffer size per thread, in events
+	static const size_t BufferSize = 32768;
+
+protected:
+	// zone event
+	struct Event
+	{
+		const char *name;
+		int64_t start;
+		int64_t end;
+	};
+
+	// Per-thread ring buffer.  Only the owning thread writes to the
+	// buffer.  'count' is the total number of events ever recorded,
+	// so the next write goes at index count % BufferSize.  It's only
+	// advanced after the event is filled in, so that a reader on
+	// another thread sees complete events, although a reader can still
+	// race with a writer that wraps around while the buffer is being
+	// copied; that's acceptable for a diagnostic tool.
+	struct ThreadBuffer
+	{
+		ThreadBuffer() : tid(GetCurrentThreadId()), events(new Event[BufferSize]) { }
+
+		DWORD tid;
+		std::unique_ptr<Event[]> events;
+		volatile LONG64 count = 0;
+	};
+
+	// get the current thread's buffer, creating it on first use
+	static ThreadBuffer *GetThreadBuffer();
+
+	// List of all thread buffers.  The buffers are never deleted, so
+	// that the events from a thread are still available for export
+	// after the thread exits, and so that the recording side never has
+	// to worry about its buffer going away.
+	static std::list<std::unique_ptr<ThreadBuffer>> threadBuffers;
+	static CriticalSection threadBufferLock;
+
+	// clock
+	static HiResTimer timer;
+};
@@ -16,6 +16,7 @@
 #include "VPinMAMEIfc.h"
 #include "DMDView.h"
 #include "DMDFont.h"
+#include "DMDScaler.h"
 #include "LogFile.h"
 
 
@@ -47,6 +48,9 @@ namespace ConfigVars
 	static const TCHAR *MirrorHorz = _T("RealDMD.MirrorHorz");
 	static const TCHAR *MirrorVert = _T("RealDMD.MirrorVert");
 	static const TCHAR *Gamma = _T("RealDMD.GrayscaleGamma");
+	static const TCHAR *VideoFilter = _T("RealDMD.VideoFilter");
+	static const TCHAR *VideoScalerBenchmark = _T("RealDMD.VideoScalerBenchmark");
+	static const TCHAR *MaxFrameRate = _T("RealDMD.MaxFrameRate");
 }
 
 // -----------------------------------------------------------------------
@@ -76,6 +80,12 @@ const tPMoptions RealDMD::defaultOpts = {
 // native device size
 static const int dmdWidth = 128, dmdHeight = 32;
 
+// Maximum video frame scale factors, relative to the device size, that
+// we'll accept from the decoder at the video's native size.  See
+// ChooseVideoFrameSize().
+static const unsigned int MaxNativeVideoScale = 4;
+static const unsigned int MaxPixelStructureScale = 16;
+
 RealDMD::RealDMD() :
 	curGame(nullptr),
 	mirrorHorz(false),
@@ -114,6 +124,10 @@ void RealDMD::UpdateGamma()
 		l = min(l, 255);
 		gammaMap[i] = l;
 	}
+
+	// update the video scaler
+	CriticalSectionLocker scalerLocker(videoScalerLock);
+	videoScaler.SetGammaMap(gammaMap);
 }
 
 RealDMD::~RealDMD()
@@ -259,6 +273,16 @@ bool RealDMD::Init(ErrorHandler &eh)
 	mirrorHorz = cfg->GetBool(ConfigVars::MirrorHorz, false);
 	mirrorVert = cfg->GetBool(ConfigVars::MirrorVert, false);
 
+	// load the video scaling filter
+	{
+		CriticalSectionLocker scalerLocker(videoScalerLock);
+		videoFilter = DMDScaler::ParseFilter(cfg->Get(ConfigVars::VideoFilter, _T("auto")));
+	}
+
+	// run the video scaler benchmark, if desired
+	if (cfg->GetBool(ConfigVars::VideoScalerBenchmark, false))
+		DMDScaler::Benchmark(dmdWidth, dmdHeight);
+
 	// Send an initial empty frame.  This clears any leftover display
 	// cruft, and also forces the virtual DMD window to open if it's 
 	// going to open.  The virtual DMD can have side effects on the
@@ -268,6 +292,16 @@ bool RealDMD::Init(ErrorHandler &eh)
 	// worry about locking.
 	Render_16_Shades_(dmdWidth, dmdHeight, emptySlide->pix.get());
 
+	// Set up the writer frame rate limit.  We can do this without
+	// locking, since the writer thread isn't running yet.
+	int maxFrameRate = cfg->GetInt(ConfigVars::MaxFrameRate, 60);
+	minFrameTicks = maxFrameRate > 0 ?
+		static_cast<int64_t>(1.0 / (maxFrameRate * writerTimer.GetTickTime_sec())) : 0;
+	nextFrameTicks = 0;
+	lastFrameHashValid = false;
+	writerResync = true;
+	writerStats = WriterStats();
+
 	// launch the writer thread
 	DWORD tid;
 	writerThreadQuit = false;
@@ -650,6 +684,11 @@ void RealDMD::Shutdown()
 
 		// forget the thread handle
 		hWriterThread = nullptr;
+
+		// log the writer statistics
+		WriterStats stats = GetWriterStats();
+		Log(_T("Real DMD writer: %I64u frames submitted, %I64u sent, %I64u duplicates skipped, %I64u dropped\n"),
+			stats.submitted, stats.sent, stats.duplicates, stats.dropped);
 	}
 
 	// if the session wasn't already closed, blank the DMD before
@@ -685,6 +724,13 @@ void RealDMD::OpenSession()
 			sessionOpen = true;
 		}
 
+		// the device display state is unknown, so make sure the writer
+		// sends the next frame even if it matches the last one
+		{
+			CriticalSectionLocker locker(writeFrameLock);
+			writerResync = true;
+		}
+
 		// Set a dummy ROM initially.  dmd-extensions will crash in some
 		// cases if we make other calls before setting a game, since it
 		// assumes from the VPM usage pattern that a ROM is always set
@@ -1389,12 +1435,59 @@ void RealDMD::SendWriterFrame(Slide *slide)
 	// out of the slide show list before the write thread gets around
 	// to displaying it.
 	CriticalSectionLocker locker(writeFrameLock);
+	++writerStats.submitted;
+
+	// If the writer hasn't picked up the previous frame yet, this one
+	// replaces it.  We only keep the latest frame, since the display
+	// is a real-time view of the current state.
+	if (writerFrame != nullptr)
+		++writerStats.dropped;
+
 	writerFrame = slide;
 
 	// wake up the writer thread
 	SetEvent(hWriterEvent);
 }
 
+RealDMD::WriterStats RealDMD::GetWriterStats()
+{
+	CriticalSectionLocker locker(writeFrameLock);
+	return writerStats;
+}
+
+UINT64 RealDMD::HashFrame(const Slide *frame)
+{
+	// Figure the pixel buffer size.  The buffer sizes are always
+	// multiples of 8 bytes, since the device height is.
+	bool rgb = frame->colorSpace == DMD_COLOR_RGB;
+	size_t len = dmdWidth * dmdHeight * (rgb ? 3 : 1);
+	const BYTE *p = frame->pix.get();
+
+	// Hash the buffer 64 bits at a time, FNV-1a style, with an extra
+	// fold of the high half into the low half on each step so that
+	// changes anywhere in a word propagate through the later steps.
+	// Start with the color space, so that the same bytes in different
+	// formats hash differently.
+	UINT64 h = 14695981039346656037ULL ^ static_cast<UINT64>(frame->colorSpace);
+	for (size_t i = 0; i < len; i += 8)
+	{
+		UINT64 w;
+		memcpy(&w, p + i, 8);
+
+		// For RGB frames, ignore the low bit of the blue component of
+		// the first pixel.  That's the bit that the dmd-extensions #176
+		// workaround in the writer thread toggles on each send, so it
+		// doesn't reflect a change in the image.
+		if (i == 0 && rgb)
+			w &= ~(1ULL << 16);
+
+		h = (h ^ w) * 1099511628211ULL;
+		h ^= h >> 32;
+	}
+
+	return h;
+}
+
 DWORD RealDMD::WriterThreadMain()
 {
 	// keep going until the 'quit' event is signaled
@@ -1422,6 +1515,8 @@ DWORD RealDMD::WriterThreadMain()
 			// get the latest video frame and settings data
 			RefPtr<Slide> frame;
 			std::unique_ptr<GameSettings> settings;
+			bool resync = false;
+			DWORD frameWait = 0;
 			{
 				// lock the queue
 				CriticalSectionLocker frameLocker(writeFrameLock);
@@ -1430,13 +1525,33 @@ DWORD RealDMD::WriterThreadMain()
 				if (writerFrame == nullptr && writerSettings == nullptr)
 					break;
 
-				// grab the pending video frame, taking over its reference count
-				frame.Attach(writerFrame.Detach());
+				// Grab the pending video frame, taking over its reference
+				// count, unless it's too soon after the last frame we sent.
+				// In that case, leave it in the slot, so that a newer frame
+				// can replace it while we wait out the interval.
+				if (writerFrame != nullptr)
+				{
+					int64_t now = writerTimer.GetTime_ticks();
+					if (minFrameTicks != 0 && now < nextFrameTicks)
+						frameWait = static_cast<DWORD>(ceil(writerTimer.TicksToUs(nextFrameTicks - now) / 1000.0));
+					else
+						frame.Attach(writerFrame.Detach());
+				}
 
 				// grab the pending settings
 				settings.reset(writerSettings.release());
+
+				// Check for a resync request.  New settings can change
+				// the palette the device uses to render grayscale frames,
+				// so they also call for a resend.
+				resync = writerResync || settings != nullptr;
+				writerResync = false;
 			}
 
+			// if a resync was requested, forget the last frame sent
+			if (resync)
+				lastFrameHashValid = false;
+
 			// send the settings to the device
 			if (settings != nullptr)
 			{
@@ -1452,12 +1567,36 @@ DWORD RealDMD::WriterThreadMain()
 					PM_GameSettings_(settings->gameName.c_str(), GEN_WPC95, settings->opts);
 			}
 
+			// skip the frame if it's identical to the last frame sent
+			if (frame != nullptr)
+			{
+				UINT64 hash = HashFrame(frame);
+				if (lastFrameHashValid && hash == lastFrameHash)
+				{
+					CriticalSectionLocker frameLocker(writeFrameLock);
+					++writerStats.duplicates;
+					frame = nullptr;
+				}
+				else
+				{
+					lastFrameHash = hash;
+					lastFrameHashValid = true;
+				}
+			}
+
 			// send the video frame to the device
 			if (frame != nullptr)
 			{
 				CriticalSectionLocker dmdLocker(dmdLock);
 				if (sessionOpen)
 				{
+					// count it, and figure the earliest time for the next frame
+					{
+						CriticalSectionLocker frameLocker(writeFrameLock);
+						++writerStats.sent;
+					}
+					nextFrameTicks = writerTimer.GetTime_ticks() + minFrameTicks;
+
 					switch (frame->colorSpace)
 					{
 					case DMD_COLOR_MONO4:
@@ -1518,6 +1657,17 @@ DWORD RealDMD::WriterThreadMain()
 					}
 				}
 			}
+
+			// If we're holding a frame for the rate limit, wait out the
+			// interval.  A new frame arriving in the meantime will wake
+			// us early, which is harmless, since we'll just come back
+			// here to wait for the remainder.
+			if (frameWait != 0)
+			{
+				WaitForSingleObject(hWriterEvent, frameWait);
+				if (writerThreadQuit)
+					return 0;
+			}
 		}
 	}
 
@@ -1651,215 +1801,122 @@ bool RealDMD::SupportsRGBDisplay() const
 	return Render_RGB24_ != nullptr;
 }
 
-// Our decoder will always call us with one of the following
-// frame sizes:
+// Choose the decoding size for a video.  Our scaler can take frames
+// of any size, so we generally prefer to get the frames at the
+// video's native size, so that we control the scaling.  That matters
+// most for videos that use the DMD pixel structure convention, where
+// each DMD dot is drawn as one lit pixel in an NxN block of video
+// pixels (e.g., 256x64 for a 128x32 DMD).  The decoder's scaler would
+// average the blank pixels into the frame and dim the whole image,
+// whereas our scaler recognizes the integer-multiple size and picks
+// out the lit pixel from each block.
 //
-// 256x64:  If the source video's frame size is 256x64, the
-// decoder will decode at that size and pass the frames to us
-// at that size.  Videos in this format are assumed to use a
-// pixel structure where every 2x2 block contains exactly one
-// DMD pixel.  The other three pixels in each 2x2 block are
-// expected to be black (zero brightness), so that the video
-// reproduces the DMD pixel structure visually when played
-// back on a regular video display.  For DMD playback, the
-// black pixels correspond to the space between pixels in
-// the physical DMD, so we don't want to display them at all.
-// To play back this format, we examine each 2x2 block and
-// pick out the brightest pixel, ignoring the rest.
+// For ordinary videos much larger than the DMD, though, having the
+// decoder write out full-size frames that we immediately reduce by a
+// factor of 50 or 100 is a waste of memory bandwidth, so we let the
+// decoder do the bulk of the scaling for those.
 //
-// 128x32:  If the source video frame size isn't one of the
-// special cases listed above, the decoder scales the frame
-// to 128x32 and passes us the 128x32 buffer.  This is the
-// same size as the native DMD, so we simply map the frame
-// pixels to DMD pixels one-to-one.
+void RealDMD::ChooseVideoFrameSize(unsigned int *width, unsigned int *height)
+{
+	CriticalSectionLocker scalerLocker(videoScalerLock);
+	videoDecoderScaled = false;
+	unsigned int cx = *width, cy = *height;
+	if (cx == 0 || cy == 0)
+	{
+		// no size information - use the native device size
+		*width = dmdWidth;
+		*height = dmdHeight;
+	}
+	else if (cx % dmdWidth == 0 && cy % dmdHeight == 0 && cx / dmdWidth == cy / dmdHeight
+		&& cx <= dmdWidth * MaxPixelStructureScale)
+	{
+		// pixel structure format - decode at the native video size
+	}
+	else if (cx <= dmdWidth * MaxNativeVideoScale && cy <= dmdHeight * MaxNativeVideoScale)
+	{
+		// small enough to decode at the native size
+	}
+	else
+	{
+		// Large ordinary video.  Have the decoder scale it to a small
+		// multiple of the device size, so that our area filter still
+		// gets a few samples per dot.  The result is an exact multiple
+		// of the device size, so flag it as decoder-scaled to keep the
+		// Auto filter from treating it as pixel structure video.
+		*width = dmdWidth * MaxNativeVideoScale;
+		*height = dmdHeight * MaxNativeVideoScale;
+		videoDecoderScaled = true;
+	}
+}
+
+// Present a video frame.  The frame can be any size (see above).  We
+// scale it to the device size through the video scaler, which applies
+// the pooling filter, the mirroring, and the conversion to the device
+// pixel format in one pass over the frame, and then pass the result to
+// the writer thread like any other frame, so that video playback gets
+// the same duplicate suppression and rate limiting as the slide show,
+// and the decoder thread never blocks on the device.
 //
 void RealDMD::PresentVideoFrame(int width, int height, const BYTE *y, const BYTE *u, const BYTE *v)
 {
-	// Figure the output buffer pointers according to the mirroring
-	// settings.
-	int dstStartRow = 0, dstStartCol = 0, dstRowInc = 1, dstColInc = 1;
-	if (mirrorVert)
-		dstStartRow = 31, dstRowInc = -1;
-	if (mirrorHorz)
-		dstStartCol = 127, dstColInc = -1;
+	// Set up the scaler for this frame.  This only rebuilds the
+	// scaler's tables if something has changed since the last frame.
+	CriticalSectionLocker scalerLocker(videoScalerLock);
+	DMDScaler::Format fmt;
+	fmt.srcWidth = width;
+	fmt.srcHeight = height;
+	fmt.dstWidth = dmdWidth;
+	fmt.dstHeight = dmdHeight;
+	fmt.filter = videoDecoderScaled && videoFilter == DMDScaler::Filter::Auto ? DMDScaler::Filter::Area : videoFilter;
+	fmt.mirrorHorz = mirrorHorz;
+	fmt.mirrorVert = mirrorVert;
+	if (fmt != videoScaler.GetFormat())
+	{
+		if (videoScaler.SetFormat(fmt))
+		{
+			Log(_T("Real DMD video frame format %dx%d, %s pooling\n"), width, height,
+				videoScaler.GetEffectiveFilter() == DMDScaler::Filter::Max ? _T("max") : _T("area"));
+		}
+		else
+		{
+			Log(_T("Real DMD video frame format %dx%d isn't supported; frames will be skipped\n"), width, height);
+		}
+	}
+
+	// skip the frame if the format isn't usable
+	if (!videoScaler.IsValid())
+		return;
+
+	// The frame buffer is in I420 format, packed with the minimum row
+	// stride.  The U and V planes are subsampled in 2x2 blocks.
+	int yPitch = width;
+	int uvPitch = (width + 1) / 2;
 
 	// prepare the buffer according to the device color space we're
 	// rendering to
+	std::unique_ptr<BYTE> pix;
 	switch (videoColorSpace)
 	{
 	case DMD_COLOR_MONO16:
-		// 16-bit monochrome mode.  The Y plane is conveniently in
-		// 8-bit luma format, at the native device size of 128x32, so
-		// all we have to do is shift all of the pixel luma values 
-		// right by four bits to get 4-bit luma.  We can ignore the U 
-		// and V planes in this mode.
-		if (width == 256 && height == 64)
-		{
-			// Double-size frame.  These should follow the convention
-			// where each DMD pixel is stored as a 2x2 block of video
-			// pixels, so that the video has the same visible pixel
-			// structure as a DMD when played back on a video device.
-			// Look for the maximum pixel value in each block, and
-			// render that in 16-shade grayscale.
-			UINT8 gray[dmdWidth * dmdHeight];
-			UINT8 *dst;
-			for (int row = 0; row < dmdHeight; ++row, y += dmdWidth*2)
-			{
-				dst = gray + dstStartRow*dmdWidth + dstStartCol;
-				dstStartRow += dstRowInc;
-				for (int col = 0; col < dmdWidth; ++col, y += 2)
-				{
-					// get the 2x2 pixel block at this position
-					BYTE a = y[0], b = y[1], c = y[dmdWidth*2], d = y[dmdWidth*2 + 1];
-
-					// take the maximum of these values
-					if (b > a) a = b;
-					if (c > a) a = c;
-					if (d > a) a = d;
-
-					// downconvert from 8 bits to 4 bits
-					*dst = (gammaMap[a] >> 4) & 0x0F;
-					dst += dstColInc;
-				}
-			}
-
-			// display it
-			CriticalSectionLocker dmdLocker(dmdLock);
-			Render_16_Shades_(dmdWidth, dmdHeight, gray);
-		}
-		else if (width == dmdWidth && height == dmdHeight)
-		{
-			// native size frame - convert from 8-bit luma to 4-bit luma
-			UINT8 gray[dmdWidth * dmdHeight];
-			UINT8 *dst;
-			for (int row = 0; row < dmdHeight; ++row)
-			{
-				dst = gray + dstStartRow*dmdWidth + dstStartCol;
-				dstStartRow += dstRowInc;
-				for (int col = 0; col < dmdWidth; ++col)
-				{
-					*dst = (gammaMap[*y++] >> 4) & 0x0F;
-					dst += dstColInc;
-				}
-			}
-
-			// display it
-			CriticalSectionLocker dmdLocker(dmdLock);
-			Render_16_Shades_(dmdWidth, dmdHeight, gray);
-		}
+		// 16-shade grayscale.  This only uses the Y plane.
+		pix.reset(new BYTE[dmdWidth * dmdHeight]);
+		videoScaler.RenderGray16(y, yPitch, pix.get());
 		break;
 
 	case DMD_COLOR_RGB:
-		if (width == dmdWidth*2 && height == dmdHeight*2)
-		{
-			// Double-size frame.  Pick out the brightest pixel from
-			// each 2x2 block.
-			rgb24 rgb[dmdWidth * dmdHeight];
-			rgb24 *dst;
-			for (int row = 0; row < dmdHeight; ++row, y += dmdWidth*2)
-			{
-				dst = rgb + dstStartRow*dmdWidth + dstStartCol;
-				dstStartRow += dstRowInc;
-				for (int col = 0; col < dmdWidth; ++col, y += 2, ++u, ++v)
-				{
-					// get the 2x2 pixel block at this position
-					BYTE a = y[0], b = y[1], c = y[dmdWidth*2], d = y[dmdWidth*2 + 1];
-					int ofs = 0;
-
-					// take the maximum of these values
-					if (b > a) a = b;
-					if (c > a) a = c;
-					if (d > a) a = d;
-
-					// By some amazing coincidence, the U and V planes are 
-					// already subsampled in 2x2 blocks, so whichever pixel
-					// we just picked out, the U and V samples are the same.
-					// Calculate the RGB value using the standard formula:
-					//
-					//  Y' = 1.164*(Y-16)
-					//  U' = U - 128
-					//  V' = V - 128
-					//
-					//  R = Y' + 1.596*V'
-					//  G = Y' - 0.813*V' - 0.391*U'
-					//  B = Y' + 2.018*U'
-					//
-					// For efficiency, do the calculations in base-65536
-					// fixed-point representation.
-					int yp = (a - 16)*76284;
-					int up = (*u - 128);
-					int vp = (*v - 128);
-					int rr = (yp + 104595*vp) >> 16;
-					int gg = (yp - 53281*vp - 25625*up) >> 16;
-					int bb = (yp + 132252*up) >> 16;
-
-					// Clamp the results to 0..255
-					rr = max(rr, 0);
-					gg = max(gg, 0);
-					bb = max(bb, 0);
-					dst->red = min(rr, 255);
-					dst->green = min(gg, 255);
-					dst->blue = min(bb, 255);
-
-					dst += dstColInc;
-				}
-			}
-
-			// display it
-			// NB: we don't worry about the dmd-extensions bug (search for #176 above)
-			// for video, as a video will typically present a new frame so quickly that
-			// a single dropped frame shouldn't be noticed.
-			CriticalSectionLocker dmdLocker(dmdLock);
-			Render_RGB24_(dmdWidth, dmdHeight, rgb);
-		}
-		else if (width == dmdWidth && height == dmdHeight)
-		{
-			// native size frame - convert from YUV to RGB
-			rgb24 rgb[dmdWidth * dmdHeight];
-			rgb24 *dst;
-			for (int row = 0; row < dmdHeight; ++row)
-			{
-				dst = rgb + dstStartRow*dmdWidth + dstStartCol;
-				dstStartRow += dstRowInc;
-				for (int col = 0; col < dmdWidth; ++col)
-				{
-					// Get the Y, U and V values for this pixel.  The U and V
-					// planes are subsampled in 2x2 blocks, so we need to figure
-					// the U/V index accordingly.
-					int yy = *y++;
-					int uvIdx = (row/2)*dmdWidth/2 + col/2;
-					int uu = u[uvIdx];
-					int vv = v[uvIdx];
-
-					// do the YUV -> RGB conversion
-					int yp = (yy - 16)*76284;
-					int up = (uu - 128);
-					int vp = (vv - 128);
-					int rr = (yp + 104595*vp) >> 16;
-					int gg = (yp - 53281*vp - 25625*up) >> 16;
-					int bb = (yp + 132252*up) >> 16;
-
-					// clamp the results to 0..255 and store the RGB pixel
-					rr = max(rr, 0);
-					gg = max(gg, 0);
-					bb = max(bb, 0);
-					dst->red = min(rr, 255);
-					dst->green = min(gg, 255);
-					dst->blue = min(bb, 255);
-
-					dst += dstColInc;
-				}
-			}
-
-			// Display the frame.
-			// NB: we don't worry about the dmd-extensions bug (search for #176 above)
-			// for video, as a video will typically present a new frame so quickly that
-			// a single dropped frame shouldn't be noticed.
-			CriticalSectionLocker dmdLocker(dmdLock);
-			Render_RGB24_(dmdWidth, dmdHeight, rgb);
-		}
+		// 24-bit RGB
+		static_assert(sizeof(rgb24) == 3, "rgb24 must be packed R,G,B bytes");
+		pix.reset(new BYTE[dmdWidth * dmdHeight * 3]);
+		videoScaler.RenderRGB24(y, yPitch, u, v, uvPitch, pix.get());
 		break;
+
+	default:
+		return;
 	}
+
+	// send it to the writer
+	RefPtr<Slide> frame(new Slide(videoColorSpace, pix.release(), 0, Slide::VideoFrame));
+	SendWriterFrame(frame);
 }
 
 void RealDMD::VideoEndOfPresentation(WPARAM cookie)
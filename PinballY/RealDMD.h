@@ -6,6 +6,8 @@
 #pragma once
 #include "VLCAudioVideoPlayer.h"
 #include "DmdDeviceDll.h"
+#include "DMDScaler.h"
+#include "HiResTimer.h"
 
 class ErrorHandler;
 class GameListItem;
@@ -71,6 +73,9 @@ public:
 	// video player callback interface
 	// 
 
+	// choose the video decoding size
+	virtual void ChooseVideoFrameSize(unsigned int *width, unsigned int *height) override;
+
 	// present a frame
 	virtual void PresentVideoFrame(int width, int height,
 		const BYTE *y, const BYTE *u, const BYTE *v) override;
@@ -230,6 +235,20 @@ protected:
 	// color space for the video
 	ColorSpace videoColorSpace;
 
+	// Video frame scaler.  This converts decoded video frames of any
+	// size to the device size and pixel format.  The scaler is used on
+	// the decoder's presentation thread, and its settings are updated
+	// from the UI thread, so access is protected by videoScalerLock.
+	DMDScaler videoScaler;
+	DMDScaler::Filter videoFilter = DMDScaler::Filter::Auto;
+	CriticalSection videoScalerLock;
+
+	// Is the decoder scaling the current video for us?  When it is, the
+	// frames are always an exact multiple of the device size, so the
+	// scaler's Auto filter would mistake them for pixel structure video;
+	// we use area pooling for these in Auto mode instead.
+	bool videoDecoderScaled = false;
+
 	// video mode
 	enum VideoMode
 	{
@@ -267,7 +286,8 @@ protected:
 		{
 			EmptySlide,      // generated empty image
 			MediaSlide,      // still image from the game's media folder
-			HighScoreSlide   // generated high score screen
+			HighScoreSlide,  // generated high score screen
+			VideoFrame       // video frame (not part of the slide show)
 		} slideType;
 
 		Slide(ColorSpace colorSpace, BYTE *pix, DWORD displayTime, SlideType slideType) :
@@ -318,6 +338,48 @@ protected:
 	// send a frame to the writer
 	void SendWriterFrame(Slide *slide);
 
+	// Writer statistics.  These are protected by writeFrameLock.
+	struct WriterStats
+	{
+		UINT64 submitted = 0;    // frames passed to SendWriterFrame()
+		UINT64 sent = 0;         // frames sent to the device
+		UINT64 duplicates = 0;   // frames skipped as identical to the last frame sent
+		UINT64 dropped = 0;      // frames replaced by a newer frame before being sent
+	};
+	WriterStats writerStats;
+
+	// get a snapshot of the writer statistics
+	WriterStats GetWriterStats();
+
+	// Hash of the last frame sent to the device.  The writer thread
+	// skips a frame if it's identical to the last one sent, since
+	// re-sending the same pixels to a USB device is pure overhead.
+	// This is only accessed on the writer thread.
+	UINT64 lastFrameHash = 0;
+	bool lastFrameHashValid = false;
+
+	// Force the next frame to be sent even if it matches the last
+	// one.  We set this when something might have changed the
+	// device's display state behind the writer's back, such as
+	// re-opening the session or sending new game settings (which
+	// can change the color palette).  Protected by writeFrameLock.
+	bool writerResync = true;
+
+	// compute the duplicate-detection hash for a frame
+	static UINT64 HashFrame(const Slide *frame);
+
+	// Minimum interval between frames sent to the device, in
+	// HiResTimer ticks, from the RealDMD.MaxFrameRate setting, and the
+	// earliest time the writer can send the next frame.  When frames
+	// arrive faster than this, the writer holds the pending frame until
+	// the interval expires; newer frames replace it in the meantime, so
+	// the device always gets the latest frame.  Zero means no limit.
+	int64_t minFrameTicks = 0;
+	int64_t nextFrameTicks = 0;
+
+	// timer for the writer frame rate limit
+	HiResTimer writerTimer;
+
 	// start slide show playback
 	void StartSlideShow();
 
@@ -501,6 +501,9 @@
 
 #define IDS_VIEWCUSTOM_MENUCMD          1010
 
+#define IDS_ERR_CAP_ITEM_ENCODE_QUEUED  1020
+#define IDS_BATCH_CAPTURE_ENCODING      1021
+
 #define ID_EXIT                         32777
 #define ID_OPTIONS                      32778
 #define ID_ABOUT                        32779
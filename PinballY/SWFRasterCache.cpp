@@ -0,0 +1,320 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// SWF raster cache
+
+#include "stdafx.h"
+#include "../Utilities/Config.h"
+#include "../zlib/zlib.h"
+#include "SWFRasterCache.h"
+#include "Application.h"
+#include "LogFile.h"
+
+namespace ConfigVars
+{
+	static const TCHAR *Enable = _T("SWFCache.Enable");
+	static const TCHAR *DiskLimit = _T("SWFCache.DiskLimit");
+}
+
+// Disk file format signature and version.  Bump the version if the
+// layout changes, or if the SWF renderer changes in a way that makes
+// existing images obsolete.
+static const DWORD DiskFileSignature = 'PBSW';
+static const DWORD DiskFileVersion = 1;
+
+SWFRasterCache *SWFRasterCache::Get()
+{
+	static SWFRasterCache inst;
+	return &inst;
+}
+
+SWFRasterCache::SWFRasterCache()
+{
+	// Figure the disk folder.  This goes in the same folder as the
+	// game stats database.
+	auto const &gameStatsPath = Application::Get()->gameStatsPath;
+	const TCHAR *subdir = _T("SWFRasterCache");
+	TCHAR path[MAX_PATH];
+	if (gameStatsPath.length() != 0)
+		PathCombine(path, gameStatsPath.c_str(), subdir);
+	else
+		GetDeployedFilePath(path, subdir, _T(""));
+	diskFolder = path;
+}
+
+size_t SWFRasterCache::DIBSize(const BITMAPINFOHEADER &bmih)
+{
+	// DIB rows are padded to DWORD boundaries
+	size_t stride = ((static_cast<size_t>(bmih.biWidth) * bmih.biBitCount + 31) / 32) * 4;
+	return stride * static_cast<size_t>(abs(bmih.biHeight));
+}
+
+bool SWFRasterCache::GetKey(const WCHAR *filename, SIZE pixSize, TSTRING &key)
+{
+	// check if the cache is enabled
+	if (!ConfigManager::GetInstance()->GetBool(ConfigVars::Enable, true))
+		return false;
+
+	// get the full path, so that the same relative name in two folders
+	// doesn't collide
+	WCHAR fullPath[MAX_PATH];
+	if (GetFullPathNameW(filename, countof(fullPath), fullPath, NULL) == 0)
+		return false;
+
+	// get the file's modification time and size
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	if (!GetFileAttributesExW(fullPath, GetFileExInfoStandard, &attrs))
+		return false;
+
+	UINT64 modTime = (static_cast<UINT64>(attrs.ftLastWriteTime.dwHighDateTime) << 32) | attrs.ftLastWriteTime.dwLowDateTime;
+	UINT64 size = (static_cast<UINT64>(attrs.nFileSizeHigh) << 32) | attrs.nFileSizeLow;
+	// include the renderer type, since the two renderers' output differs
+	key = MsgFmt(_T("%ws|%016I64x|%I64u|%dx%d|%s"), fullPath, modTime, size, pixSize.cx, pixSize.cy,
+		Application::Get()->useSoftwareSWFRenderer ? _T("sw") : _T("d2d")).Get();
+	return true;
+}
+
+bool SWFRasterCache::Find(const TSTRING &key, Movie &movie)
+{
+	CriticalSectionLocker locker(diskLock);
+	return ReadDiskFile(DiskFile(key).c_str(), key, movie);
+}
+
+void SWFRasterCache::Add(const TSTRING &key, const Movie &movie)
+{
+	// get the size limit, in MB; a zero limit disables writing
+	UINT64 diskLimit = static_cast<UINT64>(max(ConfigManager::GetInstance()->GetInt(ConfigVars::DiskLimit, 128), 0)) * 1024 * 1024;
+	if (diskLimit == 0 || movie.size() == 0)
+		return;
+
+	// write the file, then trim the cache to the limit
+	CriticalSectionLocker locker(diskLock);
+	CreateSubDirectory(diskFolder.c_str(), _T(""), NULL);
+	if (WriteDiskFile(DiskFile(key).c_str(), key, movie))
+		PruneDisk(diskLimit);
+}
+
+TSTRING SWFRasterCache::DiskFile(const TSTRING &key) const
+{
+	// Name the file after a 64-bit FNV-1a hash of the key.  The file
+	// stores the full key, so a hash collision is detected on reading
+	// and just counts as a miss.
+	UINT64 h = 14695981039346656037ULL;
+	for (TCHAR c : key)
+	{
+		h ^= static_cast<UINT64>(c);
+		h *= 1099511628211ULL;
+	}
+
+	TCHAR fname[32];
+	_stprintf_s(fname, _T("%016I64x.dat"), h);
+
+	TCHAR path[MAX_PATH];
+	PathCombine(path, diskFolder.c_str(), fname);
+	return path;
+}
+
+bool SWFRasterCache::ReadDiskFile(const TCHAR *filename, const TSTRING &key, Movie &movie)
+{
+	// Load the file into memory.  Open it with write-attributes access
+	// as well, so that we can update the modification time, which
+	// serves as the last-used time for pruning.
+	HandleHolder hFile = CreateFile(filename, GENERIC_READ | FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == NULL || hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart > MaxMovieBytes)
+		return false;
+
+	std::vector<BYTE> buf(static_cast<size_t>(fileSize.QuadPart));
+	DWORD actual;
+	if (buf.size() != 0 && (!ReadFile(hFile, buf.data(), static_cast<DWORD>(buf.size()), &actual, NULL) || actual != buf.size()))
+		return false;
+
+	// set up a bounds-checked reader
+	const BYTE *p = buf.data(), *endp = p + buf.size();
+	auto Read = [&p, endp](void *dst, size_t len)
+	{
+		if (static_cast<size_t>(endp - p) < len)
+			return false;
+		memcpy(dst, p, len);
+		p += len;
+		return true;
+	};
+	auto ReadDWORD = [&Read](DWORD &d) { return Read(&d, sizeof(d)); };
+
+	// check the signature and version
+	DWORD sig, ver;
+	if (!ReadDWORD(sig) || !ReadDWORD(ver) || sig != DiskFileSignature || ver != DiskFileVersion)
+		return false;
+
+	// check the key
+	DWORD keyLen;
+	if (!ReadDWORD(keyLen) || keyLen != key.length())
+		return false;
+	if (static_cast<size_t>(endp - p) < keyLen * sizeof(TCHAR)
+		|| memcmp(p, key.c_str(), keyLen * sizeof(TCHAR)) != 0)
+		return false;
+	p += keyLen * sizeof(TCHAR);
+
+	// read the frame count
+	DWORD nFrames;
+	if (!ReadDWORD(nFrames) || nFrames == 0 || nFrames > 10000)
+		return false;
+
+	// read the frames
+	Movie m(nFrames);
+	size_t totalBytes = 0;
+	for (DWORD i = 0; i < nFrames; ++i)
+	{
+		// Read the frame header.  Each frame records its own index, as
+		// a consistency check on the file structure.
+		auto &f = m[i];
+		DWORD frameNo, compressedLen;
+		if (!ReadDWORD(frameNo)
+			|| frameNo != i
+			|| !ReadDWORD(f.dt)
+			|| !Read(&f.bmih, sizeof(f.bmih))
+			|| f.bmih.biBitCount != 32
+			|| (totalBytes += DIBSize(f.bmih)) > MaxMovieBytes
+			|| !ReadDWORD(compressedLen)
+			|| static_cast<size_t>(endp - p) < compressedLen)
+			return false;
+
+		// decompress the pixels
+		f.pix.resize(DIBSize(f.bmih));
+		uLongf len = static_cast<uLongf>(f.pix.size());
+		if (uncompress(f.pix.data(), &len, p, compressedLen) != Z_OK || len != f.pix.size())
+			return false;
+		p += compressedLen;
+	}
+
+	// mark the file as recently used
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	SetFileTime(hFile, NULL, NULL, &now);
+
+	// success
+	movie = std::move(m);
+	return true;
+}
+
+bool SWFRasterCache::WriteDiskFile(const TCHAR *filename, const TSTRING &key, const Movie &movie)
+{
+	// build the file contents in memory
+	std::vector<BYTE> buf;
+	auto Write = [&buf](const void *src, size_t len)
+	{
+		const BYTE *b = static_cast<const BYTE*>(src);
+		buf.insert(buf.end(), b, b + len);
+	};
+	auto WriteDWORD = [&Write](DWORD d) { Write(&d, sizeof(d)); };
+
+	WriteDWORD(DiskFileSignature);
+	WriteDWORD(DiskFileVersion);
+	WriteDWORD(static_cast<DWORD>(key.length()));
+	Write(key.c_str(), key.length() * sizeof(TCHAR));
+	WriteDWORD(static_cast<DWORD>(movie.size()));
+	for (size_t i = 0; i < movie.size(); ++i)
+	{
+		auto &f = movie[i];
+		WriteDWORD(static_cast<DWORD>(i));
+		WriteDWORD(f.dt);
+		Write(&f.bmih, sizeof(f.bmih));
+
+		// Compress the pixels directly into the buffer, after a
+		// placeholder for the compressed length.  SWF renderings are
+		// mostly flat fills and text, so they compress very well.
+		size_t lenPos = buf.size();
+		WriteDWORD(0);
+		uLongf len = compressBound(static_cast<uLong>(f.pix.size()));
+		buf.resize(lenPos + 4 + len);
+		if (compress2(buf.data() + lenPos + 4, &len, f.pix.data(), static_cast<uLong>(f.pix.size()), Z_DEFAULT_COMPRESSION) != Z_OK)
+			return false;
+		buf.resize(lenPos + 4 + len);
+		DWORD dwLen = static_cast<DWORD>(len);
+		memcpy(buf.data() + lenPos, &dwLen, 4);
+	}
+
+	// Write it to a temporary file, then move it into place, so that a
+	// reader never sees a partially written file
+	TSTRING tmpname = TSTRING(filename) + _T(".tmp");
+	{
+		HandleHolder hFile = CreateFile(tmpname.c_str(), GENERIC_WRITE, 0, NULL,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (hFile == NULL || hFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		DWORD actual;
+		if (!WriteFile(hFile, buf.data(), static_cast<DWORD>(buf.size()), &actual, NULL) || actual != buf.size())
+		{
+			hFile = NULL;
+			DeleteFile(tmpname.c_str());
+			return false;
+		}
+	}
+
+	if (!MoveFileEx(tmpname.c_str(), filename, MOVEFILE_REPLACE_EXISTING))
+	{
+		WindowsErrorMessage err;
+		LogFile::Get()->Write(LogFile::MediaFileLogging, _T("SWF raster cache: error writing %s: %s\n"),
+			filename, err.Get());
+		DeleteFile(tmpname.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void SWFRasterCache::PruneDisk(UINT64 diskLimit)
+{
+	// gather the cache files
+	struct FileInfo
+	{
+		TSTRING name;
+		UINT64 size;
+		UINT64 modTime;
+	};
+	std::vector<FileInfo> files;
+	UINT64 total = 0;
+
+	TCHAR pat[MAX_PATH];
+	PathCombine(pat, diskFolder.c_str(), _T("*.dat"));
+	WIN32_FIND_DATA fd;
+	HANDLE hFind = FindFirstFile(pat, &fd);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+		{
+			UINT64 size = (static_cast<UINT64>(fd.nFileSizeHigh) << 32) | fd.nFileSizeLow;
+			UINT64 modTime = (static_cast<UINT64>(fd.ftLastWriteTime.dwHighDateTime) << 32) | fd.ftLastWriteTime.dwLowDateTime;
+			files.push_back({ fd.cFileName, size, modTime });
+			total += size;
+		}
+	} while (FindNextFile(hFind, &fd));
+	FindClose(hFind);
+
+	// if we're within the limit, there's nothing to do
+	if (total <= diskLimit)
+		return;
+
+	// Delete the least recently used files until we're comfortably
+	// under the limit, so that we don't have to do this again on the
+	// very next write.
+	std::sort(files.begin(), files.end(), [](const FileInfo &a, const FileInfo &b) { return a.modTime < b.modTime; });
+	UINT64 target = diskLimit / 10 * 9;
+	for (auto &f : files)
+	{
+		if (total <= target)
+			break;
+
+		TCHAR path[MAX_PATH];
+		PathCombine(path, diskFolder.c_str(), f.name.c_str());
+		if (DeleteFile(path))
+			total -= f.size;
+	}
+}
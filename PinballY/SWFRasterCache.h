@@ -0,0 +1,76 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// SWF raster cache
+//
+// Instruction cards in the HyperPin Media Packs are mostly SWF files,
+// which our internal renderer has to parse and rasterize every time
+// a card is shown.  That's expensive for the more complex cards, and
+// the result never changes for a given file at a given size.  This
+// cache saves the rasterized frames on disk, zlib-compressed, in a
+// folder alongside GameStats.csv, so that each file is only parsed
+// and rendered once per target size.
+//
+// The key captures the file's full path, modification time, and size,
+// plus the target pixel size, so a changed file or a resized window
+// simply misses the cache.  Stale entries are never used; they just
+// age out of the cache's disk size limit.  All of the file I/O here
+// happens on the SWF loader threads.
+
+#pragma once
+#include <memory>
+#include <vector>
+
+class SWFRasterCache
+{
+public:
+	// get the global instance
+	static SWFRasterCache *Get();
+
+	// Cached frame.  This holds a private copy of a rendered DIB, as
+	// produced by the SWF loader, plus the frame's display time.
+	struct Frame
+	{
+		BITMAPINFOHEADER bmih;
+		DWORD dt = 0;
+		std::vector<BYTE> pix;
+	};
+	typedef std::vector<Frame> Movie;
+
+	// Largest movie we'll cache, counting the uncompressed pixels.  The
+	// loader stops collecting frames for the cache past this point.
+	static const size_t MaxMovieBytes = 64 * 1024 * 1024;
+
+	// Build the cache key for a file rendered at the given size.
+	// Returns false if the cache is disabled or the file can't be
+	// found, in which case the caller should bypass the cache.
+	bool GetKey(const WCHAR *filename, SIZE pixSize, TSTRING &key);
+
+	// Look up a movie.  Returns true and fills in 'movie' on a hit.
+	bool Find(const TSTRING &key, Movie &movie);
+
+	// Add a movie to the cache
+	void Add(const TSTRING &key, const Movie &movie);
+
+	// get the byte size of a DIB's pixel array
+	static size_t DIBSize(const BITMAPINFOHEADER &bmih);
+
+protected:
+	SWFRasterCache();
+
+	// get the disk file name for a key
+	TSTRING DiskFile(const TSTRING &key) const;
+
+	// read/write a disk file
+	bool ReadDiskFile(const TCHAR *filename, const TSTRING &key, Movie &movie);
+	bool WriteDiskFile(const TCHAR *filename, const TSTRING &key, const Movie &movie);
+
+	// delete the oldest files, if the cache is over its size limit
+	void PruneDisk(UINT64 diskLimit);
+
+	// cache folder
+	TSTRING diskFolder;
+
+	// lock for file operations
+	CriticalSection diskLock;
+};
@@ -5,6 +5,7 @@
 #include <d3d11_1.h>
 #include <DirectXMath.h>
 #include <wincodec.h>
+#include "../Utilities/Config.h"
 #include "../Utilities/GraphicsUtil.h"
 #include "../Utilities/ComUtil.h"
 #include "../Utilities/SWFParser.h"
@@ -17,13 +18,23 @@
 #include "TextureShader.h"
 #include "Application.h"
 #include "FlashClient/FlashClient.h"
+#include "SWFRasterCache.h"
 #include "LogFile.h"
+#include "Profiler.h"
 #include <png.h>
 
 #pragma comment(lib, "libpng.lib")
 
 using namespace DirectX;
 
+namespace ConfigVars
+{
+	static const TCHAR *GIFFrameCacheLimit = _T("AnimatedGIF.FrameCacheLimit");
+}
+
+// statics
+volatile LONG64 Sprite::lastContentSerial = 0;
+
 Sprite::Sprite()
 {
 	alpha = 1.0f;
@@ -60,6 +71,8 @@ void Sprite::UpdateWorld()
 
 bool Sprite::Load(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, HWND msgHwnd, ErrorHandler &eh)
 {
+	PROFILE_ZONE("Sprite::Load");
+
 	// release any previous resources
 	Clear();
 
@@ -68,6 +81,7 @@ bool Sprite::Load(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, HW
 
 	// set up a new load context
 	loadContext.Attach(new LoadContext());
+	ContentChanged();
 
 	// Try to determine the image type from the file contents
 	if (ImageFileDesc desc; GetImageFileInfo(filename, desc, true, true))
@@ -239,43 +253,128 @@ bool Sprite::LoadSWF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize,
 			// interactively, so log them
 			LogFileErrorHandler leh;
 
-			// Try loading the file.  Use incremental mode so that we stop as soon
-			// as the first frame is ready to render.
-			if (!loader->parser->Load(ctx->filename.c_str(), leh, true))
-				return false;
-
-			// generate frames
-			for (;;)
+			// Check the raster cache.  If we've rendered this file at this
+			// size before, we can create the frames directly from the saved
+			// bitmaps, without parsing or rendering the SWF at all.
+			auto cache = SWFRasterCache::Get();
+			TSTRING cacheKey;
+			bool useCache = cache->GetKey(ctx->filename.c_str(), ctx->pixSize, cacheKey);
+			SWFRasterCache::Movie movie;
+			if (useCache && cache->Find(cacheKey, movie))
+			{
+				for (auto &f : movie)
+				{
+					// create the animation frame
+					auto af = ctx->loadContext->animFrames.emplace_back(new AnimFrame()).get();
+					af->dt = f.dt;
+
+					// create the texture
+					BITMAPINFO bmi;
+					ZeroMemory(&bmi, sizeof(bmi));
+					bmi.bmiHeader = f.bmih;
+					if (!Sprite::CreateTextureFromBitmapStatic(bmi, f.pix.data(), leh, _T("Sprite::SWFLoaderState (cached frame)"), &af->tv))
+					{
+						ctx->loadContext->animFrames.pop_back();
+						break;
+					}
+				}
+			}
+			else
 			{
-				// render the current frame
-				bool ok = true;
-				DrawOffScreen(ctx->pixSize.cx, ctx->pixSize.cy,
-					[&ctx, &loader, &ok](HDC hdc, HBITMAP hbitmap, const void *dibits, const BITMAPINFO &bmi)
+				// Try loading the file.  Use incremental mode so that we stop as soon
+				// as the first frame is ready to render.
+				if (!loader->parser->Load(ctx->filename.c_str(), leh, true))
+					return false;
+
+				// Generate frames.  Along the way, save copies of the frames
+				// for the raster cache, unless the movie gets too big to cache.
+				bool cacheFrames = useCache;
+				size_t cacheBytes = 0;
+				for (;;)
 				{
-					// render the current SWF display list into the DC
-					LogFileErrorHandler leh;
-					ok = loader->parser->Render(hdc, hbitmap, ctx->pixSize, leh);
-					if (ok)
+					// Add the rendered frame: create the animation frame from the
+					// pixels, and save a copy for the cache
+					bool ok = true;
+					auto AddFrame = [&ctx, &loader, &ok, &movie, &cacheFrames, &cacheBytes](const void *dibits, const BITMAPINFO &bmi)
+					{
+						LogFileErrorHandler leh;
+						if (ok)
+						{
+							// create the animation frame
+							auto af = ctx->loadContext->animFrames.emplace_back(new AnimFrame()).get();
+
+							// set the delay time for the frame - SWF has a fixed frame rate for the
+							// whole sequence
+							af->dt = loader->parser->GetFrameDelay();
+
+							// create the texture
+							ok = Sprite::CreateTextureFromBitmapStatic(bmi, dibits, leh, _T("Sprite::SWFLoaderState::CreateAnimFrame"), &af->tv);
+
+							// save a copy for the cache
+							size_t frameBytes = SWFRasterCache::DIBSize(bmi.bmiHeader);
+							if (cacheFrames && ok && (cacheBytes += frameBytes) <= SWFRasterCache::MaxMovieBytes)
+							{
+								auto &f = movie.emplace_back();
+								f.bmih = bmi.bmiHeader;
+								f.dt = af->dt;
+								f.pix.assign(static_cast<const BYTE*>(dibits), static_cast<const BYTE*>(dibits) + frameBytes);
+							}
+						}
+
+						// if anything went wrong or the movie is too big, don't cache it
+						if (!ok || cacheBytes > SWFRasterCache::MaxMovieBytes)
+						{
+							cacheFrames = false;
+							movie.clear();
+						}
+					};
+
+					// render the current frame
+					if (Application::Get()->useSoftwareSWFRenderer)
+					{
+						// Render with the software rasterizer, into a memory buffer
+						// laid out the same way as the top-down 32-bit DIB we'd get
+						// from the off-screen DC.  This doesn't need a DC or D2D.
+						BITMAPINFO bmi;
+						ZeroMemory(&bmi, sizeof(bmi));
+						bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+						bmi.bmiHeader.biWidth = ctx->pixSize.cx;
+						bmi.bmiHeader.biHeight = -ctx->pixSize.cy;
+						bmi.bmiHeader.biPlanes = 1;
+						bmi.bmiHeader.biBitCount = 32;
+						bmi.bmiHeader.biCompression = BI_RGB;
+						std::vector<BYTE> pix(static_cast<size_t>(ctx->pixSize.cx) * ctx->pixSize.cy * 4);
+						LogFileErrorHandler leh;
+						ok = loader->parser->Render(pix.data(), ctx->pixSize.cx * 4, ctx->pixSize, leh);
+						AddFrame(pix.data(), bmi);
+					}
+					else
 					{
-						// create the animation frame
-						auto af = ctx->loadContext->animFrames.emplace_back(new AnimFrame()).get();
+						// render the current SWF display list into an off-screen DC
+						DrawOffScreen(ctx->pixSize.cx, ctx->pixSize.cy,
+							[&ctx, &loader, &ok, &AddFrame](HDC hdc, HBITMAP hbitmap, const void *dibits, const BITMAPINFO &bmi)
+						{
+							LogFileErrorHandler leh;
+							ok = loader->parser->Render(hdc, hbitmap, ctx->pixSize, leh);
+							AddFrame(dibits, bmi);
+						});
+					}
 
-						// set the delay time for the frame - SWF has a fixed frame rate for the
-						// whole sequence
-						af->dt = loader->parser->GetFrameDelay();
+					// stop if we're at EOF
+					if (loader->parser->AtEof())
+						break;
 
-						// create the texture
-						ok = Sprite::CreateTextureFromBitmapStatic(bmi, dibits, leh, _T("Sprite::SWFLoaderState::CreateAnimFrame"), &af->tv);
+					// load the next frame from the SWF file
+					if (!loader->parser->ParseFrame(leh))
+					{
+						cacheFrames = false;
+						break;
 					}
-				});
-
-				// stop if we're at EOF
-				if (loader->parser->AtEof())
-					break;
+				}
 
-				// load the next frame from the SWF file
-				if (!loader->parser->ParseFrame(leh))
-					break;
+				// save the rendered frames in the cache
+				if (cacheFrames)
+					cache->Add(cacheKey, movie);
 			}
 
 			// we're done with the parser - free it up, since it's holding
@@ -362,9 +461,10 @@ Sprite::SWFLoaderState::~SWFLoaderState()
 }
 
 
-void Sprite::SWFLoaderState::DecodeNext(LoadContext *)
+bool Sprite::SWFLoaderState::DecodeNext(LoadContext *)
 {
 	// not used - we do our decoding in the background thread instead of on-demand
+	return true;
 }
 
 // Load a PNG, with animation support
@@ -372,9 +472,9 @@ bool Sprite::LoadAPNG(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize
 {
 	// Try interpreting it as an animated PNG through the incremental
 	// loader context.  If that succeeds, the loader context will be
-	// set up to load frames on demand.  If not, we'll simply fall back
-	// on the generic WIC loader, to attempt to load the file as a
-	// contentional single-frame PNG or some other image type.
+	// set up to decode frames in the background.  If not, we'll simply
+	// fall back on the generic WIC loader, to attempt to load the file
+	// as a contentional single-frame PNG or some other image type.
 	std::unique_ptr<APNGLoaderState> loader(new APNGLoaderState());
 	if (loader->Init(this, filename, normalizedSize, pixSize))
 	{
@@ -407,23 +507,43 @@ bool Sprite::LoadAPNG(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize
 // Initialize the Animated PNG incremental loader
 bool Sprite::APNGLoaderState::Init(Sprite *sprite, const WCHAR *filename, POINTF normalizedSize, SIZE pixSize)
 {
+	// remember the file name for logging
+	this->filename = filename;
+
 	// open the file
-	if (_tfopen_s(&fp, filename, _T("rb")) != 0)
+	hFile = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
 		return false;
 
+	// get the size; it has to be at least big enough for the PNG signature
+	LARGE_INTEGER liSize;
+	if (!GetFileSizeEx(hFile, &liSize) || liSize.QuadPart < 8 || static_cast<UINT64>(liSize.QuadPart) > SIZE_MAX)
+		return false;
+
+	// map the whole file into memory
+	hFileMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hFileMapping == NULL
+		|| (fileBase = static_cast<const BYTE*>(MapViewOfFile(hFileMapping, FILE_MAP_READ, 0, 0, 0))) == nullptr)
+		return false;
+	fileSize = static_cast<size_t>(liSize.QuadPart);
+
 	// Check that it's a PNG; if not, fail
-	BYTE sig[8];
-	if (fread(sig, 1, 8, fp) != 8 || png_sig_cmp(sig, 0, 8) != 0)
+	if (png_sig_cmp(fileBase, 0, 8) != 0)
 		return false;
+	filePos = 8;
 
 	// Read the IHDR chunk; if it's not an IHDR, fail
-	if (ReadChunk(IHDR) != ID_IHDR || IHDR.size != 25)
+	Chunk ihdr;
+	if (ReadChunk(ihdr) != ID_IHDR || ihdr.size != sizeof(IHDR))
 		return false;
 
+	// save a private copy, since we patch it for each frame
+	memcpy(IHDR, ihdr.data, sizeof(IHDR));
+
 	// Decode the IHDR
 	rcFull.left = rcFull.top = 0;
-	rcFull.right = png_get_uint_32(IHDR.data.get() + 8);
-	rcFull.bottom = png_get_uint_32(IHDR.data.get() + 12);
+	rcFull.right = png_get_uint_32(IHDR + 8);
+	rcFull.bottom = png_get_uint_32(IHDR + 12);
 
 	// Initialize the raw frame buffer
 	frameRaw.Init(rcFull.right, rcFull.bottom, 1, 10);
@@ -437,39 +557,184 @@ bool Sprite::APNGLoaderState::Init(Sprite *sprite, const WCHAR *filename, POINTF
 	if (!ReadThroughNextFrame() || !isAnimated)
 		return false;
 
-	// Create first snimation frame
-	if (!CreateAnimFrame(sprite->loadContext))
+	// Create first animation frame
+	if (frameCur.data == nullptr
+		|| !CreateAnimFrame(sprite->loadContext, frameCur.data.get(), frameCur.width, frameCur.height, frameCur.delayNum, frameCur.delayDen))
 		return false;
 
+	// start decoding the rest of the frames in the background
+	StartDecoder();
+
 	// success
 	return true;
 }
 
-void Sprite::APNGLoaderState::DecodeNext(LoadContext *ctx)
+Sprite::APNGLoaderState::~APNGLoaderState()
+{
+	// Shut down the decoder thread.  Signal the ring space event to
+	// wake it up in case it's waiting for DecodeNext() to free a slot.
+	if (hDecoderThread != NULL)
+	{
+		shutdown = true;
+		SetEvent(hRingSpaceEvent);
+		WaitForSingleObject(hDecoderThread, INFINITE);
+	}
+
+	// clean up any libpng context left over from a partial frame
+	EndProcessing();
+
+	// log the playback timing statistics
+	if (auto log = LogFile::Get(); log != nullptr && timing.frames != 0)
+	{
+		log->Write(LogFile::MediaFileLogging,
+			_T("Animated PNG %ws: %I64u frame changes, %I64u delayed waiting for the decoder, ")
+			_T("average lateness %I64u ms, maximum %I64u ms\n"),
+			filename.c_str(), timing.frames, timing.stalls, timing.totalLate / timing.frames, timing.maxLate);
+	}
+
+	// release the file view
+	if (fileBase != nullptr)
+		UnmapViewOfFile(fileBase);
+}
+
+void Sprite::APNGLoaderState::StartDecoder()
+{
+	// if the first frame was the only frame, there's nothing more to decode
+	if (eof)
+	{
+		decoderDone = true;
+		return;
+	}
+
+	// create the ring space event (auto-reset) and the decoder thread
+	DWORD tid;
+	hRingSpaceEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (hRingSpaceEvent != NULL)
+		hDecoderThread = CreateThread(NULL, 0, &DecoderThreadMain, this, 0, &tid);
+
+	// if that failed, log it; the animation will just show the first frame
+	if (hDecoderThread == NULL)
+	{
+		WindowsErrorMessage winErr;
+		LogFileErrorHandler eh;
+		eh.SysError(MsgFmt(IDS_ERR_IMGLOAD, filename.c_str()),
+			MsgFmt(_T("Animated PNG loader: unable to start the frame decoder thread: %s"), winErr.Get()));
+		decoderDone = true;
+	}
+}
+
+DWORD WINAPI Sprite::APNGLoaderState::DecoderThreadMain(LPVOID param)
 {
-	// read through the next frame
-	if (!eof && ReadThroughNextFrame())
-		CreateAnimFrame(ctx);
+	static_cast<APNGLoaderState*>(param)->DecoderMain();
+	return 0;
 }
 
-bool Sprite::APNGLoaderState::CreateAnimFrame(LoadContext *ctx)
+void Sprite::APNGLoaderState::DecoderMain()
 {
-	// make sure there's a current frame
-	if (frameCur.data == nullptr)
+	for (;;)
+	{
+		// Find the next free slot in the ring.  If the ring is full,
+		// wait for DecodeNext() to consume a frame.
+		UINT slot;
+		{
+			CriticalSectionLocker locker(ringLock);
+			if (shutdown)
+				break;
+
+			if (ringCount == RingSize)
+			{
+				locker.Unlock();
+				WaitForSingleObject(hRingSpaceEvent, INFINITE);
+				continue;
+			}
+
+			slot = (ringHead + ringCount) % RingSize;
+		}
+
+		// decode the next frame; stop at EOF or on a decoding error
+		if (eof || !ReadThroughNextFrame())
+			break;
+
+		// Copy the composed frame into the slot.  DecodeNext() only
+		// touches occupied slots, so we can do this without holding
+		// the lock.  The slot keeps its buffer from the last time
+		// around, so this only allocates the first time through.
+		auto &f = ring[slot];
+		const BYTE *src = frameCur.data.get();
+		f.pix.assign(src, src + frameCur.width * frameCur.height * 4);
+		f.delayNum = frameCur.delayNum;
+		f.delayDen = frameCur.delayDen;
+
+		// publish it
+		CriticalSectionLocker locker(ringLock);
+		++ringCount;
+	}
+
+	// the decoder is finished
+	CriticalSectionLocker locker(ringLock);
+	decoderDone = true;
+}
+
+bool Sprite::APNGLoaderState::DecodeNext(LoadContext *ctx)
+{
+	// note how late we are relative to the scheduled frame change
+	UINT64 now = GetTickCount64();
+	UINT64 late = now > ctx->curAnimFrameEndTime ? now - ctx->curAnimFrameEndTime : 0;
+
+	// check for a decoded frame in the ring
+	CriticalSectionLocker locker(ringLock);
+	if (ringCount != 0)
+	{
+		// Create the texture for the frame at the head of the ring.  The
+		// decoder thread won't touch an occupied slot, so we can release
+		// the lock while we work.
+		auto &f = ring[ringHead];
+		locker.Unlock();
+		CreateAnimFrame(ctx, f.pix.data(), rcFull.right, rcFull.bottom, f.delayNum, f.delayDen);
+
+		// return the slot to the decoder
+		locker.Lock(ringLock);
+		ringHead = (ringHead + 1) % RingSize;
+		--ringCount;
+		locker.Unlock();
+		SetEvent(hRingSpaceEvent);
+	}
+	else if (!decoderDone)
+	{
+		// The decoder hasn't caught up.  Tell the caller to hold the
+		// current frame.  Count this as one stall per frame change, even
+		// though the caller will keep trying on each render cycle.
+		if (!stalled)
+			++timing.stalls;
+		stalled = true;
 		return false;
+	}
+
+	// update the timing statistics
+	stalled = false;
+	timing.frames += 1;
+	timing.totalLate += late;
+	if (late > timing.maxLate)
+		timing.maxLate = late;
 
+	// the next frame is ready
+	return true;
+}
+
+bool Sprite::APNGLoaderState::CreateAnimFrame(LoadContext *ctx, const BYTE *pix, UINT width, UINT height, UINT delayNum, UINT delayDen)
+{
 	// set up the D3D texture descriptor
 	D3D11_TEXTURE2D_DESC txd = CD3D11_TEXTURE2D_DESC(
-		DXGI_FORMAT_R8G8B8A8_UNORM, frameCur.width, frameCur.height, 1, 1,
+		DXGI_FORMAT_R8G8B8A8_UNORM, width, height, 1, 1,
 		D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE,
 		1, 0, 0);
 
 	// set up the subresource descriptor
 	D3D11_SUBRESOURCE_DATA srd;
 	ZeroMemory(&srd, sizeof(srd));
-	srd.pSysMem = frameCur.data.get();
-	srd.SysMemPitch = frameCur.width * 4;
-	srd.SysMemSlicePitch = srd.SysMemPitch * frameCur.height;
+	srd.pSysMem = pix;
+	srd.SysMemPitch = width * 4;
+	srd.SysMemSlicePitch = srd.SysMemPitch * height;
 
 	// set up the shader resource view
 	D3D11_SHADER_RESOURCE_VIEW_DESC svd;
@@ -485,7 +750,7 @@ bool Sprite::APNGLoaderState::CreateAnimFrame(LoadContext *ctx)
 	// as a fraction (numerator divided by denominator) of two 16-bit.
 	// ints.  If the denominator is 0, the implied denominator is 100.
 	// Refigure it as a number of milliseconds.
-	af->dt = static_cast<DWORD>((frameCur.delayNum * 1000) / (frameCur.delayDen == 0 ? 100 : frameCur.delayDen));
+	af->dt = static_cast<DWORD>((delayNum * 1000) / (delayDen == 0 ? 100 : delayDen));
 
 	// create the texture
 	HRESULT hr = D3D::Get()->CreateTexture2D(&txd, &srd, &svd, &af->tv.rv, &af->tv.texture);
@@ -542,28 +807,32 @@ bool Sprite::APNGLoaderState::ReadThroughNextFrame()
 
 	case DOP_PREV:
 		// revert to prior frame
-		frameCur.Take(framePrev);
+		if (framePrev.data != nullptr)
+			frameCur.Copy(framePrev);
 		break;
 	}
 
 	// process the file until finishing the next frame or reaching EOF
-	while (!feof(fp)) 
+	while (filePos < fileSize)
 	{
-		// read the next chunk
+		// read the next chunk; stop if it's truncated
 		Chunk chunk;
-		auto id = ReadChunkSizeAndID(chunk);
+		auto id = ReadChunk(chunk);
+		if (id == 0)
+			break;
 
 		// let's see what we have
 		switch (id)
 		{
 		case ID_acTL:
 			// Animation control - mark it as animated
+			if (chunk.size < 20)
+				return false;
 			isAnimated = true;
-			ReadChunkContents(chunk);
 
 			// decode and save the contents
-			acTL.numFrames = png_get_uint_32(chunk.data.get() + 8);
-			acTL.numPlays = png_get_uint_32(chunk.data.get() + 12);
+			acTL.numFrames = png_get_uint_32(chunk.data + 8);
+			acTL.numPlays = png_get_uint_32(chunk.data + 12);
 			break;
 
 		case ID_fcTL:
@@ -606,7 +875,7 @@ bool Sprite::APNGLoaderState::ReadThroughNextFrame()
 				{
 					// there's no current frame yet, so the raw frame is now
 					// the current frame
-					frameCur.Take(frameRaw);
+					frameCur.Copy(frameRaw);
 				}
 
 				// set the timing data
@@ -622,15 +891,16 @@ bool Sprite::APNGLoaderState::ReadThroughNextFrame()
 			}
 
 			// Decode the new fcTL
-			ReadChunkContents(chunk);
-			fcTL.width = png_get_uint_32(chunk.data.get() + 12);
-			fcTL.height = png_get_uint_32(chunk.data.get() + 16);
-			fcTL.x = png_get_uint_32(chunk.data.get() + 20);
-			fcTL.y = png_get_uint_32(chunk.data.get() + 24);
-			fcTL.delayNum = png_get_uint_16(chunk.data.get() + 28);
-			fcTL.delayDen = png_get_uint_16(chunk.data.get() + 30);
-			fcTL.dop = chunk.data.get()[32];
-			fcTL.bop = chunk.data.get()[33];
+			if (chunk.size < 38)
+				return false;
+			fcTL.width = png_get_uint_32(chunk.data + 12);
+			fcTL.height = png_get_uint_32(chunk.data + 16);
+			fcTL.x = png_get_uint_32(chunk.data + 20);
+			fcTL.y = png_get_uint_32(chunk.data + 24);
+			fcTL.delayNum = png_get_uint_16(chunk.data + 28);
+			fcTL.delayDen = png_get_uint_16(chunk.data + 30);
+			fcTL.dop = chunk.data[32];
+			fcTL.bop = chunk.data[33];
 
 			// limit the size to the IHDR frame size
 			if (fcTL.x > frameRaw.width)
@@ -652,15 +922,12 @@ bool Sprite::APNGLoaderState::ReadThroughNextFrame()
 			// for the next frame
 			if (hasIDAT)
 			{
-				// allocate a new raw frame if necessary
-				if (frameRaw.data == nullptr)
-					frameRaw.Init(rcFull.right, rcFull.bottom, fcTL.delayNum, fcTL.delayDen);
-
 				// Start processing for the new sub-stream that follows
 				// the fcTL chunk.  Patch the original IHDR with the
 				// new size data from the fcTL, so that we create the
-				// raw frame in the proper size.
-				memcpy(IHDR.data.get() + 8, chunk.data.get() + 12, 8);
+				// raw frame in the proper size.  (The raw frame buffer
+				// itself is always full-size, so we can reuse it.)
+				memcpy(IHDR + 8, chunk.data + 12, 8);
 				StartProcessing();
 			}
 
@@ -690,9 +957,8 @@ bool Sprite::APNGLoaderState::ReadThroughNextFrame()
 			if (!isAnimated)
 				return false;
 
-			// read and process the IDAT chunk
-			ReadChunkContents(chunk);
-			ProcessChunk(chunk.data.get(), chunk.size);
+			// process the IDAT chunk
+			ProcessChunk(chunk.data, chunk.size);
 
 			// If we've encountered an fcTL record already, we now have
 			// image data to include in the animation sequence.  The IDAT
@@ -711,13 +977,18 @@ bool Sprite::APNGLoaderState::ReadThroughNextFrame()
 			// equivalent of an IDAT chunk, but simply uses a separate ID
 			// so that the file obeys the rule that IDAT is unique.  Process
 			// this through libpng as though it were an IDAT image frame.
-			// Note that we have to make the fdAT look like an IDAT, by 
-			// patching bytes +4..+11 to make them look like an IDAT
-			// header that's 16 bytes smaller than the actual chunk.
-			ReadChunkContents(chunk);
-			png_save_uint_32(chunk.data.get() + 4, chunk.size - 16);
-			memcpy(chunk.data.get() + 8, "IDAT", 4);
-			ProcessChunk(chunk.data.get() + 4, chunk.size - 4);
+			// The fdAT has a 4-byte sequence number ahead of the image
+			// data, so we feed libpng a synthesized IDAT header with the
+			// image data length, followed by the image data and CRC
+			// straight from the mapped file.
+			if (chunk.size >= 16)
+			{
+				BYTE idatHeader[8];
+				png_save_uint_32(idatHeader, chunk.size - 16);
+				memcpy(idatHeader + 4, "IDAT", 4);
+				ProcessChunk(idatHeader, 8);
+				ProcessChunk(chunk.data + 12, chunk.size - 12);
+			}
 
 			// we now have image data for the current animation frame
 			frameDataAvail = true;
@@ -725,7 +996,6 @@ bool Sprite::APNGLoaderState::ReadThroughNextFrame()
 
 		case ID_IEND:
 			// end marker - flag that we're at EOF
-			ReadChunkContents(chunk);
 			eof = true;
 
 			// if we have image data, compose the last frame into frameCur
@@ -746,17 +1016,16 @@ bool Sprite::APNGLoaderState::ReadThroughNextFrame()
 			}
 
 		default:
-			// read the rest of the chunk; ignore it if it doesn't have a valid PNG ID
-			ReadChunkContents(chunk);
+			// ignore the chunk if it doesn't have a valid PNG ID
 			if (IsValidPngId(id))
 			{
 				// process it
-				ProcessChunk(chunk.data.get(), chunk.size);
+				ProcessChunk(chunk.data, chunk.size);
 
 				// if we haven't reached the first frame's IDAT record yet, 
 				// save it for replay on subsequent fraames
 				if (!hasIDAT)
-					infoChunks.emplace_back(chunk.data.release(), chunk.size);
+					infoChunks.emplace_back(chunk);
 			}
 			break;
 		}
@@ -766,64 +1035,28 @@ bool Sprite::APNGLoaderState::ReadThroughNextFrame()
 	return false;
 }
 
-// PNG chunk header reader.  This reads just the chunk length and ID.
-// Returns the ID.
-DWORD Sprite::APNGLoaderState::ReadChunkSizeAndID(Chunk &chunk)
-{
-	// read the chunk length
-	if (fread(chunk.header, 1, 8, fp) == 8)
-	{
-		// save the size
-		chunk.size = png_get_uint_32(chunk.header) + 12;
-
-		// return the ID
-		return png_get_uint_32(chunk.header + 4);
-	}
-
-	// failed - return ID zero
-	return 0;
-}
-
-// Read the rest of a chunk
-void Sprite::APNGLoaderState::ReadChunkContents(Chunk &chunk)
-{
-	// allocate space
-	chunk.data.reset(new BYTE[chunk.size]);
-
-	// copy the 8 header bytes we've already read
-	memcpy(chunk.data.get(), chunk.header, 8);
-	
-	// read the rest of the chunk
-	fread(chunk.data.get() + 8, 1, chunk.size - 8, fp);
-}
-
-// Skip the rest of a chunk
-void Sprite::APNGLoaderState::SkipChunkContents(Chunk &chunk)
-{
-	// skip the rest of the chunk after the 8 header bytes we've already read
-	fseek(fp, chunk.size - 8, SEEK_CUR);
-}
-
-// PNG chunk reader
+// PNG chunk reader.  This sets up the chunk to point to the chunk
+// data in the mapped file view, and advances past it.
 DWORD Sprite::APNGLoaderState::ReadChunk(Chunk &chunk)
 {
-	// read the chunk length
-	if (fread(chunk.header, 1, 4, fp) == 4)
-	{
-		// set up the Chunk descriptor and allocate space for the contents
-		chunk.size = png_get_uint_32(chunk.header) + 12;
-		chunk.data.reset(new BYTE[chunk.size]);
+	// make sure there's room for the length and ID
+	if (fileSize - filePos < 8)
+		return 0;
 
-		// the first 4 bytes are the length
-		memcpy(chunk.data.get(), chunk.header, 4);
+	// Figure the full chunk size, including the length, ID, and CRC,
+	// and make sure the whole thing is within the file
+	const BYTE *p = fileBase + filePos;
+	UINT64 size = static_cast<UINT64>(png_get_uint_32(p)) + 12;
+	if (size > fileSize - filePos)
+		return 0;
 
-		// read the remainder
-		if (fread(chunk.data.get() + 4, 1, chunk.size - 4, fp) == chunk.size - 4)
-			return png_get_uint_32(chunk.data.get() + 4);
-	}
+	// set up the chunk descriptor and advance past it
+	chunk.data = p;
+	chunk.size = static_cast<UINT>(size);
+	filePos += chunk.size;
 
-	// failed - return ID zero
-	return 0;
+	// return the ID
+	return png_get_uint_32(p + 4);
 }
 
 // Start processing a PNG image
@@ -850,13 +1083,13 @@ bool Sprite::APNGLoaderState::StartProcessing()
 	png_process_data(png, pInfo, header, 8);
 
 	// process the IHDR chunk
-	png_process_data(png, pInfo, IHDR.data.get(), IHDR.size);
+	png_process_data(png, pInfo, IHDR, sizeof(IHDR));
 
 	// process pre-IDAT info chunks
 	if (this->hasIDAT)
 	{
 		for (auto &chunk : infoChunks)
-			png_process_data(png, pInfo, chunk.data.get(), chunk.size);
+			png_process_data(png, pInfo, const_cast<BYTE*>(chunk.data), chunk.size);
 	}
 
 	// success
@@ -882,7 +1115,7 @@ void PNGAPI Sprite::APNGLoaderState::RowCallback(png_structp png, png_bytep pRow
 }
 
 // Process a PNG IDAT frame
-void Sprite::APNGLoaderState::ProcessChunk(BYTE *data, UINT size)
+void Sprite::APNGLoaderState::ProcessChunk(const BYTE *data, UINT size)
 {
 	// validate the context
 	if (png == nullptr || pInfo == nullptr)
@@ -895,8 +1128,8 @@ void Sprite::APNGLoaderState::ProcessChunk(BYTE *data, UINT size)
 		return;
 	}
 
-	// process the data
-	png_process_data(png, pInfo, data, size);
+	// process the data (libpng doesn't modify it, despite the non-const API)
+	png_process_data(png, pInfo, const_cast<BYTE*>(data), size);
 }
 
 // Finish image processing
@@ -1151,9 +1384,12 @@ bool Sprite::LoadGIF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize,
 		}
 	}
 
+	// get the frame texture cache budget, in MB
+	UINT64 frameCacheLimit = static_cast<UINT64>(max(ConfigManager::GetInstance()->GetInt(ConfigVars::GIFFrameCacheLimit, 64), 0)) * 1024 * 1024;
+
 	// Set up the frame decoder state
 	std::unique_ptr<GIFLoaderState> loader(new GIFLoaderState());
-	loader->Init(pWIC, decoder, width, height, nFrames, bgColor, filename);
+	loader->Init(pWIC, decoder, width, height, nFrames, bgColor, filename, frameCacheLimit);
 
 	// create the mesh
 	if (!CreateMesh(normalizedSize, eh, MsgFmt(_T("file \"%ws\""), filename)))
@@ -1180,6 +1416,166 @@ bool Sprite::LoadGIF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize,
 	return true;
 }
 
+// Animated GIF memory statistics
+static volatile LONG64 gifCanvasBytes = 0;
+static volatile LONG64 gifFrameBytes = 0;
+static volatile LONG64 gifCachedFrames = 0;
+static volatile LONG64 gifStreamedFrames = 0;
+
+Sprite::GIFMemoryStats Sprite::GetGIFMemoryStats()
+{
+	return { gifCanvasBytes, gifFrameBytes, gifCachedFrames, gifStreamedFrames };
+}
+
+// Copy one GIF canvas to another, allocating the destination on first use
+static HRESULT CopyGIFCanvas(ScratchImage &dst, const ScratchImage &src)
+{
+	if (dst.GetPixels() == nullptr || dst.GetPixelsSize() != src.GetPixelsSize())
+	{
+		auto &m = src.GetMetadata();
+		if (HRESULT hr = dst.Initialize2D(m.format, m.width, m.height, 1, 1); FAILED(hr))
+			return hr;
+	}
+
+	memcpy(dst.GetPixels(), src.GetPixels(), src.GetPixelsSize());
+	return S_OK;
+}
+
+Sprite::GIFLoaderState::~GIFLoaderState()
+{
+	// release the decoder resources
+	Clear();
+
+	// Remove our frame textures from the statistics.  The textures
+	// belong to the loader context, but the context always discards
+	// them along with the loader.
+	UINT64 streamBytes = streamTV.texture != nullptr ? static_cast<UINT64>(rcFull.right) * rcFull.bottom * 4 : 0;
+	InterlockedAdd64(&gifFrameBytes, -static_cast<LONG64>(frameCacheBytes + streamBytes));
+	InterlockedAdd64(&gifCachedFrames, -static_cast<LONG64>(nCached));
+	InterlockedAdd64(&gifStreamedFrames, -static_cast<LONG64>(nStreamed));
+}
+
+void Sprite::GIFLoaderState::Clear()
+{
+	iFrame = nFrames = 0;
+	filename = _T("");
+	canvas.Release();
+	restoreCanvas.Release();
+	resumeCanvas.Release();
+	UpdateCanvasStats();
+	pWIC = nullptr;
+	decoder = nullptr;
+}
+
+void Sprite::GIFLoaderState::UpdateCanvasStats()
+{
+	UINT64 bytes = canvas.GetPixelsSize() + restoreCanvas.GetPixelsSize() + resumeCanvas.GetPixelsSize();
+	InterlockedAdd64(&gifCanvasBytes, static_cast<LONG64>(bytes) - static_cast<LONG64>(canvasBytes));
+	canvasBytes = bytes;
+}
+
+bool Sprite::GIFLoaderState::DecodeNext(LoadContext *ctx)
+{
+	// if decoding has ended, there's nothing more to do
+	if (nFrames == 0)
+		return true;
+
+	// on the first pass through the animation, decode the next frame
+	if (ctx->animFrames.size() < nFrames)
+	{
+		DecodeFrame(ctx);
+		return true;
+	}
+
+	// We've been through the whole animation once, so all of the cached
+	// frames are ready to go.  If the frame about to be displayed is one
+	// of the streamed frames, we have to decode it into the streaming
+	// texture.
+	UINT next = ctx->curAnimFrame + 1;
+	if (next >= nFrames)
+		next = 0;
+	if (next < nCached)
+		return true;
+
+	// If the decoder isn't positioned at this frame, we've looped back
+	// around to the first streamed frame, so pick up from the canvas we
+	// saved there on the first pass.
+	if (next != iFrame)
+	{
+		if (HRESULT hr = CopyGIFCanvas(canvas, resumeCanvas); FAILED(hr))
+		{
+			LogFileErrorHandler eh;
+			WindowsErrorMessage sysErr(hr);
+			eh.SysError(MsgFmt(IDS_ERR_IMGLOAD, filename.c_str()),
+				MsgFmt(_T("GIF frame decoder: Unable to restore streaming canvas (HRESULT %lx: %s)"), hr, sysErr.Get()));
+			Clear();
+			return true;
+		}
+		iFrame = nCached;
+	}
+
+	// decode through the target frame
+	while (iFrame <= next && iFrame < nFrames)
+		DecodeFrame(ctx);
+
+	return true;
+}
+
+HRESULT Sprite::GIFLoaderState::CreateFrameTexture(const Image &img, TextureAndView *tv)
+{
+	// set up the D3D texture descriptor
+	D3D11_TEXTURE2D_DESC txd = CD3D11_TEXTURE2D_DESC(
+		DXGI_FORMAT_B8G8R8A8_UNORM,
+		static_cast<UINT>(img.width), static_cast<UINT>(img.height),
+		1, 1, D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE,
+		1, 0, 0);
+
+	// set up the subresource descriptor
+	D3D11_SUBRESOURCE_DATA srd;
+	ZeroMemory(&srd, sizeof(srd));
+	srd.pSysMem = img.pixels;
+	srd.SysMemPitch = static_cast<UINT>(img.rowPitch);
+	srd.SysMemSlicePitch = static_cast<UINT>(img.slicePitch);
+
+	// set up the shader resource view
+	D3D11_SHADER_RESOURCE_VIEW_DESC svd;
+	svd.Format = txd.Format;
+	svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	svd.Texture2D.MipLevels = txd.MipLevels;
+	svd.Texture2D.MostDetailedMip = 0;
+
+	// create the texture and resource view
+	return D3D::Get()->CreateTexture2D(&txd, &srd, &svd, &tv->rv, &tv->texture);
+}
+
+HRESULT Sprite::GIFLoaderState::UpdateStreamTexture(const Image &img)
+{
+	// if we haven't created the streaming texture yet, create it with
+	// the image as its initial contents
+	if (streamTV.texture == nullptr)
+	{
+		HRESULT hr = CreateFrameTexture(img, &streamTV);
+		if (SUCCEEDED(hr))
+			InterlockedAdd64(&gifFrameBytes, static_cast<LONG64>(img.slicePitch));
+		return hr;
+	}
+
+	// copy the image into the texture
+	D3D::DeviceContextLocker devctx;
+	D3D11_MAPPED_SUBRESOURCE msr;
+	HRESULT hr = devctx->Map(streamTV.texture, 0, D3D11_MAP_WRITE_DISCARD, 0, &msr);
+	if (FAILED(hr))
+		return hr;
+
+	const BYTE *src = img.pixels;
+	BYTE *dst = static_cast<BYTE*>(msr.pData);
+	for (size_t row = 0; row < img.height; ++row, src += img.rowPitch, dst += msr.RowPitch)
+		memcpy(dst, src, img.width * 4);
+
+	devctx->Unmap(streamTV.texture, 0);
+	return S_OK;
+}
+
 void Sprite::GIFLoaderState::DecodeFrame(LoadContext *ctx)
 {
 	// if we've decoded the last frame, we're done
@@ -1200,32 +1596,38 @@ void Sprite::GIFLoaderState::DecodeFrame(LoadContext *ctx)
 		Clear();
 	};
 
-	// create a scratch image frame
-	std::unique_ptr<ScratchImage> image(new (std::nothrow) ScratchImage);
-	if (image == nullptr)
-		return (hr = E_OUTOFMEMORY), SysErr("Unable to allocate frame memory");
-
-	// initialize the frame, using the previous frame if we have one,
-	// otherwise a blank background
-	if (disposal == DM_PREVIOUS)
-		hr = image->InitializeFromImage(*frames[prevFrame]->GetImage(0, 0, 0));
-	else if (iFrame > 0)
-		hr = image->InitializeFromImage(*frames[iFrame - 1]->GetImage(0, 0, 0));
-	else
-		hr = image->Initialize2D(DXGI_FORMAT_B8G8R8A8_UNORM, rcFull.right, rcFull.bottom, 1, 1);
-
-	if (FAILED(hr))
-		return SysErr("Unable to initialize image frame");
+	// On the first frame, set up the canvas, cleared to the background
+	if (iFrame == 0)
+	{
+		if (FAILED(hr = canvas.Initialize2D(DXGI_FORMAT_B8G8R8A8_UNORM, rcFull.right, rcFull.bottom, 1, 1)))
+			return SysErr("Unable to initialize image frame");
 
-	// get the current image as the starting point for composition
-	auto composedImage = image->GetImage(0, 0, 0);
+		FillGIFRect(*canvas.GetImage(0, 0, 0), rcFull, bgColor);
+		UpdateCanvasStats();
+	}
 
-	// fill the whole first frame with the background; fill later
-	// frames over the update area
-	if (iFrame == 0)
-		FillGIFRect(*composedImage, rcFull, bgColor);
-	else if (disposal == DM_BACKGROUND)
-		FillGIFRect(*composedImage, rcSub, bgColor);
+	// get the canvas as the starting point for composition
+	auto composedImage = canvas.GetImage(0, 0, 0);
+
+	// Figure out whether this frame gets its own texture or is streamed.
+	// On the first pass, we cache frames until we reach the byte budget,
+	// and stream everything from there on.  The first frame is always
+	// cached, regardless of the budget.  On later passes, we only come
+	// here to decode streamed frames.
+	bool firstPass = (ctx->animFrames.size() == iFrame);
+	UINT64 frameBytes = composedImage->slicePitch;
+	bool streamed = !firstPass
+		|| nCached != iFrame
+		|| (iFrame != 0 && frameCacheBytes + frameBytes > frameCacheLimit);
+
+	// If this is the first streamed frame, save the canvas as the resume
+	// point for decoding the streamed frames again on later passes
+	if (firstPass && streamed && iFrame == nCached)
+	{
+		if (FAILED(hr = CopyGIFCanvas(resumeCanvas, canvas)))
+			return SysErr("Unable to save canvas for streaming");
+		UpdateCanvasStats();
+	}
 
 	// decode the frame
 	RefPtr<IWICBitmapFrameDecode> decodedFrame;
@@ -1246,6 +1648,7 @@ void Sprite::GIFLoaderState::DecodeFrame(LoadContext *ctx)
 	// if we can't get the reader, as the frame might not have any
 	// metadata.
 	LONG delay = 0;
+	disposal = DM_UNDEFINED;
 	RefPtr<IWICMetadataQueryReader> meta;
 	if (SUCCEEDED(decodedFrame->GetMetadataQueryReader(&meta)))
 	{
@@ -1274,7 +1677,6 @@ void Sprite::GIFLoaderState::DecodeFrame(LoadContext *ctx)
 			rcSub.bottom = rcSub.top + lval;
 
 		// get the disposal for the frame
-		disposal = DM_UNDEFINED;
 		PROPVARIANTEx dprop;
 		if (SUCCEEDED(meta->GetMetadataByName(L"/grctlext/Disposal", &dprop))
 			&& dprop.vt == VT_UI1)
@@ -1285,6 +1687,15 @@ void Sprite::GIFLoaderState::DecodeFrame(LoadContext *ctx)
 			delay = lval * 10;
 	}
 
+	// If the frame reverts to the previous image after it's displayed,
+	// save the canvas as it stands before we draw the frame
+	if (disposal == DM_PREVIOUS)
+	{
+		if (FAILED(hr = CopyGIFCanvas(restoreCanvas, canvas)))
+			return SysErr("Unable to save canvas for frame disposal");
+		UpdateCanvasStats();
+	}
+
 	UINT w, h;
 	if (FAILED(hr = decodedFrame->GetSize(&w, &h)))
 		return SysErr("Unable to read frame size");
@@ -1309,7 +1720,7 @@ void Sprite::GIFLoaderState::DecodeFrame(LoadContext *ctx)
 	if (FAILED(hr = conv->CopyPixels(nullptr, static_cast<UINT>(img->rowPitch), static_cast<UINT>(img->slicePitch), img->pixels)))
 		return SysErr("Unable to copy pixels to raw frame");
 
-	// copy the first frame, or blend the new frame with the last frame
+	// copy the first frame, or blend the new frame with the canvas
 	if (iFrame == 0)
 	{
 		Rect rcFull(0, 0, img->width, img->height);
@@ -1322,55 +1733,54 @@ void Sprite::GIFLoaderState::DecodeFrame(LoadContext *ctx)
 		BlendGIFRect(*composedImage, *img, rcSub);
 	}
 
-	// if we're not reverting to the previous frame, this frame
-	// will be the previous frame for the next frame with 
-	// disposal method DM_PREVIOUS
-	if (disposal != DM_PREVIOUS)
-		prevFrame = iFrame;
+	// on the first pass, add an animation frame for this frame
+	if (firstPass)
+		ctx->animFrames.emplace_back(new AnimFrame())->dt = static_cast<DWORD>(delay);
 
-	// Create a D3D texture and shader resource view for the frame
+	// Load the canvas into the frame's texture
+	auto animFrame = ctx->animFrames[iFrame].get();
+	if (!streamed)
 	{
-		// get the image data
-		auto imageData = image->GetImage(0, 0, 0);
-
-		// create an animation frame
-		auto animFrame = ctx->animFrames.emplace_back(new AnimFrame()).get();
-		animFrame->dt = static_cast<DWORD>(delay);
-
-		// set up the D3D texture descriptor
-		D3D11_TEXTURE2D_DESC txd = CD3D11_TEXTURE2D_DESC(
-			DXGI_FORMAT_B8G8R8A8_UNORM,
-			static_cast<UINT>(imageData->width), static_cast<UINT>(imageData->height),
-			1, 1, D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE,
-			1, 0, 0);
-
-		// set up the subresource descriptor
-		D3D11_SUBRESOURCE_DATA srd;
-		ZeroMemory(&srd, sizeof(srd));
-		srd.pSysMem = imageData->pixels;
-		srd.SysMemPitch = static_cast<UINT>(imageData->rowPitch);
-		srd.SysMemSlicePitch = static_cast<UINT>(imageData->slicePitch);
-
-		// set up the shader resource view
-		D3D11_SHADER_RESOURCE_VIEW_DESC svd;
-		svd.Format = txd.Format;
-		svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		svd.Texture2D.MipLevels = txd.MipLevels;
-		svd.Texture2D.MostDetailedMip = 0;
-
-		// create the texture and resource view
-		if (FAILED(hr = D3D::Get()->CreateTexture2D(&txd, &srd, &svd, &animFrame->tv.rv, &animFrame->tv.texture)))
+		// cached frame - create its own texture
+		if (FAILED(hr = CreateFrameTexture(*composedImage, &animFrame->tv)))
 			return SysErr("CreateTexture2D failed");
+
+		// count it in the cache
+		++nCached;
+		frameCacheBytes += frameBytes;
+		InterlockedAdd64(&gifFrameBytes, static_cast<LONG64>(frameBytes));
+		InterlockedIncrement64(&gifCachedFrames);
+	}
+	else
+	{
+		// streamed frame - load it into the shared streaming texture
+		if (FAILED(hr = UpdateStreamTexture(*composedImage)))
+			return SysErr("Unable to update streaming texture");
+
+		// on the first pass, point the frame at the streaming texture
+		if (firstPass)
+		{
+			animFrame->tv.texture = streamTV.texture;
+			animFrame->tv.rv = streamTV.rv;
+			++nStreamed;
+			InterlockedIncrement64(&gifStreamedFrames);
+		}
 	}
 
-	// Add the image to the results, to facilitate composing subsequent frames
-	frames.emplace_back(std::move(image));
+	// Apply the frame's disposal, to leave the canvas ready for the
+	// next frame
+	if (disposal == DM_BACKGROUND)
+		FillGIFRect(*composedImage, rcSub, bgColor);
+	else if (disposal == DM_PREVIOUS)
+		memcpy(canvas.GetPixels(), restoreCanvas.GetPixels(), canvas.GetPixelsSize());
 
 	// advance to the next frame
 	++iFrame;
 
-	// if we're done, clear resources
-	if (iFrame >= nFrames)
+	// If we're done, and all of the frames are cached, we have no further
+	// need for the decoder, so clear resources.  If we're streaming, keep
+	// the decoder open for the next pass.
+	if (iFrame >= nFrames && nCached == nFrames)
 		Clear();
 }
 
@@ -1496,6 +1906,7 @@ bool Sprite::CreateTextureFromBitmap(const BITMAPINFO &bmi, const void *dibits,
 
 	// set up a new load context
 	loadContext.Attach(new LoadContext());
+	ContentChanged();
 
 	// create the texture and load it into the new load context
 	return CreateTextureFromBitmapStatic(bmi, dibits, eh, descForErrors, &loadContext->tv);
@@ -1611,19 +2022,40 @@ bool Sprite::CreateMesh(POINTF sz, ErrorHandler &eh, const TCHAR *descForErrors)
 		return false;
 	}
 
-	// remember the load size
+	// remember the load size and mesh size
 	loadSize = sz;
+	meshSize = sz;
+	ContentChanged();
 
 	// success
 	return true;
 }
 
 void Sprite::Render(Camera *camera)
+{
+	// prepare the frame; do nothing if there's nothing to draw
+	ID3D11ShaderResourceView *rvToRender = PrepareFrame();
+	if (rvToRender == nullptr)
+		return;
+
+	// prepare my shader
+	Shader *ts = GetShader();
+	ts->PrepareForRendering(camera);
+	ts->SetAlpha(UpdateFade());
+
+	// load our texture into the pixel shader
+	D3D::Get()->PSSetShaderResources(0, 1, &rvToRender);
+
+	// do the basic mesh rendering
+	RenderMesh();
+}
+
+ID3D11ShaderResourceView *Sprite::PrepareFrame()
 {
 	// If there's no loader context, or it's not ready, we don't have 
 	// anything to render
 	if (loadContext == nullptr || loadContext->readyState == LoadContext::ReadyState::Loading)
-		return;
+		return nullptr;
 
 	// Check if the context is newly ready
 	if (loadContext->readyState == LoadContext::ReadyState::Loaded)
@@ -1674,11 +2106,11 @@ void Sprite::Render(Camera *camera)
 			// re-create our main texture and shader resource view
 			SilentErrorHandler eh;
 			if (!CreateTextureFromBitmap(bmi, bits, eh, _T("Load Shockwave Flash frame")))
-				return;
+				return nullptr;
 
 			// re-create our staging texture
 			if (!CreateStagingTexture(bmi.bmiHeader.biWidth, abs(bmi.bmiHeader.biHeight), eh))
-				return;
+				return nullptr;
 
 			// We no longer need to copy the updated bitmap to the texture,
 			// because we just created a brand new texture using the bitmap
@@ -1753,8 +2185,10 @@ void Sprite::Render(Camera *camera)
 		UINT64 now = GetTickCount64();
 		while (animRunning && now >= loadContext->curAnimFrameEndTime)
 		{
-			// If decoding is still in progress, decode the next frame
-			loadContext->animation->DecodeNext(loadContext);
+			// If decoding is still in progress, decode the next frame.  If
+			// the decoder hasn't caught up yet, hold the current frame.
+			if (!loadContext->animation->DecodeNext(loadContext))
+				break;
 
 			// advance to the next frame; loop after the last frame
 			if (++loadContext->curAnimFrame >= loadContext->animFrames.size())
@@ -1790,20 +2224,8 @@ void Sprite::Render(Camera *camera)
 			rvToRender = loadContext->animFrames[loadContext->curAnimFrame]->tv.rv;
 	}
 
-	// do nothing if we don't have a shader resource view
-	if (rvToRender == nullptr)
-		return;
-
-	// prepare my shader
-	Shader *ts = GetShader();
-	ts->PrepareForRendering(camera);
-	ts->SetAlpha(UpdateFade());
-
-	// load our texture into the pixel shader
-	D3D::Get()->PSSetShaderResources(0, 1, &rvToRender);
-
-	// do the basic mesh rendering
-	RenderMesh();
+	// return the view to draw (which might be null, if we don't have one)
+	return rvToRender;
 }
 
 Shader *Sprite::GetShader() const
@@ -1812,6 +2234,57 @@ Shader *Sprite::GetShader() const
 	return Application::Get()->textureShader.get();
 }
 
+bool Sprite::CanBatch() const
+{
+	// The batcher draws with the instanced version of the texture
+	// shader, so we can only batch sprites that use the texture shader.
+	// We also need a mesh, since we don't draw anything without one.
+	return vertexBuffer != nullptr && GetShader() == Application::Get()->textureShader.get();
+}
+
+XMMATRIX Sprite::GetBatchWorld() const
+{
+	return XMMatrixMultiply(XMMatrixScaling(meshSize.x, meshSize.y, 1.0f), world);
+}
+
+bool Sprite::IsLive() const
+{
+	// a fade changes the alpha on every frame
+	if (fadeDir != 0)
+		return true;
+
+	// Flash objects can redraw themselves at any time
+	if (flashSite != nullptr)
+		return true;
+
+	if (loadContext != nullptr)
+	{
+		// a load that hasn't been displayed yet will change when it's ready
+		if (loadContext->readyState != LoadContext::ReadyState::Ready)
+			return true;
+
+		// a running animation changes when the next frame is due
+		if (loadContext->animation != nullptr && animRunning
+			&& GetTickCount64() >= loadContext->curAnimFrameEndTime)
+			return true;
+	}
+
+	// the sprite is static
+	return false;
+}
+
+Sprite::DrawState Sprite::GetDrawState() const
+{
+	DrawState ds;
+	ds.sprite = this;
+	ds.contentSerial = contentSerial;
+	ds.animFrame = loadContext != nullptr ? loadContext->curAnimFrame : 0;
+	ds.alpha = alpha;
+	ds.live = IsLive();
+	XMStoreFloat4x4(&ds.world, world);
+	return ds;
+}
+
 void Sprite::RenderMesh()
 {
 	// we can only proceed if we have valid vertex and index buffers
@@ -1913,4 +2386,5 @@ void Sprite::Clear()
 	vertexBuffer = nullptr;
 	indexBuffer = nullptr;
 	loadContext = nullptr;
+	ContentChanged();
 }
@@ -79,9 +79,57 @@ public:
 	// shader resource view is currently loaded.
 	void RenderMesh();
 
+	// Prepare for drawing the current frame, and get the shader resource
+	// view to draw.  This does the per-frame work of advancing animations
+	// and refreshing Flash textures.  Returns null if there's nothing to
+	// draw.  Render() calls this, and so does the sprite batcher for the
+	// sprites that it draws itself.
+	ID3D11ShaderResourceView *PrepareFrame();
+
+	// Can the sprite batcher draw this sprite?  This is true for plain
+	// textured sprites, which the batcher draws through the instanced
+	// version of the texture shader.  Sprites with special shaders or
+	// custom rendering have to be drawn individually through Render().
+	virtual bool CanBatch() const;
+
+	// Get the world transform for drawing through the sprite batcher.
+	// The batcher draws every sprite with a shared unit quad, so this
+	// folds our mesh size into our world transform.
+	DirectX::XMMATRIX GetBatchWorld() const;
+
 	// Is the first frame ready for display?
 	virtual bool IsFrameReady() const { return loadContext != nullptr && loadContext->readyState == LoadContext::ReadyState::Ready; }
 
+	// Is the sprite's appearance changing on its own?  This is true when
+	// a fade is in progress, when an animation frame is due, while a load
+	// is completing, and for live media such as Flash and video, since
+	// any of these can change what the sprite draws from one frame to
+	// the next without any change to its drawing state (see below).
+	virtual bool IsLive() const;
+
+	// Drawing state.  This captures everything about the sprite that
+	// determines what it draws, apart from live content (see IsLive()),
+	// so that a window can tell whether a new frame would be identical
+	// to the last one it drew.  'contentSerial' changes whenever the
+	// sprite's texture or mesh is replaced.
+	struct DrawState
+	{
+		const Sprite *sprite;
+		UINT64 contentSerial;
+		UINT animFrame;
+		float alpha;
+		bool live;
+		DirectX::XMFLOAT4X4 world;
+
+		bool SameAs(const DrawState &other) const
+		{
+			return sprite == other.sprite && contentSerial == other.contentSerial
+				&& animFrame == other.animFrame && alpha == other.alpha
+				&& memcmp(&world, &other.world, sizeof(world)) == 0;
+		}
+	};
+	DrawState GetDrawState() const;
+
 	// image load size, in normalized coordinates (window height = 1.0)
 	POINTF loadSize;
 
@@ -155,6 +203,17 @@ public:
 	// and animated GIFs, which don't require this service.
 	virtual void ServiceLoopNeededMessage(ErrorHandler&) { }
 
+	// Animated GIF memory statistics.  These are global counters across
+	// all sprites, for the performance overlay.
+	struct GIFMemoryStats
+	{
+		INT64 canvasBytes;      // decoder canvases and snapshots
+		INT64 frameBytes;       // frame textures (cached frames plus streaming textures)
+		INT64 cachedFrames;     // frames with their own textures
+		INT64 streamedFrames;   // frames decoded again each time they're played
+	};
+	static GIFMemoryStats GetGIFMemoryStats();
+
 protected:
 	virtual ~Sprite();
 
@@ -222,6 +281,15 @@ protected:
 	RefPtr<ID3D11Buffer> vertexBuffer;
 	RefPtr<ID3D11Buffer> indexBuffer;
 
+	// size of the mesh in the vertex buffer, in normalized units
+	POINTF meshSize = { 0.0f, 0.0f };
+
+	// Content serial number, for the drawing state.  Call ContentChanged()
+	// to assign a new serial number whenever the texture or mesh changes.
+	UINT64 contentSerial = 0;
+	void ContentChanged() { contentSerial = static_cast<UINT64>(InterlockedIncrement64(&lastContentSerial)); }
+	static volatile LONG64 lastContentSerial;
+
 	// Flash client site, for SWF objects
 	RefPtr<FlashClientSite> flashSite;
 
@@ -243,12 +311,15 @@ protected:
 	};
 
 	// Animation loader interface.  This is the abstract base class
-	// for the various animation formats (GIF, APNG, SWF).
+	// for the various animation formats (GIF, APNG, SWF).  DecodeNext()
+	// is called when it's time to advance to the next frame.  It returns
+	// false if the next frame isn't ready yet, in which case the caller
+	// should keep showing the current frame and try again later.
 	struct LoadContext;
 	struct Animation
 	{
 		virtual ~Animation() { }
-		virtual void DecodeNext(LoadContext *) = 0;
+		virtual bool DecodeNext(LoadContext *) = 0;
 	};
 
 	// Deferred loader context.  Loading images can take a noticable
@@ -331,7 +402,7 @@ protected:
 		virtual ~SWFLoaderState();
 
 		// Animation interface implementation
-		virtual void DecodeNext(LoadContext *ctx) override;
+		virtual bool DecodeNext(LoadContext *ctx) override;
 
 		// release resources
 		void Clear() { }
@@ -382,17 +453,13 @@ protected:
 	struct GIFLoaderState : Animation
 	{
 		// Animation interface implementation
-		virtual ~GIFLoaderState() { Clear(); }
-		virtual void DecodeNext(LoadContext *ctx) override
-		{
-			// if we haven't reached the last frame yet, decode the next frame
-			if (ctx->animFrames.size() < nFrames)
-				DecodeFrame(ctx);
-		}
+		virtual ~GIFLoaderState();
+		virtual bool DecodeNext(LoadContext *ctx) override;
 
 		// initialize
 		void Init(IWICImagingFactory *pWIC, IWICBitmapDecoder *decoder, 
-			UINT width, UINT height, UINT nFrames, WICColor bgColor, const WCHAR *filename)
+			UINT width, UINT height, UINT nFrames, WICColor bgColor, const WCHAR *filename,
+			UINT64 frameCacheLimit)
 		{
 			this->pWIC = pWIC;
 			this->decoder = decoder;
@@ -400,19 +467,13 @@ protected:
 			this->nFrames = nFrames;
 			this->bgColor = bgColor;
 			this->filename = filename;
-
-			this->frames.reserve(nFrames);
+			this->frameCacheLimit = frameCacheLimit;
 		}
 
-		// clear - releases resources when we're done
-		void Clear()
-		{
-			iFrame = nFrames = 0;
-			filename = _T("");
-			frames.clear();
-			pWIC = nullptr;
-			decoder = nullptr;
-		}
+		// Clear - releases the decoder resources when we're done.  This
+		// doesn't affect the frame textures, which belong to the loader
+		// context.
+		void Clear();
 
 		// WIC factory
 		RefPtr<IWICImagingFactory> pWIC;
@@ -432,20 +493,21 @@ protected:
 		// current frame number
 		UINT iFrame = 0;
 
-		// "Previous" frame number, for frame disposal purposes.
-		// One of the disposal codes is "revert to previous"; this
-		// keeps track of the frame that refers to.
-		UINT prevFrame = 0;
-
-		// Image frame history.  GIF specifies each frame
-		// as a difference from a previous frame, so we 
-		// need to keep a history of recent frames.  We
-		// actually only need the current frame and one
-		// prior frame, so we could make this more
-		// efficient, but for now we'll keep all frames.
-		std::vector<std::unique_ptr<DirectX::ScratchImage>> frames;
-
-		// GIF "Disposal" code for the prior frame
+		// Compositing canvas.  GIF specifies each frame as a difference
+		// from the prior frame, so we compose each frame by drawing it
+		// over the canvas left by the previous frame.  The previous
+		// frame's disposal (clear to background, or revert) has already
+		// been applied by the time we start on the next frame, so the
+		// canvas is the only state we need to carry between frames.
+		DirectX::ScratchImage canvas;
+
+		// "Restore previous" snapshot.  When a frame's disposal code is
+		// DM_PREVIOUS, we save the canvas here before drawing the frame,
+		// and copy it back after the frame has been displayed.  This is
+		// only allocated if the file actually uses DM_PREVIOUS.
+		DirectX::ScratchImage restoreCanvas;
+
+		// GIF "Disposal" code for the current frame
 		enum disposal_t {
 			DM_UNDEFINED = 0,
 			DM_NONE = 1,         // keep this frame, draw next frame on top of it
@@ -459,19 +521,54 @@ protected:
 		// sub-frame rectangle for the current frame
 		RECT rcSub = { 0, 0, 0, 0 };
 
+		// Frame cache.  Each frame we decode becomes a D3D texture in the
+		// loader context's animation frame list, so the first pass through
+		// the animation caches every frame, up to a byte budget.  Frames
+		// past the budget are "streamed": they all share a single dynamic
+		// texture, which we update by decoding each one again as playback
+		// reaches it.  nCached is the number of leading frames with their
+		// own textures; if it's less than nFrames, we're streaming.
+		UINT64 frameCacheLimit = 0;
+		UINT64 frameCacheBytes = 0;
+		UINT nCached = 0;
+		UINT nStreamed = 0;
+		TextureAndView streamTV;
+
+		// Resume point for streaming.  This is a copy of the canvas as it
+		// stood just before the first streamed frame, so that when playback
+		// loops back around to the streamed frames, we can pick up decoding
+		// there without decoding the cached frames again.
+		DirectX::ScratchImage resumeCanvas;
+
+		// Canvas bytes currently counted in the global memory statistics
+		UINT64 canvasBytes = 0;
+
+		// update the global memory statistics for changes in the canvas allocations
+		void UpdateCanvasStats();
+
 		// Decode the next GIF frame
 		void DecodeFrame(LoadContext *ctx);
+
+		// create a D3D texture and shader resource view for a frame
+		HRESULT CreateFrameTexture(const DirectX::Image &img, TextureAndView *tv);
+
+		// load a streamed frame into the streaming texture
+		HRESULT UpdateStreamTexture(const DirectX::Image &img);
 	};
 
 	// Animated PNG incremental frame reader.  This is the PNG
-	// counterpart of the GIF frame reader: it keeps track of the
-	// read position in an open PNG file so that we can read one
-	// frame at a time on demand.
+	// counterpart of the GIF frame reader.  The file is memory-mapped,
+	// so reading a chunk just means pointing into the mapped view.  The
+	// first frame is decoded synchronously in Init(); after that, a
+	// background thread decodes ahead of playback into a small ring of
+	// composed frames, and DecodeNext() turns the next ready frame into
+	// a texture.  The ring slots own their pixel buffers, so once the
+	// ring has filled, decoding doesn't allocate any more memory.
 	struct APNGLoaderState : Animation
 	{
 		// Animation interface implementation
-		virtual ~APNGLoaderState() { EndProcessing(); }
-		virtual void DecodeNext(LoadContext *ctx) override;
+		virtual ~APNGLoaderState();
+		virtual bool DecodeNext(LoadContext *ctx) override;
 
 		// Initialize.  This opens the file and scans for the animated
 		// PNG marker chunk.  Returns true if we successfully identify
@@ -483,8 +580,17 @@ protected:
 		// can determine what to do with the file;
 		bool Init(Sprite *sprite, const WCHAR *filename, POINTF normalizedSize, SIZE pixSize);
 
-		// file handle
-		FILEPtrHolder fp;
+		// Start the decode-ahead thread.  Init() calls this after
+		// decoding the first frame.
+		void StartDecoder();
+
+		// Memory-mapped file.  fileBase points to the mapped view, and
+		// filePos is the read position within it.
+		HandleHolder hFile;
+		HandleHolder hFileMapping;
+		const BYTE *fileBase = nullptr;
+		size_t fileSize = 0;
+		size_t filePos = 0;
 
 		// sprite file name, for error reporting
 		WSTRING filename;
@@ -501,17 +607,15 @@ protected:
 		// sub-frame rectangle for the current frame
 		RECT rcSub = { 0, 0, 0, 0 };
 
-		// PNG chunk
+		// PNG chunk.  This points directly into the mapped file view,
+		// so it's only valid as long as the mapping is open.
 		struct Chunk
 		{
-			Chunk() : size(0) { }
-			Chunk(BYTE *data, UINT size) : data(data), size(size) { }
+			Chunk() : data(nullptr), size(0) { }
+			Chunk(const BYTE *data, UINT size) : data(data), size(size) { }
 
-			std::unique_ptr<BYTE> data;
+			const BYTE *data;
 			UINT size;
-			BYTE header[8];
-
-			void Clear() { data.reset(); }
 		};
 
 		// APNG frame
@@ -519,12 +623,18 @@ protected:
 		{
 			void Init(UINT width, UINT height, UINT delayNum, UINT delayDen)
 			{
-				// save the properties
-				this->width = width;
-				this->height = height;
+				// save the timing
 				this->delayNum = delayNum;
 				this->delayDen = delayDen;
-					
+
+				// if we already have a buffer of this size, reuse it
+				if (data != nullptr && width == this->width && height == this->height)
+					return;
+
+				// save the size
+				this->width = width;
+				this->height = height;
+
 				// allocate the pixel buffer, 32 bits = 4 bytes per pixel
 				UINT bytesPerRow = width * 4;
 				data.reset(new BYTE[height * bytesPerRow]);
@@ -536,24 +646,11 @@ protected:
 					rows.get()[row] = rowp;
 			}
 
-			// take ownership of another frame's resources
-			void Take(APNGFrame &src)
-			{
-				// take ownership of the image data
-				data.reset(src.data.release());
-				rows.reset(src.rows.release());
-
-				// copy the properties
-				width = src.width;
-				height = src.height;
-				delayNum = src.delayNum;
-				delayDen = src.delayDen;
-			}
-
-			// make a copy of another frame's resources
+			// Make a copy of another frame's contents.  This reuses our
+			// existing buffer if it's already the right size.
 			void Copy(const APNGFrame &src)
 			{
-				// copy properties and allocate memory
+				// copy properties and allocate memory if necessary
 				Init(src.width, src.height, src.delayNum, src.delayDen);
 
 				// Copy the image data.  Note that we DON'T copy the row
@@ -564,10 +661,10 @@ protected:
 
 			std::unique_ptr<BYTE> data;
 			std::unique_ptr<BYTE*> rows;
-			UINT width;
-			UINT height;
-			UINT delayNum;          // delay numerator
-			UINT delayDen;          // delay denominator
+			UINT width = 0;
+			UINT height = 0;
+			UINT delayNum = 0;      // delay numerator
+			UINT delayDen = 0;      // delay denominator
 		};
 
 		// acTL data
@@ -650,7 +747,7 @@ protected:
 		// lets the static libpng believe it's decoding a complete PNG file
 		// for each frame.
 		bool StartProcessing();
-		void ProcessChunk(BYTE *p, UINT size);
+		void ProcessChunk(const BYTE *p, UINT size);
 		bool EndProcessing();
 
 		// Read the file through the next image frame.  Returns true if we
@@ -666,8 +763,9 @@ protected:
 		// libpng info struct
 		png_infop pInfo = nullptr;
 
-		// IHDR chunk
-		Chunk IHDR;
+		// IHDR chunk.  We keep a private copy of this rather than pointing
+		// into the file, since we patch the frame size for each sub-stream.
+		BYTE IHDR[25];
 
 		// pre-IDAT info chunks
 		std::list<Chunk> infoChunks;
@@ -684,17 +782,61 @@ protected:
 		// do we have frame data to include in the animation?
 		bool frameDataAvail = false;
 
-		// Read a chunk size and ID header, returning the ID
-		DWORD ReadChunkSizeAndID(Chunk &chunk);
-
-		// Read/skip the rest of the chunk after the size and ID header
-		void ReadChunkContents(Chunk &chunk);
-		void SkipChunkContents(Chunk &chunk);
-
-		// Read a PNG chunk, returning the ID
+		// Read the next PNG chunk from the mapped file, returning the ID.
+		// Returns zero at EOF or if the chunk runs past the end of the file.
 		DWORD ReadChunk(Chunk &chunk);
 
-		// create an animation frame and add it to the sprite's frame list
-		bool CreateAnimFrame(LoadContext *ctx);
+		// create an animation frame from a composed frame buffer, and add
+		// it to the sprite's frame list
+		bool CreateAnimFrame(LoadContext *ctx, const BYTE *pix, UINT width, UINT height, UINT delayNum, UINT delayDen);
+
+		// Decoded frame ring.  The decoder thread composes frames into
+		// the slot at ringHead+ringCount, and DecodeNext() consumes them
+		// from ringHead.  Each slot's buffer is allocated the first time
+		// the slot is used, and reused from then on.
+		struct ReadyFrame
+		{
+			std::vector<BYTE> pix;
+			UINT delayNum = 0;
+			UINT delayDen = 0;
+		};
+		static const UINT RingSize = 4;
+		ReadyFrame ring[RingSize];
+		UINT ringHead = 0;
+		UINT ringCount = 0;
+
+		// lock for the ring and the decoder status flags
+		CriticalSection ringLock;
+
+		// Ring space event.  DecodeNext() signals this when it frees a
+		// slot, and the destructor signals it when shutting down the
+		// decoder thread, to wake the thread if it's waiting for space.
+		HandleHolder hRingSpaceEvent;
+
+		// decoder thread
+		HandleHolder hDecoderThread;
+		static DWORD WINAPI DecoderThreadMain(LPVOID param);
+		void DecoderMain();
+
+		// Decoder status.  decoderDone is set when the decoder thread
+		// reaches the end of the file (or an error); shutdown tells the
+		// thread to exit early.
+		volatile bool decoderDone = false;
+		volatile bool shutdown = false;
+
+		// Frame timing statistics.  We record how late each frame switch
+		// happens relative to its scheduled time, and how often playback
+		// had to hold a frame because the decoder hadn't caught up.  These
+		// are written to the log when the loader is deleted.
+		struct
+		{
+			UINT64 frames = 0;       // frame switches
+			UINT64 stalls = 0;       // switches delayed waiting for the decoder
+			UINT64 totalLate = 0;    // total lateness, in milliseconds
+			UINT64 maxLate = 0;      // maximum lateness, in milliseconds
+		} timing;
+
+		// is playback currently held waiting for the decoder?
+		bool stalled = false;
 	};
 };
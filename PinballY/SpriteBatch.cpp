@@ -0,0 +1,199 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+#include "stdafx.h"
+#include "SpriteBatch.h"
+#include "SpriteBatchShader.h"
+#include "Sprite.h"
+#include "Application.h"
+#include "LogFile.h"
+
+using namespace DirectX;
+
+SpriteBatch::SpriteBatch()
+{
+}
+
+SpriteBatch::~SpriteBatch()
+{
+}
+
+bool SpriteBatch::CreateQuad()
+{
+	// if we've already created the quad, there's nothing to do
+	if (quadVertexBuffer != nullptr && quadIndexBuffer != nullptr)
+		return true;
+
+	// Unit quad vertices.  This is the same layout as Sprite::CreateMesh()
+	// uses, at unit size; the instance transform scales it to the sprite's
+	// mesh size.
+	const CommonVertex v[] = {
+		{ XMFLOAT4(-0.5f, 0.5f, 0.0f, 0.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT3(0, 1, 0) },  // top left
+		{ XMFLOAT4(0.5f, 0.5f, 0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT3(0, 1, 0) },   // top right
+		{ XMFLOAT4(0.5f, -0.5f, 0.0f, 0.0f), XMFLOAT2(1.0f, 1.0f), XMFLOAT3(0, 1, 0) },  // bottom right
+		{ XMFLOAT4(-0.5f, -0.5f, 0.0f, 0.0f), XMFLOAT2(0.0f, 1.0f), XMFLOAT3(0, 1, 0) }  // bottom left
+	};
+	static const WORD idx[] = {
+		0, 1, 2,
+		2, 3, 0
+	};
+
+	// create the vertex buffer
+	D3D *d3d = D3D::Get();
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = (UINT)sizeof(v);
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	D3D11_SUBRESOURCE_DATA sd;
+	ZeroMemory(&sd, sizeof(sd));
+	sd.pSysMem = v;
+	HRESULT hr;
+	if (FAILED(hr = d3d->CreateBuffer(&bd, &sd, &quadVertexBuffer, "SpriteBatch::quadVertexBuffer")))
+	{
+		LogFile::Get()->Write(_T("Sprite batch: error creating quad vertex buffer, HRESULT %lx\n"), (long)hr);
+		return false;
+	}
+
+	// create the index buffer
+	bd.ByteWidth = (UINT)sizeof(idx);
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	sd.pSysMem = idx;
+	if (FAILED(hr = d3d->CreateBuffer(&bd, &sd, &quadIndexBuffer, "SpriteBatch::quadIndexBuffer")))
+	{
+		LogFile::Get()->Write(_T("Sprite batch: error creating quad index buffer, HRESULT %lx\n"), (long)hr);
+		return false;
+	}
+
+	// success
+	return true;
+}
+
+bool SpriteBatch::ReserveInstances(size_t n)
+{
+	// if the current buffer is big enough, keep it
+	if (instanceBuffer != nullptr && n <= instanceCapacity)
+		return true;
+
+	// grow in powers of two, to keep reallocations rare as the list grows
+	size_t newCapacity = 64;
+	while (newCapacity < n)
+		newCapacity *= 2;
+
+	// create the new buffer
+	instanceBuffer = nullptr;
+	instanceCapacity = 0;
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = (UINT)(sizeof(SpriteBatchShader::InstanceData) * newCapacity);
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	HRESULT hr;
+	if (FAILED(hr = D3D::Get()->CreateBuffer(&bd, &instanceBuffer, "SpriteBatch::instanceBuffer")))
+	{
+		LogFile::Get()->Write(_T("Sprite batch: error creating instance buffer, HRESULT %lx\n"), (long)hr);
+		return false;
+	}
+
+	// success
+	instanceCapacity = newCapacity;
+	return true;
+}
+
+void SpriteBatch::Render(Camera *camera, const std::list<RefPtr<Sprite>> &sprites)
+{
+	// reset the frame state
+	stats = Stats();
+	steps.clear();
+	instances.clear();
+
+	// We can only batch if we have our quad mesh and room for the whole
+	// list in the instance buffer.  If not, we'll simply draw everything
+	// individually.
+	bool batching = CreateQuad() && ReserveInstances(sprites.size());
+
+	// Build the drawing steps
+	for (auto &s : sprites)
+	{
+		++stats.sprites;
+		if (batching && s->CanBatch())
+		{
+			// get the texture for this frame; skip the sprite if there's nothing to draw
+			ID3D11ShaderResourceView *rv = s->PrepareFrame();
+			if (rv == nullptr)
+				continue;
+
+			// add the instance
+			auto &inst = instances.emplace_back();
+			XMStoreFloat4x4(&inst.world, s->GetBatchWorld());
+			inst.alpha = s->UpdateFade();
+
+			// Extend the current batch if it's for the same texture, otherwise
+			// start a new batch
+			if (steps.size() != 0 && steps.back().sprite == nullptr && steps.back().rv == rv)
+				++steps.back().nInstances;
+			else
+				steps.push_back({ nullptr, rv, static_cast<UINT>(instances.size() - 1), 1 });
+
+			++stats.batched;
+		}
+		else
+		{
+			// draw this sprite individually
+			steps.push_back({ s, nullptr, 0, 0 });
+		}
+	}
+
+	// Upload the instance data for the whole frame in one go.  If that
+	// fails, skip the batched sprites for this frame, but still draw the
+	// individual sprites.
+	bool instancesLoaded = false;
+	if (instances.size() != 0)
+	{
+		D3D::DeviceContextLocker ctx;
+		D3D11_MAPPED_SUBRESOURCE msr;
+		if (SUCCEEDED(ctx->Map(instanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &msr)))
+		{
+			memcpy(msr.pData, instances.data(), instances.size() * sizeof(instances[0]));
+			ctx->Unmap(instanceBuffer, 0);
+			instancesLoaded = true;
+		}
+	}
+
+	// draw the steps
+	D3D *d3d = D3D::Get();
+	Shader *shader = Application::Get()->spriteBatchShader.get();
+	bool buffersLoaded = false;
+	for (auto &step : steps)
+	{
+		if (step.sprite != nullptr)
+		{
+			// draw the sprite individually
+			step.sprite->Render(camera);
+
+			// the sprite will have loaded its own mesh buffers
+			buffersLoaded = false;
+		}
+		else if (instancesLoaded)
+		{
+			// load the batch shader, if it's not already loaded
+			shader->PrepareForRendering(camera);
+
+			// load the quad and instance buffers, if they're not already loaded
+			if (!buffersLoaded)
+			{
+				ID3D11Buffer *buffers[] = { quadVertexBuffer, instanceBuffer };
+				static const UINT strides[] = { sizeof(CommonVertex), sizeof(SpriteBatchShader::InstanceData) };
+				d3d->IASetVertexBuffers(2, buffers, strides);
+				d3d->IASetIndexBuffer(quadIndexBuffer);
+				buffersLoaded = true;
+			}
+
+			// load the texture and draw the batch
+			d3d->PSSetShaderResources(0, 1, &step.rv);
+			d3d->DrawIndexedInstanced(6, step.nInstances, step.firstInstance);
+			++stats.batches;
+		}
+	}
+}
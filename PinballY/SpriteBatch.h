@@ -0,0 +1,81 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Sprite batcher.  This draws a window's sprite list with as few draw
+// calls and state changes as possible.  Plain textured sprites (the
+// large majority: backgrounds, wheel icons, status lines, menus, and
+// popups) are drawn with a shared unit quad through the instanced
+// sprite batch shader, with each sprite's world transform and alpha
+// packed into a single per-frame instance buffer.  This replaces the
+// two constant buffer updates (world transform and alpha) and the
+// shader and mesh setup that each sprite otherwise does individually.
+// Consecutive sprites that share a texture are drawn with a single
+// instanced draw call.
+//
+// Sprites are always drawn in drawing list order, since they're
+// alpha-blended and frequently overlap, so the batcher can't reorder
+// them to group by texture.  Sprites that can't be batched (videos,
+// DMD sprites, text sprites, and anything else with its own shader)
+// are drawn individually through their Render() methods, in their
+// proper places in the list.
+
+#pragma once
+
+#include <list>
+#include <vector>
+#include "D3D.h"
+#include "SpriteBatchShader.h"
+
+class Sprite;
+class Camera;
+
+class SpriteBatch
+{
+public:
+	SpriteBatch();
+	~SpriteBatch();
+
+	// render a sprite list
+	void Render(Camera *camera, const std::list<RefPtr<Sprite>> &sprites);
+
+	// statistics for the last Render()
+	struct Stats
+	{
+		int sprites = 0;	// sprites in the list
+		int batched = 0;	// sprites drawn through the batcher
+		int batches = 0;	// instanced draw calls for the batched sprites
+	};
+	const Stats &GetStats() const { return stats; }
+
+protected:
+	// create the shared unit quad mesh, if we haven't already
+	bool CreateQuad();
+
+	// make sure the instance buffer can hold at least n instances
+	bool ReserveInstances(size_t n);
+
+	// Drawing step.  This is either a single sprite to draw through its
+	// Render() method, or a run of instances sharing a texture.
+	struct Step
+	{
+		Sprite *sprite;						// sprite to draw individually, or null for a batch
+		ID3D11ShaderResourceView *rv;		// texture for the batch
+		UINT firstInstance;					// first instance in the batch
+		UINT nInstances;					// number of instances
+	};
+	std::vector<Step> steps;
+
+	// instance data for the current frame
+	std::vector<SpriteBatchShader::InstanceData> instances;
+
+	// unit quad mesh
+	RefPtr<ID3D11Buffer> quadVertexBuffer;
+	RefPtr<ID3D11Buffer> quadIndexBuffer;
+
+	// instance buffer, and its capacity in instances
+	RefPtr<ID3D11Buffer> instanceBuffer;
+	size_t instanceCapacity = 0;
+
+	// statistics
+	Stats stats;
+};
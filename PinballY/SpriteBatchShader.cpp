@@ -0,0 +1,74 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+#include "stdafx.h"
+#include <d3d11_1.h>
+#include <DirectXMath.h>
+#include "Resource.h"
+#include "D3D.h"
+#include "camera.h"
+#include "SpriteBatchShader.h"
+#include "shaders/SpriteBatchShaderVS.h"
+#include "shaders/SpriteBatchShaderPS.h"
+
+using namespace DirectX;
+
+SpriteBatchShader::SpriteBatchShader()
+{
+}
+
+SpriteBatchShader::~SpriteBatchShader()
+{
+}
+
+bool SpriteBatchShader::Init()
+{
+	D3D *d3d = D3D::Get();
+	HRESULT hr;
+	auto GenErr = [hr](const TCHAR *details) {
+		LogSysError(ErrorIconType::EIT_Error, LoadStringT(IDS_ERR_GENERICD3DINIT),
+			MsgFmt(_T("%s, system error code %lx"), details, hr));
+		return false;
+	};
+
+	// Create the vertex shader
+	if (FAILED(hr = d3d->CreateVertexShader(g_vsSpriteBatchShader, sizeof(g_vsSpriteBatchShader), &vs)))
+		return GenErr(_T("Sprite Batch Shader -> CreateVertexShader"));
+
+	// Create the input layout.  Slot 0 is the mesh, and slot 1 is the
+	// per-instance data.
+	D3D11_INPUT_ELEMENT_DESC layoutDesc[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "ALPHA", 0, DXGI_FORMAT_R32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
+	};
+	if (!CreateInputLayout(d3d, layoutDesc, countof(layoutDesc), g_vsSpriteBatchShader, sizeof(g_vsSpriteBatchShader)))
+		return false;
+
+	// create the pixel shader
+	if (FAILED(hr = d3d->CreatePixelShader(g_psSpriteBatchShader, sizeof(g_psSpriteBatchShader), &ps)))
+		return GenErr(_T("Sprite Batch Shader -> CreatePixelShader"));
+
+	// success
+	return true;
+}
+
+void SpriteBatchShader::SetShaderInputs(Camera *camera)
+{
+	D3D *d3d = D3D::Get();
+
+	// Vertex shader inputs - these must match the 'cbuffer' definition 
+	// order in SpriteBatchShaderVS.hlsl
+	camera->VSSetViewConstantBuffer(0);
+	camera->VSSetProjectionConstantBuffer(1);
+
+	// Set the input layout
+	d3d->SetInputLayout(layout);
+	d3d->SetTriangleTopology();
+}
@@ -0,0 +1,45 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Sprite batch shader.  This is an instanced version of the texture
+// shader, for drawing runs of sprites through a single draw call.  The
+// vertex input has two streams: slot 0 is the shared unit quad mesh
+// (CommonVertex), and slot 1 is the per-instance data (InstanceData),
+// which gives each sprite's world transform and alpha.
+
+#pragma once
+
+#include "stdafx.h"
+#include <d3d11_1.h>
+#include <DirectXMath.h>
+#include "D3D.h"
+#include "Shader.h"
+
+class SpriteBatchShader : public Shader
+{
+public:
+	SpriteBatchShader();
+	virtual ~SpriteBatchShader();
+
+	virtual const char *ID() const { return "SpriteBatchShader"; }
+
+	// initialize
+	virtual bool Init();
+
+	// set shader inputs
+	virtual void SetShaderInputs(Camera *camera);
+
+	// Alpha comes from the per-instance data, so there's no global
+	// alpha to set
+	void SetAlpha(float) override { }
+
+	// Per-instance data - must match the instance inputs in
+	// SpriteBatchShaderVS.hlsl.  'world' is the untransposed world
+	// matrix, since the shader builds the matrix from its rows.
+	struct InstanceData
+	{
+		DirectX::XMFLOAT4X4 world;
+		float alpha;
+		DirectX::XMFLOAT3 padding;
+	};
+};
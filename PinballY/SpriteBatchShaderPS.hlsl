@@ -0,0 +1,31 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Sprite batch shader - pixel shader
+
+Texture2D shaderTexture;
+SamplerState SampleType;
+
+struct PixelInputType
+{
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float alpha : ALPHA;
+};
+
+float4 main(PixelInputType input) : SV_TARGET
+{
+	// pass through the color from the texture
+	float4 textureColor;
+	textureColor = shaderTexture.Sample(SampleType, input.tex);
+
+	// apply the instance alpha
+	textureColor.w *= input.alpha;
+
+	// discard fully transparent pixels, as in the texture shader
+	if (textureColor.w == 0)
+		discard;
+
+	// return the texture color
+	return textureColor;
+}
@@ -0,0 +1,60 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Sprite batch shader - vertex shader
+//
+// This is the instanced version of the texture shader vertex shader.
+// Every sprite in a batch shares a unit quad mesh; the per-instance
+// data supplies the sprite's world transform (with the sprite's mesh
+// size folded in) and its alpha.
+
+cbuffer MatrixBuffer
+{
+	matrix viewMatrix;
+}
+cbuffer MatrixBuffer
+{
+	matrix projectionMatrix;
+}
+
+struct VertexInputType
+{
+	float4 position : POSITION;
+	float2 tex : TEXCOORD;
+	float3 normal : NORMAL;
+
+	// per-instance data: world matrix rows, and the alpha
+	float4 world0 : WORLD0;
+	float4 world1 : WORLD1;
+	float4 world2 : WORLD2;
+	float4 world3 : WORLD3;
+	float alpha : ALPHA;
+};
+
+struct PixelInputType
+{
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float alpha : ALPHA;
+};
+
+
+PixelInputType main(VertexInputType input)
+{
+	PixelInputType output;
+
+	// Change the position vector to be 4 units for proper matrix calculations.
+	input.position.w = 1.0f;
+
+	// Calculate the position of the vertex against the world, view, and projection matrices.
+	float4x4 worldMatrix = float4x4(input.world0, input.world1, input.world2, input.world3);
+	output.position = mul(input.position, worldMatrix);
+	output.position = mul(output.position, viewMatrix);
+	output.position = mul(output.position, projectionMatrix);
+
+	// pass the texture coordinates and alpha through to the pixel shader
+	output.tex = input.tex;
+	output.alpha = input.alpha;
+
+	return output;
+}
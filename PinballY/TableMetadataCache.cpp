@@ -0,0 +1,530 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+#include "stdafx.h"
+#include "TableMetadataCache.h"
+#include "VPFileReader.h"
+#include "GameList.h"
+#include "CSVFile.h"
+#include "Application.h"
+#include "LogFile.h"
+
+
+TableMetadataCache::TableMetadataCache()
+{
+	// create the shutdown event
+	shutdownEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	// Figure the number of worker threads.  The work is mostly file
+	// I/O, with a little parsing, so a few threads are enough to keep
+	// the disk busy; more than that would just make the threads take
+	// turns waiting on the disk.
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	maxWorkers = max(min(static_cast<int>(si.dwNumberOfProcessors), 4), 1);
+
+	// Figure the cache file name.  This goes in the same folder as the
+	// game stats database.
+	auto const &gameStatsPath = Application::Get()->gameStatsPath;
+	const TCHAR *fname = _T("TableMetadata.csv");
+	TCHAR path[MAX_PATH];
+	if (gameStatsPath.length() != 0)
+		PathCombine(path, gameStatsPath.c_str(), fname);
+	else
+		GetDeployedFilePath(path, fname, _T(""));
+	filename = path;
+}
+
+TableMetadataCache::~TableMetadataCache()
+{
+	// make sure the worker threads have exited
+	Shutdown(5000);
+}
+
+// cache file columns
+namespace TableMetadataColumns
+{
+	static const TCHAR *Path = _T("Path");
+	static const TCHAR *Size = _T("Size");
+	static const TCHAR *ModTime = _T("ModTime");
+	static const TCHAR *OK = _T("OK");
+	static const TCHAR *FileVersion = _T("FileVersion");
+	static const TCHAR *TableName = _T("TableName");
+	static const TCHAR *TableVersion = _T("TableVersion");
+	static const TCHAR *ReleaseDate = _T("ReleaseDate");
+	static const TCHAR *AuthorName = _T("AuthorName");
+	static const TCHAR *AuthorEmail = _T("AuthorEmail");
+	static const TCHAR *AuthorWebSite = _T("AuthorWebSite");
+	static const TCHAR *Blurb = _T("Blurb");
+	static const TCHAR *Description = _T("Description");
+	static const TCHAR *Rules = _T("Rules");
+	static const TCHAR *ScriptRom = _T("ScriptRom");
+}
+
+void TableMetadataCache::Load()
+{
+	// if there's no cache file yet, there's nothing to load
+	if (!FileExists(filename.c_str()))
+		return;
+
+	// read the file
+	CSVFile csv;
+	csv.SetFile(filename.c_str());
+	if (!csv.Read(SilentErrorHandler()))
+	{
+		LogFile::Get()->Write(LogFile::SystemSetupLogging, _T("Table metadata cache: error reading %s\n"), filename.c_str());
+		return;
+	}
+
+	// look up the columns
+	using namespace TableMetadataColumns;
+	auto colPath = csv.DefineColumn(Path);
+	auto colSize = csv.DefineColumn(Size);
+	auto colModTime = csv.DefineColumn(ModTime);
+	auto colOK = csv.DefineColumn(OK);
+	auto colFileVersion = csv.DefineColumn(FileVersion);
+	auto colTableName = csv.DefineColumn(TableName);
+	auto colTableVersion = csv.DefineColumn(TableVersion);
+	auto colReleaseDate = csv.DefineColumn(ReleaseDate);
+	auto colAuthorName = csv.DefineColumn(AuthorName);
+	auto colAuthorEmail = csv.DefineColumn(AuthorEmail);
+	auto colAuthorWebSite = csv.DefineColumn(AuthorWebSite);
+	auto colBlurb = csv.DefineColumn(Blurb);
+	auto colDescription = csv.DefineColumn(Description);
+	auto colRules = csv.DefineColumn(Rules);
+	auto colScriptRom = csv.DefineColumn(ScriptRom);
+
+	// load the rows
+	CriticalSectionLocker locker(lock);
+	int nRows = static_cast<int>(csv.GetNumRows());
+	for (int row = 0; row < nRows; ++row)
+	{
+		// skip rows without a path
+		const TCHAR *path = colPath->Get(row, _T(""));
+		if (path[0] == 0)
+			continue;
+
+		// populate the entry
+		Entry &e = entries[path];
+		e.fileSize = _tcstoui64(colSize->Get(row, _T("0")), nullptr, 10);
+		e.modTime = _tcstoui64(colModTime->Get(row, _T("0")), nullptr, 10);
+		e.ok = colOK->GetBool(row, false);
+		e.fileVersion = colFileVersion->GetInt(row, 0);
+		e.tableName = colTableName->Get(row, _T(""));
+		e.tableVersion = colTableVersion->Get(row, _T(""));
+		e.releaseDate = colReleaseDate->Get(row, _T(""));
+		e.authorName = colAuthorName->Get(row, _T(""));
+		e.authorEmail = colAuthorEmail->Get(row, _T(""));
+		e.authorWebSite = colAuthorWebSite->Get(row, _T(""));
+		e.blurb = colBlurb->Get(row, _T(""));
+		e.description = colDescription->Get(row, _T(""));
+		e.rules = colRules->Get(row, _T(""));
+		e.scriptRom = colScriptRom->Get(row, _T(""));
+	}
+
+	LogFile::Get()->Write(LogFile::SystemSetupLogging, _T("Table metadata cache: loaded %d entries from %s\n"),
+		static_cast<int>(entries.size()), filename.c_str());
+}
+
+void TableMetadataCache::Save()
+{
+	// only one save at a time
+	CriticalSectionLocker saveLocker(saveLock);
+
+	// Take a snapshot of the entries to save, so that we don't hold
+	// the main lock during the file write.
+	std::list<std::pair<TSTRING, Entry>> snapshot;
+	{
+		CriticalSectionLocker locker(lock);
+		if (!dirty)
+			return;
+
+		for (auto &it : entries)
+		{
+			if (!prune || it.second.touched)
+				snapshot.emplace_back(it.first, it.second);
+		}
+		dirty = false;
+	}
+
+	// set up the CSV file
+	CSVFile csv;
+	csv.SetFile(filename.c_str());
+	using namespace TableMetadataColumns;
+	auto colPath = csv.DefineColumn(Path);
+	auto colSize = csv.DefineColumn(Size);
+	auto colModTime = csv.DefineColumn(ModTime);
+	auto colOK = csv.DefineColumn(OK);
+	auto colFileVersion = csv.DefineColumn(FileVersion);
+	auto colTableName = csv.DefineColumn(TableName);
+	auto colTableVersion = csv.DefineColumn(TableVersion);
+	auto colReleaseDate = csv.DefineColumn(ReleaseDate);
+	auto colAuthorName = csv.DefineColumn(AuthorName);
+	auto colAuthorEmail = csv.DefineColumn(AuthorEmail);
+	auto colAuthorWebSite = csv.DefineColumn(AuthorWebSite);
+	auto colBlurb = csv.DefineColumn(Blurb);
+	auto colDescription = csv.DefineColumn(Description);
+	auto colRules = csv.DefineColumn(Rules);
+	auto colScriptRom = csv.DefineColumn(ScriptRom);
+
+	// populate the rows
+	for (auto &it : snapshot)
+	{
+		auto &e = it.second;
+		int row = csv.CreateRow();
+		TCHAR buf[32];
+		colPath->Set(row, it.first.c_str());
+		_stprintf_s(buf, _T("%I64u"), e.fileSize);
+		colSize->Set(row, buf);
+		_stprintf_s(buf, _T("%I64u"), e.modTime);
+		colModTime->Set(row, buf);
+		colOK->SetBool(row, e.ok);
+		colFileVersion->Set(row, static_cast<int>(e.fileVersion));
+		colTableName->Set(row, e.tableName.c_str());
+		colTableVersion->Set(row, e.tableVersion.c_str());
+		colReleaseDate->Set(row, e.releaseDate.c_str());
+		colAuthorName->Set(row, e.authorName.c_str());
+		colAuthorEmail->Set(row, e.authorEmail.c_str());
+		colAuthorWebSite->Set(row, e.authorWebSite.c_str());
+		colBlurb->Set(row, e.blurb.c_str());
+		colDescription->Set(row, e.description.c_str());
+		colRules->Set(row, e.rules.c_str());
+		colScriptRom->Set(row, e.scriptRom.c_str());
+	}
+
+	// write the file; if that fails, mark the cache as still dirty so
+	// that we try again on the next save
+	if (!csv.Write(LogFileErrorHandler(_T("Table metadata cache: "), LogFile::SystemSetupLogging)))
+	{
+		CriticalSectionLocker locker(lock);
+		dirty = true;
+	}
+}
+
+void TableMetadataCache::ScanGameList()
+{
+	// collect the table files that need to be read
+	int nGames = 0, nQueued = 0;
+	{
+		CriticalSectionLocker locker(lock);
+		auto gl = GameList::Get();
+		for (int i = 0, n = gl->GetAllGamesCount(); i < n; ++i)
+		{
+			// resolve the game's file; skip it if it's not a VP table file
+			auto game = gl->GetAllGamesAt(i);
+			GameListItem::ResolvedFile rf;
+			game->ResolveFile(rf);
+			if (!rf.exists || !IsTableFile(rf.path.c_str()))
+				continue;
+
+			// If we have a current entry, just mark it as referenced.
+			// Otherwise queue the file.
+			++nGames;
+			UINT64 size, modTime;
+			if (auto it = entries.find(Key(rf.path.c_str())); it != entries.end()
+				&& GetFileStamp(rf.path.c_str(), size, modTime)
+				&& it->second.fileSize == size && it->second.modTime == modTime)
+			{
+				it->second.touched = true;
+			}
+			else
+			{
+				Enqueue(rf.path, false);
+				++nQueued;
+			}
+		}
+
+		// we've referenced every entry that's still in use, so we can
+		// drop the rest at the next save
+		prune = true;
+		dirty = true;
+	}
+
+	LogFile::Get()->Write(LogFile::SystemSetupLogging,
+		_T("Table metadata cache: %d table files in game list, %d queued for metadata extraction\n"),
+		nGames, nQueued);
+}
+
+bool TableMetadataCache::Get(const TCHAR *path, Entry &entry, bool queue)
+{
+	// get the file's directory information
+	UINT64 size, modTime;
+	if (!GetFileStamp(path, size, modTime))
+		return false;
+
+	// look up the cache entry, and return it if it's current
+	CriticalSectionLocker locker(lock);
+	if (auto it = entries.find(Key(path)); it != entries.end()
+		&& it->second.fileSize == size && it->second.modTime == modTime)
+	{
+		entry = it->second;
+		return true;
+	}
+
+	// not found - queue it for extraction at high priority if desired
+	if (queue && IsTableFile(path))
+		Enqueue(path, true);
+
+	return false;
+}
+
+bool TableMetadataCache::Get(const GameListItem *game, Entry &entry, bool queue)
+{
+	GameListItem::ResolvedFile rf;
+	game->ResolveFile(rf);
+	return rf.exists && Get(rf.path.c_str(), entry, queue);
+}
+
+bool TableMetadataCache::Read(const TCHAR *path, Entry &entry)
+{
+	// if it's already in the cache, use the cached data
+	if (Get(path, entry, false))
+		return entry.ok;
+
+	// read it now
+	Extract(path, entry);
+	entry.touched = true;
+
+	// add it to the cache
+	CriticalSectionLocker locker(lock);
+	entries[Key(path)] = entry;
+	dirty = true;
+	return entry.ok;
+}
+
+void TableMetadataCache::Enqueue(const TSTRING &path, bool front)
+{
+	// if the file is already queued, just move it to the front if desired
+	TSTRING key = Key(path.c_str());
+	if (pendingKeys.find(key) != pendingKeys.end())
+	{
+		if (front)
+		{
+			auto it = std::find_if(pending.begin(), pending.end(), [&key](const TSTRING &p) { return Key(p.c_str()) == key; });
+			if (it != pending.end())
+				pending.splice(pending.begin(), pending, it);
+		}
+		return;
+	}
+
+	// add it to the queue
+	if (front)
+		pending.emplace_front(path);
+	else
+		pending.emplace_back(path);
+	pendingKeys.emplace(key);
+	status.nQueued += 1;
+
+	// start a new worker if we're below the thread limit
+	if (nWorkers < maxWorkers && WaitForSingleObject(shutdownEvent, 0) != WAIT_OBJECT_0)
+	{
+		// forget any threads that have already exited
+		threads.remove_if([](const HandleHolder &h) { return WaitForSingleObject(h, 0) == WAIT_OBJECT_0; });
+
+		// launch the thread
+		DWORD tid;
+		if (HANDLE hThread = CreateThread(NULL, 0, &SWorkerMain, this, 0, &tid); hThread != NULL)
+		{
+			threads.emplace_back(hThread);
+			nWorkers += 1;
+		}
+	}
+}
+
+void TableMetadataCache::Shutdown(DWORD timeout)
+{
+	// tell the workers to stop, and discard anything that hasn't started
+	SetEvent(shutdownEvent);
+
+	// take over the thread list, and clear the queue
+	std::list<HandleHolder> h;
+	{
+		CriticalSectionLocker locker(lock);
+		h.swap(threads);
+		pending.clear();
+		pendingKeys.clear();
+		status.nQueued = 0;
+	}
+
+	// wait for the worker threads to exit, but not too long
+	ULONGLONG tEnd = GetTickCount64() + timeout;
+	for (auto &t : h)
+	{
+		ULONGLONG now = GetTickCount64();
+		WaitForSingleObject(t, now < tEnd ? static_cast<DWORD>(tEnd - now) : 0);
+	}
+}
+
+TableMetadataCache::Status TableMetadataCache::GetStatus()
+{
+	CriticalSectionLocker locker(lock);
+	return status;
+}
+
+DWORD WINAPI TableMetadataCache::SWorkerMain(LPVOID lParam)
+{
+	return reinterpret_cast<TableMetadataCache*>(lParam)->WorkerMain();
+}
+
+DWORD TableMetadataCache::WorkerMain()
+{
+	// Run in background mode, which lowers our disk I/O priority as well
+	// as our CPU priority, so that we don't interfere with video playback
+	// in the UI.
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+	ULONGLONG tStart = GetTickCount64();
+	for (;;)
+	{
+		// get the next file; exit the thread if the queue is empty
+		TSTRING path;
+		bool lastWorker = false;
+		{
+			CriticalSectionLocker locker(lock);
+			if (pending.size() == 0 || WaitForSingleObject(shutdownEvent, 0) == WAIT_OBJECT_0)
+			{
+				nWorkers -= 1;
+				lastWorker = (nWorkers == 0 && pending.size() == 0);
+			}
+			else
+			{
+				path = pending.front();
+				pending.pop_front();
+				pendingKeys.erase(Key(path.c_str()));
+				status.nQueued -= 1;
+				status.nRunning += 1;
+			}
+		}
+
+		// If the queue is empty, we're done.  If we're the last worker
+		// out, save the updated cache, unless we're shutting down, in
+		// which case the application will save it during the shutdown.
+		if (path.length() == 0)
+		{
+			if (lastWorker && WaitForSingleObject(shutdownEvent, 0) != WAIT_OBJECT_0)
+			{
+				Status s = GetStatus();
+				LogFile::Get()->Write(LogFile::SystemSetupLogging,
+					_T("Table metadata cache: queue empty; %d files read (%d failed) in this session, this batch took %.1fs\n"),
+					s.nDone, s.nFailed, static_cast<double>(GetTickCount64() - tStart) / 1000.0);
+				Save();
+			}
+			return 0;
+		}
+
+		// extract the metadata
+		Entry entry;
+		Extract(path.c_str(), entry);
+		entry.touched = true;
+
+		// store the results
+		{
+			CriticalSectionLocker locker(lock);
+			status.nRunning -= 1;
+			status.nDone += 1;
+			if (!entry.ok)
+				status.nFailed += 1;
+
+			entries[Key(path.c_str())] = std::move(entry);
+			dirty = true;
+		}
+	}
+}
+
+void TableMetadataCache::Extract(const TCHAR *path, Entry &e)
+{
+	// note the file's current size and modification time
+	e = Entry();
+	GetFileStamp(path, e.fileSize, e.modTime);
+
+	// read the file
+	VPFileReader vpr;
+	HRESULT hr = vpr.Read(path, true);
+	e.ok = SUCCEEDED(hr);
+	e.fileVersion = vpr.fileVersion;
+
+	// Copy the Table Info strings.  Keep whatever we got even if the
+	// read failed partway through, since the Table Info streams are
+	// separate from the game data stream.
+	auto Copy = [](TSTRING &dst, const std::unique_ptr<WCHAR> &src) { if (src != nullptr) dst = WideToTSTRING(src.get()); };
+	Copy(e.tableName, vpr.tableName);
+	Copy(e.tableVersion, vpr.tableVersion);
+	Copy(e.releaseDate, vpr.releaseDate);
+	Copy(e.authorName, vpr.authorName);
+	Copy(e.authorEmail, vpr.authorEmail);
+	Copy(e.authorWebSite, vpr.authorWebSite);
+	Copy(e.blurb, vpr.blurb);
+	Copy(e.description, vpr.description);
+	Copy(e.rules, vpr.rules);
+
+	// look for the VPinMAME ROM name in the script
+	if (vpr.script != nullptr)
+		ParseScriptRom(vpr.script.get(), e.scriptRom);
+
+	if (!e.ok)
+		LogFile::Get()->Write(LogFile::SystemSetupLogging, _T("Table metadata cache: error reading %s (HRESULT %lx)\n"),
+			path, static_cast<unsigned long>(hr));
+}
+
+void TableMetadataCache::ParseScriptRom(const CHAR *script, TSTRING &rom)
+{
+	// Scan the script line by line.  Scripts can be several hundred KB,
+	// so this is a simple hand-coded scan rather than a regex search.
+	auto SkipSpaces = [](const CHAR *p) { while (*p == ' ' || *p == '\t') ++p; return p; };
+	auto MatchWord = [](const CHAR *&p, const CHAR *word)
+	{
+		size_t len = strlen(word);
+		if (_strnicmp(p, word, len) != 0 || isalnum(static_cast<unsigned char>(p[len])) || p[len] == '_')
+			return false;
+		p += len;
+		return true;
+	};
+	for (const CHAR *p = script; *p != 0; )
+	{
+		// check for "[Const] cGameName = " at the start of the line
+		const CHAR *q = SkipSpaces(p);
+		if (MatchWord(q, "const"))
+			q = SkipSpaces(q);
+		if (MatchWord(q, "cGameName") && *(q = SkipSpaces(q)) == '=' && *(q = SkipSpaces(q + 1)) == '"')
+		{
+			// find the close quote
+			const CHAR *start = ++q;
+			for (; *q != '"' && *q != 0 && *q != '\r' && *q != '\n'; ++q);
+			if (*q == '"' && q != start)
+			{
+				rom = AnsiToTSTRING(std::string(start, q - start).c_str());
+				return;
+			}
+		}
+
+		// skip to the next line
+		for (; *p != 0 && *p != '\n'; ++p);
+		if (*p == '\n')
+			++p;
+	}
+}
+
+bool TableMetadataCache::GetFileStamp(const TCHAR *path, UINT64 &size, UINT64 &modTime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	if (!GetFileAttributesEx(path, GetFileExInfoStandard, &attrs)
+		|| (attrs.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+		return false;
+
+	size = (static_cast<UINT64>(attrs.nFileSizeHigh) << 32) | attrs.nFileSizeLow;
+	modTime = (static_cast<UINT64>(attrs.ftLastWriteTime.dwHighDateTime) << 32) | attrs.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+TSTRING TableMetadataCache::Key(const TCHAR *path)
+{
+	// Windows file names are case-insensitive, so key on the lower-case path
+	TSTRING key(path);
+	std::transform(key.begin(), key.end(), key.begin(), ::_totlower);
+	return key;
+}
+
+bool TableMetadataCache::IsTableFile(const TCHAR *path)
+{
+	return tstriEndsWith(path, _T(".vpt")) || tstriEndsWith(path, _T(".vpx"));
+}
@@ -0,0 +1,182 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Table metadata cache
+//
+// Visual Pinball table files carry some embedded metadata that the
+// table author can fill in through the VP editor (table name, author,
+// version, release date, blurb, rules), plus the table script, which
+// we can mine for other information, such as the VPinMAME ROM name
+// that the script passes to the controller.  VPFileReader can extract
+// all of this, but it has to open and parse the table file to do so,
+// and table files can be hundreds of MB each.  That's fine for one
+// file at a time in a dialog, but it's too slow to do on demand for
+// features that want the information for the whole library.
+//
+// This class runs the extraction for all of the table files in the
+// game list in the background, on a small pool of worker threads,
+// and keeps the results in memory and in a persistent cache file
+// (TableMetadata.csv, alongside GameStats.csv).  Each cache entry is
+// keyed by the table file's path, and is stamped with the file's size
+// and modification time, so that we can tell if the file has changed
+// since the entry was made just by checking the directory entry,
+// without reopening the file.  Once a file is in the cache, lookups
+// are just a hash table search.
+//
+// The cache only stores the items extracted from the script (the ROM
+// name), not the script text itself, since the scripts are large and
+// most users have hundreds of tables.  Code that needs the full script
+// text should still use VPFileReader directly.
+
+#pragma once
+#include <list>
+#include <memory>
+#include "../Utilities/WinUtil.h"
+
+class GameListItem;
+
+class TableMetadataCache
+{
+public:
+	TableMetadataCache();
+	~TableMetadataCache();
+
+	// Cached metadata for one table file
+	struct Entry
+	{
+		// file size and modification time at the time of extraction
+		UINT64 fileSize = 0;
+		UINT64 modTime = 0;
+
+		// Did we successfully read the file?  We keep entries for files
+		// that we couldn't read, too, so that we don't keep retrying
+		// them every session, as long as they don't change.
+		bool ok = false;
+
+		// VP file format version
+		INT32 fileVersion = 0;
+
+		// Table Info metadata
+		TSTRING tableName;
+		TSTRING tableVersion;
+		TSTRING releaseDate;
+		TSTRING authorName;
+		TSTRING authorEmail;
+		TSTRING authorWebSite;
+		TSTRING blurb;
+		TSTRING description;
+		TSTRING rules;
+
+		// VPinMAME ROM name set in the script ('cGameName'), if found
+		TSTRING scriptRom;
+
+		// Has the entry been referenced by a game list scan in this
+		// session?  We drop unreferenced entries when saving after a
+		// full scan, so that the cache doesn't accumulate entries for
+		// deleted or renamed files forever.
+		bool touched = false;
+	};
+
+	// Load the persistent cache file
+	void Load();
+
+	// Save the persistent cache file, if it's changed
+	void Save();
+
+	// Queue all of the VP table files in the game list for extraction.
+	// Files with current cache entries are skipped.  This must be called
+	// on the main UI thread, since it accesses the game list.
+	void ScanGameList();
+
+	// Look up the cached metadata for a file.  Returns true if we have
+	// an entry that's current with respect to the file's size and
+	// modification time.  If not, and 'queue' is true, we add the file
+	// to the front of the work queue, so that it'll be available soon.
+	bool Get(const TCHAR *path, Entry &entry, bool queue = true);
+
+	// Look up the cached metadata for a game's table file.  This must be
+	// called on the main UI thread.
+	bool Get(const GameListItem *game, Entry &entry, bool queue = true);
+
+	// Look up the metadata for a file, extracting it synchronously on
+	// the calling thread if it's not already in the cache.  Returns
+	// true if the file was read successfully (now or previously).
+	bool Read(const TCHAR *path, Entry &entry);
+
+	// Shut down.  This discards any queued files and waits (up to the
+	// timeout) for the worker threads to exit.
+	void Shutdown(DWORD timeout);
+
+	// Queue status snapshot
+	struct Status
+	{
+		int nQueued = 0;    // files waiting to be read
+		int nRunning = 0;   // files currently being read
+		int nDone = 0;      // files read so far in this session
+		int nFailed = 0;    // files we couldn't read
+	};
+	Status GetStatus();
+
+	// Is a given file a VP table file that we can extract metadata from?
+	static bool IsTableFile(const TCHAR *path);
+
+protected:
+	// worker thread entrypoint
+	static DWORD WINAPI SWorkerMain(LPVOID lParam);
+	DWORD WorkerMain();
+
+	// queue a file; must be called with the lock held
+	void Enqueue(const TSTRING &path, bool front);
+
+	// extract a file's metadata
+	static void Extract(const TCHAR *path, Entry &entry);
+
+	// Find the VPinMAME ROM name in a table script.  VPM tables set this
+	// in a line of the form 'Const cGameName = "rom_name"'.  We only look
+	// for it at the start of a line, so that we skip commented-out lines,
+	// which scripts often use to list alternative ROM versions.
+	static void ParseScriptRom(const CHAR *script, TSTRING &rom);
+
+	// get a file's size and modification time
+	static bool GetFileStamp(const TCHAR *path, UINT64 &size, UINT64 &modTime);
+
+	// get the map key for a path
+	static TSTRING Key(const TCHAR *path);
+
+	// cache file name
+	TSTRING filename;
+
+	// cached entries, keyed by lower-cased file path
+	std::unordered_map<TSTRING, Entry> entries;
+
+	// paths queued for extraction, and the set of queued keys
+	std::list<TSTRING> pending;
+	std::unordered_set<TSTRING> pendingKeys;
+
+	// Has the cache changed since we loaded or last saved it?
+	bool dirty = false;
+
+	// Prune untouched entries on the next save?  We set this after a
+	// full game list scan.
+	bool prune = false;
+
+	// current status
+	Status status;
+
+	// maximum number of worker threads, and number currently running
+	int maxWorkers;
+	int nWorkers = 0;
+
+	// worker thread handles
+	std::list<HandleHolder> threads;
+
+	// shutdown event
+	HandleHolder shutdownEvent;
+
+	// lock for the entry map, queue, and status
+	CriticalSection lock;
+
+	// lock for saving the file; this is separate from the main lock
+	// so that lookups aren't held up during the file write
+	CriticalSection saveLock;
+};
@@ -12,6 +12,7 @@
 #include "TextDraw.h"
 #include "TextShader.h"
 #include "Resource.h"
+#include "../Utilities/GraphicsUtil.h"
 
 using namespace DirectX;
 
@@ -111,6 +112,48 @@ TextDrawFont *TextDraw::GetFont(const TCHAR *filename, ErrorHandler &handler)
 	return font;
 }
 
+const TCHAR *const TextDraw::atlasKeyPrefix = _T("atlas:");
+
+TextDrawFont *TextDraw::GetFont(FontPref &pref, ErrorHandler &handler)
+{
+	// Check the cache.  Key atlas fonts on the font description, which
+	// can't collide with file names.  This returns null for a font that
+	// we already failed to build.
+	TSTRING key = MsgFmt(_T("%s%s|%d|%d|%d"), atlasKeyPrefix, pref.family.c_str(), pref.ptSize, pref.weight, pref.italic ? 1 : 0).Get();
+	auto it = fontCache.find(key);
+	if (it != fontCache.end())
+		return it->second;
+
+	// it's not in the cache - build it
+	GlyphAtlasFont *font = new GlyphAtlasFont();
+	if (!font->Load(pref, handler))
+	{
+		// cache the failure, so that we don't keep retrying it
+		delete font;
+		fontCache.emplace(key, nullptr);
+		return 0;
+	}
+
+	// add it to the cache and return it
+	fontCache.emplace(std::make_pair(key, font));
+	return font;
+}
+
+void TextDraw::ClearAtlasFonts()
+{
+	size_t prefixLen = _tcslen(atlasKeyPrefix);
+	for (auto it = fontCache.begin(); it != fontCache.end(); )
+	{
+		if (it->first.compare(0, prefixLen, atlasKeyPrefix) == 0)
+		{
+			delete it->second;
+			it = fontCache.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
 // -------------------------------------------------------------------------
 //
 // TextDrawItem - one TextDraw string
@@ -346,6 +389,9 @@ HRESULT TextDrawFont::CreateBuffers(
 	// no vertices in the list yet
 	int nv = 0;
 
+	// no previous character on the line yet, for kerning
+	TCHAR prev = 0;
+
 	// add each character
 	for (const TCHAR *p = text; *p != 0; ++p)
 	{
@@ -354,6 +400,7 @@ HRESULT TextDrawFont::CreateBuffers(
 		{
 			x = 0;
 			y -= lineSpacing;
+			prev = 0;
 			continue;
 		}
 
@@ -362,13 +409,17 @@ HRESULT TextDrawFont::CreateBuffers(
 			continue;
 
 		// look up the glyph
-		auto it = glyphMap.find(*p);
-		Glyph *g = it != glyphMap.end() ? it->second : defaultGlyph;
+		Glyph *g = GetGlyph(*p);
 
 		// we must have a glyph to proceed
 		if (g == 0)
 			return E_FAIL;
 
+		// apply kerning against the previous character
+		if (prev != 0)
+			x += GetKerning(prev, *p);
+		prev = *p;
+
 		// advance by the offset to get the start position for the character cell
 		x += g->xOffset;
 
@@ -444,11 +495,20 @@ HRESULT TextDrawFont::CreateBuffers(
 	return S_OK;
 }
 
-POINTF TextDrawFont::MeasureText(const TCHAR *text) const
+TextDrawFont::Glyph *TextDrawFont::GetGlyph(TCHAR c)
+{
+	auto it = glyphMap.find(c);
+	return it != glyphMap.end() ? it->second : defaultGlyph;
+}
+
+POINTF TextDrawFont::MeasureText(const TCHAR *text)
 {
 	// start at the top left corner
 	float x = 0, y = 0;
 
+	// no previous character on the line yet, for kerning
+	TCHAR prev = 0;
+
 	// iterate over the characters
 	for (const TCHAR *p = text; *p != 0; ++p)
 	{
@@ -457,6 +517,7 @@ POINTF TextDrawFont::MeasureText(const TCHAR *text) const
 		{
 			x = 0;
 			y -= lineSpacing;
+			prev = 0;
 			continue;
 		}
 
@@ -465,13 +526,17 @@ POINTF TextDrawFont::MeasureText(const TCHAR *text) const
 			continue;
 
 		// look up the glyph
-		auto it = glyphMap.find(*p);
-		Glyph *g = it != glyphMap.end() ? it->second : defaultGlyph;
+		Glyph *g = GetGlyph(*p);
 
 		// skip missing characters
 		if (g == 0)
 			continue;
 
+		// apply kerning against the previous character
+		if (prev != 0)
+			x += GetKerning(prev, *p);
+		prev = *p;
+
 		// figure the advance width
 		x += g->xOffset + (g->subrect.right - g->subrect.left) + g->xAdvance;
 	}
@@ -479,3 +544,239 @@ POINTF TextDrawFont::MeasureText(const TCHAR *text) const
 	// return the result
 	return { x, y };
 }
+
+
+// -------------------------------------------------------------------------
+//
+// GlyphAtlasFont - font object built from a GDI+ font
+//
+
+GlyphAtlasFont::GlyphAtlasFont()
+{
+	texture = 0;
+}
+
+GlyphAtlasFont::~GlyphAtlasFont()
+{
+	if (texture != 0) texture->Release();
+}
+
+bool GlyphAtlasFont::Load(FontPref &pref, ErrorHandler &handler)
+{
+	D3D *d3d = D3D::Get();
+
+	// Make a private copy of the font.  The preference item discards its
+	// cached font when the settings change, and we outlive that.
+	if (Gdiplus::Font *prefFont = pref.Get(); prefFont != nullptr)
+		font.reset(prefFont->Clone());
+	if (font == nullptr)
+	{
+		handler.SysError(LoadStringT(IDS_ERR_FONTINIT), MsgFmt(_T("Glyph atlas: unable to create font %s"), pref.family.c_str()));
+		return false;
+	}
+
+	// get the line height, in pixels
+	{
+		Gdiplus::Bitmap bmp(1, 1, PixelFormat32bppARGB);
+		Gdiplus::Graphics g(&bmp);
+		lineSpacing = font->GetHeight(&g);
+	}
+
+	// Size the atlas for about 16 rows of 16 glyphs at the line height,
+	// which leaves plenty of room beyond the ASCII set.
+	uint32_t cell = static_cast<uint32_t>(ceilf(lineSpacing)) + 1;
+	textureSize = { 256, 256 };
+	while (textureSize.width < cell * 16 && textureSize.width < 2048)
+		textureSize.width *= 2, textureSize.height *= 2;
+
+	// Create the texture, initially fully transparent.  Glyphs are white,
+	// with the coverage in the alpha channel, so that the text shader's
+	// color gives the text color.
+	std::vector<UINT32> initPix(textureSize.width * textureSize.height, 0);
+	CD3D11_TEXTURE2D_DESC texDesc(
+		DXGI_FORMAT_B8G8R8A8_UNORM, textureSize.width, textureSize.height, 1, 1,
+		D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DEFAULT);
+	CD3D11_SHADER_RESOURCE_VIEW_DESC viewDesc(
+		D3D11_SRV_DIMENSION_TEXTURE2D, DXGI_FORMAT_B8G8R8A8_UNORM);
+	D3D11_SUBRESOURCE_DATA initData = { initPix.data(), textureSize.width * 4 };
+	HRESULT hr;
+	if (!SUCCEEDED(hr = d3d->CreateTexture2D(&texDesc, &initData, &viewDesc, &shaderResourceView, &texture)))
+	{
+		handler.SysError(LoadStringT(IDS_ERR_FONTINIT),
+			MsgFmt(_T("Glyph atlas: CreateTexture2D failed, error code %lx"), hr));
+		return false;
+	}
+
+	// Start packing one pixel in from the edges.  We leave a one-pixel
+	// transparent gutter around each glyph, so that texture filtering
+	// doesn't pick up pixels from neighboring glyphs.
+	nextX = nextY = 1;
+	rowHeight = 0;
+
+	// rasterize the printable ASCII set up front
+	for (TCHAR c = 0x20; c < 0x7F; ++c)
+		AddGlyph(c);
+
+	// use '?' for characters that don't fit in the atlas
+	if (auto it = glyphMap.find('?'); it != glyphMap.end())
+		defaultGlyph = it->second;
+
+	// load the kerning pairs
+	LoadKerning();
+
+	// success
+	return true;
+}
+
+TextDrawFont::Glyph *GlyphAtlasFont::GetGlyph(TCHAR c)
+{
+	// use the existing glyph if we have one
+	if (auto it = glyphMap.find(c); it != glyphMap.end())
+		return it->second;
+
+	// Add it to the atlas.  If there's no room, map the character to the
+	// default glyph, so that we don't try again every time it's drawn.
+	if (Glyph *g = AddGlyph(c); g != nullptr)
+		return g;
+
+	glyphMap.emplace(c, defaultGlyph);
+	return defaultGlyph;
+}
+
+TextDrawFont::Glyph *GlyphAtlasFont::AddGlyph(TCHAR c)
+{
+	// Set up a scratch bitmap big enough for the glyph, with extra room
+	// on the left for overhangs (italic descenders, for example)
+	const int pad = 2;
+	int lh = static_cast<int>(ceilf(lineSpacing));
+	int cellWidth = lh * 2 + pad * 2, cellHeight = lh + pad * 2;
+	float originX = static_cast<float>(lh / 2 + pad), originY = static_cast<float>(pad);
+	Gdiplus::Bitmap bmp(cellWidth, cellHeight, PixelFormat32bppARGB);
+	Gdiplus::Graphics g(&bmp);
+	g.SetTextRenderingHint(Gdiplus::TextRenderingHintAntiAliasGridFit);
+
+	// measure the advance width, including the width of spaces
+	Gdiplus::StringFormat fmt(Gdiplus::StringFormat::GenericTypographic());
+	fmt.SetFormatFlags(fmt.GetFormatFlags() | Gdiplus::StringFormatFlagsMeasureTrailingSpaces);
+	Gdiplus::RectF bbox;
+	g.MeasureString(&c, 1, font.get(), Gdiplus::PointF(0.0f, 0.0f), &fmt, &bbox);
+
+	// draw the glyph in white
+	Gdiplus::SolidBrush br(Gdiplus::Color(255, 255, 255, 255));
+	g.DrawString(&c, 1, font.get(), Gdiplus::PointF(originX, originY), &fmt, &br);
+	g.Flush();
+
+	// find the ink bounds
+	Gdiplus::Rect rcLock(0, 0, cellWidth, cellHeight);
+	Gdiplus::BitmapData bd;
+	if (bmp.LockBits(&rcLock, Gdiplus::ImageLockModeRead, PixelFormat32bppARGB, &bd) != Gdiplus::Ok)
+		return nullptr;
+	auto Row = [&bd](int y) { return reinterpret_cast<const UINT32*>(static_cast<const BYTE*>(bd.Scan0) + y * bd.Stride); };
+	int x0 = cellWidth, y0 = cellHeight, x1 = 0, y1 = 0;
+	for (int y = 0; y < cellHeight; ++y)
+	{
+		const UINT32 *row = Row(y);
+		for (int x = 0; x < cellWidth; ++x)
+		{
+			if ((row[x] >> 24) != 0)
+			{
+				x0 = min(x0, x), x1 = max(x1, x + 1);
+				y0 = min(y0, y), y1 = max(y1, y + 1);
+			}
+		}
+	}
+
+	// set up the glyph descriptor
+	Glyph glyph;
+	glyph.charCode = c;
+	if (x1 <= x0)
+	{
+		// no ink (a space, say) - it's all advance
+		glyph.subrect = { 0, 0, 0, 0 };
+		glyph.xOffset = 0.0f;
+		glyph.yOffset = 0.0f;
+		glyph.xAdvance = bbox.Width;
+	}
+	else
+	{
+		// find room in the atlas, starting a new row if necessary
+		int width = x1 - x0, height = y1 - y0;
+		if (nextX + width + 1 > static_cast<int>(textureSize.width))
+		{
+			nextX = 1;
+			nextY += rowHeight + 1;
+			rowHeight = 0;
+		}
+		if (nextY + height + 1 > static_cast<int>(textureSize.height))
+		{
+			bmp.UnlockBits(&bd);
+			return nullptr;
+		}
+
+		// copy the coverage into the atlas as white + alpha
+		std::vector<UINT32> pix(static_cast<size_t>(width) * height);
+		for (int y = 0; y < height; ++y)
+		{
+			const UINT32 *src = Row(y0 + y) + x0;
+			UINT32 *dst = pix.data() + static_cast<size_t>(y) * width;
+			for (int x = 0; x < width; ++x)
+				dst[x] = (src[x] & 0xFF000000) | 0x00FFFFFF;
+		}
+		D3D11_BOX box = { static_cast<UINT>(nextX), static_cast<UINT>(nextY), 0,
+			static_cast<UINT>(nextX + width), static_cast<UINT>(nextY + height), 1 };
+		D3D::Get()->UpdateResource(texture, box, pix.data(), width * 4);
+
+		// The cell is placed relative to the pen position, and the advance
+		// covers the rest of the measured width after the cell.
+		glyph.subrect = { nextX, nextY, nextX + width, nextY + height };
+		glyph.xOffset = static_cast<float>(x0) - originX;
+		glyph.yOffset = static_cast<float>(y0) - originY;
+		glyph.xAdvance = bbox.Width - glyph.xOffset - static_cast<float>(width);
+
+		// advance the packing position
+		nextX += width + 1;
+		rowHeight = max(rowHeight, height);
+	}
+	bmp.UnlockBits(&bd);
+
+	// add it to the glyph list and map
+	atlasGlyphs.push_back(glyph);
+	Glyph *ret = &atlasGlyphs.back();
+	glyphMap.emplace(c, ret);
+	return ret;
+}
+
+void GlyphAtlasFont::LoadKerning()
+{
+	// GDI+ doesn't expose kerning information, so get the pairs from
+	// the equivalent GDI font.  The GDI+ font is sized in pixels, and
+	// the memory DC uses pixel units, so the kerning amounts come back
+	// in the same pixel units as our glyph metrics.
+	MemoryDC dc;
+	LOGFONTW lf;
+	{
+		Gdiplus::Graphics g(dc);
+		if (font->GetLogFontW(&g, &lf) != Gdiplus::Ok)
+			return;
+	}
+	HFONT hfont = CreateFontIndirectW(&lf);
+	if (hfont == NULL)
+		return;
+
+	HGDIOBJ oldFont = SelectObject(dc, hfont);
+	if (DWORD n = GetKerningPairsW(dc, 0, nullptr); n != 0)
+	{
+		std::vector<KERNINGPAIR> pairs(n);
+		n = GetKerningPairsW(dc, n, pairs.data());
+		for (DWORD i = 0; i < n; ++i)
+		{
+			if (pairs[i].iKernAmount != 0)
+			{
+				kerning.emplace((static_cast<uint32_t>(pairs[i].wFirst) << 16) | static_cast<uint32_t>(pairs[i].wSecond),
+					static_cast<float>(pairs[i].iKernAmount));
+			}
+		}
+	}
+	SelectObject(dc, oldFont);
+	DeleteObject(hfont);
+}
@@ -12,6 +12,7 @@
 
 #include "stdafx.h"
 #include <vector>
+#include <deque>
 #include <unordered_map>
 #include <d3d11_1.h>
 #include <DirectXMath.h>
@@ -19,6 +20,7 @@
 #include "Shader.h"
 #include "d3d.h"
 #include "TextShader.h"
+#include "FontPref.h"
 
 // text object vertex type
 struct TextVertexType
@@ -32,7 +34,7 @@ class TextDrawFont
 {
 public:
 	TextDrawFont();
-	~TextDrawFont();
+	virtual ~TextDrawFont();
 
 	// Load a font.  Returns true on success, false on failure.
 	bool Load(const TCHAR *filename, ErrorHandler &handler);
@@ -54,7 +56,7 @@ public:
 	float GetLineHeight() const { return lineSpacing; }
 
 	// measure text
-	POINTF MeasureText(const TCHAR *text) const;
+	POINTF MeasureText(const TCHAR *text);
 
 protected:
 	// Glyph descriptor.  This matches the byte layout of the objects
@@ -78,9 +80,29 @@ protected:
 	// glyph hash
 	std::unordered_map<uint32_t, Glyph *> glyphMap;
 
+	// Look up the glyph for a character, returning the default glyph
+	// if the font doesn't have one
+	virtual Glyph *GetGlyph(TCHAR c);
+
 	// default character
 	Glyph *defaultGlyph;
 
+	// Kerning pairs.  This maps a character pair, with the first
+	// character in the high 16 bits, to the horizontal adjustment to
+	// the space between them.  DirectXTK font files don't have kerning
+	// information, so this is only populated for glyph atlas fonts.
+	std::unordered_map<uint32_t, float> kerning;
+
+	// get the kerning adjustment between two characters
+	float GetKerning(TCHAR prev, TCHAR c) const
+	{
+		if (kerning.size() == 0)
+			return 0.0f;
+
+		auto it = kerning.find((static_cast<uint32_t>(prev) << 16) | static_cast<uint32_t>(c));
+		return it != kerning.end() ? it->second : 0.0f;
+	}
+
 	// line height
 	float lineSpacing;
 
@@ -88,6 +110,52 @@ protected:
 	ID3D11ShaderResourceView *shaderResourceView;
 };
 
+// Glyph atlas font.  This is a TextDrawFont built at run-time from a
+// GDI+ font, rather than loaded from a DirectXTK font file, so that we
+// can draw text through the D3D text path in any of the fonts that the
+// user can select through FontPref settings.  Each glyph is rasterized
+// once into a shared atlas texture, so drawing a new string only
+// requires building a small vertex buffer.  The printable ASCII glyphs
+// are rasterized when the font is loaded; other characters are added
+// to the atlas on demand, as long as there's room.  Glyphs are laid out
+// at the font's pixel size, which for FontPref fonts is in terms of the
+// 1920-pixel reference window height.
+class GlyphAtlasFont : public TextDrawFont
+{
+public:
+	GlyphAtlasFont();
+	virtual ~GlyphAtlasFont();
+
+	// Load from a font preference.  Returns true on success.
+	bool Load(FontPref &font, ErrorHandler &handler);
+
+protected:
+	virtual Glyph *GetGlyph(TCHAR c) override;
+
+	// rasterize a glyph into the atlas; returns null if it doesn't fit
+	Glyph *AddGlyph(TCHAR c);
+
+	// load the kerning pairs for the font
+	void LoadKerning();
+
+	// GDI+ font
+	std::unique_ptr<Gdiplus::Font> font;
+
+	// Glyph storage.  A deque keeps the glyph addresses stable as we
+	// add glyphs, since glyphMap points into it.
+	std::deque<Glyph> atlasGlyphs;
+
+	// atlas texture
+	ID3D11Resource *texture;
+
+	// Next free position in the atlas.  Glyphs are packed in rows, left
+	// to right; 'rowHeight' is the height of the tallest glyph in the
+	// current row.
+	int nextX = 0;
+	int nextY = 0;
+	int rowHeight = 0;
+};
+
 // Text item.  This is a D3D triangle list for a string of text.
 class TextDrawItem : public Align16
 {
@@ -194,13 +262,29 @@ public:
 	// Look up a font, loading it into our cache if it's not already present
 	TextDrawFont *GetFont(const TCHAR *filename, ErrorHandler &handler);
 
+	// Look up a glyph atlas font for a font preference, building it if
+	// we don't already have one with the same description.  Returns null
+	// if the atlas can't be built.  Failures are cached too, so that we
+	// don't retry (and log the error again) on every call.
+	TextDrawFont *GetFont(FontPref &font, ErrorHandler &handler);
+
+	// Discard the cached glyph atlas fonts.  Call this when the font
+	// preferences change, so that we don't keep atlases for fonts that
+	// are no longer in use, and so that failed fonts are retried.
+	// Existing text items keep their own references to the atlas
+	// textures, so they remain valid.
+	void ClearAtlasFonts();
+
 protected:
 	// Shader
 	TextShader *shader;
 
-	// font cache
+	// font cache; atlas fonts that failed to build have null entries
 	std::unordered_map<TSTRING, TextDrawFont *> fontCache;
 
+	// key prefix for atlas fonts in the cache
+	static const TCHAR *const atlasKeyPrefix;
+
 	// active text item list
 	std::vector<TextDrawItem *> items;
 };
@@ -0,0 +1,158 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Text raster cache
+
+#include "stdafx.h"
+#include "../Utilities/GraphicsUtil.h"
+#include "TextRasterCache.h"
+#include "LogFile.h"
+
+TextRasterCache::TextRasterCache(size_t memoryLimit) :
+	memoryLimit(memoryLimit)
+{
+}
+
+TextRasterCache::~TextRasterCache()
+{
+	// log the statistics
+	LogStats();
+}
+
+void TextRasterCache::Raster::Draw(Gdiplus::Graphics &g) const
+{
+	// Draw at the original pixel size.  Use the destination rectangle
+	// form, since the plain point form scales by the ratio of the bitmap
+	// and context resolutions.
+	g.DrawImage(bitmap.get(), rc);
+}
+
+Gdiplus::TextRenderingHint TextRasterCache::ResolveTextRenderingHint(Gdiplus::TextRenderingHint hint)
+{
+	// explicit hints need no translation
+	if (hint != Gdiplus::TextRenderingHintSystemDefault)
+		return hint;
+
+	// use aliased text if font smoothing is off
+	BOOL smoothing = TRUE;
+	if (SystemParametersInfo(SPI_GETFONTSMOOTHING, 0, &smoothing, 0) && !smoothing)
+		return Gdiplus::TextRenderingHintSingleBitPerPixelGridFit;
+
+	// use ClearType or grayscale anti-aliasing, according to the smoothing type
+	UINT type = FE_FONTSMOOTHINGSTANDARD;
+	SystemParametersInfo(SPI_GETFONTSMOOTHINGTYPE, 0, &type, 0);
+	return type == FE_FONTSMOOTHINGCLEARTYPE ?
+		Gdiplus::TextRenderingHintClearTypeGridFit : Gdiplus::TextRenderingHintAntiAliasGridFit;
+}
+
+bool TextRasterCache::IsCacheableHint(Gdiplus::TextRenderingHint hint)
+{
+	return hint != Gdiplus::TextRenderingHintClearTypeGridFit
+		&& hint != Gdiplus::TextRenderingHintSystemDefault;
+}
+
+const TextRasterCache::Raster *TextRasterCache::Find(const TSTRING &key)
+{
+	if (auto it = entries.find(key); it != entries.end())
+	{
+		// move it to the front of the LRU list
+		lru.splice(lru.begin(), lru, it->second.lruPos);
+		++stats.hits;
+		return it->second.raster.get();
+	}
+
+	// not found
+	++stats.misses;
+	return nullptr;
+}
+
+const TextRasterCache::Raster *TextRasterCache::Add(
+	const TSTRING &key, const Gdiplus::Rect &rc, const Gdiplus::RectF &bbox,
+	Surface surface, std::function<void(Gdiplus::Graphics&)> render)
+{
+	// Figure the size.  Don't bother with empty areas, or with anything
+	// that would take a big bite out of the cache on its own.
+	if (rc.Width <= 0 || rc.Height <= 0)
+		return nullptr;
+	size_t pixBytes = static_cast<size_t>(rc.Width) * static_cast<size_t>(rc.Height) * 4;
+	size_t bytes = key.length() * sizeof(TCHAR) + sizeof(Raster) + pixBytes;
+	if (bytes > memoryLimit / 4)
+		return nullptr;
+
+	// set up the raster, with a transparent premultiplied bitmap over
+	// our own pixel array
+	int64_t t0 = rasterTimer.GetTime_ticks();
+	std::unique_ptr<Raster> raster(new Raster());
+	raster->rc = rc;
+	raster->bbox = bbox;
+	raster->pix.resize(pixBytes);
+	raster->bitmap.reset(new Gdiplus::Bitmap(rc.Width, rc.Height, rc.Width * 4,
+		PixelFormat32bppPARGB, raster->pix.data()));
+
+	if (surface == Surface::Bitmap)
+	{
+		// draw directly into the bitmap
+		Gdiplus::Graphics g(raster->bitmap.get());
+		render(g);
+		g.Flush();
+	}
+	else
+	{
+		// draw into a DIB, and copy the pixels into the bitmap (the DIB
+		// is the same top-down 32-bit layout)
+		DrawOffScreen(rc.Width, rc.Height, [&raster, &render, pixBytes](HDC hdc, HBITMAP, const void *dibits, const BITMAPINFO&)
+		{
+			Gdiplus::Graphics g(hdc);
+			render(g);
+			g.Flush();
+			GdiFlush();
+			memcpy(raster->pix.data(), dibits, pixBytes);
+		});
+	}
+	stats.rasterTicks += rasterTimer.GetTime_ticks() - t0;
+
+	// remove any existing entry for the key
+	if (auto it = entries.find(key); it != entries.end())
+	{
+		memoryBytes -= it->second.bytes;
+		lru.erase(it->second.lruPos);
+		entries.erase(it);
+	}
+
+	// make room by discarding least recently used entries
+	while (memoryBytes + bytes > memoryLimit && lru.size() != 0)
+	{
+		auto it = entries.find(lru.back());
+		memoryBytes -= it->second.bytes;
+		entries.erase(it);
+		lru.pop_back();
+		++stats.evictions;
+	}
+
+	// add the new entry at the front of the LRU list
+	const Raster *ret = raster.get();
+	lru.emplace_front(key);
+	entries.emplace(key, Entry{ std::move(raster), bytes, lru.begin() });
+	memoryBytes += bytes;
+	return ret;
+}
+
+void TextRasterCache::Clear()
+{
+	entries.clear();
+	lru.clear();
+	memoryBytes = 0;
+}
+
+void TextRasterCache::LogStats()
+{
+	auto &s = stats;
+	UINT64 lookups = s.hits + s.misses;
+	if (auto log = LogFile::Get(); log != nullptr && lookups != 0)
+	{
+		log->Write(LogFile::JSLogging,
+			_T("Text raster cache: %I64u lookups, %I64u hits (%.1f%%), %I64u evictions, %.1f ms rasterizing, %.1f KB in use\n"),
+			lookups, s.hits, 100.0 * s.hits / lookups, s.evictions,
+			rasterTimer.TicksToUs(s.rasterTicks) / 1000.0, memoryBytes / 1024.0);
+	}
+}
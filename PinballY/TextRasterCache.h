@@ -0,0 +1,127 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Text raster cache
+//
+// Javascript custom drawing functions tend to draw the same text over
+// and over: status lines, menu items, and popup labels get redrawn
+// every time their sprite is rebuilt, usually with exactly the same
+// string, font, and colors as last time.  Rasterizing text through
+// GDI+ or DirectWrite is one of the more expensive things a drawing
+// function can do, so this cache keeps the rendered pixels.
+//
+// Each entry holds a premultiplied ARGB bitmap covering the area where
+// the text was drawn, keyed by a string that captures everything that
+// goes into the rendering: the text, font, size, color, alignment, and
+// layout rectangle.  A hit draws the saved bitmap with a single image
+// blit.  The cache is bounded by a byte limit, discarding the least
+// recently used entries first.
+//
+// GDI+ text has to be rendered with the same text rendering hint as the
+// target context, so that a cache hit looks the same as drawing the
+// text directly.  ClearType rendering can't be cached, since it blends
+// the color subpixels against the destination background, which the
+// cache's transparent surface doesn't have.  Callers check for that
+// with IsCacheableHint() and draw directly in that case.
+//
+// The cache is only used from the UI thread (where all Javascript
+// drawing happens), so it's not thread-safe.
+
+#pragma once
+#include <list>
+#include <memory>
+#include <vector>
+#include "HiResTimer.h"
+
+class TextRasterCache
+{
+public:
+	TextRasterCache(size_t memoryLimit = DefaultMemoryLimit);
+	~TextRasterCache();
+
+	// default memory limit, in bytes
+	static const size_t DefaultMemoryLimit = 16 * 1024 * 1024;
+
+	// Cached raster.  'rc' is the area of the drawing surface that the
+	// bitmap covers, and 'bbox' is the text bounding box that the
+	// renderer reported when the text was rasterized, for callers that
+	// advance a text position past the text.
+	struct Raster
+	{
+		Gdiplus::Rect rc;
+		Gdiplus::RectF bbox;
+		std::vector<BYTE> pix;
+		std::unique_ptr<Gdiplus::Bitmap> bitmap;
+
+		// draw the raster into a context, at its original position
+		void Draw(Gdiplus::Graphics &g) const;
+	};
+
+	// Look up a raster.  Returns null if the key isn't cached.
+	const Raster *Find(const TSTRING &key);
+
+	// Resolve the text rendering hint that a GDI+ context will actually
+	// use.  SystemDefault follows the system font smoothing settings, so
+	// we translate it to the equivalent explicit hint.
+	static Gdiplus::TextRenderingHint ResolveTextRenderingHint(Gdiplus::TextRenderingHint hint);
+
+	// Can text rendered with the given (resolved) hint be cached?  This
+	// is true for everything except ClearType.
+	static bool IsCacheableHint(Gdiplus::TextRenderingHint hint);
+
+	// Off-screen surface types for rasterizing.  Bitmap draws into a GDI+
+	// bitmap, which is the right choice for GDI+ text drawing.  DC draws
+	// into a GDI+ context on a memory DC, for renderers (such as DirectWrite
+	// through a D2D DC render target) that need an HDC.
+	enum class Surface { Bitmap, DC };
+
+	// Rasterize text and add it to the cache.  This sets up a transparent
+	// off-screen surface covering 'rc', and invokes the callback to draw
+	// the text.  The callback's context has its origin at the top left of
+	// 'rc', so the callback must offset its coordinates by (-rc.X, -rc.Y).
+	// The callback is responsible for setting up the rendering options,
+	// such as the text rendering hint, to match the target context.
+	// Returns null if the area is empty or too large to cache; the caller
+	// should draw directly in that case.
+	const Raster *Add(const TSTRING &key, const Gdiplus::Rect &rc, const Gdiplus::RectF &bbox,
+		Surface surface, std::function<void(Gdiplus::Graphics&)> render);
+
+	// discard all entries
+	void Clear();
+
+	// Statistics.  'hits' and 'misses' count Find() calls, 'evictions'
+	// counts entries discarded to make room, and 'rasterTicks' is the
+	// HiResTimer time spent rasterizing the misses.
+	struct Stats
+	{
+		UINT64 hits = 0;
+		UINT64 misses = 0;
+		UINT64 evictions = 0;
+		int64_t rasterTicks = 0;
+	};
+	const Stats &GetStats() const { return stats; }
+
+	// write the statistics to the log file
+	void LogStats();
+
+protected:
+	// cache entry
+	struct Entry
+	{
+		std::unique_ptr<Raster> raster;
+		size_t bytes;
+		std::list<TSTRING>::iterator lruPos;
+	};
+	std::unordered_map<TSTRING, Entry> entries;
+
+	// LRU list of keys, most recently used first
+	std::list<TSTRING> lru;
+
+	// total bytes cached, and the limit
+	size_t memoryBytes = 0;
+	size_t memoryLimit;
+
+	// statistics, and the timer for collecting them
+	Stats stats;
+	HiResTimer rasterTimer;
+};
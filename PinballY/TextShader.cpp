@@ -92,3 +92,22 @@ void TextShader::SetShaderInputs(Camera *camera)
 	d3d->SetInputLayout(layout);
 	d3d->SetTriangleTopology();
 }
+
+void SpriteTextShader::SetShaderInputs(Camera *camera)
+{
+	D3D *d3d = D3D::Get();
+
+	// Vertex shader inputs.  These are the same as for the base text
+	// shader, except that we use the regular camera view, as for the
+	// texture shader.
+	camera->VSSetViewConstantBuffer(0);
+	camera->VSSetProjectionConstantBuffer(1);
+	d3d->VSSetWorldConstantBuffer(2);
+
+	// set the pixel shader inputs
+	d3d->PSSetConstantBuffers(0, 1, &cbColor);
+
+	// Set the input layout
+	d3d->SetInputLayout(layout);
+	d3d->SetTriangleTopology();
+}
@@ -40,3 +40,17 @@ protected:
 	// pixel shader input
 	RefPtr<ID3D11Buffer> cbColor;
 };
+
+// Sprite text shader.  This is the same text shader, set up to draw
+// in the normalized sprite coordinate system (1.0 = window height)
+// rather than the pixel coordinates of the text overlay, so that text
+// meshes can be drawn in line with the sprites in a window's drawing
+// list, with the same camera rotation and mirroring.
+class SpriteTextShader : public TextShader
+{
+public:
+	virtual const char *ID() const override { return "SpriteTextShader"; }
+
+	// set shader inputs
+	virtual void SetShaderInputs(Camera *camera) override;
+};
@@ -0,0 +1,96 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+#include "stdafx.h"
+#include "TextSprite.h"
+#include "TextDraw.h"
+#include "TextShader.h"
+#include "Application.h"
+#include "Camera.h"
+
+using namespace DirectX;
+
+TextSprite::TextSprite()
+{
+}
+
+TextSprite::~TextSprite()
+{
+}
+
+void TextSprite::SetSize(int pixWidth, int pixHeight)
+{
+	this->pixWidth = pixWidth;
+	this->pixHeight = pixHeight;
+
+	// set the normalized layout size, for callers that position
+	// sprites according to their size
+	loadSize = { float(pixWidth) / 1920.0f, float(pixHeight) / 1920.0f };
+	ContentChanged();
+}
+
+void TextSprite::ClearText()
+{
+	runs.clear();
+	ContentChanged();
+}
+
+bool TextSprite::AddText(const TCHAR *text, TextDrawFont *font, XMFLOAT4 color, float x, float y)
+{
+	// build the run's vertex and index buffers through the font
+	Run &run = runs.emplace_back();
+	if (FAILED(font->CreateBuffers(text, &run.vertexBuffer, &run.indexBuffer, &run.indexCount)))
+	{
+		runs.pop_back();
+		return false;
+	}
+
+	// set up the rest of the run
+	run.shaderResourceView.Attach(font->GetShaderResourceView());
+	run.color = color;
+	run.x = x;
+	run.y = y;
+	ContentChanged();
+	return true;
+}
+
+Shader *TextSprite::GetShader() const
+{
+	return Application::Get()->spriteTextShader.get();
+}
+
+void TextSprite::Render(Camera *camera)
+{
+	// do nothing if there's no text or it's fully transparent
+	float a = UpdateFade();
+	if (runs.size() == 0 || a == 0.0f)
+		return;
+
+	// prepare the shader
+	auto shader = static_cast<SpriteTextShader*>(GetShader());
+	shader->PrepareForRendering(camera);
+
+	D3D *d3d = D3D::Get();
+	for (auto &run : runs)
+	{
+		// The glyph vertices are in reference pixels, with the origin at
+		// the top left of the text and +Y up.  Move the origin to the
+		// run's position within the layout box, relative to the center
+		// of the box (which is the sprite's origin), scale to normalized
+		// units, and then apply the sprite's world transform.
+		XMMATRIX m = XMMatrixTranslation(run.x - float(pixWidth) / 2.0f, float(pixHeight) / 2.0f - run.y, 0.0f);
+		m = XMMatrixMultiply(m, XMMatrixScaling(1.0f / 1920.0f, 1.0f / 1920.0f, 1.0f));
+		m = XMMatrixMultiply(m, world);
+		d3d->UpdateWorldTransform(XMMatrixTranspose(m));
+
+		// set the color, applying the sprite's alpha
+		shader->SetColor(XMFLOAT4(run.color.x, run.color.y, run.color.z, run.color.w * a));
+
+		// load the atlas texture and the glyph mesh, and draw
+		ID3D11ShaderResourceView *rv = run.shaderResourceView;
+		d3d->PSSetShaderResources(0, 1, &rv);
+		d3d->IASetVertexBuffer(run.vertexBuffer, sizeof(TextVertexType));
+		d3d->IASetIndexBuffer(run.indexBuffer);
+		d3d->DrawIndexed(static_cast<INT>(run.indexCount));
+	}
+}
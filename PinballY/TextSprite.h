@@ -0,0 +1,69 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Text Sprite.  This is a subclass of the basic Sprite that draws
+// text directly from a glyph atlas font, rather than from a bitmap
+// rendered through GDI+.  Each run of text is a small vertex buffer
+// of glyph quads referencing the font's atlas texture, so changing
+// the text only requires building a new vertex buffer, rather than
+// rasterizing the text and uploading a whole new texture.
+//
+// The sprite's layout box is set in pixels at the 1920-pixel reference
+// window height, the same as for sprites drawn through GDI+, and the
+// text runs are positioned within the box in the same pixel units.
+// The sprite can be positioned, scaled, rotated, and faded like any
+// other sprite.
+
+#pragma once
+#include <list>
+#include <DirectXMath.h>
+#include "Sprite.h"
+
+class Camera;
+class TextDrawFont;
+
+class TextSprite : public Sprite
+{
+public:
+	TextSprite();
+
+	// Set the layout box size, in reference pixels
+	void SetSize(int pixWidth, int pixHeight);
+
+	// discard all text runs
+	void ClearText();
+
+	// Add a run of text.  'x' and 'y' give the position of the top left
+	// of the text relative to the top left of the layout box, in
+	// reference pixels.  Returns true on success.
+	bool AddText(const TCHAR *text, TextDrawFont *font, DirectX::XMFLOAT4 color, float x, float y);
+
+	// text sprites are always ready to draw
+	virtual bool IsFrameReady() const override { return true; }
+
+	// Render the text
+	virtual void Render(Camera *camera) override;
+
+protected:
+	virtual ~TextSprite();
+
+	// we draw through the sprite text shader
+	virtual Shader *GetShader() const override;
+
+	// layout box size, in reference pixels
+	int pixWidth = 0;
+	int pixHeight = 0;
+
+	// text run
+	struct Run
+	{
+		RefPtr<ID3D11Buffer> vertexBuffer;
+		RefPtr<ID3D11Buffer> indexBuffer;
+		size_t indexCount = 0;
+		RefPtr<ID3D11ShaderResourceView> shaderResourceView;
+		DirectX::XMFLOAT4 color;
+		float x = 0.0f;
+		float y = 0.0f;
+	};
+	std::list<Run> runs;
+};
@@ -1161,38 +1161,18 @@ unsigned int VLCAudioVideoPlayer::OnDMDSetFormat(void **opaque, char *chroma,
 	// get the 'this' pointer
 	auto self = reinterpret_cast<VLCAudioVideoPlayer*>(*opaque);
 
-	// Real DMD devices use a fixed size of 128x32 pixels, so that's
-	// generally our target size for the output.
-	//
-	// Special case:  if the video is exactly double size (256x64),
-	// we'll assume that this is in the special format sometimes
-	// used for PinballX real DMD videos, where the DMD pixel
-	// structure is mapped onto one pixel per 2x2 block in the
-	// video.  This makes the video look like a DMD when played
-	// back on a video monitor, but it makes decoding for true
-	// DMD playback just a little tricky.  The problem is that
-	// the scaling algorithm in the vlc decoder would normally
-	// want to average all of those blank pixels, but the blank
-	// pixels are meant to represent actual blank spaces in the
-	// DMD, and thus don't need to be interpolated into the frame.
-	// To get this right, we have to let vlc decode at the input
-	// size, keeping the blank pixels, and then *we* have to
-	// discard the blank pixels in our rendering step.  The DMD
-	// device callback knows to do that if presented with a
-	// 256x64 video.
-	if (*width == 256 && *height == 64)
-	{
-		// special case for PinballX double-size media - decode
-		// at this same size
-	}
-	else
-	{
-		// use the native DMD device 128x32 sizing
-		*width = 128;
-		*height = 32;
-	}
-
-	// set up to decide in I420 mode at the native video size
+	// Let the device choose the decoding size.  The device does its
+	// own scaling to the physical DMD size, so it'll generally want
+	// the frames at the video's native size, particularly for videos
+	// that use the DMD pixel structure convention (e.g., the 256x64
+	// format sometimes used for PinballX real DMD videos, where each
+	// DMD dot is mapped onto one pixel per 2x2 block).  vlc's scaler
+	// would average the blank pixels in those blocks into the frame,
+	// but they represent the spaces between the physical dots, so
+	// the device has to discard them instead.
+	self->dmd->ChooseVideoFrameSize(width, height);
+
+	// set up to decode in I420 mode at the selected size
 	memcpy(chroma, "I420", 4);
 	pitches[0] = *width;
 	pitches[1] = pitches[2] = (*width + 1) / 2;
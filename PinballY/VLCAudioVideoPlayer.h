@@ -48,13 +48,18 @@ public:
 	public:
 		virtual ~DMD() { }
 
+		// Choose the frame size for decoding.  On entry, the
+		// width and height are the video's native size (or zero
+		// if unknown); the device can change them to select the
+		// size that the decoder scales the frames to.
+		virtual void ChooseVideoFrameSize(unsigned int *width, unsigned int *height) = 0;
+
 		// Present a video frame on the device.  The frame is in
-		// I420 format, with separate Y, U, and V buffers.  The
-		// frame is a fixed 128x32 pixel format.  Note that the
+		// I420 format, with separate Y, U, and V buffers, at the
+		// size selected by ChooseVideoFrameSize().  Note that the
 		// U and V buffers are subsampled in 2x2 blocks, so these
-		// contain only 64x16 samples.  All of the buffers are
-		// packed with minimal row stride - 128 bytes per row
-		// for the Y buffer, 64 bytes per row for U and V.
+		// contain only ((width+1)/2)x((height+1)/2) samples.  All
+		// of the buffers are packed with minimal row stride.
 		virtual void PresentVideoFrame(
 			int width, int height,
 			const BYTE *y, const BYTE *u, const BYTE *v) = 0;
@@ -17,6 +17,14 @@
 //
 // VP uses OLE Structured Storage as its main wrapper format, and uses
 // a bunch of ad hoc formats within the Structured Storage streams.
+// We read the Structured Storage layer with our own CompoundFile
+// reader rather than through the OLE StgOpenStorage API.  The OLE
+// implementation does a fair amount of work up front to set up for
+// general read/write access, which is all wasted when we only want
+// a few small streams out of a file that can be hundreds of MB, and
+// it ties us to COM.  CompoundFile memory-maps the file and follows
+// the sector chains directly, so it only touches the parts of the
+// file we actually read.
 // There's no particular rhyme or reason to the various formats; you 
 // just have to look at the code to see what it's doing.  For the Table
 // Information metadata, these are simply a bunch of strings that are
@@ -42,6 +50,7 @@
 #include "stdafx.h"
 #include "VPFileReader.h"
 #include "../Utilities/WinCryptUtil.h"
+#include "../Utilities/CompoundFile.h"
 
 // File "tag" maker macro.  A tag is a four-character code
 // packed into four bytes in the FOURCC fashion.  'TAG(ABCD)'
@@ -66,12 +75,11 @@ HRESULT VPFileReader::Read(const WCHAR *filename, bool getScript)
 	if (filename == nullptr)
 		return E_POINTER;
 
-	// VP's underlying raw storage format is OLE Structured Storage.  Open 
-	// the file as an IStorage.
-	RefPtr<IStorage> stg;
-	HRESULT hr = StgOpenStorage(filename, NULL, STGM_TRANSACTED | STGM_READ | STGM_SHARE_EXCLUSIVE, NULL, 0, &stg);
-	if (FAILED(hr))
-		return hr;
+	// VP's underlying raw storage format is OLE Structured Storage, aka
+	// Compound File Binary format.  Open the file.
+	CompoundFile cf;
+	if (!cf.Open(filename))
+		return STG_E_INVALIDHEADER;
 
 	// Set up a cryptography context, in case we need to decrypt a locked file
 	HCRYPTPROVHolder hcp;
@@ -87,30 +95,29 @@ HRESULT VPFileReader::Read(const WCHAR *filename, bool getScript)
 		return HRESULT_FROM_WIN32(GetLastError());
 
 	// Read the Table Info stream
-	RefPtr<IStorage> infoStg;
-	if (SUCCEEDED(hr = stg->OpenStorage(L"TableInfo", NULL, STGM_DIRECT | STGM_READ | STGM_SHARE_EXCLUSIVE, NULL, 0, &infoStg)))
+	CompoundFile::EntryID infoStg = cf.Find(CompoundFile::RootEntry, "TableInfo");
+	if (infoStg != CompoundFile::NoEntry)
 	{
-		auto ReadValue = [&infoStg](const WCHAR *name, std::unique_ptr<WCHAR> &value)
+		auto ReadValue = [&cf, infoStg](const char *name, std::unique_ptr<WCHAR> &value)
 		{
 			// open the stream by name
-			RefPtr<IStream> stream;
-			HRESULT hr = infoStg->OpenStream(name, NULL, STGM_DIRECT | STGM_READ | STGM_SHARE_EXCLUSIVE, 0, &stream);
-			if (FAILED(hr))
-				return hr;
+			CompoundFile::Stream stream;
+			if (!cf.OpenStream(cf.Find(infoStg, name), stream))
+				return STG_E_FILENOTFOUND;
 
 			// get the content size
-			STATSTG ss;
-			stream->Stat(&ss, STATFLAG_NONAME);
-			DWORD byteLen = ss.cbSize.LowPart;
+			DWORD byteLen = static_cast<DWORD>(stream.Size());
 			DWORD charLen = byteLen / sizeof(WCHAR);
 
 			// allocate a buffer
 			value.reset(new WCHAR[charLen + 1]);
 
 			// read it
-			ULONG read;
-			if (FAILED(hr = stream->Read(value.get(), byteLen, &read)))
-				return hr;
+			if (!stream.ReadExact(value.get(), charLen * sizeof(WCHAR)))
+			{
+				value.reset();
+				return STG_E_READFAULT;
+			}
 
 			// null-terminate it
 			value.get()[charLen] = 0;
@@ -120,30 +127,29 @@ HRESULT VPFileReader::Read(const WCHAR *filename, bool getScript)
 		};
 
 		// Read the values
-		ReadValue(L"TableName", tableName);
-		ReadValue(L"TableVersion", tableVersion);
-		ReadValue(L"ReleaseDate", releaseDate);
-		ReadValue(L"AuthorName", authorName);
-		ReadValue(L"AuthorEmail", authorEmail);
-		ReadValue(L"AuthorWebSite", authorWebSite);
-		ReadValue(L"TableBlurb", blurb);
-		ReadValue(L"TableDescription", description);
-		ReadValue(L"Rules", rules);
+		ReadValue("TableName", tableName);
+		ReadValue("TableVersion", tableVersion);
+		ReadValue("ReleaseDate", releaseDate);
+		ReadValue("AuthorName", authorName);
+		ReadValue("AuthorEmail", authorEmail);
+		ReadValue("AuthorWebSite", authorWebSite);
+		ReadValue("TableBlurb", blurb);
+		ReadValue("TableDescription", description);
+		ReadValue("Rules", rules);
 	}
 
 	// open the main "Game" substorage
-	RefPtr<IStorage> dataStg;
-	if (FAILED(hr = stg->OpenStorage(L"GameStg", NULL, STGM_DIRECT | STGM_READ | STGM_SHARE_EXCLUSIVE, NULL, 0, &dataStg)))
-		return hr;
+	CompoundFile::EntryID dataStg = cf.Find(CompoundFile::RootEntry, "GameStg");
+	if (dataStg == CompoundFile::NoEntry)
+		return STG_E_FILENOTFOUND;
 
 	// open the Version stream
-	RefPtr<IStream> versionStream;
+	CompoundFile::Stream versionStream;
 	HCRYPTKEYHolder hPasswordKey;
-	if (SUCCEEDED(hr = dataStg->OpenStream(L"Version", NULL, STGM_DIRECT | STGM_READ | STGM_SHARE_EXCLUSIVE, 0, &versionStream)))
+	if (cf.OpenStream(cf.Find(dataStg, "Version"), versionStream))
 	{
 		// read the version data
-		ULONG read;
-		if (SUCCEEDED(hr = versionStream->Read(&fileVersion, sizeof(fileVersion), &read)))
+		if (versionStream.ReadExact(&fileVersion, sizeof(fileVersion)))
 		{
 			// Initialize the password decryption key according to the file version
 			CryptDeriveKey(hcp, CALG_RC2, hchkey,
@@ -153,9 +159,9 @@ HRESULT VPFileReader::Read(const WCHAR *filename, bool getScript)
 	}
 
 	// open the Game Data stream
-	RefPtr<IStream> gameStream;
-	if (FAILED(hr = dataStg->OpenStream(L"GameData", NULL, STGM_DIRECT | STGM_READ | STGM_SHARE_EXCLUSIVE, 0, &gameStream)))
-		return hr;
+	CompoundFile::Stream gameStream;
+	if (!cf.OpenStream(cf.Find(dataStg, "GameData"), gameStream))
+		return STG_E_FILENOTFOUND;
 
 	// if we don't need any of the data items, we're done
 	if (!getScript)
@@ -167,10 +173,9 @@ HRESULT VPFileReader::Read(const WCHAR *filename, bool getScript)
 		// read the record size and tag
 		INT32 recLen;
 		INT32 tag;
-		ULONG read;
-		if (FAILED(hr = gameStream->Read(&recLen, sizeof(recLen), &read))
-			|| FAILED(hr = gameStream->Read(&tag, sizeof(tag), &read)))
-			return hr;
+		if (!gameStream.ReadExact(&recLen, sizeof(recLen))
+			|| !gameStream.ReadExact(&tag, sizeof(tag)))
+			return STG_E_READFAULT;
 
 		// the nominal record length includes the FOURCC tag, so deduct
 		// that from the remaining data, as we've read it now
@@ -182,15 +187,19 @@ HRESULT VPFileReader::Read(const WCHAR *filename, bool getScript)
 		case TAG(CODE):
 			// CODE is just an empty tag not stored in the usual format;
 			// a size prefix comes next, then the text.  Read the size.
-			if (FAILED(hr = gameStream->Read(&recLen, sizeof(recLen), &read)))
-				return hr;
+			if (!gameStream.ReadExact(&recLen, sizeof(recLen)))
+				return STG_E_READFAULT;
+
+			// make sure the size is sane before allocating space for it
+			if (recLen < 0 || (UINT64)recLen > gameStream.Size() - gameStream.Tell())
+				return STG_E_DOCFILECORRUPT;
 
 			// allocate space
 			script.reset(new CHAR[recLen + 1]);
 
 			// read the data
-			if (FAILED(hr = gameStream->Read(script.get(), recLen, &read)))
-				return hr;
+			if (!gameStream.ReadExact(script.get(), recLen))
+				return STG_E_READFAULT;
 
 			// null-terminate it
 			script.get()[recLen] = 0;
@@ -207,8 +216,8 @@ HRESULT VPFileReader::Read(const WCHAR *filename, bool getScript)
 
 		case TAG(SECB):
 			// security data
-			if (FAILED(hr = gameStream->Read(&protection, sizeof(protection), &read)))
-				return hr;
+			if (!gameStream.ReadExact(&protection, sizeof(protection)))
+				return STG_E_READFAULT;
 			break;
 
 		case TAG(ENDB):
@@ -216,14 +225,10 @@ HRESULT VPFileReader::Read(const WCHAR *filename, bool getScript)
 			break;
 
 		default:
-			// skip the record
-			{
-				LARGE_INTEGER skip;
-				skip.HighPart = 0;
-				skip.LowPart = recLen;
-				if (FAILED(hr = gameStream->Seek(skip, STREAM_SEEK_CUR, NULL)))
-					return hr;
-			}
+			// Skip the record.  This only follows the sector chain; it
+			// doesn't touch the skipped data.
+			if (recLen < 0 || !gameStream.Skip(recLen))
+				return STG_E_DOCFILECORRUPT;
 			break;
 		}
 	}
@@ -33,7 +33,8 @@ void VPinMAMEIfc::EnumRoms(std::function<bool(const TCHAR*)> func)
 
 			// check for the special names that aren't for ROMs
 			if (_tcscmp(buf, _T("default")) == 0
-				|| _tcscmp(buf, _T("global")) == 0)
+				|| _tcscmp(buf, _T("global")) == 0
+				|| _tcscmp(buf, _T("globals")) == 0)
 				continue;
 			
 			// pass it to the callback; if it returns false, stop the
@@ -44,14 +45,6 @@ void VPinMAMEIfc::EnumRoms(std::function<bool(const TCHAR*)> func)
 	}
 }
 
-// Check for a prefix match to a ROM name
-bool PrefixMatch(const TCHAR *prefix, size_t prefixLen, const TCHAR *rom, size_t romLen)
-{
-	return romLen > prefixLen
-		&& rom[prefixLen] == '_'
-		&& _tcsnicmp(prefix, rom, prefixLen) == 0;
-}
-
 // Find the VPM ROM for a given game
 bool VPinMAMEIfc::FindRom(TSTRING &romName, const GameListItem *game)
 {
@@ -60,6 +53,9 @@ bool VPinMAMEIfc::FindRom(TSTRING &romName, const GameListItem *game)
 	// - If there's an explicit ROM setting in the game database
 	//   entry, use that
 	//
+	// - Otherwise, if the table metadata cache has found the ROM
+	//   name in the table script, use that
+	//
 	// - Otherwise, try to get the NVRAM file for the game.  If
 	//   there's an exact match in the VPinMAME ROM records, we'll
 	//   use that.
@@ -79,6 +75,7 @@ bool VPinMAMEIfc::FindRom(TSTRING &romName, const GameListItem *game)
 	//   right one of the several possible versions.
 	//
 	TSTRING targetName, nvramPath, nvramName;
+	TableMetadataCache::Entry metadata;
 	const TCHAR *dofRom;
 	if (game->rom.length() != 0)
 	{
@@ -88,6 +85,17 @@ bool VPinMAMEIfc::FindRom(TSTRING &romName, const GameListItem *game)
 		// wrong.
 		targetName = game->rom;
 	}
+	else if (auto tmc = Application::Get()->GetTableMetadataCache(); tmc != nullptr
+		&& tmc->Get(game, metadata) && metadata.scriptRom.length() != 0)
+	{
+		// We found the ROM name in the table script, via the table
+		// metadata cache.  This is the name the table actually passes
+		// to VPinMAME, so it's more reliable than any of the guesswork
+		// below.  Note that we only use the cached data here; if the
+		// file hasn't been scanned yet, the lookup queues it, and we
+		// fall back on the other methods for now.
+		targetName = metadata.scriptRom;
+	}
 	else if (Application::Get()->highScores->GetNvramFile(nvramPath, nvramName, game))
 	{
 		// We got an NVRAM file.  For a VPM game, the NVRAM file has
@@ -132,63 +140,20 @@ bool VPinMAMEIfc::FindRom(TSTRING &romName, const GameListItem *game)
 		return false;
 	}
 
-	// Scan for matching ROMs
-	bool found = false;
-	EnumRoms([&found, &targetName, &romName](const TCHAR *cur)
-	{
-		// check for an exact match
-		if (_tcsicmp(cur, targetName.c_str()) == 0)
-		{
-			// got it - we can stop searching, since we're not going
-			// to find anything stronger than an exact match
-			romName = cur;
-			found = true;
-			return false;
-		}
-
-		// check for a prefix match
-		if (PrefixMatch(targetName.c_str(), targetName.length(), cur, _tcslen(cur)))
-		{
-			// It's a partial match up to the version suffix.  Stash
-			// it as the best match so far, but keep searching, since
-			// there might still be an exact match yet to be found,
-			// which would override this partial match.
-			romName = cur;
-			found = true;
-		}
-
-		// continue the enumeration
-		return true;
-	});
-
-	// indicate whether or not we found anything
-	return found;
+	// Look up the ROM in the catalog.  This finds an exact match if
+	// possible, otherwise a ROM named "target_xxx".  The partial match
+	// will give us the right version as long as the user has only run
+	// one version of the ROM.
+	return GetCatalog()->Find(romName, targetName.c_str());
 }
 
 void VPinMAMEIfc::GetInstalledRomVersions(
 	std::list<TSTRING> &installedRoms,
 	const TCHAR *searchName)
 {
-	// note if searchName contains a suffix
-	size_t searchNameLen = _tcslen(searchName);
-	const TCHAR *und = _tcschr(searchName, '_');
-	size_t prefixLen = und != nullptr ? und - searchName : 0;
-
-	// Enumerate the ROMs
-	EnumRoms([searchName, searchNameLen, prefixLen, &installedRoms](const TCHAR *cur)
-	{
-		size_t curLen = _tcslen(cur);
-
-		// check for matches
-		if (_tcsicmp(searchName, cur) == 0
-			|| PrefixMatch(searchName, searchNameLen, cur, curLen)
-			|| (prefixLen != 0 && curLen == prefixLen && _tcsnicmp(searchName, cur, curLen) == 0)
-			|| (prefixLen != 0 && PrefixMatch(searchName, prefixLen, cur, curLen)))
-			installedRoms.push_back(cur);
-
-		// continue the enumeration
-		return true;
-	});
+	// The installed versions are the members of the search name's
+	// family in the catalog
+	GetCatalog()->GetFamily(installedRoms, searchName);
 }
 
 bool VPinMAMEIfc::GetRomDir(TSTRING &dir)
@@ -216,3 +181,159 @@ bool VPinMAMEIfc::GetRomDir(TSTRING &dir)
 
 	return false;
 }
+
+// --------------------------------------------------------------------------
+//
+// ROM catalog
+//
+
+VPinMAMEIfc::RomCatalog *VPinMAMEIfc::GetCatalog()
+{
+	static RomCatalog catalog(new RegistryRomSource());
+	return &catalog;
+}
+
+UINT64 VPinMAMEIfc::RegistryRomSource::GetStamp()
+{
+	// query the VPM key's subkey count and last write time
+	HKEYHolder hkeyVPM;
+	DWORD nSubkeys = 0;
+	FILETIME ft = { 0, 0 };
+	if (RegOpenKeyEx(HKEY_CURRENT_USER, configKey, 0, KEY_QUERY_VALUE, &hkeyVPM) != ERROR_SUCCESS
+		|| RegQueryInfoKey(hkeyVPM, NULL, NULL, NULL, &nSubkeys, NULL, NULL, NULL, NULL, NULL, NULL, &ft) != ERROR_SUCCESS)
+		return 0;
+
+	// Combine them into the stamp.  The write time is in 100ns units,
+	// so the low bits are essentially noise; fold the key count in there.
+	UINT64 t = (static_cast<UINT64>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+	return t ^ nSubkeys;
+}
+
+void VPinMAMEIfc::ListRomSource::EnumRoms(std::function<bool(const TCHAR*)> func)
+{
+	for (auto &rom : roms)
+	{
+		if (!func(rom.c_str()))
+			break;
+	}
+}
+
+TSTRING VPinMAMEIfc::RomCatalog::Fold(const TCHAR *name)
+{
+	TSTRING key(name);
+	std::transform(key.begin(), key.end(), key.begin(), ::_totlower);
+	return key;
+}
+
+TSTRING VPinMAMEIfc::RomCatalog::Family(const TSTRING &folded)
+{
+	// the family is the part before the first '_', or the whole name
+	// if there's no '_'
+	return folded.substr(0, folded.find('_'));
+}
+
+void VPinMAMEIfc::RomCatalog::Refresh()
+{
+	CriticalSectionLocker locker(lock);
+	CheckStamp();
+}
+
+void VPinMAMEIfc::RomCatalog::Invalidate()
+{
+	CriticalSectionLocker locker(lock);
+	built = false;
+}
+
+void VPinMAMEIfc::RomCatalog::CheckStamp()
+{
+	// rebuild if we haven't built the index yet, or the source changed
+	UINT64 newStamp = source->GetStamp();
+	if (!built || newStamp != stamp)
+	{
+		stamp = newStamp;
+		Rebuild();
+	}
+}
+
+void VPinMAMEIfc::RomCatalog::Rebuild()
+{
+	// load the names from the source
+	roms.clear();
+	source->EnumRoms([this](const TCHAR *name)
+	{
+		roms.emplace_back(name);
+		return true;
+	});
+
+	// sort by family, then by full name
+	std::sort(roms.begin(), roms.end(), [](const Rom &a, const Rom &b) {
+		int d = a.family.compare(b.family);
+		return d != 0 ? d < 0 : a.key < b.key;
+	});
+
+	built = true;
+}
+
+std::pair<size_t, size_t> VPinMAMEIfc::RomCatalog::FindFamily(const TSTRING &folded) const
+{
+	TSTRING family = Family(folded);
+	auto first = std::lower_bound(roms.begin(), roms.end(), family,
+		[](const Rom &r, const TSTRING &f) { return r.family < f; });
+	auto last = std::upper_bound(first, roms.end(), family,
+		[](const TSTRING &f, const Rom &r) { return f < r.family; });
+	return { first - roms.begin(), last - roms.begin() };
+}
+
+bool VPinMAMEIfc::RomCatalog::Find(TSTRING &romName, const TCHAR *target)
+{
+	CriticalSectionLocker locker(lock);
+	CheckStamp();
+
+	// find the target's family
+	TSTRING key = Fold(target);
+	auto fam = FindFamily(key);
+	auto first = roms.begin() + fam.first, last = roms.begin() + fam.second;
+	auto KeyLess = [](const Rom &r, const TSTRING &k) { return r.key < k; };
+
+	// check for an exact match
+	auto it = std::lower_bound(first, last, key, KeyLess);
+	if (it != last && it->key == key)
+	{
+		romName = it->name;
+		return true;
+	}
+
+	// Look for "target_xxx" matches.  These form a contiguous run
+	// within the family; take the last one.
+	TSTRING prefix = key + _T("_");
+	bool found = false;
+	for (it = std::lower_bound(it, last, prefix, KeyLess);
+		it != last && it->key.compare(0, prefix.length(), prefix) == 0; ++it)
+	{
+		romName = it->name;
+		found = true;
+	}
+
+	return found;
+}
+
+void VPinMAMEIfc::RomCatalog::GetFamily(std::list<TSTRING> &result, const TCHAR *searchName)
+{
+	CriticalSectionLocker locker(lock);
+	CheckStamp();
+
+	// The ROMs for a game are the exact family name and all of the
+	// "family_xxx" names.  If the search name has a version suffix,
+	// it's the same family, so this covers the search name itself
+	// and all of its sibling versions.
+	auto fam = FindFamily(Fold(searchName));
+	for (size_t i = fam.first; i < fam.second; ++i)
+		result.push_back(roms[i].name);
+}
+
+size_t VPinMAMEIfc::RomCatalog::GetCount()
+{
+	CriticalSectionLocker locker(lock);
+	CheckStamp();
+	return roms.size();
+}
@@ -57,4 +57,129 @@ public:
 
 	// Get the VPM ROM file system path
 	static bool GetRomDir(TSTRING &dir);
+
+	// ROM list source for the catalog.  The normal source is the VPM
+	// configuration data in the registry, but the catalog can be
+	// populated from any source, such as an in-memory list, which is
+	// useful for testing the matching rules.
+	class RomSource
+	{
+	public:
+		virtual ~RomSource() { }
+
+		// Enumerate the ROM names.  The callback returns true to
+		// continue, false to stop.
+		virtual void EnumRoms(std::function<bool(const TCHAR*)> func) = 0;
+
+		// Get a "stamp" value that changes whenever the ROM list might
+		// have changed.  This should be much cheaper than enumerating
+		// the list.  The catalog rebuilds itself when the stamp changes.
+		virtual UINT64 GetStamp() = 0;
+	};
+
+	// Registry ROM source.  This reads the ROMs from the VPM config
+	// data in the registry.
+	class RegistryRomSource : public RomSource
+	{
+	public:
+		virtual void EnumRoms(std::function<bool(const TCHAR*)> func) override { VPinMAMEIfc::EnumRoms(func); }
+
+		// The stamp combines the VPM key's last write time with its
+		// subkey count, which we can get with one registry query.
+		// Creating or deleting a subkey updates both.
+		virtual UINT64 GetStamp() override;
+	};
+
+	// In-memory ROM source
+	class ListRomSource : public RomSource
+	{
+	public:
+		ListRomSource(const std::list<TSTRING> &roms) : roms(roms) { }
+
+		virtual void EnumRoms(std::function<bool(const TCHAR*)> func) override;
+		virtual UINT64 GetStamp() override { return stamp; }
+
+		// update the list
+		void Set(const std::list<TSTRING> &roms) { this->roms = roms; ++stamp; }
+
+	protected:
+		std::list<TSTRING> roms;
+		UINT64 stamp = 1;
+	};
+
+	// ROM catalog.  This is an index of the ROM names from a source,
+	// built once and then reused for all lookups until the source
+	// changes, so that a lookup is a binary search rather than a full
+	// enumeration of the registry keys.
+	//
+	// The index is sorted by "family" (the "game" part of the "game_ver"
+	// naming convention, folded to lower case), then by full name, so
+	// that all versions of a game form a contiguous run, and all names
+	// with a given prefix form a contiguous run within the family.
+	class RomCatalog
+	{
+	public:
+		// Create a catalog from a source; the catalog takes ownership
+		RomCatalog(RomSource *source) : source(source) { }
+
+		// Rebuild the index if the source has changed since the last
+		// build.  Lookups do this automatically.
+		void Refresh();
+
+		// Force a rebuild on the next lookup
+		void Invalidate();
+
+		// Find a ROM matching a target name.  An exact match (ignoring
+		// case) is best; otherwise we take a ROM named "target_xxx".
+		// If there are several of those, we take the last one in
+		// collation order, which is usually the latest version.
+		bool Find(TSTRING &romName, const TCHAR *target);
+
+		// Get all of the ROMs in the same family as the search name.
+		// See GetInstalledRomVersions() for the rules.
+		void GetFamily(std::list<TSTRING> &roms, const TCHAR *searchName);
+
+		// get the number of ROMs in the catalog
+		size_t GetCount();
+
+	protected:
+		// rebuild the index; must be called with the lock held
+		void Rebuild();
+
+		// check the stamp and rebuild if necessary; must be called
+		// with the lock held
+		void CheckStamp();
+
+		// find the [first, last) range of the family for a folded name
+		std::pair<size_t, size_t> FindFamily(const TSTRING &folded) const;
+
+		// fold a name to the index collation, and get its family part
+		static TSTRING Fold(const TCHAR *name);
+		static TSTRING Family(const TSTRING &folded);
+
+		// ROM source
+		std::unique_ptr<RomSource> source;
+
+		// stamp at the last rebuild, and whether we've built the index yet
+		UINT64 stamp = 0;
+		bool built = false;
+
+		// index entry
+		struct Rom
+		{
+			Rom(const TCHAR *name) : name(name), key(Fold(name)), family(Family(key)) { }
+			TSTRING name;     // name as it appears in the source
+			TSTRING key;      // folded name
+			TSTRING family;   // folded family name
+		};
+
+		// the index, sorted by family, then key
+		std::vector<Rom> roms;
+
+		// lock, since lookups can come from any thread
+		CriticalSection lock;
+	};
+
+	// Get the global catalog of installed ROMs, from the registry
+	static RomCatalog *GetCatalog();
 };
@@ -89,6 +89,9 @@ void VideoSprite::ReleaseVideoPlayer()
 
 		// transfer the video player to a shutdown thread object
 		new ShutdownThread(videoPlayer.Detach());
+
+		// we'll go back to drawing the static image, if any
+		ContentChanged();
 	}
 }
 
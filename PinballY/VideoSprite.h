@@ -27,6 +27,13 @@ public:
 	// is the first frame ready?
 	virtual bool IsFrameReady() const { return videoPlayer != nullptr && videoPlayer->IsFrameReady(); }
 
+	// a video is live while it's playing, or still waiting for its first frame
+	virtual bool IsLive() const override
+	{
+		return (videoPlayer != nullptr && (videoPlayer->IsPlaying() || !videoPlayer->IsFrameReady()))
+			|| __super::IsLive();
+	}
+
 	// Clear resources
 	virtual void Clear() override;
 
@@ -36,6 +43,10 @@ public:
 	// Render the video
 	virtual void Render(Camera *camera) override;
 
+	// video frames are drawn through the video player's own shaders,
+	// so we can only batch when we're showing a static image
+	virtual bool CanBatch() const override { return videoPlayer == nullptr && __super::CanBatch(); }
+
 	// Do we have a video?
 	bool IsVideo() const { return videoPlayer != nullptr; }
 
@@ -0,0 +1,531 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Compound File Binary reader
+//
+// Note that this file doesn't use the precompiled header, since it's
+// meant to be buildable outside of the Windows project.  It only needs
+// the standard library and the OS file mapping calls.
+//
+// Format reference: [MS-CFB] Compound File Binary File Format.  The
+// parts we use:
+//
+//   - The file is a series of fixed-size sectors (512 bytes for version
+//     3 files, 4096 bytes for version 4).  The header occupies the first
+//     sector-sized block; sector N starts at byte (N+1)*sectorSize.
+//
+//   - The FAT is an array of 32-bit "next sector" links, one per sector,
+//     forming a linked-list chain for each stream.  The FAT itself is
+//     stored in sectors listed in the DIFAT, the first 109 entries of
+//     which are in the header, with the rest in a chain of DIFAT sectors.
+//
+//   - Streams below the mini stream cutoff size (4096 bytes) are stored
+//     in 64-byte mini sectors, chained through the mini FAT.  The mini
+//     sectors are packed into the "mini stream", which is the regular
+//     stream belonging to the root directory entry.
+//
+//   - The directory is a regular stream of 128-byte entries.  The
+//     children of each storage form a red-black tree linked through
+//     the left/right sibling fields; the storage points to the root of
+//     its child tree.
+//
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <string.h>
+#include "CompoundFile.h"
+
+// little-endian field readers
+static inline uint16_t Get16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t Get32(const uint8_t *p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+static inline uint64_t Get64(const uint8_t *p) { return (uint64_t)Get32(p) | ((uint64_t)Get32(p + 4) << 32); }
+
+CompoundFile::CompoundFile()
+{
+}
+
+CompoundFile::~CompoundFile()
+{
+	Close();
+}
+
+bool CompoundFile::Fail(const char *msg)
+{
+	error = msg;
+	return false;
+}
+
+#ifdef _WIN32
+
+// Windows file mapping.  The two Open() variants differ only in how
+// they open the file handle.
+static bool MapFileHandle(HANDLE hFile, void *&hMapping, const uint8_t *&base, size_t &size)
+{
+	LARGE_INTEGER li;
+	if (!GetFileSizeEx(hFile, &li) || li.QuadPart == 0 || (uint64_t)li.QuadPart > SIZE_MAX)
+		return false;
+
+	hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMapping == NULL)
+		return false;
+
+	base = static_cast<const uint8_t*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+	if (base == nullptr)
+		return false;
+
+	size = static_cast<size_t>(li.QuadPart);
+	return true;
+}
+
+bool CompoundFile::Open(const wchar_t *filename)
+{
+	Close();
+	HANDLE h = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (h == INVALID_HANDLE_VALUE)
+		return Fail("unable to open file");
+
+	hFile = h;
+	if (!MapFileHandle(h, hMapping, base, fileSize))
+	{
+		Close();
+		return Fail("unable to map file");
+	}
+
+	mapped = true;
+	return Init();
+}
+
+bool CompoundFile::Open(const char *filename)
+{
+	Close();
+	HANDLE h = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (h == INVALID_HANDLE_VALUE)
+		return Fail("unable to open file");
+
+	hFile = h;
+	if (!MapFileHandle(h, hMapping, base, fileSize))
+	{
+		Close();
+		return Fail("unable to map file");
+	}
+
+	mapped = true;
+	return Init();
+}
+
+void CompoundFile::Unmap()
+{
+	if (mapped && base != nullptr)
+		UnmapViewOfFile(base);
+	if (hMapping != nullptr)
+		CloseHandle(hMapping);
+	if (hFile != nullptr)
+		CloseHandle(hFile);
+
+	hMapping = hFile = nullptr;
+}
+
+#else // _WIN32
+
+bool CompoundFile::Open(const char *filename)
+{
+	Close();
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return Fail("unable to open file");
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		Close();
+		return Fail("unable to get file size");
+	}
+
+	void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+	{
+		Close();
+		return Fail("unable to map file");
+	}
+
+	base = static_cast<const uint8_t*>(p);
+	fileSize = static_cast<size_t>(st.st_size);
+	mapped = true;
+	return Init();
+}
+
+void CompoundFile::Unmap()
+{
+	if (mapped && base != nullptr)
+		munmap(const_cast<uint8_t*>(base), fileSize);
+	if (fd >= 0)
+		close(fd);
+
+	fd = -1;
+}
+
+#endif // _WIN32
+
+bool CompoundFile::OpenMemory(const void *data, size_t len)
+{
+	Close();
+	base = static_cast<const uint8_t*>(data);
+	fileSize = len;
+	return Init();
+}
+
+void CompoundFile::Close()
+{
+	Unmap();
+	base = nullptr;
+	fileSize = 0;
+	mapped = false;
+	fatSectors.clear();
+	miniFatSectors.clear();
+	miniStreamSectors.clear();
+	dir.clear();
+	nSectors = 0;
+}
+
+bool CompoundFile::Init()
+{
+	// check the header signature
+	static const uint8_t sig[] = { 0xD0, 0xCF, 0x11, 0xE0, 0xA1, 0xB1, 0x1A, 0xE1 };
+	if (fileSize < 512 || memcmp(base, sig, sizeof(sig)) != 0)
+		return Fail("not a compound file");
+
+	// get the sector sizes; version 3 uses 512-byte sectors, version 4 uses 4K
+	sectorShift = Get16(base + 0x1E);
+	miniSectorShift = Get16(base + 0x20);
+	if ((sectorShift != 9 && sectorShift != 12) || miniSectorShift != 6)
+		return Fail("unsupported sector size");
+	sectorSize = 1u << sectorShift;
+	miniSectorSize = 1u << miniSectorShift;
+	miniStreamCutoff = Get32(base + 0x38);
+
+	// Figure the number of sectors in the file.  The header occupies
+	// the first sector, so the file has to be at least two sectors long
+	// to hold anything; a v4 header on a file shorter than that would
+	// otherwise wrap the count and defeat all of the bounds checks.
+	if (fileSize < (2ull << sectorShift))
+		return Fail("truncated file");
+	nSectors = static_cast<uint32_t>(fileSize >> sectorShift) - 1;
+
+	// Gather the FAT sector list from the DIFAT.  The first 109 entries
+	// are in the header; the rest are in a chain of DIFAT sectors, each
+	// of which holds a sector's worth of entries minus the last one,
+	// which links to the next DIFAT sector.
+	uint32_t nFatSectors = Get32(base + 0x2C);
+	if (nFatSectors > nSectors)
+		return Fail("invalid FAT size");
+	for (int i = 0; i < 109 && fatSectors.size() < nFatSectors; ++i)
+		fatSectors.push_back(Get32(base + 0x4C + i*4));
+	uint32_t entriesPerSector = sectorSize / 4;
+	uint32_t difat = Get32(base + 0x44);
+	for (uint32_t steps = 0; fatSectors.size() < nFatSectors && difat <= MaxRegSect; ++steps)
+	{
+		const uint8_t *p = SectorPtr(difat);
+		if (p == nullptr || steps > nSectors)
+			return Fail("invalid DIFAT chain");
+
+		for (uint32_t i = 0; i < entriesPerSector - 1 && fatSectors.size() < nFatSectors; ++i)
+			fatSectors.push_back(Get32(p + i*4));
+
+		difat = Get32(p + (entriesPerSector - 1)*4);
+	}
+	if (fatSectors.size() < nFatSectors)
+		return Fail("truncated DIFAT");
+
+	// read the directory
+	std::vector<uint32_t> dirChain;
+	if (!ReadChain(Get32(base + 0x30), dirChain) || dirChain.size() == 0)
+		return Fail("invalid directory chain");
+	uint32_t entriesPerDirSector = sectorSize / 128;
+	dir.reserve(dirChain.size() * entriesPerDirSector);
+	bool v3 = sectorShift == 9;
+	for (auto s : dirChain)
+	{
+		const uint8_t *p = SectorPtr(s);
+		for (uint32_t i = 0; i < entriesPerDirSector; ++i, p += 128)
+		{
+			auto &e = dir.emplace_back();
+
+			// the name length is in bytes, including the null terminator
+			uint16_t nameBytes = Get16(p + 0x40);
+			if (nameBytes > 64)
+				nameBytes = 64;
+			for (int j = 0; j + 2 < nameBytes; j += 2)
+				e.name.push_back(static_cast<char16_t>(Get16(p + j)));
+
+			e.type = p[0x42];
+			e.left = Get32(p + 0x44);
+			e.right = Get32(p + 0x48);
+			e.child = Get32(p + 0x4C);
+			e.startSector = Get32(p + 0x74);
+
+			// Version 3 files only use the low 32 bits of the size.  Some
+			// writers leave garbage in the high part, so ignore it.
+			e.size = v3 ? Get32(p + 0x78) : Get64(p + 0x78);
+		}
+	}
+	if (dir[RootEntry].type != TypeRoot)
+		return Fail("missing root directory entry");
+
+	// read the mini FAT sector list
+	uint32_t miniFatStart = Get32(base + 0x3C);
+	if (miniFatStart <= MaxRegSect && !ReadChain(miniFatStart, miniFatSectors))
+		return Fail("invalid mini FAT chain");
+
+	// read the mini stream sector list, from the root entry's chain
+	if (dir[RootEntry].size != 0 && !ReadChain(dir[RootEntry].startSector, miniStreamSectors))
+		return Fail("invalid mini stream chain");
+
+	// success
+	error.clear();
+	return true;
+}
+
+const uint8_t *CompoundFile::SectorPtr(uint32_t sector) const
+{
+	if (sector >= nSectors)
+		return nullptr;
+
+	return base + ((static_cast<size_t>(sector) + 1) << sectorShift);
+}
+
+uint32_t CompoundFile::NextSector(uint32_t sector) const
+{
+	uint32_t entriesPerSector = sectorSize / 4;
+	uint32_t idx = sector / entriesPerSector;
+	if (idx >= fatSectors.size())
+		return FreeSect;
+
+	const uint8_t *p = SectorPtr(fatSectors[idx]);
+	return p != nullptr ? Get32(p + (sector % entriesPerSector) * 4) : FreeSect;
+}
+
+uint32_t CompoundFile::NextMiniSector(uint32_t sector) const
+{
+	uint32_t entriesPerSector = sectorSize / 4;
+	uint32_t idx = sector / entriesPerSector;
+	if (idx >= miniFatSectors.size())
+		return FreeSect;
+
+	const uint8_t *p = SectorPtr(miniFatSectors[idx]);
+	return p != nullptr ? Get32(p + (sector % entriesPerSector) * 4) : FreeSect;
+}
+
+const uint8_t *CompoundFile::MiniSectorPtr(uint32_t miniSector) const
+{
+	uint64_t ofs = static_cast<uint64_t>(miniSector) << miniSectorShift;
+	uint64_t idx = ofs >> sectorShift;
+	if (idx >= miniStreamSectors.size())
+		return nullptr;
+
+	const uint8_t *p = SectorPtr(miniStreamSectors[static_cast<size_t>(idx)]);
+	return p != nullptr ? p + (ofs & (sectorSize - 1)) : nullptr;
+}
+
+bool CompoundFile::ReadChain(uint32_t start, std::vector<uint32_t> &chain) const
+{
+	for (uint32_t s = start; s != EndOfChain; s = NextSector(s))
+	{
+		// a chain can't be longer than the file, so a longer chain
+		// must contain a cycle
+		if (s > MaxRegSect || s >= nSectors || chain.size() > nSectors)
+			return false;
+
+		chain.push_back(s);
+	}
+	return true;
+}
+
+bool CompoundFile::NameMatches(const std::u16string &entryName, const char *name)
+{
+	size_t i = 0;
+	for (; i < entryName.size() && name[i] != 0; ++i)
+	{
+		char16_t a = entryName[i], b = static_cast<unsigned char>(name[i]);
+		if (a >= 'a' && a <= 'z') a -= 'a' - 'A';
+		if (b >= 'a' && b <= 'z') b -= 'a' - 'A';
+		if (a != b)
+			return false;
+	}
+	return i == entryName.size() && name[i] == 0;
+}
+
+CompoundFile::EntryID CompoundFile::Find(EntryID storage, const char *name) const
+{
+	if (storage >= dir.size() || (dir[storage].type != TypeStorage && dir[storage].type != TypeRoot))
+		return NoEntry;
+
+	// Search the child tree.  The tree is ordered by a name collation
+	// that's awkward to reproduce exactly, and storages rarely have more
+	// than a few dozen children, so just visit every node.  Bound the
+	// number of visits by the directory size, in case of cycles.
+	std::vector<EntryID> stack;
+	stack.push_back(dir[storage].child);
+	for (size_t visits = 0; stack.size() != 0 && visits <= dir.size(); ++visits)
+	{
+		EntryID id = stack.back();
+		stack.pop_back();
+		if (id >= dir.size())
+			continue;
+
+		auto &e = dir[id];
+		if (e.type != TypeEmpty && NameMatches(e.name, name))
+			return id;
+
+		stack.push_back(e.left);
+		stack.push_back(e.right);
+	}
+
+	return NoEntry;
+}
+
+CompoundFile::EntryID CompoundFile::FindPath(const char *path) const
+{
+	EntryID id = RootEntry;
+	std::string elem;
+	for (const char *p = path; id != NoEntry; ++p)
+	{
+		if (*p == '/' || *p == 0)
+		{
+			if (elem.length() != 0)
+				id = Find(id, elem.c_str());
+			elem.clear();
+			if (*p == 0)
+				break;
+		}
+		else
+			elem.push_back(*p);
+	}
+	return id;
+}
+
+uint8_t CompoundFile::GetType(EntryID id) const
+{
+	return id < dir.size() ? dir[id].type : TypeEmpty;
+}
+
+uint64_t CompoundFile::GetSize(EntryID id) const
+{
+	return id < dir.size() ? dir[id].size : 0;
+}
+
+bool CompoundFile::OpenStream(EntryID id, Stream &stream) const
+{
+	if (id >= dir.size() || dir[id].type != TypeStream)
+		return false;
+
+	auto &e = dir[id];
+	stream.cf = this;
+	stream.mini = e.size < miniStreamCutoff;
+	stream.size = e.size;
+	stream.pos = 0;
+	stream.sector = e.startSector;
+	stream.offset = 0;
+	stream.steps = 0;
+	return true;
+}
+
+bool CompoundFile::ReadStream(EntryID id, std::vector<uint8_t> &buf) const
+{
+	Stream s;
+	if (!OpenStream(id, s))
+		return false;
+
+	// Don't trust the size in the directory entry any further than the
+	// space its sectors could actually occupy: the mini stream for a mini
+	// stream entry, otherwise the file.  A corrupted entry could otherwise
+	// make us allocate gigabytes before the first sector read fails.
+	uint64_t maxSize = s.mini ?
+		static_cast<uint64_t>(miniStreamSectors.size()) << sectorShift :
+		static_cast<uint64_t>(nSectors) << sectorShift;
+	if (s.Size() > maxSize)
+		return false;
+
+	buf.resize(static_cast<size_t>(s.Size()));
+	return s.ReadExact(buf.data(), buf.size());
+}
+
+const uint8_t *CompoundFile::Stream::CurrentRun(size_t &avail)
+{
+	if (cf == nullptr || pos >= size)
+		return nullptr;
+
+	// get the sector pointer
+	const uint8_t *p = mini ? cf->MiniSectorPtr(sector) : cf->SectorPtr(sector);
+	if (p == nullptr)
+		return nullptr;
+
+	// the run extends to the end of the sector or the end of the stream
+	uint32_t secSize = mini ? cf->miniSectorSize : cf->sectorSize;
+	uint64_t rem = size - pos;
+	avail = static_cast<size_t>(rem < secSize - offset ? rem : secSize - offset);
+	return p + offset;
+}
+
+void CompoundFile::Stream::Advance(size_t n)
+{
+	pos += n;
+	offset += static_cast<uint32_t>(n);
+
+	// if we've reached the end of the sector, follow the chain
+	uint32_t secSize = mini ? cf->miniSectorSize : cf->sectorSize;
+	if (offset == secSize)
+	{
+		sector = mini ? cf->NextMiniSector(sector) : cf->NextSector(sector);
+		offset = 0;
+
+		// if the chain is longer than the file, it must have a cycle
+		if (++steps > (cf->fileSize >> (mini ? cf->miniSectorShift : cf->sectorShift)))
+			sector = FreeSect;
+	}
+}
+
+size_t CompoundFile::Stream::Read(void *buf, size_t len)
+{
+	uint8_t *dst = static_cast<uint8_t*>(buf);
+	size_t total = 0;
+	while (total < len)
+	{
+		size_t avail;
+		const uint8_t *p = CurrentRun(avail);
+		if (p == nullptr)
+			break;
+
+		size_t n = len - total < avail ? len - total : avail;
+		memcpy(dst + total, p, n);
+		total += n;
+		Advance(n);
+	}
+	return total;
+}
+
+bool CompoundFile::Stream::Skip(uint64_t len)
+{
+	if (cf == nullptr || len > size - pos)
+		return false;
+
+	// Walk forward a sector at a time.  This only reads the FAT links,
+	// not the skipped data.
+	while (len != 0)
+	{
+		uint32_t secSize = mini ? cf->miniSectorSize : cf->sectorSize;
+		uint64_t n = secSize - offset;
+		if (n > len)
+			n = len;
+
+		Advance(static_cast<size_t>(n));
+		len -= n;
+	}
+	return true;
+}
@@ -0,0 +1,232 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Compound File Binary reader
+//
+// This is a small, read-only reader for the Microsoft Compound File
+// Binary format (the on-disk format of OLE Structured Storage), which
+// Visual Pinball uses as the container format for .vpt and .vpx files.
+//
+// The Windows Structured Storage API (StgOpenStorage et al) can read
+// these files, of course, but it's designed for general-purpose
+// read/write access, so it does a lot of work up front that we don't
+// need when we just want to pull a few small streams out of a large
+// file.  It also goes through COM, so it's tied to Windows and to
+// the COM threading rules.  This reader memory-maps the file and
+// resolves the sector chains directly from the mapped FAT and mini
+// FAT, so opening a file costs almost nothing beyond reading the
+// header and directory, and reading a stream only touches the sectors
+// that the stream actually occupies.  Skipping forward in a stream
+// only walks the FAT, without touching the skipped data.
+//
+// The reader depends only on the standard library plus the OS memory
+// mapping calls, so it builds on any platform.  A CompoundFile object
+// is immutable once opened, so any number of Stream objects can read
+// from it concurrently, on any threads.
+
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CompoundFile
+{
+public:
+	CompoundFile();
+	~CompoundFile();
+
+	// Open a file.  Returns true on success.  On failure, GetError()
+	// returns a description of the problem.
+	bool Open(const char *filename);
+#ifdef _WIN32
+	bool Open(const wchar_t *filename);
+#endif
+
+	// Open an in-memory image of a file.  The caller must keep the
+	// memory valid for the lifetime of the CompoundFile object.
+	bool OpenMemory(const void *data, size_t len);
+
+	// close the file
+	void Close();
+
+	// get the error message for the last failed operation
+	const char *GetError() const { return error.c_str(); }
+
+	// Directory entry types
+	static const uint8_t TypeEmpty = 0;
+	static const uint8_t TypeStorage = 1;
+	static const uint8_t TypeStream = 2;
+	static const uint8_t TypeRoot = 5;
+
+	// Directory entry IDs.  The root storage is always entry 0.
+	typedef uint32_t EntryID;
+	static const EntryID RootEntry = 0;
+	static const EntryID NoEntry = 0xFFFFFFFF;
+
+	// Find a child of a storage by name.  Names are compared without
+	// regard to case, following the Compound File rules (which only
+	// fold case for ASCII letters, which is all we need for the names
+	// we look up).  Returns NoEntry if there's no such child.
+	EntryID Find(EntryID storage, const char *name) const;
+
+	// Find an entry by path, with path elements separated by '/', as
+	// in "GameStg/GameData".  The path is relative to the root.
+	EntryID FindPath(const char *path) const;
+
+	// get information on an entry
+	uint8_t GetType(EntryID id) const;
+	uint64_t GetSize(EntryID id) const;
+
+	// Stream reader.  This reads the contents of a stream entry
+	// sequentially, following the sector chain as it goes.
+	class Stream
+	{
+		friend class CompoundFile;
+
+	public:
+		Stream() { }
+
+		// Read up to 'len' bytes into the buffer.  Returns the number
+		// of bytes actually read, which is less than 'len' only at the
+		// end of the stream or if the sector chain is corrupted.
+		size_t Read(void *buf, size_t len);
+
+		// Read exactly 'len' bytes; returns false if that many bytes
+		// aren't available
+		bool ReadExact(void *buf, size_t len) { return Read(buf, len) == len; }
+
+		// Skip ahead by 'len' bytes.  Returns false if that goes past
+		// the end of the stream.
+		bool Skip(uint64_t len);
+
+		// stream size and current position
+		uint64_t Size() const { return size; }
+		uint64_t Tell() const { return pos; }
+
+		// is the stream open?
+		bool IsOpen() const { return cf != nullptr; }
+
+	protected:
+		// get the current contiguous run of bytes at the read position;
+		// returns null at the end of the stream or on a chain error
+		const uint8_t *CurrentRun(size_t &avail);
+
+		// advance the position by 'n' bytes, within the current sector
+		void Advance(size_t n);
+
+		// the file we're reading from
+		const CompoundFile *cf = nullptr;
+
+		// is this a mini stream?
+		bool mini = false;
+
+		// stream size and current read position
+		uint64_t size = 0;
+		uint64_t pos = 0;
+
+		// current sector number (in the FAT or mini FAT, according to
+		// the stream type), and byte offset within the sector
+		uint32_t sector = 0;
+		uint32_t offset = 0;
+
+		// Number of sectors we've followed.  We use this to detect
+		// cycles in corrupted chains.
+		uint32_t steps = 0;
+	};
+
+	// Open a stream entry for reading.  Returns false if the entry
+	// isn't a stream.
+	bool OpenStream(EntryID id, Stream &stream) const;
+
+	// Read an entire stream into a byte vector.  Returns false if the
+	// entry isn't a stream, if its declared size is larger than the file
+	// could hold, or if its sector chain ends early.
+	bool ReadStream(EntryID id, std::vector<uint8_t> &buf) const;
+
+protected:
+	// special sector numbers
+	static const uint32_t MaxRegSect = 0xFFFFFFFA;
+	static const uint32_t EndOfChain = 0xFFFFFFFE;
+	static const uint32_t FreeSect = 0xFFFFFFFF;
+
+	// set up the structures after mapping the file
+	bool Init();
+
+	// set the error message and return false
+	bool Fail(const char *msg);
+
+	// unmap the file
+	void Unmap();
+
+	// Get a pointer to a sector in the mapped file.  Returns null if
+	// the sector is out of bounds.
+	const uint8_t *SectorPtr(uint32_t sector) const;
+
+	// follow the FAT/mini FAT chain from a sector
+	uint32_t NextSector(uint32_t sector) const;
+	uint32_t NextMiniSector(uint32_t sector) const;
+
+	// Get a pointer to a mini sector.  Mini sectors live inside the
+	// mini stream, which is itself a regular stream belonging to the
+	// root entry.
+	const uint8_t *MiniSectorPtr(uint32_t miniSector) const;
+
+	// directory entry
+	struct DirEntry
+	{
+		std::u16string name;
+		uint8_t type;
+		EntryID left;
+		EntryID right;
+		EntryID child;
+		uint32_t startSector;
+		uint64_t size;
+	};
+
+	// compare a directory entry name to an ASCII name, ignoring case
+	static bool NameMatches(const std::u16string &entryName, const char *name);
+
+	// read a regular sector chain into a vector of sector numbers
+	bool ReadChain(uint32_t start, std::vector<uint32_t> &chain) const;
+
+	// mapped file view
+	const uint8_t *base = nullptr;
+	size_t fileSize = 0;
+
+	// platform file and mapping handles
+#ifdef _WIN32
+	void *hFile = nullptr;
+	void *hMapping = nullptr;
+#else
+	int fd = -1;
+#endif
+	bool mapped = false;
+
+	// sector sizes
+	uint32_t sectorShift = 9;
+	uint32_t sectorSize = 512;
+	uint32_t miniSectorShift = 6;
+	uint32_t miniSectorSize = 64;
+
+	// streams smaller than this are stored in the mini stream
+	uint32_t miniStreamCutoff = 4096;
+
+	// Sectors containing the FAT, in order, gathered from the header
+	// DIFAT and the DIFAT sector chain
+	std::vector<uint32_t> fatSectors;
+
+	// sectors containing the mini FAT, in order
+	std::vector<uint32_t> miniFatSectors;
+
+	// sectors containing the mini stream, in order
+	std::vector<uint32_t> miniStreamSectors;
+
+	// directory
+	std::vector<DirEntry> dir;
+
+	// number of sectors in the file, for bounding chain walks
+	uint32_t nSectors = 0;
+
+	// last error message
+	std::string error;
+};
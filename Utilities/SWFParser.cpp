@@ -1892,6 +1892,299 @@ void SWFParser::UncompressedReader::ReadShape(ShapeRecordList &shapeRecords, UIN
 
 }
 
+// Direct2D render target.  This draws through a D2D DC render target
+// into the GDI DC passed to Render().
+class SWFParser::D2DRenderTarget : public SWFParser::RenderTarget
+{
+public:
+	D2DRenderTarget(SWFParser *parser, ID2D1DCRenderTarget *target) : RenderTarget(parser), target(target) { }
+
+	virtual void Clear(const RGBA &color) override
+	{
+		RefPtr<ID2D1SolidColorBrush> br;
+		if (SUCCEEDED(target->CreateSolidColorBrush(D2D1_COLOR_F{ color.r / 255.0f, color.g / 255.0f, color.b / 255.0f, 1.0f }, &br)))
+		{
+			auto size = target->GetSize();
+			target->FillRectangle(D2D1_RECT_F{ 0.0f, 0.0f, size.width, size.height }, br);
+		}
+	}
+
+	virtual void FillPath(const SWFRasterizer::Path &path, SWFRasterizer::FillRule rule,
+		const FillStyle &fill, const SWFRasterizer::Matrix&) override
+	{
+		// create the path geometry
+		RefPtr<ID2D1PathGeometry> geometry;
+		if (!CreateGeometry(geometry, path, rule, true))
+			return;
+
+		switch (fill.type)
+		{
+		case FillStyle::FillType::Solid:
+			{
+				// fill with a solid-color brush
+				RefPtr<ID2D1SolidColorBrush> brush;
+				if (SUCCEEDED(target->CreateSolidColorBrush(fill.color.ToD2D(), &brush)))
+					target->FillGeometry(geometry, brush);
+			}
+			break;
+
+		case FillStyle::FillType::RepeatingBitmap:
+		case FillStyle::FillType::NonSmoothedRepeatingBitmap:
+			// TO DO - for now just draw the same as clipped
+			// fall through...
+
+		case FillStyle::FillType::ClippedBitmap:
+		case FillStyle::FillType::NonSmoothedClippedBitmap:
+			// look up the image object from the dictionary, and retrieve its bitmap
+			if (auto image = parser->FindImage(fill.bitmapId); image != nullptr)
+			{
+				if (auto bitmap = image->GetOrCreateBitmap(target, parser); bitmap != nullptr)
+				{
+					// set up a clipping layer based on the path
+					RefPtr<ID2D1Layer> layer;
+					if (SUCCEEDED(target->CreateLayer(&layer)))
+					{
+						// push the layer
+						target->PushLayer(D2D1::LayerParameters(D2D1::InfiniteRect(), geometry), layer);
+
+						// draw the bitmap
+						D2D1_RECT_F rcBounds, rcSrc;
+						geometry->GetBounds(D2D1::IdentityMatrix(), &rcBounds);
+						auto bitmapSize = bitmap->GetPixelSize();
+						auto topLeft = fill.matrix.Apply(D2D1_POINT_2F{ 0.0f, 0.0f });
+						auto botRight = fill.matrix.Apply(D2D1_POINT_2F{ static_cast<float>(bitmapSize.width), static_cast<float>(bitmapSize.height) });
+						rcSrc = { topLeft.x, topLeft.y, botRight.x, botRight.y };
+						target->DrawBitmap(bitmap, rcBounds, 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, rcSrc);
+
+						// pop the layer
+						target->PopLayer();
+					}
+				}
+			}
+			break;
+
+		case FillStyle::FillType::LinearGradient:
+		case FillStyle::FillType::RadialGradient:
+		case FillStyle::FillType::FocalRadialGradient:
+			// TO DO - only the software target implements gradients so far
+			break;
+		}
+	}
+
+	virtual void StrokePath(const SWFRasterizer::Path &path, const LineStyle &line) override
+	{
+		RefPtr<ID2D1PathGeometry> geometry;
+		RefPtr<ID2D1SolidColorBrush> brush;
+		if (CreateGeometry(geometry, path, SWFRasterizer::FillRule::EvenOdd, false)
+			&& SUCCEEDED(target->CreateSolidColorBrush(line.color.ToD2D(), &brush)))
+			target->DrawGeometry(geometry, brush, line.width);
+	}
+
+	virtual void PushClip(const SWFRasterizer::Path &path, SWFRasterizer::FillRule rule) override
+	{
+		// Create a D2D layer with the path as its geometric mask.  If that
+		// fails, stack a null layer anyway, to keep our stack in sync with
+		// the caller's.
+		RefPtr<ID2D1PathGeometry> geometry;
+		RefPtr<ID2D1Layer> layer;
+		if (CreateGeometry(geometry, path, rule, true) && SUCCEEDED(target->CreateLayer(nullptr, &layer)))
+			target->PushLayer(D2D1::LayerParameters(D2D1::InfiniteRect(), geometry), layer);
+		else
+			layer = nullptr;
+
+		layers.emplace_back(layer);
+	}
+
+	virtual void PopClip() override
+	{
+		if (layers.size() != 0)
+		{
+			if (layers.back() != nullptr)
+				target->PopLayer();
+			layers.pop_back();
+		}
+	}
+
+	virtual void DrawImage(ImageBits *image) override
+	{
+		if (auto bitmap = image->GetOrCreateBitmap(target, parser); bitmap != nullptr)
+			target->DrawBitmap(bitmap);
+	}
+
+protected:
+	// create a D2D path geometry from a path
+	bool CreateGeometry(RefPtr<ID2D1PathGeometry> &geometry, const SWFRasterizer::Path &path, SWFRasterizer::FillRule rule, bool filled)
+	{
+		// create and open a path geometry
+		RefPtr<ID2D1GeometrySink> sink;
+		if (!(SUCCEEDED(d2dFactory->CreatePathGeometry(&geometry)) && SUCCEEDED(geometry->Open(&sink))))
+			return false;
+
+		// set the fill rule
+		sink->SetFillMode(rule == SWFRasterizer::FillRule::NonZero ? D2D1_FILL_MODE_WINDING : D2D1_FILL_MODE_ALTERNATE);
+
+		// add the figures
+		auto D2DPoint = [](const SWFRasterizer::Point &p) { return D2D1_POINT_2F{ p.x, p.y }; };
+		const SWFRasterizer::Point *pt = path.pts.data();
+		bool inFigure = false;
+		for (auto op : path.ops)
+		{
+			switch (op)
+			{
+			case SWFRasterizer::Path::Op::Move:
+				if (inFigure)
+					sink->EndFigure(D2D1_FIGURE_END_OPEN);
+				sink->BeginFigure(D2DPoint(*pt++), filled ? D2D1_FIGURE_BEGIN_FILLED : D2D1_FIGURE_BEGIN_HOLLOW);
+				inFigure = true;
+				break;
+
+			case SWFRasterizer::Path::Op::Line:
+				sink->AddLine(D2DPoint(*pt++));
+				break;
+
+			case SWFRasterizer::Path::Op::Quad:
+				sink->AddQuadraticBezier(D2D1_QUADRATIC_BEZIER_SEGMENT{ D2DPoint(pt[0]), D2DPoint(pt[1]) });
+				pt += 2;
+				break;
+
+			case SWFRasterizer::Path::Op::Close:
+				if (inFigure)
+					sink->EndFigure(D2D1_FIGURE_END_CLOSED);
+				inFigure = false;
+				break;
+			}
+		}
+
+		// finish the last figure and close the sink
+		if (inFigure)
+			sink->EndFigure(D2D1_FIGURE_END_OPEN);
+		return SUCCEEDED(sink->Close());
+	}
+
+	// D2D target
+	ID2D1DCRenderTarget *target;
+
+	// D2D clipping layer stack
+	std::vector<RefPtr<ID2D1Layer>> layers;
+};
+
+// Software render target.  This draws into a memory buffer with the
+// portable rasterizer.
+class SWFParser::SoftwareRenderTarget : public SWFParser::RenderTarget
+{
+public:
+	SoftwareRenderTarget(SWFParser *parser, int width, int height, UINT32 *pixels, int stride) :
+		RenderTarget(parser), rasterizer(width, height, pixels, stride) { }
+
+	virtual void Clear(const RGBA &color) override
+	{
+		rasterizer.Clear(color.ToARGB() | 0xFF000000);
+	}
+
+	virtual void FillPath(const SWFRasterizer::Path &path, SWFRasterizer::FillRule rule,
+		const FillStyle &fill, const SWFRasterizer::Matrix &shapeToTarget) override
+	{
+		SWFRasterizer::Paint paint;
+		switch (fill.type)
+		{
+		case FillStyle::FillType::Solid:
+			paint.color = fill.color.ToARGB();
+			break;
+
+		case FillStyle::FillType::LinearGradient:
+		case FillStyle::FillType::RadialGradient:
+		case FillStyle::FillType::FocalRadialGradient:
+			paint.type = fill.type == FillStyle::FillType::LinearGradient ?
+				SWFRasterizer::Paint::Type::LinearGradient : SWFRasterizer::Paint::Type::RadialGradient;
+			for (auto &g : fill.gradient.gradients)
+				paint.stops.push_back({ g.ratio / 255.0f, g.color.ToARGB() });
+			switch (fill.gradient.spreadMode)
+			{
+			case GRADIENT::SpreadMode::Reflect:
+				paint.spread = SWFRasterizer::Paint::Spread::Reflect;
+				break;
+
+			case GRADIENT::SpreadMode::Repeat:
+				paint.spread = SWFRasterizer::Paint::Spread::Repeat;
+				break;
+			}
+			if (fill.type == FillStyle::FillType::FocalRadialGradient)
+				paint.focalPoint = fill.gradient.focalPoint;
+
+			// The gradient square spans -16384..+16384 twips in gradient
+			// space, which the fill matrix maps into shape space.  (The
+			// matrix's translation is already in pixels.)
+			paint.matrix = shapeToTarget * fill.matrix.ToRasterizer() * SWFRasterizer::Matrix::Scale(16384.0f / 20.0f, 16384.0f / 20.0f);
+			break;
+
+		case FillStyle::FillType::RepeatingBitmap:
+		case FillStyle::FillType::ClippedBitmap:
+		case FillStyle::FillType::NonSmoothedRepeatingBitmap:
+		case FillStyle::FillType::NonSmoothedClippedBitmap:
+			{
+				// look up the image and get its pixels
+				auto image = parser->FindImage(fill.bitmapId);
+				auto pixels = image != nullptr ? image->GetPixels(parser) : nullptr;
+				if (pixels == nullptr)
+					return;
+
+				paint.type = SWFRasterizer::Paint::Type::Bitmap;
+				paint.bitmap = pixels->pix.data();
+				paint.bitmapWidth = paint.bitmapStride = static_cast<int>(pixels->width);
+				paint.bitmapHeight = static_cast<int>(pixels->height);
+				paint.repeat = fill.type == FillStyle::FillType::RepeatingBitmap
+					|| fill.type == FillStyle::FillType::NonSmoothedRepeatingBitmap;
+				paint.smooth = fill.type == FillStyle::FillType::RepeatingBitmap
+					|| fill.type == FillStyle::FillType::ClippedBitmap;
+
+				// the fill matrix maps bitmap pixels to shape space in twips
+				paint.matrix = shapeToTarget * fill.matrix.ToRasterizer() * SWFRasterizer::Matrix::Scale(1.0f / 20.0f, 1.0f / 20.0f);
+			}
+			break;
+
+		default:
+			return;
+		}
+
+		rasterizer.FillPath(path, rule, paint);
+	}
+
+	virtual void StrokePath(const SWFRasterizer::Path &path, const LineStyle &line) override
+	{
+		SWFRasterizer::Paint paint;
+		paint.color = line.color.ToARGB();
+		rasterizer.StrokePath(path, line.width, paint);
+	}
+
+	virtual void PushClip(const SWFRasterizer::Path &path, SWFRasterizer::FillRule rule) override
+	{
+		rasterizer.PushClip(path, rule);
+	}
+
+	virtual void PopClip() override
+	{
+		rasterizer.PopClip();
+	}
+
+	virtual void DrawImage(ImageBits *image) override
+	{
+		if (auto pixels = image->GetPixels(parser); pixels != nullptr)
+		{
+			// draw the image at the origin, one image pixel per target pixel
+			SWFRasterizer::Paint paint;
+			paint.type = SWFRasterizer::Paint::Type::Bitmap;
+			paint.bitmap = pixels->pix.data();
+			paint.bitmapWidth = paint.bitmapStride = static_cast<int>(pixels->width);
+			paint.bitmapHeight = static_cast<int>(pixels->height);
+			paint.smooth = false;
+			rasterizer.DrawBitmap(paint);
+		}
+	}
+
+protected:
+	SWFRasterizer rasterizer;
+};
+
 bool SWFParser::Render(HDC hdc, HBITMAP hbitmap, SIZE targetPixSize, ErrorHandler &eh)
 {
 	// HRESULT error handler - log it and return
@@ -1920,11 +2213,39 @@ bool SWFParser::Render(HDC hdc, HBITMAP hbitmap, SIZE targetPixSize, ErrorHandle
 	// open the drawing in the render target
 	target->BeginDraw();
 
+	// draw the display list
+	D2DRenderTarget d2dTarget(this, target);
+	DrawDisplayList(d2dTarget, targetPixSize);
+
+	// close drawing in the render target
+	if (!SUCCEEDED(hr = target->EndDraw()))
+		return HRError(_T("EndDraw"));
+
+	// successful completion
+	return true;
+}
+
+bool SWFParser::Render(BYTE *pixels, int stride, SIZE targetPixSize, ErrorHandler &eh)
+{
+	// the rasterizer addresses the buffer in whole pixels
+	if (pixels == nullptr || stride % 4 != 0 || stride < targetPixSize.cx * 4)
+	{
+		eh.Error(_T("SWF rendering error: invalid pixel buffer layout"));
+		return false;
+	}
+
+	// draw the display list
+	SoftwareRenderTarget target(this, targetPixSize.cx, targetPixSize.cy, reinterpret_cast<UINT32*>(pixels), stride / 4);
+	DrawDisplayList(target, targetPixSize);
+
+	// successful completion
+	return true;
+}
+
+void SWFParser::DrawDisplayList(RenderTarget &target, SIZE targetPixSize)
+{
 	// fill the frame with the background color
-	RefPtr<ID2D1SolidColorBrush> br;
-	if (!SUCCEEDED(hr = target->CreateSolidColorBrush(D2D1_COLOR_F{ bgColor.r / 255.0f, bgColor.g / 255.0f, bgColor.b / 255.0f, 1.0f }, &br)))
-		return HRError(_T("Create default brush"));
-	target->FillRectangle(D2D1_RECT_F{ 0.0f, 0.0f, static_cast<float>(targetPixSize.cx), static_cast<float>(targetPixSize.cy) }, br);
+	target.Clear(bgColor);
 
 	// Build an index on the display list so that we can sort into
 	// display order, by depth
@@ -1944,96 +2265,37 @@ bool SWFParser::Render(HDC hdc, HBITMAP hbitmap, SIZE targetPixSize, ErrorHandle
 	};
 
 	// draw the display list
-	Character::CharacterDrawingContext cdc{ this, target, scale };
+	Character::CharacterDrawingContext cdc{ this, &target, scale };
 	for (auto p : displayListIndex)
 	{
 		// Check for expired clipping layers.  Any clipping layer with
 		// a clipping depth less than the current display item depth
 		// is expired, since it only applies to layers below this point.
 		//
-		// Start by removing each expired layer from the END of the
-		// current layer list.  This lets us be as efficient as possible
-		// with D2D's way of accessing the clipping layers, which is
-		// strictly as a stack - the only layer we can remove with D2D
-		// is the top of the stack, which corresponds to the last item
-		// in our list.
-		while (clippingLayers.size() != 0 && clippingLayers.back().depth < p->depth)
+		// The render target's clipping layers work strictly as a stack,
+		// so removing a layer means popping it and everything above it.
+		// SWF allows random access to the clipping layers, though, so
+		// there can be unexpired layers above an expired one.  Those
+		// have to go back on the stack after we remove the expired
+		// layers beneath them.  In the usual case, the expired layers
+		// are all at the top, so there's nothing to push back.
+		auto firstExpired = std::find_if(clippingLayers.begin(), clippingLayers.end(),
+			[p](const ClippingLayer &l) { return l.depth < p->depth; });
+		if (firstExpired != clippingLayers.end())
 		{
-			// discard the layer from our list and from D2D's stack
-			clippingLayers.pop_back();
-			target->PopLayer();
-		}
+			// pop the target's stack down through the first expired layer
+			for (auto it = firstExpired; it != clippingLayers.end(); ++it)
+				target.PopClip();
 
-		// Now do a scan of the remaining layers to see if we need to
-		// remove any layers deeper down the stack.  We know that the
-		// current top layer is a keeper, because we would have already
-		// removed it if not.   But there could still be layers further 
-		// down the stack that have expired, since SWF'2 model allows
-		// for random access to the clipping layers, unlike D2D.
-		if (clippingLayers.size() != 0)
-		{
-			// scan for expired layers
-			std::list<ClippingLayer*> expired;
-			for (auto &l : clippingLayers)
-			{
-				if (l.depth < p->depth)
-					expired.push_back(&l);
-			}
-			if (expired.size() != 0)
+			// discard the expired layers, and restore the unexpired ones
+			for (auto it = firstExpired; it != clippingLayers.end(); )
 			{
-				// We found buried expired layers.  Remove them, working
-				// from the top of the D2D stack == back of our list.
-				std::list<ClippingLayer*> unexpired;
-				for (auto it = clippingLayers.rbegin(); it != clippingLayers.rend() && expired.size() != 0; ++it)
+				if (it->depth < p->depth)
+					it = clippingLayers.erase(it);
+				else
 				{
-					// Whatever we decide about this layer, we're going to have to
-					// remove it from the D2D stack.  The only question is whether
-					// or not it's going to go back on later...
-					target->PopLayer();
-
-					// check if this is the topmost expired item
-					ClippingLayer *l = &(*it);
-					if (l == expired.back())
-					{
-						// This is the topmost expired layer.  Remove it from the list
-						// of items we're seeking.
-						expired.pop_back();
-					}
-					else
-					{
-						// This is an unexpired layer that's still on top of an expired
-						// layer.  Remove it from the D2D stack so that we can remove
-						// the unexpired one deeper down.  But add it to our list of
-						// keepers so that we can push it back onto the D2D stack when
-						// we've finished removing the buried expired layers.
-						target->PopLayer();
-						unexpired.push_front(l);
-					}
-
-					// Okay, we've removed all of the expired layers from D2D.  Now we
-					// can discard them from our internal list - we didn't do that already
-					// just because it's inconvenient to do so during a reverse iteration.
-					for (auto it = clippingLayers.begin(); it != clippingLayers.end(); )
-					{
-						// remember the next one, in case we delete the current one and
-						// make the iterator invalid
-						auto nxt = it;
-						++nxt;
-
-						// if this item has expired, remove it from the list
-						if ((*it).depth < p->depth)
-							clippingLayers.erase(it);
-
-						// move on to the next one
-						it = nxt;
-					}
-
-					// One last step!  If we have anything in the "unexpired" list, 
-					// add those back to the D2D layer stack.  We had to remove them
-					// temporarily to be able to reach the buried expired ones, but
-					// now we're done with that, so we have to restore them.
-					for (auto &u : unexpired)
-						target->PushLayer(D2D1_LAYER_PARAMETERS{ D2D1::InfiniteRect(), u->geometry }, u->layer);
+					target.PushClip(it->path, it->fillRule);
+					++it;
 				}
 			}
 		}
@@ -2049,18 +2311,16 @@ bool SWFParser::Render(HDC hdc, HBITMAP hbitmap, SIZE targetPixSize, ErrorHandle
 
 	// Pop any remaining clipping layers.  (This isn't just being picky;
 	// D2D actually checks.)
-	while (clippingLayers.size() != 0)
-	{
-		target->PopLayer();
-		clippingLayers.pop_back();
-	}
+	for ( ; clippingLayers.size() != 0; clippingLayers.pop_back())
+		target.PopClip();
+}
 
-	// close drawing in the render target
-	if (!SUCCEEDED(hr = target->EndDraw()))
-		return HRError(_T("EndDraw"));
+SWFParser::ImageBits *SWFParser::FindImage(UINT16 charId)
+{
+	if (auto it = dict.find(charId); it != dict.end())
+		return dynamic_cast<ImageBits*>(it->second.get());
 
-	// successful completion
-	return true;
+	return nullptr;
 }
 
 void SWFParser::Text::Draw(CharacterDrawingContext &cdc, PlaceObject *po)
@@ -2162,6 +2422,10 @@ void SWFParser::ShapeWithStyle::Draw(CharacterDrawingContext &cdc, PlaceObject *
 	// start drawing at the shape origin
 	sdc.pt = { 0.0f, 0.0f };
 
+	// DefineShape4 can select the non-zero winding fill rule
+	if (usesFillWindingRule)
+		sdc.fillRule = SWFRasterizer::FillRule::NonZero;
+
 	// Draw each shape record.  This won't actually render anything yet; it
 	// just populates the style-keyed line and edge maps in the drawing context.
 	for (auto &sp : shapeRecords)
@@ -2171,67 +2435,36 @@ void SWFParser::ShapeWithStyle::Draw(CharacterDrawingContext &cdc, PlaceObject *
 	sdc.RenderMaps();
 }
 
-void SWFParser::LossyImageBits::Draw(CharacterDrawingContext &dc, PlaceObject *po)
+void SWFParser::ImageBits::Draw(CharacterDrawingContext &dc, PlaceObject *po)
 {
-	if (auto bitmap = GetOrCreateBitmap(dc); bitmap != nullptr)
-		dc.target->DrawBitmap(bitmap);
+	dc.target->DrawImage(this);
 }
 
-ID2D1Bitmap *SWFParser::LossyImageBits::GetOrCreateBitmap(CharacterDrawingContext &dc)
+const SWFParser::ImageBits::Pixels *SWFParser::ImageBits::GetPixels(SWFParser *parser)
 {
-	// if we haven't already cached the bitmap, create it
-	if (bitmap == nullptr)
+	// decode the image on first use, keeping an empty buffer on failure
+	if (!decoded)
 	{
-		// temporary image stream, in case we need to combine JPEG fragments
-		std::unique_ptr<BYTE> tmpImageStream;
-		BYTE *imageStream = nullptr;
-		size_t imageStreamLen = 0;
-
-		switch (type)
-		{
-		case Type::JPEGImageData:
-			// This is a "DefineBits" record, which only has the pixel section of the
-			// JPEG file.  We need to combine this with the common JPEG file header
-			// from the "JPEGTables" record.  The JPEGTables record has an extra
-			// end-of-image tag (FF D9) at the end, and the DefineBits record has
-			// an extra IOS tag (FF D8) at the beginning.  So to merge them, we just
-			// need to lop off the last two bytes of the tables record and the
-			// first two bytes of the pixel record, and concatenate the results.
-			tmpImageStream.reset(new BYTE[dc.parser->jpegTables.len + imageDataSize - 4]);
-			imageStream = tmpImageStream.get();
-			imageStreamLen = dc.parser->jpegTables.len - 2;
-			memcpy(imageStream, dc.parser->jpegTables.data.get(), imageStreamLen);
-			memcpy(imageStream + imageStreamLen, imageData.get() + 2, imageDataSize - 2);
-			imageStreamLen += imageDataSize - 2;
-			break;
+		decoded = true;
+		if (!Decode(parser, pixels))
+			pixels = Pixels();
+	}
 
-		default:
-			// for other types, our record contains the full image stream
-			imageStream = imageData.get();
-			imageStreamLen = imageDataSize;
-			break;
-		}
+	// return the cached pixels, if we have any
+	return pixels.pix.size() != 0 ? &pixels : nullptr;
+}
 
-		// if we have an image stream, create the WIC object
-		if (imageStream != nullptr)
+ID2D1Bitmap *SWFParser::ImageBits::GetOrCreateBitmap(ID2D1RenderTarget *target, SWFParser *parser)
+{
+	// if we haven't already cached the bitmap, create it from the pixels
+	if (bitmap == nullptr)
+	{
+		if (auto p = GetPixels(parser); p != nullptr)
 		{
-			// create a memory stream on the image data
-			RefPtr<IStream> istream(SHCreateMemStream(imageStream, static_cast<UINT>(imageStreamLen)));
-
-			// create a WIC decoder
-			RefPtr<IWICBitmapDecoder> decoder;
-			RefPtr<IWICBitmapFrameDecode> frameDec;
-			RefPtr<IWICFormatConverter> converter;
+			D2D1_BITMAP_PROPERTIES props{ { DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED }, 96.0f, 96.0f };
 			RefPtr<ID2D1Bitmap> bitmap;
-			if (SUCCEEDED(wicFactory->CreateDecoderFromStream(istream, NULL, WICDecodeMetadataCacheOnDemand, &decoder))
-				&& SUCCEEDED(decoder->GetFrame(0, &frameDec))
-				&& SUCCEEDED(wicFactory->CreateFormatConverter(&converter))
-				&& SUCCEEDED(converter->Initialize(frameDec, GUID_WICPixelFormat32bppPBGRA, WICBitmapDitherTypeNone, NULL, 0.0f, WICBitmapPaletteTypeCustom))
-				&& SUCCEEDED(dc.target->CreateBitmapFromWicBitmap(converter, &bitmap)))
-			{
-				// save the cached bitmap
+			if (SUCCEEDED(target->CreateBitmap({ p->width, p->height }, p->pix.data(), p->width * 4, props, &bitmap)))
 				this->bitmap = bitmap;
-			}
 		}
 	}
 
@@ -2239,29 +2472,126 @@ ID2D1Bitmap *SWFParser::LossyImageBits::GetOrCreateBitmap(CharacterDrawingContex
 	return bitmap;
 }
 
-void SWFParser::LosslessImageBits::Draw(CharacterDrawingContext &dc, PlaceObject *po)
+bool SWFParser::LossyImageBits::Decode(SWFParser *parser, Pixels &pixels)
 {
-	if (auto bitmap = GetOrCreateBitmap(dc); bitmap != nullptr)
-		dc.target->DrawBitmap(bitmap);
+	// temporary image stream, in case we need to combine JPEG fragments
+	std::unique_ptr<BYTE> tmpImageStream;
+	BYTE *imageStream = nullptr;
+	size_t imageStreamLen = 0;
+
+	switch (type)
+	{
+	case Type::JPEGImageData:
+		// This is a "DefineBits" record, which only has the pixel section of the
+		// JPEG file.  We need to combine this with the common JPEG file header
+		// from the "JPEGTables" record.  The JPEGTables record has an extra
+		// end-of-image tag (FF D9) at the end, and the DefineBits record has
+		// an extra IOS tag (FF D8) at the beginning.  So to merge them, we just
+		// need to lop off the last two bytes of the tables record and the
+		// first two bytes of the pixel record, and concatenate the results.
+		tmpImageStream.reset(new BYTE[parser->jpegTables.len + imageDataSize - 4]);
+		imageStream = tmpImageStream.get();
+		imageStreamLen = parser->jpegTables.len - 2;
+		memcpy(imageStream, parser->jpegTables.data.get(), imageStreamLen);
+		memcpy(imageStream + imageStreamLen, imageData.get() + 2, imageDataSize - 2);
+		imageStreamLen += imageDataSize - 2;
+		break;
+
+	default:
+		// for other types, our record contains the full image stream
+		imageStream = imageData.get();
+		imageStreamLen = imageDataSize;
+		break;
+	}
+
+	// if we don't have an image stream, there's nothing to decode
+	if (imageStream == nullptr)
+		return false;
+
+	// create a memory stream on the image data
+	RefPtr<IStream> istream(SHCreateMemStream(imageStream, static_cast<UINT>(imageStreamLen)));
+
+	// decode it through WIC, converting to premultiplied BGRA
+	RefPtr<IWICBitmapDecoder> decoder;
+	RefPtr<IWICBitmapFrameDecode> frameDec;
+	RefPtr<IWICFormatConverter> converter;
+	UINT width, height;
+	if (!(SUCCEEDED(wicFactory->CreateDecoderFromStream(istream, NULL, WICDecodeMetadataCacheOnDemand, &decoder))
+		&& SUCCEEDED(decoder->GetFrame(0, &frameDec))
+		&& SUCCEEDED(wicFactory->CreateFormatConverter(&converter))
+		&& SUCCEEDED(converter->Initialize(frameDec, GUID_WICPixelFormat32bppPBGRA, WICBitmapDitherTypeNone, NULL, 0.0f, WICBitmapPaletteTypeCustom))
+		&& SUCCEEDED(converter->GetSize(&width, &height))))
+		return false;
+
+	// copy out the pixels
+	pixels.width = width;
+	pixels.height = height;
+	pixels.pix.resize(static_cast<size_t>(width) * height);
+	return SUCCEEDED(converter->CopyPixels(NULL, width * 4, static_cast<UINT>(pixels.pix.size() * 4), reinterpret_cast<BYTE*>(pixels.pix.data())));
 }
 
-ID2D1Bitmap *SWFParser::LosslessImageBits::GetOrCreateBitmap(CharacterDrawingContext &dc)
+bool SWFParser::LosslessImageBits::Decode(SWFParser*, Pixels &pixels)
 {
-	// if we haven't already cached the bitmap, create it
-	if (bitmap == nullptr)
+	if (imageData == nullptr)
+		return false;
+
+	// Convert from RGBA to BGRA byte order.  The ARGB32 format is already
+	// premultiplied; the formats without alpha are opaque.
+	pixels.width = width;
+	pixels.height = height;
+	pixels.pix.resize(static_cast<size_t>(width) * height);
+	const BYTE *src = imageData.get();
+	UINT32 alphaMask = alphaMode == D2D1_ALPHA_MODE_IGNORE ? 0xFF000000 : 0;
+	for (auto &dst : pixels.pix)
 	{
-		D2D1_BITMAP_PROPERTIES props{ { DXGI_FORMAT_R8G8B8A8_UNORM, alphaMode }, 96.0f, 96.0f };
-		RefPtr<ID2D1Bitmap> bitmap;
-		if (SUCCEEDED(dc.target->CreateBitmap({ width, height }, imageData.get(), width*4, props, &bitmap)))
-			this->bitmap = bitmap;
+		dst = ((static_cast<UINT32>(src[3]) << 24) | (src[0] << 16) | (src[1] << 8) | src[2]) | alphaMask;
+		src += 4;
 	}
 
-	// return the cached bitmap
-	return bitmap;
+	return true;
+}
+
+void SWFParser::ShapeRecord::ShapeDrawingContext::BuildPath(SWFRasterizer::Path &path, const std::list<Segment> &edges) const
+{
+	// open the initial figure at the start of the first segment
+	D2D1_POINT_2F pt = edges.front().start;
+	D2D1_POINT_2F startPt = pt;
+	path.MoveTo(TargetCoords(startPt));
+
+	// visit each segment
+	for (auto &edge : edges)
+	{
+		// if the new segment isn't continuous with the last one, start a new figure
+		if (edge.start.x != pt.x || edge.start.y != pt.y)
+		{
+			// close the current figure if it ended where it started
+			if (startPt.x == pt.x && startPt.y == pt.y)
+				path.Close();
+
+			// start a new one
+			startPt = pt = edge.start;
+			path.MoveTo(TargetCoords(startPt));
+		}
+
+		// add this segment
+		if (edge.straight)
+			path.LineTo(TargetCoords(edge.end));
+		else
+			path.QuadTo(TargetCoords(edge.control), TargetCoords(edge.end));
+
+		// move to the end of the segment
+		pt = edge.end;
+	}
+
+	// close the last figure if it ended where it started
+	if (startPt.x == pt.x && startPt.y == pt.y)
+		path.Close();
 }
 
 void SWFParser::ShapeRecord::ShapeDrawingContext::RenderMaps()
 {
+	auto target = chardc.target;
+
 	// draw the fills, from the fill style map
 	for (auto &pair : fillEdges)
 	{
@@ -2270,135 +2600,27 @@ void SWFParser::ShapeRecord::ShapeDrawingContext::RenderMaps()
 		if (edges.size() == 0)
 			continue;
 
-		// create and open a path geometry 
-		RefPtr<ID2D1PathGeometry> path;
-		RefPtr<ID2D1GeometrySink> geomSink;
-		if (!(SUCCEEDED(d2dFactory->CreatePathGeometry(&path)) && SUCCEEDED(path->Open(&geomSink))))
-			break;
-
-		// open the initial figure at the start of the first segment
-		D2D1_POINT_2F pt = edges.front().start;
-		D2D1_POINT_2F startPt = pt;
-		geomSink->BeginFigure(TargetCoords(edges.front().start), D2D1_FIGURE_BEGIN_FILLED);
+		// build the path
+		SWFRasterizer::Path path;
+		BuildPath(path, edges);
 
-		// visit each segment
-		for (auto& edge : edges)
-		{
-			// if the new segment isn't continuous with the last one, end the current figure
-			if (edge.start.x != pt.x || edge.start.y != pt.y)
-			{
-				// end the current figure
-				geomSink->EndFigure(startPt.x == pt.x && startPt.y == pt.y ? D2D1_FIGURE_END_CLOSED : D2D1_FIGURE_END_OPEN); 
-
-				// start a new one
-				startPt = pt = edge.start;
-				geomSink->BeginFigure(TargetCoords(startPt), D2D1_FIGURE_BEGIN_FILLED);
-			}
-			
-			// add this segment
-			if (edge.straight)
-				geomSink->AddLine(TargetCoords(edge.end));
-			else
-				geomSink->AddQuadraticBezier(D2D1_QUADRATIC_BEZIER_SEGMENT{ TargetCoords(edge.control), TargetCoords(edge.end) });
-
-			// move to the end of the segment
-			pt = edge.end;
-		}
-
-		// Finish the last path and close the geometry sink
-		geomSink->EndFigure(startPt.x == pt.x && startPt.y == pt.y ? D2D1_FIGURE_END_CLOSED : D2D1_FIGURE_END_OPEN);
-		geomSink->Close();
-
-		// If this is a clipping layer, set up the D2D clipping.  Oherwise
+		// If this is a clipping layer, set up the clipping.  Otherwise
 		// execute the fill.
 		if (po->clipDepth != 0)
 		{
 			// This is a clipping layer, so we don't actually draw anything;
-			// we just set up the geometry as a clipping mask for layers up
+			// we just set up the path as a clipping mask for layers up
 			// through the clipDepth.
-			//
-			// Create the D2D clipping layer
-			RefPtr<ID2D1Layer> d2dLayer;
-			if (SUCCEEDED(chardc.target->CreateLayer(nullptr, &d2dLayer)))
-			{
-				// Create our clipping layer list entry
-				auto& layer = chardc.parser->clippingLayers.emplace_back();
-				layer.depth = po->clipDepth;
-				layer.layer = d2dLayer;
-				layer.geometry = path;
-
-				// push the layer in the D2D target
-				chardc.target->PushLayer(D2D1::LayerParameters(D2D1::InfiniteRect(), path), d2dLayer);
-			}
+			auto& layer = chardc.parser->clippingLayers.emplace_back();
+			layer.depth = po->clipDepth;
+			layer.path = std::move(path);
+			layer.fillRule = fillRule;
+			target->PushClip(layer.path, layer.fillRule);
 		}
 		else
 		{
-			// regular drawing layer - get the fill style
-			auto fillStyle = reinterpret_cast<FillStyle*>(pair.first);
-
-			switch (fillStyle->type)
-			{
-			case FillStyle::FillType::Solid:
-				{
-					// fill with a solid-color brush
-					RefPtr<ID2D1SolidColorBrush> brush;
-					if (SUCCEEDED(chardc.target->CreateSolidColorBrush(fillStyle->color.ToD2D(), &brush)))
-						chardc.target->FillGeometry(path, brush);
-				}
-				break;
-
-			case FillStyle::FillType::RepeatingBitmap:
-			case FillStyle::FillType::NonSmoothedRepeatingBitmap:
-				// TO DO - for now just draw the same as clipped
-				// fall through...
-
-			case FillStyle::FillType::ClippedBitmap:
-			case FillStyle::FillType::NonSmoothedClippedBitmap:
-				// look up the image object from the dictionary
-				if (auto it = chardc.parser->dict.find(fillStyle->bitmapId); it != chardc.parser->dict.end())
-				{
-					// make sure it's an ImageBits object
-					if (auto image = dynamic_cast<ImageBits*>(it->second.get()); image != nullptr)
-					{
-						// retrieve the bitmap
-						if (auto bitmap = image->GetOrCreateBitmap(chardc); bitmap != nullptr)
-						{
-							// set up a clipping layer based on the path
-							RefPtr<ID2D1Layer> layer;
-							if (SUCCEEDED(chardc.target->CreateLayer(&layer)))
-							{
-								// push the layer
-								chardc.target->PushLayer(D2D1::LayerParameters(D2D1::InfiniteRect(), path), layer);
-
-								// draw the bitmap
-								D2D1_RECT_F rcBounds, rcSrc;
-								path->GetBounds(D2D1::IdentityMatrix(), &rcBounds);
-								auto bitmapSize = bitmap->GetPixelSize();
-								auto topLeft = fillStyle->matrix.Apply(D2D1_POINT_2F{ 0.0f, 0.0f });
-								auto botRight = fillStyle->matrix.Apply(D2D1_POINT_2F{ static_cast<float>(bitmapSize.width), static_cast<float>(bitmapSize.height) });
-								rcSrc = { topLeft.x, topLeft.y, botRight.x, botRight.y };
-								chardc.target->DrawBitmap(bitmap, rcBounds, 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, rcSrc);
-
-								// pop the layer
-								chardc.target->PopLayer();
-							}
-						}
-					}
-				}
-				break;
-
-			case FillStyle::FillType::LinearGradient:
-				// TO DO
-				break;
-
-			case FillStyle::FillType::RadialGradient:
-				// TO DO
-				break;
-
-			case FillStyle::FillType::FocalRadialGradient:
-				// TO DO
-				break;
-			}
+			// regular drawing layer - fill it with the fill style
+			target->FillPath(path, fillRule, *reinterpret_cast<FillStyle*>(pair.first), TargetMatrix());
 		}
 	}
 
@@ -2410,68 +2632,18 @@ void SWFParser::ShapeRecord::ShapeDrawingContext::RenderMaps()
 	{
 		for (auto &pair : lineEdges)
 		{
-			// get the line style
-			auto lineStyle = reinterpret_cast<LineStyle*>(pair.first);
-
-			// create a brush for it
-			RefPtr<ID2D1SolidColorBrush> brush;
-			if (!SUCCEEDED(chardc.target->CreateSolidColorBrush(lineStyle->color.ToD2D(), &brush)))
+			// skip empty edge lists
+			if (pair.second.size() == 0)
 				continue;
 
-			// visit each segment
-			RefPtr<ID2D1PathGeometry> path;
-			RefPtr<ID2D1GeometrySink> geomSink;
-			D2D1_POINT_2F pt{ 0.0f, 0.0f };
-			D2D1_POINT_2F startPt{ 0.0f, 0.0f };
-			for (auto& seg : pair.second)
-			{
-				// if the new segment isn't continuous with the last one, draw the last one
-				if (path != nullptr && (seg.start.x != pt.x || seg.start.y != pt.y))
-				{
-					// close the figure and draw the path
-					geomSink->EndFigure(startPt.x == pt.x && startPt.y == pt.y ? D2D1_FIGURE_END_CLOSED : D2D1_FIGURE_END_OPEN);
-					geomSink->Close();
-					chardc.target->DrawGeometry(path, brush, lineStyle->width);
-
-					// forget it - we need to start a new one
-					path = nullptr;
-					geomSink = nullptr;
-				}
-
-				// open a new path if necessary
-				if (path == nullptr)
-				{
-					// create the geometry and open the path
-					if (!(SUCCEEDED(d2dFactory->CreatePathGeometry(&path)) && SUCCEEDED(path->Open(&geomSink))))
-						break;
-
-					// start the figure at the segment starting point
-					geomSink->BeginFigure(TargetCoords(seg.start), D2D1_FIGURE_BEGIN_HOLLOW);
-					startPt = pt = seg.start;
-				}
-
-				// add this segment
-				if (seg.straight)
-					geomSink->AddLine(TargetCoords(seg.end));
-				else
-					geomSink->AddQuadraticBezier(D2D1_QUADRATIC_BEZIER_SEGMENT{ TargetCoords(seg.control), TargetCoords(seg.end) });
-
-				// move to the end of the segment
-				pt = seg.end;
-			}
-
-			// draw the last path, if we didn't close it out
-			if (geomSink != nullptr)
-			{
-				geomSink->EndFigure(startPt.x == pt.x && startPt.y == pt.y ? D2D1_FIGURE_END_CLOSED : D2D1_FIGURE_END_OPEN);
-				geomSink->Close();
-				chardc.target->DrawGeometry(path, brush, lineStyle->width);
-			}
+			// build the path and stroke it with the line style
+			SWFRasterizer::Path path;
+			BuildPath(path, pair.second);
+			target->StrokePath(path, *reinterpret_cast<LineStyle*>(pair.first));
 		}
 	}
 }
 
-
 // Add an edge to a style map.  For each line style and each fill
 // style used in a shape, we build a list of line/curve segments
 // using that style, in the same order as they appear in the SWF.
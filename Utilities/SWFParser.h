@@ -14,6 +14,7 @@
 #include "GraphicsUtil.h"
 #include "LogError.h"
 #include "Pointers.h"
+#include "SWFRasterizer.h"
 
 class SWFParser
 {
@@ -37,9 +38,16 @@ public:
 	// it's time for the next frame after that, and so on.
 	bool ParseFrame(ErrorHandler &eh);
 
-	// Render the current display list
+	// Render the current display list through Direct2D, into a DIB
+	// section selected into a GDI DC
 	bool Render(HDC hdc, HBITMAP hbitmap, SIZE targetPixSize, ErrorHandler &eh);
 
+	// Render the current display list with the software rasterizer, into
+	// a 32-bit premultiplied BGRA pixel buffer (top-down, 'stride' bytes
+	// per row).  This doesn't use Direct2D or GDI, so separate parser
+	// objects can render in parallel on background threads.
+	bool Render(BYTE *pixels, int stride, SIZE targetPixSize, ErrorHandler &eh);
+
 	// Have we reached the end of the file yet?  This can be used to determine
 	// if there's more data to parse when in incremental mode.
 	bool AtEof() const { return reader.BytesRemaining() != 0; }
@@ -73,6 +81,7 @@ public:
 		BYTE a = 255;
 
 		D2D1_COLOR_F ToD2D() const { return D2D1_COLOR_F{ r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f }; }
+		UINT32 ToARGB() const { return (static_cast<UINT32>(a) << 24) | (r << 16) | (g << 8) | b; }
 
 		bool operator==(const RGBA& other) const { return r == other.r && g == other.g && b == other.b && a == other.a; }
 	};
@@ -111,6 +120,12 @@ public:
 				scaleY * m.translateY + rotateSkew0 * m.translateX + translateY
 			};
 		}
+
+		// convert to a rasterizer matrix
+		SWFRasterizer::Matrix ToRasterizer() const
+		{
+			return { scaleX, rotateSkew0, rotateSkew1, scaleY, translateX, translateY };
+		}
 	};
 
 	// SWF Color Transform type
@@ -138,6 +153,9 @@ public:
 		UINT16 clipDepth = 0;
 	};
 
+	// Render target, defined below
+	class RenderTarget;
+
 	// SWF Character
 	struct Character
 	{
@@ -153,7 +171,7 @@ public:
 			SWFParser *parser;
 
 			// render target
-			ID2D1DCRenderTarget *target;
+			RenderTarget *target;
 
 			// scale transform, to translate from SWF frame coordinates
 			// to render target pixel coordinates
@@ -276,6 +294,44 @@ public:
 		FillStyle fillType;
 	};
 
+	// Render target.  Rendering walks the display list and reduces each
+	// character to path fills, path strokes, clipping paths, and image
+	// draws, in render target pixel coordinates, and passes them to a
+	// render target to do the pixel work.  There are two implementations
+	// (in SWFParser.cpp): one draws through Direct2D into a GDI DC, and
+	// the other draws into a memory buffer with SWFRasterizer.
+	struct ImageBits;
+	class RenderTarget
+	{
+	public:
+		virtual ~RenderTarget() { }
+
+		// fill the whole target with a color
+		virtual void Clear(const RGBA &color) = 0;
+
+		// Fill a path.  'shapeToTarget' is the shape's transform into
+		// target coordinates, which gradient and bitmap fills combine
+		// with the fill style matrix.
+		virtual void FillPath(const SWFRasterizer::Path &path, SWFRasterizer::FillRule rule,
+			const FillStyle &fill, const SWFRasterizer::Matrix &shapeToTarget) = 0;
+
+		// stroke a path
+		virtual void StrokePath(const SWFRasterizer::Path &path, const LineStyle &line) = 0;
+
+		// push/pop a clipping path
+		virtual void PushClip(const SWFRasterizer::Path &path, SWFRasterizer::FillRule rule) = 0;
+		virtual void PopClip() = 0;
+
+		// draw an image character at the origin
+		virtual void DrawImage(ImageBits *image) = 0;
+
+	protected:
+		RenderTarget(SWFParser *parser) : parser(parser) { }
+
+		// parser that we're rendering for
+		SWFParser *parser;
+	};
+
 	// Shape Record
 	struct ShapeWithStyle;
 	struct ShapeRecord
@@ -308,13 +364,17 @@ public:
 			FillStyle *curFillStyle1 = nullptr;
 			LineStyle *curLineStyle = nullptr;
 
+			// Fill rule.  DefineShape4 shapes can select the non-zero rule;
+			// everything else uses even-odd.
+			SWFRasterizer::FillRule fillRule = SWFRasterizer::FillRule::EvenOdd;
+
 			// Line/curve segment maps.  To draw a figure, we first build a
 			// set of maps that group the segments making up a shape by line
-			// style and by fill style, then we turn each group into a D2D
-			// path.  This is necessary because the SWF geometry model allows
-			// heterogeneous styles in a single path, whereas D2D only allows
-			// one stroke style and one fill style per path.  See the rendering
-			// code for a more detailed explanation.
+			// style and by fill style, then we turn each group into a render
+			// target path.  This is necessary because the SWF geometry model
+			// allows heterogeneous styles in a single path, whereas D2D only
+			// allows one stroke style and one fill style per path.  See the
+			// rendering code for a more detailed explanation.
 			struct Segment
 			{
 				bool straight;
@@ -344,16 +404,27 @@ public:
 				lineEdges.clear();
 			}
 
+			// Build a render target path from an edge list.  Each run of
+			// continuous segments becomes a figure, which is closed if it
+			// ends where it started.
+			void BuildPath(SWFRasterizer::Path &path, const std::list<Segment> &edges) const;
+
 			// Transform coordinates from shape-relative coordinates to
-			// Direct2D render target coordinates.  This first applies the
-			// coordinate transform matrix from the PlaceObject record to
-			// get the SWF frame coordinates, then applies the rendering
-			// scaling factor to get the final render target coordinates.
-			D2D1_POINT_2F TargetCoords(D2D1_POINT_2F shapeRelativePt) const
+			// render target coordinates.  This first applies the coordinate
+			// transform matrix from the PlaceObject record to get the SWF
+			// frame coordinates, then applies the rendering scaling factor
+			// to get the final render target coordinates.
+			SWFRasterizer::Point TargetCoords(D2D1_POINT_2F shapeRelativePt) const
 			{
 				auto frameRelativePt = po->matrix.Apply(shapeRelativePt);
 				return { frameRelativePt.x * chardc.scale.x, frameRelativePt.y * chardc.scale.y };
 			}
+
+			// get the same transform as a matrix
+			SWFRasterizer::Matrix TargetMatrix() const
+			{
+				return SWFRasterizer::Matrix::Scale(chardc.scale.x, chardc.scale.y) * po->matrix.ToRasterizer();
+			}
 		};
 
 		virtual ~ShapeRecord() { }
@@ -497,7 +568,34 @@ public:
 	{
 		ImageBits(UINT tagId, UINT16 charId) : Character(tagId, charId) { }
 
-		virtual ID2D1Bitmap *GetOrCreateBitmap(CharacterDrawingContext &dc) = 0;
+		virtual void Draw(CharacterDrawingContext &cdc, PlaceObject *p) override;
+
+		// Decoded pixels, in premultiplied BGRA format, which is the
+		// native format for both render targets
+		struct Pixels
+		{
+			UINT width = 0;
+			UINT height = 0;
+			std::vector<UINT32> pix;
+		};
+
+		// Get the decoded pixels, decoding the image on first use.
+		// Returns null if the image can't be decoded.
+		const Pixels *GetPixels(SWFParser *parser);
+
+		// get or create the cached D2D bitmap for a render target
+		ID2D1Bitmap *GetOrCreateBitmap(ID2D1RenderTarget *target, SWFParser *parser);
+
+	protected:
+		// decode the image into the pixel buffer
+		virtual bool Decode(SWFParser *parser, Pixels &pixels) = 0;
+
+		// cached decoded pixels
+		Pixels pixels;
+		bool decoded = false;
+
+		// cached D2D bitmap
+		RefPtr<ID2D1Bitmap> bitmap;
 	};
 
 
@@ -506,9 +604,6 @@ public:
 	{
 		LossyImageBits(UINT tagId, UINT16 charId) : ImageBits(tagId, charId) { }
 
-		virtual void Draw(CharacterDrawingContext &cdc, PlaceObject *p) override;
-		virtual ID2D1Bitmap *GetOrCreateBitmap(CharacterDrawingContext &dc) override;
-
 		// image data size and bytes
 		UINT32 imageDataSize = 0;
 		std::unique_ptr<BYTE> imageData;
@@ -530,9 +625,8 @@ public:
 			GIF89a           // GIF89a stream, non-animated
 		} type = Type::Unknown;
 
-		// cached D2D bitmap
-		RefPtr<ID2D1Bitmap> bitmap;
-
+	protected:
+		virtual bool Decode(SWFParser *parser, Pixels &pixels) override;
 	};
 
 	// Lossless bitmap image bits
@@ -540,9 +634,6 @@ public:
 	{
 		LosslessImageBits(UINT tagId, UINT16 charId) : ImageBits(tagId, charId) { }
 
-		virtual void Draw(CharacterDrawingContext &cdc, PlaceObject *p) override;
-		virtual ID2D1Bitmap *GetOrCreateBitmap(CharacterDrawingContext &dc) override;
-
 		// Image data buffer.  This is the full image in R8G8B8A8_UINT format
 		// (four bytes per pixel, R-G-B-A byte order, integer 0..255 values 
 		// per color component).
@@ -567,8 +658,8 @@ public:
 		// D2D alpha mode
 		D2D1_ALPHA_MODE alphaMode = D2D1_ALPHA_MODE_IGNORE;
 
-		// cached D2D bitmap
-		RefPtr<ID2D1Bitmap> bitmap;
+	protected:
+		virtual bool Decode(SWFParser *parser, Pixels &pixels) override;
 	};
 
 	// SWF Frame
@@ -948,6 +1039,17 @@ protected:
 	// we know we're actually going to use the SWF mini-renderer.
 	static bool Init(ErrorHandler &eh);
 
+	// Draw the display list into a render target.  This is the common
+	// part of rendering, shared by the Direct2D and software targets.
+	void DrawDisplayList(RenderTarget &target, SIZE targetPixSize);
+
+	// render target implementations
+	class D2DRenderTarget;
+	class SoftwareRenderTarget;
+
+	// look up an image character in the dictionary
+	ImageBits *FindImage(UINT16 charId);
+
 	// static initialization completed?
 	static bool inited;
 
@@ -1001,11 +1103,9 @@ protected:
 		// the drawing list, we'll remove this clipping layer.
 		UINT depth;
 
-		// D2D clipping layer
-		RefPtr<ID2D1Layer> layer;
-
-		// geometry that specifies the layer's clipping mask
-		RefPtr<ID2D1Geometry> geometry;
+		// clipping path, in render target coordinates, and its fill rule
+		SWFRasterizer::Path path;
+		SWFRasterizer::FillRule fillRule;
 	};
 	std::list<ClippingLayer> clippingLayers;
 
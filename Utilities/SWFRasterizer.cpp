@@ -0,0 +1,608 @@
+// This file is part of PinballY
+// Copyright 2021 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Software scanline rasterizer for the SWF mini-renderer
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "SWFRasterizer.h"
+
+namespace
+{
+	// Multiply each 8-bit channel of a packed pixel by s/255, with rounding
+	inline uint32_t ScalePixel(uint32_t c, uint32_t s)
+	{
+		uint32_t rb = (c & 0x00FF00FF) * s + 0x00800080;
+		rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+		uint32_t ag = ((c >> 8) & 0x00FF00FF) * s + 0x00800080;
+		ag = (ag + ((ag >> 8) & 0x00FF00FF)) & 0xFF00FF00;
+		return rb | ag;
+	}
+
+	// premultiply a straight 0xAARRGGBB color
+	inline uint32_t Premultiply(uint32_t argb)
+	{
+		uint32_t a = argb >> 24;
+		return (ScalePixel(argb, a) & 0x00FFFFFF) | (a << 24);
+	}
+
+	// Blend a premultiplied source pixel over a destination pixel, with
+	// 0..255 coverage
+	inline uint32_t Blend(uint32_t dst, uint32_t src, uint32_t cov)
+	{
+		if (cov != 255)
+			src = ScalePixel(src, cov);
+		return src + ScalePixel(dst, 255 - (src >> 24));
+	}
+
+	// Bilinear interpolation of four premultiplied pixels, with 0..256
+	// fractional weights fx and fy
+	inline uint32_t Lerp(uint32_t a, uint32_t b, uint32_t f)
+	{
+		uint32_t rb = (((a & 0x00FF00FF) * (256 - f) + (b & 0x00FF00FF) * f) >> 8) & 0x00FF00FF;
+		uint32_t ag = ((((a >> 8) & 0x00FF00FF) * (256 - f) + ((b >> 8) & 0x00FF00FF) * f)) & 0xFF00FF00;
+		return rb | ag;
+	}
+
+	// Paint sampler.  This resolves a Paint into the per-pixel source
+	// color, precomputing what it can per fill.
+	struct Sampler
+	{
+		Sampler(const SWFRasterizer::Paint &paint) : paint(paint)
+		{
+			if (paint.type == SWFRasterizer::Paint::Type::Solid)
+			{
+				solid = Premultiply(paint.color);
+			}
+			else
+			{
+				// map target pixels back to paint space
+				inv = paint.matrix.Invert();
+
+				// build the gradient color table
+				if (paint.type != SWFRasterizer::Paint::Type::Bitmap)
+					BuildGradientTable();
+			}
+		}
+
+		void BuildGradientTable()
+		{
+			auto &stops = paint.stops;
+			if (stops.size() == 0)
+			{
+				memset(lut, 0, sizeof(lut));
+				return;
+			}
+
+			size_t si = 0;
+			for (int i = 0; i < 256; ++i)
+			{
+				// find the stops on either side of this position
+				float t = i / 255.0f;
+				while (si + 1 < stops.size() && stops[si + 1].pos < t)
+					++si;
+
+				// interpolate the straight colors, then premultiply
+				uint32_t c;
+				if (t <= stops[si].pos || si + 1 >= stops.size())
+					c = stops[si].color;
+				else
+				{
+					auto &s0 = stops[si], &s1 = stops[si + 1];
+					float span = s1.pos - s0.pos;
+					float f = span > 0.0f ? (t - s0.pos) / span : 1.0f;
+					c = 0;
+					for (int shift = 0; shift < 32; shift += 8)
+					{
+						float c0 = static_cast<float>((s0.color >> shift) & 0xFF);
+						float c1 = static_cast<float>((s1.color >> shift) & 0xFF);
+						c |= static_cast<uint32_t>(c0 + (c1 - c0) * f + 0.5f) << shift;
+					}
+				}
+				lut[i] = Premultiply(c);
+			}
+		}
+
+		// apply the spread mode to a gradient position
+		float Spread(float t) const
+		{
+			switch (paint.spread)
+			{
+			case SWFRasterizer::Paint::Spread::Repeat:
+				return t - floorf(t);
+
+			case SWFRasterizer::Paint::Spread::Reflect:
+				t = fabsf(t);
+				t = fmodf(t, 2.0f);
+				return t > 1.0f ? 2.0f - t : t;
+
+			default:
+				return t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
+			}
+		}
+
+		// fetch a bitmap pixel, applying the tiling mode
+		uint32_t Texel(int x, int y) const
+		{
+			int w = paint.bitmapWidth, h = paint.bitmapHeight;
+			if (paint.repeat)
+			{
+				x %= w; if (x < 0) x += w;
+				y %= h; if (y < 0) y += h;
+			}
+			else
+			{
+				x = x < 0 ? 0 : x >= w ? w - 1 : x;
+				y = y < 0 ? 0 : y >= h ? h - 1 : y;
+			}
+			return paint.bitmap[y * paint.bitmapStride + x];
+		}
+
+		// get the premultiplied color for the pixel at (x, y)
+		uint32_t Sample(int x, int y) const
+		{
+			// figure the paint-space position of the pixel center
+			SWFRasterizer::Point p = inv.Apply({ x + 0.5f, y + 0.5f });
+			switch (paint.type)
+			{
+			case SWFRasterizer::Paint::Type::LinearGradient:
+				return lut[static_cast<int>(Spread((p.x + 1.0f) * 0.5f) * 255.0f + 0.5f)];
+
+			case SWFRasterizer::Paint::Type::RadialGradient:
+				{
+					// Figure the ratio of the distance from the focal point
+					// to the pixel, to the distance from the focal point to
+					// the unit circle along the same ray.  With the focal
+					// point at the center, that's just the radius.
+					float t;
+					float fx = paint.focalPoint;
+					if (fx == 0.0f)
+						t = sqrtf(p.x*p.x + p.y*p.y);
+					else
+					{
+						float dx = p.x - fx, dy = p.y;
+						float dd = dx*dx + dy*dy;
+						if (dd == 0.0f)
+							t = 0.0f;
+						else
+						{
+							float b = fx * dx;
+							float disc = b*b - dd*(fx*fx - 1.0f);
+							float s = (-b + sqrtf(disc > 0.0f ? disc : 0.0f)) / dd;
+							t = s > 0.0f ? 1.0f / s : 1.0f;
+						}
+					}
+					return lut[static_cast<int>(Spread(t) * 255.0f + 0.5f)];
+				}
+
+			case SWFRasterizer::Paint::Type::Bitmap:
+				if (paint.bitmap == nullptr || paint.bitmapWidth <= 0 || paint.bitmapHeight <= 0)
+					return 0;
+
+				if (!paint.smooth)
+					return Texel(static_cast<int>(floorf(p.x)), static_cast<int>(floorf(p.y)));
+				else
+				{
+					// bilinear filtering, between the four nearest texel centers
+					float sx = p.x - 0.5f, sy = p.y - 0.5f;
+					float flx = floorf(sx), fly = floorf(sy);
+					int ix = static_cast<int>(flx), iy = static_cast<int>(fly);
+					uint32_t fx = static_cast<uint32_t>((sx - flx) * 256.0f);
+					uint32_t fy = static_cast<uint32_t>((sy - fly) * 256.0f);
+					uint32_t top = Lerp(Texel(ix, iy), Texel(ix + 1, iy), fx);
+					uint32_t bot = Lerp(Texel(ix, iy + 1), Texel(ix + 1, iy + 1), fx);
+					return Lerp(top, bot, fy);
+				}
+
+			default:
+				return solid;
+			}
+		}
+
+		const SWFRasterizer::Paint &paint;
+		uint32_t solid = 0;
+		SWFRasterizer::Matrix inv;
+		uint32_t lut[256];
+	};
+
+	// Accumulate one edge's signed area into the accumulation buffer.
+	// The buffer covers a bw x bh box, with bw+2 cells per row; the
+	// coordinates are relative to the box.
+	void AccumulateLine(float x0, float y0, float x1, float y1, float *acc, int rowStride, int bw, int bh)
+	{
+		// horizontal edges don't contribute anything
+		if (y0 == y1)
+			return;
+
+		// orient the edge downwards, remembering the original direction
+		float dir = 1.0f;
+		if (y0 > y1)
+		{
+			std::swap(x0, x1);
+			std::swap(y0, y1);
+			dir = -1.0f;
+		}
+
+		// clip vertically to the box
+		if (y1 <= 0.0f || y0 >= static_cast<float>(bh))
+			return;
+		float dxdy = (x1 - x0) / (y1 - y0);
+		float x = x0;
+		if (y0 < 0.0f)
+		{
+			x -= y0 * dxdy;
+			y0 = 0.0f;
+		}
+		if (y1 > static_cast<float>(bh))
+			y1 = static_cast<float>(bh);
+
+		// visit each row the edge crosses
+		float fbw = static_cast<float>(bw);
+		for (int y = static_cast<int>(y0), yEnd = static_cast<int>(ceilf(y1)); y < yEnd; ++y)
+		{
+			float *row = acc + y * rowStride;
+			float dy = std::min(static_cast<float>(y + 1), y1) - std::max(static_cast<float>(y), y0);
+			float xnext = x + dxdy * dy;
+			float d = dy * dir;
+
+			// Clamp the row's section of the edge horizontally to the box.
+			// Anything to the left collapses onto the left edge, where it
+			// still contributes its full winding to the pixels to its
+			// right; anything to the right falls off the visible area.
+			float xa = std::min(std::max(x, 0.0f), fbw);
+			float xb = std::min(std::max(xnext, 0.0f), fbw);
+			float lo = std::min(xa, xb), hi = std::max(xa, xb);
+			float loFloor = floorf(lo), hiCeil = ceilf(hi);
+			int loi = static_cast<int>(loFloor), hii = static_cast<int>(hiCeil);
+			if (hii <= loi + 1)
+			{
+				// the section is within one pixel column
+				float xmf = 0.5f * (xa + xb) - loFloor;
+				row[loi] += d - d * xmf;
+				row[loi + 1] += d * xmf;
+			}
+			else
+			{
+				// the section spans multiple columns
+				float s = 1.0f / (hi - lo);
+				float lof = lo - loFloor;
+				float a0 = 0.5f * s * (1.0f - lof) * (1.0f - lof);
+				float hif = hi - hiCeil + 1.0f;
+				float am = 0.5f * s * hif * hif;
+				row[loi] += d * a0;
+				if (hii == loi + 2)
+				{
+					row[loi + 1] += d * (1.0f - a0 - am);
+				}
+				else
+				{
+					float a1 = s * (1.5f - lof);
+					row[loi + 1] += d * (a1 - a0);
+					for (int xi = loi + 2; xi < hii - 1; ++xi)
+						row[xi] += d * s;
+					float a2 = a1 + static_cast<float>(hii - loi - 3) * s;
+					row[hii - 1] += d * (1.0f - a2 - am);
+				}
+				row[hii] += d * am;
+			}
+
+			x = xnext;
+		}
+	}
+}
+
+SWFRasterizer::Matrix SWFRasterizer::Matrix::Invert() const
+{
+	float det = a*d - b*c;
+	if (det == 0.0f)
+		return { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+
+	float r = 1.0f / det;
+	return {
+		d*r, -b*r,
+		-c*r, a*r,
+		(c*f - d*e)*r, (b*e - a*f)*r
+	};
+}
+
+SWFRasterizer::SWFRasterizer(int width, int height, uint32_t *pixels, int stride) :
+	width(width), height(height), pixels(pixels), stride(stride)
+{
+}
+
+void SWFRasterizer::Clear(uint32_t argb)
+{
+	uint32_t c = Premultiply(argb);
+	for (int y = 0; y < height; ++y)
+		std::fill(pixels + y * stride, pixels + y * stride + width, c);
+}
+
+void SWFRasterizer::Flatten(const Path &path)
+{
+	polyPts.clear();
+	polyEnds.clear();
+	polyClosed.clear();
+
+	auto EndFigure = [this](bool closed)
+	{
+		if (polyPts.size() != 0 && (polyEnds.size() == 0 || polyEnds.back() != polyPts.size()))
+		{
+			polyEnds.push_back(polyPts.size());
+			polyClosed.push_back(closed);
+		}
+	};
+
+	const Point *p = path.pts.data();
+	Point cur = { 0.0f, 0.0f };
+	for (auto op : path.ops)
+	{
+		switch (op)
+		{
+		case Path::Op::Move:
+			EndFigure(false);
+			cur = *p++;
+			polyPts.push_back(cur);
+			break;
+
+		case Path::Op::Line:
+			cur = *p++;
+			polyPts.push_back(cur);
+			break;
+
+		case Path::Op::Quad:
+			{
+				// Subdivide uniformly.  The maximum deviation of an n-segment
+				// approximation is |p0 - 2c + p1|/(8n^2), so pick n to keep
+				// that under a tenth of a pixel.
+				Point c = p[0], e = p[1];
+				p += 2;
+				float ddx = cur.x - 2.0f*c.x + e.x, ddy = cur.y - 2.0f*c.y + e.y;
+				float dd = sqrtf(ddx*ddx + ddy*ddy);
+				int n = static_cast<int>(ceilf(sqrtf(dd * 1.25f)));
+				n = n < 1 ? 1 : n > 256 ? 256 : n;
+				for (int i = 1; i <= n; ++i)
+				{
+					float t = static_cast<float>(i) / n, u = 1.0f - t;
+					polyPts.push_back({
+						u*u*cur.x + 2.0f*u*t*c.x + t*t*e.x,
+						u*u*cur.y + 2.0f*u*t*c.y + t*t*e.y });
+				}
+				cur = e;
+			}
+			break;
+
+		case Path::Op::Close:
+			EndFigure(true);
+			break;
+		}
+	}
+	EndFigure(false);
+}
+
+void SWFRasterizer::AddFlattenedFigures()
+{
+	size_t start = 0;
+	for (size_t end : polyEnds)
+	{
+		for (size_t i = start; i + 1 < end; ++i)
+			AddLine(polyPts[i], polyPts[i + 1]);
+		if (end - start > 1)
+			AddLine(polyPts[end - 1], polyPts[start]);
+		start = end;
+	}
+}
+
+template<typename SpanFunc>
+void SWFRasterizer::Rasterize(FillRule rule, SpanFunc func)
+{
+	if (lines.size() == 0)
+		return;
+
+	// figure the bounding box, limited to the target area
+	float minX = lines[0].x0, maxX = minX, minY = lines[0].y0, maxY = minY;
+	for (auto &l : lines)
+	{
+		minX = std::min(minX, std::min(l.x0, l.x1));
+		maxX = std::max(maxX, std::max(l.x0, l.x1));
+		minY = std::min(minY, std::min(l.y0, l.y1));
+		maxY = std::max(maxY, std::max(l.y0, l.y1));
+	}
+	int bx0 = std::max(0, static_cast<int>(floorf(std::max(minX, -1.0f))));
+	int by0 = std::max(0, static_cast<int>(floorf(std::max(minY, -1.0f))));
+	int bx1 = std::min(width, static_cast<int>(ceilf(std::min(maxX, static_cast<float>(width)))));
+	int by1 = std::min(height, static_cast<int>(ceilf(std::min(maxY, static_cast<float>(height)))));
+	if (bx0 >= bx1 || by0 >= by1)
+	{
+		lines.clear();
+		return;
+	}
+
+	// set up the accumulation buffer over the box
+	int bw = bx1 - bx0, bh = by1 - by0;
+	int rowStride = bw + 2;
+	acc.assign(static_cast<size_t>(rowStride) * bh, 0.0f);
+	cov.resize(bw);
+
+	// accumulate the edges
+	float ox = static_cast<float>(bx0), oy = static_cast<float>(by0);
+	for (auto &l : lines)
+		AccumulateLine(l.x0 - ox, l.y0 - oy, l.x1 - ox, l.y1 - oy, acc.data(), rowStride, bw, bh);
+	lines.clear();
+
+	// sum each row into coverage values, and pass back the covered spans
+	for (int y = 0; y < bh; ++y)
+	{
+		const float *row = acc.data() + y * rowStride;
+		float sum = 0.0f;
+		int first = -1, last = -1;
+		for (int x = 0; x < bw; ++x)
+		{
+			sum += row[x];
+			float c = fabsf(sum);
+			if (rule == FillRule::NonZero)
+				c = std::min(c, 1.0f);
+			else
+			{
+				c = fmodf(c, 2.0f);
+				if (c > 1.0f)
+					c = 2.0f - c;
+			}
+
+			uint8_t v = static_cast<uint8_t>(c * 255.0f + 0.5f);
+			cov[x] = v;
+			if (v != 0)
+			{
+				if (first < 0)
+					first = x;
+				last = x;
+			}
+		}
+
+		if (first >= 0)
+			func(by0 + y, bx0 + first, bx0 + last + 1, cov.data() + first);
+	}
+}
+
+void SWFRasterizer::PaintEdges(FillRule rule, const Paint &paint)
+{
+	Sampler sampler(paint);
+	bool solid = paint.type == Paint::Type::Solid;
+	const uint8_t *clip = clipStack.size() != 0 ? clipStack.back().data() : nullptr;
+	Rasterize(rule, [this, &sampler, solid, clip](int y, int x0, int x1, const uint8_t *cov)
+	{
+		uint32_t *dst = pixels + y * stride;
+		const uint8_t *clipRow = clip != nullptr ? clip + y * width : nullptr;
+		for (int x = x0; x < x1; ++x, ++cov)
+		{
+			// combine the path coverage with the clipping coverage
+			uint32_t c = *cov;
+			if (clipRow != nullptr)
+				c = (c * clipRow[x] + 127) / 255;
+			if (c == 0)
+				continue;
+
+			// blend the paint color into the target
+			dst[x] = Blend(dst[x], solid ? sampler.solid : sampler.Sample(x, y), c);
+		}
+	});
+}
+
+void SWFRasterizer::FillPath(const Path &path, FillRule rule, const Paint &paint)
+{
+	Flatten(path);
+	AddFlattenedFigures();
+	PaintEdges(rule, paint);
+}
+
+void SWFRasterizer::StrokePath(const Path &path, float strokeWidth, const Paint &paint)
+{
+	// Build the stroke outline as a union of polygons: a rectangle along
+	// each segment, plus a circle at each end point and at each corner,
+	// which yields round caps and joins.  The polygons all wind in the
+	// same direction, so a non-zero fill of the set paints their union.
+	float hw = std::max(strokeWidth, 1.0f) * 0.5f;
+	int nCircle = std::min(64, std::max(8, static_cast<int>(ceilf(hw * 4.0f))));
+	auto AddCircle = [this, hw, nCircle](Point c)
+	{
+		Point prev = { c.x + hw, c.y };
+		for (int i = 1; i <= nCircle; ++i)
+		{
+			float theta = -6.2831853f * i / nCircle;
+			Point p = { c.x + hw * cosf(theta), c.y + hw * sinf(theta) };
+			AddLine(prev, p);
+			prev = p;
+		}
+	};
+
+	Flatten(path);
+	size_t start = 0;
+	for (size_t fi = 0; fi < polyEnds.size(); ++fi)
+	{
+		size_t end = polyEnds[fi];
+		bool closed = polyClosed[fi];
+		size_t n = end - start;
+
+		// a lone point gets a dot
+		if (n == 1)
+			AddCircle(polyPts[start]);
+
+		// visit the segments, including the closing segment for a closed figure
+		size_t nSegs = closed ? n : n - 1;
+		Point prevDir = { 0.0f, 0.0f };
+		for (size_t si = 0; si < nSegs && n > 1; ++si)
+		{
+			Point a = polyPts[start + si];
+			Point b = polyPts[start + (si + 1) % n];
+			float dx = b.x - a.x, dy = b.y - a.y;
+			float len = sqrtf(dx*dx + dy*dy);
+			if (len == 0.0f)
+				continue;
+
+			// segment rectangle
+			Point nrm = { -dy / len * hw, dx / len * hw };
+			Point r0 = { a.x + nrm.x, a.y + nrm.y }, r1 = { b.x + nrm.x, b.y + nrm.y };
+			Point r2 = { b.x - nrm.x, b.y - nrm.y }, r3 = { a.x - nrm.x, a.y - nrm.y };
+			AddLine(r0, r1);
+			AddLine(r1, r2);
+			AddLine(r2, r3);
+			AddLine(r3, r0);
+
+			// Add a round join at the start of the segment, unless the turn
+			// is slight enough that the rectangles already meet (which is
+			// the usual case within a flattened curve).  Always add one at
+			// the start of an open figure, for the cap.
+			Point dir = { dx / len, dy / len };
+			if (si == 0 ? true : (prevDir.x * dir.x + prevDir.y * dir.y) < 0.985f)
+				AddCircle(a);
+			prevDir = dir;
+		}
+
+		// cap the end of an open figure; close the loop on a closed one
+		if (n > 1)
+			AddCircle(closed ? polyPts[start] : polyPts[end - 1]);
+
+		start = end;
+	}
+
+	PaintEdges(FillRule::NonZero, paint);
+}
+
+void SWFRasterizer::DrawBitmap(const Paint &paint)
+{
+	// fill the bitmap's rectangle, mapped through the paint matrix
+	float w = static_cast<float>(paint.bitmapWidth), h = static_cast<float>(paint.bitmapHeight);
+	auto &m = paint.matrix;
+	Point p0 = m.Apply({ 0.0f, 0.0f }), p1 = m.Apply({ w, 0.0f }), p2 = m.Apply({ w, h }), p3 = m.Apply({ 0.0f, h });
+	AddLine(p0, p1);
+	AddLine(p1, p2);
+	AddLine(p2, p3);
+	AddLine(p3, p0);
+	PaintEdges(FillRule::NonZero, paint);
+}
+
+void SWFRasterizer::PushClip(const Path &path, FillRule rule)
+{
+	// start with an empty mask
+	std::vector<uint8_t> mask(static_cast<size_t>(width) * height, 0);
+
+	// rasterize the path into the mask, intersecting it with the current clip
+	const uint8_t *clip = clipStack.size() != 0 ? clipStack.back().data() : nullptr;
+	Flatten(path);
+	AddFlattenedFigures();
+	Rasterize(rule, [this, &mask, clip](int y, int x0, int x1, const uint8_t *cov)
+	{
+		uint8_t *dst = mask.data() + y * width;
+		const uint8_t *clipRow = clip != nullptr ? clip + y * width : nullptr;
+		for (int x = x0; x < x1; ++x, ++cov)
+			dst[x] = clipRow != nullptr ? static_cast<uint8_t>((*cov * clipRow[x] + 127) / 255) : *cov;
+	});
+
+	clipStack.emplace_back(std::move(mask));
+}
+
+void SWFRasterizer::PopClip()
+{
+	if (clipStack.size() != 0)
+		clipStack.pop_back();
+}
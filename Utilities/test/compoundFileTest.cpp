@@ -0,0 +1,156 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "CompoundFile.h"
+
+// The fixture, data/sample.cfb, is a version 3 (512-byte sector) file:
+//
+//   sector 0      FAT
+//   sectors 1-2   directory
+//   sector 3      mini FAT
+//   sector 4      mini stream (320 bytes)
+//   sectors 5-14  BigStream, chained out of order: 5 6 8 7 9 10 12 11 13 14
+//
+//   Root Entry
+//     GameStg           storage
+//       GameData        200 bytes, mini sectors 0-3, byte i = i*7+3
+//       Version         4 bytes, mini sector 4, uint32 1234
+//     BigStream         5000 bytes, byte i = i*13 + i/256
+//
+// BigStream is above the 4096-byte mini stream cutoff, so it's read
+// through the FAT; the GameStg streams are read through the mini FAT.
+
+static const char *fixture = TEST_DATA_DIR "sample.cfb";
+
+static uint8_t GameDataByte(size_t i) { return (uint8_t)(i*7 + 3); }
+static uint8_t BigStreamByte(size_t i) { return (uint8_t)(i*13 + i/256); }
+
+static std::vector<uint8_t> LoadFixture() {
+  std::vector<uint8_t> buf;
+  FILE *fp = fopen(fixture, "rb");
+  assert(fp);
+  uint8_t tmp[4096];
+  for (size_t n; (n = fread(tmp, 1, sizeof(tmp), fp)) != 0; )
+    buf.insert(buf.end(), tmp, tmp + n);
+  fclose(fp);
+  return buf;
+}
+
+static void DirectoryTest() {
+  CompoundFile cf;
+  bool ok = cf.Open(fixture);
+  if (!ok)
+    printf("open failed: %s\n", cf.GetError());
+  assert(ok);
+
+  auto stg = cf.FindPath("GameStg");
+  assert(stg != CompoundFile::NoEntry && cf.GetType(stg) == CompoundFile::TypeStorage);
+
+  // names are matched without regard to case
+  auto gd = cf.FindPath("GameStg/GameData");
+  assert(gd != CompoundFile::NoEntry && cf.GetType(gd) == CompoundFile::TypeStream && cf.GetSize(gd) == 200);
+  assert(cf.FindPath("gamestg/GAMEDATA") == gd);
+  assert(cf.Find(stg, "Version") != CompoundFile::NoEntry);
+
+  // missing entries
+  assert(cf.FindPath("GameStg/Missing") == CompoundFile::NoEntry);
+  assert(cf.FindPath("BigStream/GameData") == CompoundFile::NoEntry);
+}
+
+static void MiniStreamTest() {
+  CompoundFile cf;
+  assert(cf.Open(fixture));
+
+  // read a whole stream that spans several mini sectors
+  std::vector<uint8_t> buf;
+  assert(cf.ReadStream(cf.FindPath("GameStg/GameData"), buf));
+  assert(buf.size() == 200);
+  for (size_t i = 0; i < buf.size(); i++)
+    assert(buf[i] == GameDataByte(i));
+
+  // read a single-sector stream
+  assert(cf.ReadStream(cf.FindPath("GameStg/Version"), buf));
+  uint32_t version;
+  assert(buf.size() == sizeof(version));
+  memcpy(&version, buf.data(), sizeof(version));
+  assert(version == 1234);
+
+  // skip across mini sector boundaries, and read past the end
+  CompoundFile::Stream s;
+  assert(cf.OpenStream(cf.FindPath("GameStg/GameData"), s));
+  assert(s.Skip(130) && s.Tell() == 130);
+  uint8_t tmp[100];
+  assert(s.Read(tmp, sizeof(tmp)) == 70);
+  for (size_t i = 0; i < 70; i++)
+    assert(tmp[i] == GameDataByte(130 + i));
+  assert(!s.Skip(1));
+}
+
+static void FatStreamTest() {
+  CompoundFile cf;
+  assert(cf.Open(fixture));
+
+  // read a whole stream, following the out-of-order chain
+  auto id = cf.FindPath("BigStream");
+  std::vector<uint8_t> buf;
+  assert(cf.ReadStream(id, buf));
+  assert(buf.size() == 5000);
+  for (size_t i = 0; i < buf.size(); i++)
+    assert(buf[i] == BigStreamByte(i));
+
+  // skip to the middle of a sector, and read across several sectors
+  CompoundFile::Stream s;
+  assert(cf.OpenStream(id, s));
+  assert(s.Skip(1000));
+  uint8_t tmp[1500];
+  assert(s.ReadExact(tmp, sizeof(tmp)) && s.Tell() == 2500);
+  for (size_t i = 0; i < sizeof(tmp); i++)
+    assert(tmp[i] == BigStreamByte(1000 + i));
+  assert(s.Skip(2500) && !s.ReadExact(tmp, 1));
+}
+
+static void CorruptFileTest() {
+  std::vector<uint8_t> image = LoadFixture();
+  CompoundFile cf;
+  assert(cf.OpenMemory(image.data(), image.size()));
+
+  // A stream size larger than the file is rejected before we try to
+  // allocate the buffer for it.  BigStream is directory entry 2, in
+  // the first directory sector; the size is at offset 0x78.
+  std::vector<uint8_t> bad = image;
+  const size_t sizeOfs = 512*2 + 128*2 + 0x78;
+  bad[sizeOfs] = 0xF0; bad[sizeOfs + 1] = 0xFF; bad[sizeOfs + 2] = 0xFF; bad[sizeOfs + 3] = 0xFF;
+  assert(cf.OpenMemory(bad.data(), bad.size()));
+  std::vector<uint8_t> buf;
+  assert(!cf.ReadStream(cf.FindPath("BigStream"), buf));
+  assert(buf.capacity() < image.size());
+
+  // A file truncated after the mini stream opens, and the mini streams
+  // are readable, but BigStream is cut off
+  assert(cf.OpenMemory(image.data(), 512*6));
+  assert(cf.ReadStream(cf.FindPath("GameStg/GameData"), buf));
+  assert(!cf.ReadStream(cf.FindPath("BigStream"), buf));
+
+  // a file truncated in the directory, or in the header
+  assert(!cf.OpenMemory(image.data(), 512*3));
+  assert(!cf.OpenMemory(image.data(), 100));
+
+  // A version 4 header on a file shorter than two 4K sectors.  This
+  // would wrap the sector count if it weren't rejected.
+  bad.assign(image.begin(), image.begin() + 1000);
+  bad[0x1A] = 4; bad[0x1E] = 12;
+  assert(!cf.OpenMemory(bad.data(), bad.size()));
+
+  // not a compound file at all
+  bad = image;
+  bad[0] = 'X';
+  assert(!cf.OpenMemory(bad.data(), bad.size()));
+}
+
+void compoundFileTest() {
+  DirectoryTest();
+  MiniStreamTest();
+  FatStreamTest();
+  CorruptFileTest();
+}
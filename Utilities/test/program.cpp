@@ -0,0 +1,16 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+void compoundFileTest();
+void swfRasterizerTest();
+
+int main(int argc, char **argv) {
+	int testId = argc > 1 ? atoi(argv[1]) : 1;
+	// Launch test
+	switch (testId) {
+	case 1: compoundFileTest(); break;
+	case 2: swfRasterizerTest(); break;
+	default: printf("Unknown test.\n"); return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,310 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "SWFRasterizer.h"
+
+// Each case renders a small scene and compares it to a reference image
+// in data/swf.  The references are uncompressed 32-bit TGA files, which
+// most image viewers can open.  Every scene is drawn over an opaque
+// background, so the premultiplied pixels are the same as the straight
+// pixels that TGA expects.
+//
+// To regenerate the references after an intentional rendering change,
+// run the test with UPDATE_REFERENCE_IMAGES=1 in the environment, and
+// check the new images by eye before committing them.
+
+typedef SWFRasterizer R;
+
+static const int W = 64, H = 64;
+
+// Pixels may differ by this much per channel from the reference, to
+// allow for floating-point differences between compilers and platforms
+static const int tolerance = 2;
+
+static std::string ReferencePath(const char *name) {
+  return std::string(TEST_DATA_DIR "swf/") + name + ".tga";
+}
+
+static bool WriteTga(const std::string &path, const std::vector<uint32_t> &pix) {
+  FILE *fp = fopen(path.c_str(), "wb");
+  if (!fp)
+    return false;
+
+  // uncompressed true-color, 32 bits per pixel, 8 alpha bits, top-down
+  uint8_t hdr[18] = { 0, 0, 2 };
+  hdr[12] = W & 0xFF; hdr[13] = W >> 8;
+  hdr[14] = H & 0xFF; hdr[15] = H >> 8;
+  hdr[16] = 32;
+  hdr[17] = 0x28;
+  fwrite(hdr, 1, sizeof(hdr), fp);
+  for (uint32_t p : pix) {
+    uint8_t bgra[4] = { (uint8_t)p, (uint8_t)(p >> 8), (uint8_t)(p >> 16), (uint8_t)(p >> 24) };
+    fwrite(bgra, 1, 4, fp);
+  }
+  fclose(fp);
+  return true;
+}
+
+static bool ReadTga(const std::string &path, std::vector<uint32_t> &pix) {
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (!fp)
+    return false;
+
+  uint8_t hdr[18];
+  bool ok = fread(hdr, 1, sizeof(hdr), fp) == sizeof(hdr)
+    && hdr[2] == 2 && hdr[16] == 32 && hdr[17] == 0x28
+    && (hdr[12] | (hdr[13] << 8)) == W && (hdr[14] | (hdr[15] << 8)) == H;
+  pix.resize(W * H);
+  for (size_t i = 0; ok && i < pix.size(); i++) {
+    uint8_t bgra[4];
+    ok = fread(bgra, 1, 4, fp) == 4;
+    pix[i] = bgra[0] | (bgra[1] << 8) | (bgra[2] << 16) | ((uint32_t)bgra[3] << 24);
+  }
+  fclose(fp);
+  return ok;
+}
+
+static void CheckReference(const char *name, const std::vector<uint32_t> &pix) {
+  std::string ref = ReferencePath(name);
+  if (getenv("UPDATE_REFERENCE_IMAGES")) {
+    bool ok = WriteTga(ref, pix);
+    assert(ok);
+    printf("%s: wrote %s\n", name, ref.c_str());
+    return;
+  }
+
+  std::vector<uint32_t> expected;
+  bool loaded = ReadTga(ref, expected);
+  if (!loaded) {
+    printf("%s: can't read reference image %s\n", name, ref.c_str());
+    fflush(stdout);
+  }
+  assert(loaded);
+
+  int nDiff = 0, maxDiff = 0;
+  for (size_t i = 0; i < pix.size(); i++) {
+    for (int shift = 0; shift < 32; shift += 8) {
+      int d = abs((int)((pix[i] >> shift) & 0xFF) - (int)((expected[i] >> shift) & 0xFF));
+      if (d > maxDiff)
+        maxDiff = d;
+      if (d > tolerance) {
+        nDiff++;
+        break;
+      }
+    }
+  }
+
+  // on a mismatch, save the actual image next to the test program, for
+  // comparing by eye
+  if (nDiff != 0) {
+    std::string actual = std::string(name) + ".actual.tga";
+    WriteTga(actual, pix);
+    printf("%s: %d pixels differ from the reference (max channel difference %d); see %s\n",
+      name, nDiff, maxDiff, actual.c_str());
+    fflush(stdout);
+  }
+  assert(nDiff == 0);
+}
+
+// add a circle, as eight quadratic arcs
+static void AddCircle(R::Path &path, float cx, float cy, float r) {
+  const float pi = 3.14159265f;
+  float k = r / cosf(pi / 8);
+  path.MoveTo({ cx + r, cy });
+  for (int i = 1; i <= 8; i++) {
+    float a0 = (i - 0.5f) * pi / 4, a1 = i * pi / 4;
+    path.QuadTo({ cx + k*cosf(a0), cy + k*sinf(a0) }, { cx + r*cosf(a1), cy + r*sinf(a1) });
+  }
+  path.Close();
+}
+
+// add a five-pointed star, drawn as a single self-intersecting figure
+static void AddStar(R::Path &path, float cx, float cy, float r) {
+  const float pi = 3.14159265f;
+  for (int i = 0; i < 5; i++) {
+    float a = -pi/2 + i * 4*pi/5;
+    R::Point p = { cx + r*cosf(a), cy + r*sinf(a) };
+    if (i == 0)
+      path.MoveTo(p);
+    else
+      path.LineTo(p);
+  }
+  path.Close();
+}
+
+static R::Paint Solid(uint32_t argb) {
+  R::Paint p;
+  p.color = argb;
+  return p;
+}
+
+static void FillRuleTest() {
+  std::vector<uint32_t> pix(W * H);
+  R r(W, H, pix.data(), W);
+  r.Clear(0xFFFFFFFF);
+
+  // the same star under each fill rule: the center is filled under
+  // non-zero, and empty under even-odd
+  R::Path path;
+  AddStar(path, 16, 18, 15);
+  r.FillPath(path, R::FillRule::NonZero, Solid(0xFF2040C0));
+  path.Clear();
+  AddStar(path, 48, 18, 15);
+  r.FillPath(path, R::FillRule::EvenOdd, Solid(0xFFC02020));
+
+  // a curved shape, with a translucent overlapping circle
+  path.Clear();
+  path.MoveTo({ 4, 60 });
+  path.QuadTo({ 16, 24 }, { 30, 60 });
+  path.QuadTo({ 44, 40 }, { 60, 60 });
+  path.Close();
+  r.FillPath(path, R::FillRule::NonZero, Solid(0xFF208020));
+  path.Clear();
+  AddCircle(path, 40, 46, 12);
+  r.FillPath(path, R::FillRule::NonZero, Solid(0x80E0A000));
+
+  CheckReference("fill_rules", pix);
+}
+
+static void StrokeTest() {
+  std::vector<uint32_t> pix(W * H);
+  R r(W, H, pix.data(), W);
+  r.Clear(0xFFF0F0F0);
+
+  // an open zigzag with round joins and caps
+  R::Path path;
+  path.MoveTo({ 6, 40 });
+  path.LineTo({ 18, 10 });
+  path.LineTo({ 30, 40 });
+  path.LineTo({ 42, 10 });
+  path.LineTo({ 56, 30 });
+  r.StrokePath(path, 5, Solid(0xFF000080));
+
+  // a closed curve with a thin stroke
+  path.Clear();
+  AddCircle(path, 32, 48, 12);
+  r.StrokePath(path, 1.5f, Solid(0xFFC00000));
+
+  // a hairline
+  path.Clear();
+  path.MoveTo({ 2, 62 });
+  path.LineTo({ 62, 54 });
+  r.StrokePath(path, 0.25f, Solid(0xFF000000));
+
+  CheckReference("strokes", pix);
+}
+
+static void LinearGradientTest() {
+  std::vector<uint32_t> pix(W * H);
+  R r(W, H, pix.data(), W);
+  r.Clear(0xFFFFFFFF);
+
+  // a three-stop horizontal gradient across the top half; the unit
+  // gradient runs from x=-1 to x=+1
+  R::Paint p;
+  p.type = R::Paint::Type::LinearGradient;
+  p.stops = { { 0.0f, 0xFFFF0000 }, { 0.5f, 0xFF00FF00 }, { 1.0f, 0xFF0000FF } };
+  p.matrix = { 32, 0, 0, 32, 32, 0 };
+  R::Path path;
+  path.MoveTo({ 0, 0 });
+  path.LineTo({ 64, 0 });
+  path.LineTo({ 64, 30 });
+  path.LineTo({ 0, 30 });
+  path.Close();
+  r.FillPath(path, R::FillRule::NonZero, p);
+
+  // a rotated, reflected gradient over a triangle on the bottom half,
+  // fading to transparent
+  p.stops = { { 0.0f, 0xFF000000 }, { 1.0f, 0x00FFFFFF } };
+  p.spread = R::Paint::Spread::Reflect;
+  p.matrix = { 6, 6, -6, 6, 32, 48 };
+  path.Clear();
+  path.MoveTo({ 2, 62 });
+  path.LineTo({ 32, 32 });
+  path.LineTo({ 62, 62 });
+  path.Close();
+  r.FillPath(path, R::FillRule::NonZero, p);
+
+  CheckReference("linear_gradient", pix);
+}
+
+static void RadialGradientTest() {
+  std::vector<uint32_t> pix(W * H);
+  R r(W, H, pix.data(), W);
+  r.Clear(0xFF202020);
+
+  // a radial gradient with an off-center focal point, filling a circle
+  R::Paint p;
+  p.type = R::Paint::Type::RadialGradient;
+  p.stops = { { 0.0f, 0xFFFFFFA0 }, { 0.6f, 0xFFFF8000 }, { 1.0f, 0xFF800000 } };
+  p.focalPoint = 0.5f;
+  p.matrix = { 28, 0, 0, 28, 32, 32 };
+  R::Path path;
+  AddCircle(path, 32, 32, 28);
+  r.FillPath(path, R::FillRule::NonZero, p);
+
+  // a small repeating gradient over a square in the corner
+  p.stops = { { 0.0f, 0xFF0000FF }, { 1.0f, 0xFF00FFFF } };
+  p.focalPoint = 0;
+  p.spread = R::Paint::Spread::Repeat;
+  p.matrix = { 4, 0, 0, 4, 8, 8 };
+  path.Clear();
+  path.MoveTo({ 0, 0 });
+  path.LineTo({ 16, 0 });
+  path.LineTo({ 16, 16 });
+  path.LineTo({ 0, 16 });
+  path.Close();
+  r.FillPath(path, R::FillRule::NonZero, p);
+
+  CheckReference("radial_gradient", pix);
+}
+
+static void BitmapClipTest() {
+  std::vector<uint32_t> pix(W * H);
+  R r(W, H, pix.data(), W);
+  r.Clear(0xFFFFFFFF);
+
+  // a 4x4 checkerboard, in premultiplied BGRA
+  uint32_t bmp[16];
+  for (int i = 0; i < 16; i++)
+    bmp[i] = ((i / 4 + i % 4) & 1) ? 0xFF00A0FF : 0xFF303030;
+  R::Paint p;
+  p.type = R::Paint::Type::Bitmap;
+  p.bitmap = bmp;
+  p.bitmapWidth = p.bitmapHeight = p.bitmapStride = 4;
+
+  // draw it scaled up, unfiltered, clipped to a circle
+  R::Path clip;
+  AddCircle(clip, 20, 20, 18);
+  r.PushClip(clip, R::FillRule::NonZero);
+  p.smooth = false;
+  p.matrix = { 10, 0, 0, 10, 0, 0 };
+  r.DrawBitmap(p);
+  r.PopClip();
+
+  // draw it again, filtered and rotated, tiled across a rectangle
+  p.smooth = true;
+  p.repeat = true;
+  p.matrix = { 4, 2, -2, 4, 40, 36 };
+  R::Path path;
+  path.MoveTo({ 34, 34 });
+  path.LineTo({ 62, 34 });
+  path.LineTo({ 62, 62 });
+  path.LineTo({ 34, 62 });
+  path.Close();
+  r.FillPath(path, R::FillRule::NonZero, p);
+
+  CheckReference("bitmap_clip", pix);
+}
+
+void swfRasterizerTest() {
+  FillRuleTest();
+  StrokeTest();
+  LinearGradientTest();
+  RadialGradientTest();
+  BitmapClipTest();
+}
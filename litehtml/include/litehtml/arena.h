@@ -0,0 +1,100 @@
+#ifndef LH_ARENA_H
+#define LH_ARENA_H
+
+#include <stddef.h>
+#include <memory>
+#include <vector>
+
+namespace litehtml
+{
+	// Memory arena.  Small allocations are carved out of large blocks,
+	// and all of the blocks are freed together when the arena is
+	// destroyed, so a whole tree of objects costs a handful of heap
+	// operations instead of one per object.  Memory returned through
+	// deallocate() goes on a free list for its size, for reuse by later
+	// allocations of the same size.  Not thread-safe.
+	class arena
+	{
+		struct free_node
+		{
+			free_node*	next;
+		};
+
+		std::vector<char*>		m_blocks;
+		std::vector<free_node*>	m_free;
+		char*					m_cur;
+		char*					m_end;
+		size_t					m_block_size;
+		size_t					m_reserved;
+	public:
+		// allocation granularity and alignment
+		static const size_t	alignment = 16;
+
+		// largest size kept on the free lists
+		static const size_t	max_pooled_size = 4096;
+
+		explicit arena(size_t block_size = 16384);
+		~arena();
+
+		void*	allocate(size_t size);
+		void	deallocate(void* p, size_t size);
+
+		// total bytes obtained from the heap
+		size_t	reserved() const
+		{
+			return m_reserved;
+		}
+
+	private:
+		arena(const arena&);
+		arena& operator=(const arena&);
+
+		void*	allocate_block(size_t size);
+	};
+
+	// Standard allocator that allocates from a shared arena.  Each copy
+	// keeps the arena alive, so objects created through std::allocate_shared
+	// can safely outlive whatever created them.
+	template<class T>
+	class arena_allocator
+	{
+		template<class U> friend class arena_allocator;
+
+		std::shared_ptr<arena>	m_arena;
+	public:
+		typedef T	value_type;
+
+		explicit arena_allocator(const std::shared_ptr<arena>& a) : m_arena(a)
+		{
+		}
+
+		template<class U>
+		arena_allocator(const arena_allocator<U>& val) : m_arena(val.m_arena)
+		{
+		}
+
+		T* allocate(size_t n)
+		{
+			return static_cast<T*>(m_arena->allocate(n * sizeof(T)));
+		}
+
+		void deallocate(T* p, size_t n)
+		{
+			m_arena->deallocate(p, n * sizeof(T));
+		}
+
+		template<class U>
+		bool operator==(const arena_allocator<U>& val) const
+		{
+			return m_arena == val.m_arena;
+		}
+
+		template<class U>
+		bool operator!=(const arena_allocator<U>& val) const
+		{
+			return m_arena != val.m_arena;
+		}
+	};
+}
+
+#endif  // LH_ARENA_H
@@ -2,18 +2,48 @@
 #define LH_CONTEXT_H
 
 #include "stylesheet.h"
+#include <unordered_map>
 
 namespace litehtml
 {
 	class context
 	{
-		litehtml::css	m_master_css;
+		// Compiled document style sheets, keyed by a hash of the
+		// combined style sheet text.  Each entry keeps the full text
+		// too, so that a hash collision can't return the wrong sheet.
+		struct compiled_css
+		{
+			tstring		text;
+			css::ptr	styles;
+		};
+		typedef std::unordered_multimap<size_t, compiled_css>	compiled_css_map;
+
+		litehtml::css		m_master_css;
+		compiled_css_map	m_compiled_css;
 	public:
+		// maximum number of compiled style sheets kept in the cache
+		static const size_t	max_compiled_css = 32;
+
 		void			load_master_stylesheet(const tchar_t* str);
 		litehtml::css&	master_css()
 		{
 			return m_master_css;
 		}
+
+		// Find a compiled style sheet by its combined source text.
+		// Returns null if the text hasn't been compiled yet.
+		css::ptr		find_compiled_css(const tstring& text) const;
+
+		// Add a compiled style sheet to the cache.  The sheet must not
+		// be modified after it's added, since any number of documents
+		// can share it.
+		void			add_compiled_css(const tstring& text, const css::ptr& styles);
+
+		// discard all cached style sheets
+		void			clear_compiled_css()
+		{
+			m_compiled_css.clear();
+		}
 	};
 }
 
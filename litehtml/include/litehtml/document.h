@@ -4,6 +4,7 @@
 #include "style.h"
 #include "types.h"
 #include "context.h"
+#include "arena.h"
 
 namespace litehtml
 {
@@ -58,17 +59,22 @@ namespace litehtml
 		std::shared_ptr<document_container>	m_container;
 		fonts_map							m_fonts;
 		css_text::vector					m_css;
-		litehtml::css						m_styles;
+		css::ptr							m_styles;
 		litehtml::web_color					m_def_color;
 		litehtml::context*					m_context;
 		litehtml::size						m_size;
 		position::vector					m_fixed_boxes;
 		media_query_list::vector			m_media_lists;
 		element::ptr						m_over_element;
+		position							m_client_rect;
 		elements_vector						m_tabular_elements;
 		media_features						m_media;
 		tstring                             m_lang;
 		tstring                             m_culture;
+
+		// Pool for the document's elements.  Each element keeps the pool
+		// alive, so it's freed in one piece when the last element goes.
+		std::shared_ptr<arena>				m_arena;
 	public:
 		document(std::shared_ptr<litehtml::document_container> objContainer, litehtml::context* ctx);
 		virtual ~document();
@@ -98,6 +104,21 @@ namespace litehtml
 		void							add_tabular(const element::ptr& el);
 		const element::const_ptr		get_over_element() const { return m_over_element; }
 
+		// The compiled style sheet from the document's <style> and <link>
+		// elements.  This can be shared with other documents, so it must
+		// not be modified.
+		const css::ptr&					styles() const { return m_styles; }
+
+		// Replace an element's children with plain text.  Any ::before and
+		// ::after content is kept.  Only the element and its ancestors are
+		// laid out again on the next render.
+		void							set_element_text(const element::ptr& el, const tchar_t* text);
+
+		// Discard all saved layouts, so that the next render lays out the
+		// whole document.  Call this if anything the layout depends on
+		// changes outside of the document, such as image sizes.
+		void							invalidate_layout();
+
 		void                            append_children_from_string(element& parent, const tchar_t* str);
 		void                            append_children_from_utf8(element& parent, const char* str);
 
@@ -108,6 +129,15 @@ namespace litehtml
 		litehtml::uint_ptr	add_font(const tchar_t* name, int size, const tchar_t* weight, const tchar_t* style, const tchar_t* decoration, font_metrics* fm);
 
 		void create_node(void* gnode, elements_vector& elements, bool parseTextNode);
+
+		template<class T, class... Args>
+		std::shared_ptr<T> make_element(Args&&... args)
+		{
+			return std::allocate_shared<T>(arena_allocator<T>(m_arena), std::forward<Args>(args)...);
+		}
+
+		void create_text_nodes(const std::wstring& str, elements_vector& elements);
+		void invalidate_layout(element* el);
 		bool update_media_lists(const media_features& features);
 		void fix_tables_layout();
 		void fix_table_children(element::ptr& el_ptr, style_display disp, const tchar_t* disp_str);
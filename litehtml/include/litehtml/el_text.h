@@ -20,6 +20,7 @@ namespace litehtml
 
 		virtual void				get_text(tstring& text) override;
 		virtual const tchar_t*		get_style_property(const tchar_t* name, bool inherited, const tchar_t* def = 0) override;
+		virtual const property_value*	get_style_value(int id, bool inherited) override;
 		virtual void				parse_styles(bool is_reparse) override;
 		virtual int					get_base_line() override;
 		virtual void				draw(uint_ptr hdc, int x, int y, const position* clip) override;
@@ -30,6 +30,7 @@ namespace litehtml
 		margins						m_padding;
 		margins						m_borders;
 		bool						m_skip;
+		bool						m_layout_dirty;
 		
 		virtual void select_all(const css_selector& selector, elements_vector& res);
 	public:
@@ -73,6 +74,15 @@ namespace litehtml
 
 		bool						in_normal_flow()			const;
 		litehtml::web_color			get_color(const tchar_t* prop_name, bool inherited, const litehtml::web_color& def_color = litehtml::web_color());
+
+		// Style lookups by property ID, using the pre-parsed values.  When
+		// the property isn't set, get_style_keyword() and get_style_length()
+		// return its initial value; get_style_keyword() returns 'invalid'
+		// if the value isn't in the property's keyword list.
+		const tchar_t*				get_style_text(int id, bool inherited, const tchar_t* def = 0);
+		int							get_style_keyword(int id, bool inherited, int invalid);
+		void						get_style_length(css_length& len, int id, bool inherited);
+
 		bool						is_inline_box()				const;
 		position					get_placement()				const;
 		bool						collapse_top_margin()		const;
@@ -90,6 +100,14 @@ namespace litehtml
 		int							get_inline_shift_right();
 		void						apply_relative_shift(int parent_width);
 
+		// Mark the element's layout as out of date, along with the
+		// layouts of its ancestors, which depend on it.  Call this after
+		// changing the element's content.  The next render lays these
+		// elements out again, and reuses the last layout of unchanged
+		// subtrees where that doesn't depend on their surroundings.
+		void						invalidate_layout();
+		bool						is_layout_dirty() const		{ return m_layout_dirty; }
+
 		std::shared_ptr<document>	get_document() const;
 
 		virtual elements_vector		select_all(const tstring& selector);
@@ -160,6 +178,7 @@ namespace litehtml
 		virtual void				draw(uint_ptr hdc, int x, int y, const position* clip);
 		virtual void				draw_background( uint_ptr hdc, int x, int y, const position* clip );
 		virtual const tchar_t*		get_style_property(const tchar_t* name, bool inherited, const tchar_t* def = 0);
+		virtual const property_value*	get_style_value(int id, bool inherited);
 		virtual uint_ptr			get_font(font_metrics* fm = 0);
 		virtual int					get_font_size() const;
 		virtual void				get_text(tstring& text);
@@ -177,6 +196,7 @@ namespace litehtml
 		virtual void				init();
 		virtual bool				is_floats_holder() const;
 		virtual int					get_floats_height(element_float el_float = float_none) const;
+		virtual int					get_floats_count() const;
 		virtual int					get_left_floats_height() const;
 		virtual int					get_right_floats_height() const;
 		virtual int					get_line_left(int y);
@@ -87,6 +87,12 @@ namespace litehtml
 		int_int_cache			m_cahe_line_left;
 		int_int_cache			m_cahe_line_right;
 
+		// last render() arguments and results, and whether any
+		// descendant was absolute or fixed positioned as of the last
+		// fetch_positioned()
+		render_cache			m_render_cache;
+		bool					m_has_positioned;
+
 		// data for table rendering
 		std::unique_ptr<table_grid>	m_grid;
 		css_length				m_css_border_spacing_x;
@@ -166,6 +172,7 @@ namespace litehtml
 		virtual void				draw_background(uint_ptr hdc, int x, int y, const position* clip) override;
 
 		virtual const tchar_t*		get_style_property(const tchar_t* name, bool inherited, const tchar_t* def = 0) override;
+		virtual const property_value*	get_style_value(int id, bool inherited) override;
 		virtual uint_ptr			get_font(font_metrics* fm = 0) override;
 		virtual int					get_font_size() const override;
 
@@ -196,6 +203,7 @@ namespace litehtml
 		virtual void				get_inline_boxes(position::vector& boxes) override;
 		virtual bool				is_floats_holder() const override;
 		virtual int					get_floats_height(element_float el_float = float_none) const override;
+		virtual int					get_floats_count() const override;
 		virtual int					get_left_floats_height() const override;
 		virtual int					get_right_floats_height() const override;
 		virtual int					get_line_left(int y) override;
@@ -225,6 +233,7 @@ namespace litehtml
 		void						draw_children_table(uint_ptr hdc, int x, int y, const position* clip, draw_flag flag, int zindex);
 		int							render_box(int x, int y, int max_width, bool second_pass = false);
 		int							render_table(int x, int y, int max_width, bool second_pass = false);
+		bool						is_layout_cacheable() const;
 		int							fix_line_width(int max_width, element_float flt);
 		void						parse_background();
 		void						init_background_paint( position pos, background_paint &bg_paint, const background* bg );
@@ -232,6 +241,7 @@ namespace litehtml
 		tstring						get_list_marker_text(int index);
 		void						parse_nth_child_params( tstring param, int &num, int &off );
 		void						remove_before_after();
+		void						apply_selector(const css_selector::ptr& sel);
 		litehtml::element::ptr		get_element_before();
 		litehtml::element::ptr		get_element_after();
 	};
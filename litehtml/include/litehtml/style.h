@@ -2,40 +2,77 @@
 #define LH_STYLE_H
 
 #include "attributes.h"
+#include "css_length.h"
 #include <string>
+#include <vector>
+#include <algorithm>
 
 namespace litehtml
 {
+	// Property value.  Along with the source text, this holds the value
+	// pre-parsed according to the property's type (see property_type), so
+	// that the parsing happens once per rule rather than once per element
+	// the rule applies to.
 	class property_value
 	{
 	public:
 		tstring	m_value;
 		bool			m_important;
+		bool			m_inherit;		// the value is "inherit"
+		int				m_keyword;		// index in the property's keyword list, or -1
+		css_length		m_length;		// parsed value, for length properties
 
 		property_value()
 		{
 			m_important = false;
+			m_inherit	= false;
+			m_keyword	= -1;
 		}
 		property_value(const tchar_t* val, bool imp)
 		{
 			m_important = imp;
 			m_value		= val;
+			m_inherit	= false;
+			m_keyword	= -1;
 		}
 		property_value(const property_value& val)
 		{
 			m_value		= val.m_value;
 			m_important	= val.m_important;
+			m_inherit	= val.m_inherit;
+			m_keyword	= val.m_keyword;
+			m_length	= val.m_length;
 		}
 
 		property_value& operator=(const property_value& val)
 		{
 			m_value		= val.m_value;
 			m_important	= val.m_important;
+			m_inherit	= val.m_inherit;
+			m_keyword	= val.m_keyword;
+			m_length	= val.m_length;
 			return *this;
 		}
 	};
 
-	typedef std::map<tstring, property_value>	props_map;
+	// Value type of a property.  Properties that elements read as keywords
+	// have a keyword list, and properties read as lengths have the length
+	// predefs; the initial value is used when no rule sets the property.
+	struct property_type
+	{
+		const tchar_t*	keywords;
+		const tchar_t*	length_predefs;
+		int				initial_keyword;
+		css_length		initial_length;
+
+		property_type() : keywords(0), length_predefs(0), initial_keyword(-1) {}
+	};
+
+	// Properties, as (property ID, value) pairs sorted by ID.  A style only
+	// holds a few dozen properties at most, so a flat array is smaller and
+	// faster to search than a tree.
+	typedef std::pair<int, property_value>	props_entry;
+	typedef std::vector<props_entry>		props_vector;
 
 	class style
 	{
@@ -43,7 +80,7 @@ namespace litehtml
 		typedef std::shared_ptr<style>		ptr;
 		typedef std::vector<style::ptr>		vector;
 	private:
-		props_map			m_properties;
+		props_vector		m_properties;
 		static string_map	m_valid_values;
 	public:
 		style();
@@ -66,15 +103,36 @@ namespace litehtml
 		{
 			if(name)
 			{
-				props_map::const_iterator f = m_properties.find(name);
-				if(f != m_properties.end())
+				const property_value* val = get_property_value(find_property_id(name));
+				if(val)
 				{
-					return f->second.m_value.c_str();
+					return val->m_value.c_str();
 				}
 			}
 			return 0;
 		}
 
+		const property_value* get_property_value(int id) const
+		{
+			props_vector::const_iterator f = find(id);
+			if(f != m_properties.end() && f->first == id)
+			{
+				return &f->second;
+			}
+			return 0;
+		}
+
+		// Get the ID for a property name, assigning a new one if the name
+		// hasn't been seen before
+		static int property_id(const tstring& name);
+
+		// Get the ID for a property name without assigning one; returns -1
+		// if no style has ever had the property
+		static int find_property_id(const tchar_t* name);
+
+		// get the value type of a property
+		static const property_type& get_property_type(int id);
+
 		void combine(const litehtml::style& src);
 		void clear()
 		{
@@ -82,12 +140,25 @@ namespace litehtml
 		}
 
 	private:
+		props_vector::const_iterator find(int id) const
+		{
+			return std::lower_bound(m_properties.begin(), m_properties.end(), id,
+				[](const props_entry& e, int id) { return e.first < id; });
+		}
+		props_vector::iterator find(int id)
+		{
+			return std::lower_bound(m_properties.begin(), m_properties.end(), id,
+				[](const props_entry& e, int id) { return e.first < id; });
+		}
+
 		void parse_property(const tstring& txt, const tchar_t* baseurl);
 		void parse(const tchar_t* txt, const tchar_t* baseurl);
 		void parse_short_border(const tstring& prefix, const tstring& val, bool important);
 		void parse_short_background(const tstring& val, const tchar_t* baseurl, bool important);
 		void parse_short_font(const tstring& val, bool important);
 		void add_parsed_property(const tstring& name, const tstring& val, bool important);
+		void add_parsed_property(int id, const property_value& val);
+		void append_parsed_property(const tstring& name, const tstring& val, bool important);
 		void remove_property(const tstring& name, bool important);
 	};
 }
@@ -1,6 +1,7 @@
 #ifndef LH_STYLESHEET_H
 #define LH_STYLESHEET_H
 
+#include <unordered_map>
 #include "style.h"
 #include "css_selector.h"
 
@@ -10,11 +11,28 @@ namespace litehtml
 
 	class css
 	{
+	public:
+		typedef std::shared_ptr<css>	ptr;
+		typedef std::vector<int>	index_list;
+	private:
+		typedef std::unordered_map<tstring, index_list>	selector_index;
+
 		css_selector::vector	m_selectors;
+
+		// Selector index, by the key of each selector's rightmost
+		// element selector: its id, else a class, else its tag.
+		// Selectors with none of those go in the universal list.  The
+		// lists hold positions in m_selectors, in ascending order, so
+		// the index is only valid after sort_selectors().
+		selector_index			m_id_index;
+		selector_index			m_class_index;
+		selector_index			m_tag_index;
+		index_list				m_universal_index;
+		bool					m_indexed;
 	public:
 		css()
 		{
-
+			m_indexed = false;
 		}
 		
 		~css()
@@ -30,13 +48,26 @@ namespace litehtml
 		void clear()
 		{
 			m_selectors.clear();
+			clear_index();
+		}
+
+		bool is_indexed() const
+		{
+			return m_indexed;
 		}
 
 		void	parse_stylesheet(const tchar_t* str, const tchar_t* baseurl, const std::shared_ptr <document>& doc, const media_query_list::ptr& media);
 		void	sort_selectors();
 		static void	parse_css_url(const tstring& str, tstring& url);
 
+		// Get the positions in selectors() of the selectors that could
+		// match an element with the given id, classes and tag, in
+		// ascending order.  Requires is_indexed().
+		void	get_candidates(const tchar_t* id, const string_vector& classes, const tstring& tag, index_list& result) const;
+
 	private:
+		void	build_index();
+		void	clear_index();
 		void	parse_atrule(const tstring& text, const tchar_t* baseurl, const std::shared_ptr<document>& doc, const media_query_list::ptr& media);
 		void	add_selector(css_selector::ptr selector);
 		bool	parse_selectors(const tstring& txt, const litehtml::style::ptr& styles, const media_query_list::ptr& media);
@@ -47,6 +78,7 @@ namespace litehtml
 	{
 		selector->m_order = (int) m_selectors.size();
 		m_selectors.push_back(selector);
+		clear_index();
 	}
 
 }
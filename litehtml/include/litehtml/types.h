@@ -486,6 +486,93 @@ namespace litehtml
 	};
 
 
+#define css_property_strings		_t("-litehtml-border-spacing-x;-litehtml-border-spacing-y;background-attachment;background-clip;background-color;background-image;background-image-baseurl;background-origin;background-position;background-repeat;background-size;border-bottom-color;border-bottom-left-radius-x;border-bottom-left-radius-y;border-bottom-right-radius-x;border-bottom-right-radius-y;border-bottom-style;border-bottom-width;border-collapse;border-left-color;border-left-style;border-left-width;border-right-color;border-right-style;border-right-width;border-top-color;border-top-left-radius-x;border-top-left-radius-y;border-top-right-radius-x;border-top-right-radius-y;border-top-style;border-top-width;bottom;box-sizing;clear;color;content;cursor;display;float;font-family;font-size;font-style;font-variant;font-weight;height;left;line-height;list-style-image;list-style-image-baseurl;list-style-position;list-style-type;margin-bottom;margin-left;margin-right;margin-top;max-height;max-width;min-height;min-width;overflow;padding-bottom;padding-left;padding-right;padding-top;position;right;text-align;text-decoration;text-indent;text-transform;top;vertical-align;visibility;white-space;width;z-index")
+
+	// Interned property IDs for the properties litehtml reads, in the same
+	// order as css_property_strings.  style::property_id() assigns IDs from
+	// css_property_count up to any other property names.
+	enum css_property
+	{
+		css_property_litehtml_border_spacing_x,
+		css_property_litehtml_border_spacing_y,
+		css_property_background_attachment,
+		css_property_background_clip,
+		css_property_background_color,
+		css_property_background_image,
+		css_property_background_image_baseurl,
+		css_property_background_origin,
+		css_property_background_position,
+		css_property_background_repeat,
+		css_property_background_size,
+		css_property_border_bottom_color,
+		css_property_border_bottom_left_radius_x,
+		css_property_border_bottom_left_radius_y,
+		css_property_border_bottom_right_radius_x,
+		css_property_border_bottom_right_radius_y,
+		css_property_border_bottom_style,
+		css_property_border_bottom_width,
+		css_property_border_collapse,
+		css_property_border_left_color,
+		css_property_border_left_style,
+		css_property_border_left_width,
+		css_property_border_right_color,
+		css_property_border_right_style,
+		css_property_border_right_width,
+		css_property_border_top_color,
+		css_property_border_top_left_radius_x,
+		css_property_border_top_left_radius_y,
+		css_property_border_top_right_radius_x,
+		css_property_border_top_right_radius_y,
+		css_property_border_top_style,
+		css_property_border_top_width,
+		css_property_bottom,
+		css_property_box_sizing,
+		css_property_clear,
+		css_property_color,
+		css_property_content,
+		css_property_cursor,
+		css_property_display,
+		css_property_float,
+		css_property_font_family,
+		css_property_font_size,
+		css_property_font_style,
+		css_property_font_variant,
+		css_property_font_weight,
+		css_property_height,
+		css_property_left,
+		css_property_line_height,
+		css_property_list_style_image,
+		css_property_list_style_image_baseurl,
+		css_property_list_style_position,
+		css_property_list_style_type,
+		css_property_margin_bottom,
+		css_property_margin_left,
+		css_property_margin_right,
+		css_property_margin_top,
+		css_property_max_height,
+		css_property_max_width,
+		css_property_min_height,
+		css_property_min_width,
+		css_property_overflow,
+		css_property_padding_bottom,
+		css_property_padding_left,
+		css_property_padding_right,
+		css_property_padding_top,
+		css_property_position,
+		css_property_right,
+		css_property_text_align,
+		css_property_text_decoration,
+		css_property_text_indent,
+		css_property_text_transform,
+		css_property_top,
+		css_property_vertical_align,
+		css_property_visibility,
+		css_property_white_space,
+		css_property_width,
+		css_property_z_index,
+		css_property_count
+	};
+
 #define pseudo_class_strings		_t("only-child;only-of-type;first-child;first-of-type;last-child;last-of-type;nth-child;nth-of-type;nth-last-child;nth-last-of-type;not;lang")
 
 	enum pseudo_class
@@ -585,6 +672,32 @@ namespace litehtml
 		}
 	};
 
+	// The arguments and results of an element's last render() call, for
+	// reusing its layout while nothing that it depends on has changed
+	struct render_cache
+	{
+		int			max_width;
+		bool		second_pass;
+		int			ret_width;
+		position	pos;		// element position, relative to the x,y arguments
+		margins		el_margins;
+		margins		el_padding;
+		margins		el_borders;
+		bool		is_valid;
+
+		render_cache()
+		{
+			max_width	= 0;
+			second_pass	= false;
+			ret_width	= 0;
+			is_valid	= false;
+		}
+		void invalidate()
+		{
+			is_valid	= false;
+		}
+	};
+
 	enum select_result
 	{
 		select_no_match				= 0x00,
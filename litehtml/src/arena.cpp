@@ -0,0 +1,74 @@
+#include "html.h"
+#include "arena.h"
+
+litehtml::arena::arena(size_t block_size)
+{
+	m_cur			= 0;
+	m_end			= 0;
+	m_block_size	= block_size;
+	m_reserved		= 0;
+	m_free.resize(max_pooled_size / alignment, 0);
+}
+
+litehtml::arena::~arena()
+{
+	for (char* block : m_blocks)
+	{
+		::operator delete(block);
+	}
+}
+
+void* litehtml::arena::allocate(size_t size)
+{
+	size = size ? (size + alignment - 1) & ~(alignment - 1) : alignment;
+
+	// reuse a freed chunk of the same size if there is one
+	if (size <= max_pooled_size)
+	{
+		free_node*& head = m_free[size / alignment - 1];
+		if (head)
+		{
+			void* p = head;
+			head = head->next;
+			return p;
+		}
+	}
+
+	// Large requests get a block to themselves, so that they don't
+	// waste the rest of the current block.
+	if (size > m_block_size / 4)
+	{
+		return allocate_block(size);
+	}
+
+	if (size > (size_t) (m_end - m_cur))
+	{
+		m_cur = static_cast<char*>(allocate_block(m_block_size));
+		m_end = m_cur + m_block_size;
+	}
+	void* p = m_cur;
+	m_cur += size;
+	return p;
+}
+
+void litehtml::arena::deallocate(void* p, size_t size)
+{
+	// Anything too large for the free lists stays allocated until the
+	// arena itself is destroyed.
+	size = size ? (size + alignment - 1) & ~(alignment - 1) : alignment;
+	if (p && size <= max_pooled_size)
+	{
+		free_node* node = static_cast<free_node*>(p);
+		free_node*& head = m_free[size / alignment - 1];
+		node->next = head;
+		head = node;
+	}
+}
+
+void* litehtml::arena::allocate_block(size_t size)
+{
+	char* block = static_cast<char*>(::operator new(size));
+	m_blocks.push_back(block);
+	m_reserved += size;
+	return block;
+}
@@ -10,3 +10,28 @@ void litehtml::context::load_master_stylesheet( const tchar_t* str )
 	m_master_css.parse_stylesheet(str, 0, std::shared_ptr<litehtml::document>(), media_query_list::ptr());
 	m_master_css.sort_selectors();
 }
+
+litehtml::css::ptr litehtml::context::find_compiled_css( const tstring& text ) const
+{
+	auto range = m_compiled_css.equal_range(std::hash<tstring>()(text));
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second.text == text)
+		{
+			return it->second.styles;
+		}
+	}
+	return nullptr;
+}
+
+void litehtml::context::add_compiled_css( const tstring& text, const css::ptr& styles )
+{
+	// The cache is only meant to hold the handful of distinct style
+	// sheets an application keeps reusing, so rather than tracking
+	// usage, just start over if it fills up.
+	if (m_compiled_css.size() >= max_compiled_css)
+	{
+		m_compiled_css.clear();
+	}
+	m_compiled_css.insert(std::make_pair(std::hash<tstring>()(text), compiled_css { text, styles }));
+}
@@ -28,10 +28,35 @@
 #include "gumbo.h"
 #include "utf8_strings.h"
 
+// Gumbo allocator hooks for parsing into a temporary arena.  The parse
+// tree is only needed until it's converted to litehtml elements, so
+// it's all released at once with the arena, rather than node by node.
+static void* gumbo_arena_allocate(void* userdata, size_t size)
+{
+	return static_cast<litehtml::arena*>(userdata)->allocate(size);
+}
+
+static void gumbo_arena_deallocate(void* userdata, void* ptr)
+{
+	// Gumbo doesn't pass the size, so the memory can't go on the arena's
+	// free lists.  It's released along with the rest of the arena.
+}
+
+static GumboOutput* gumbo_parse_in_arena(const char* str, litehtml::arena& parse_arena)
+{
+	GumboOptions options	= kGumboDefaultOptions;
+	options.allocator		= gumbo_arena_allocate;
+	options.deallocator		= gumbo_arena_deallocate;
+	options.userdata		= &parse_arena;
+	return gumbo_parse_with_options(&options, str, strlen(str));
+}
+
 litehtml::document::document(std::shared_ptr<litehtml::document_container> objContainer, litehtml::context* ctx)
 {
 	m_container	= objContainer;
 	m_context	= ctx;
+	m_styles	= std::make_shared<css>();
+	m_arena		= std::make_shared<arena>();
 }
 
 litehtml::document::~document()
@@ -54,20 +79,19 @@ litehtml::document::ptr litehtml::document::createFromString( const tchar_t* str
 litehtml::document::ptr litehtml::document::createFromUTF8(const char* str, std::shared_ptr<litehtml::document_container> objPainter, litehtml::context* ctx, litehtml::css* user_styles)
 {
 	// parse document into GumboOutput
-	GumboOutput* output = gumbo_parse((const char*) str);
+	arena parse_arena;
+	GumboOutput* output = gumbo_parse_in_arena((const char*) str, parse_arena);
 
 	// Create litehtml::document
 	litehtml::document::ptr doc = std::make_shared<litehtml::document>(objPainter, ctx);
 
-	// Create litehtml::elements.
+	// Create litehtml::elements.  The GumboOutput goes away with the arena.
 	elements_vector root_elements;
 	doc->create_node(output->root, root_elements, true);
 	if (!root_elements.empty())
 	{
 		doc->m_root = root_elements.back();
 	}
-	// Destroy GumboOutput
-	gumbo_destroy_output(&kGumboDefaultOptions, output);
 
 	// Let's process created elements tree
 	if (doc->m_root)
@@ -80,22 +104,70 @@ litehtml::document::ptr litehtml::document::createFromUTF8(const char* str, std:
 		// parse elements attributes
 		doc->m_root->parse_attributes();
 
-		// parse style sheets linked in document
-		media_query_list::ptr media;
-		for (css_text::vector::iterator css = doc->m_css.begin(); css != doc->m_css.end(); css++)
+		// Build the cache key for the style sheets linked in the
+		// document, from their text and base URLs.  Style sheets with
+		// media attributes can't be shared, since the media lists keep
+		// per-document state.
+		tstring css_key;
+		bool css_cacheable = true;
+		for (const auto& css : doc->m_css)
 		{
-			if (!css->media.empty())
+			css_key += css.baseurl;
+			css_key += _t('\x01');
+			css_key += css.text;
+			css_key += _t('\x02');
+			if (!css.media.empty())
 			{
-				media = media_query_list::create_from_string(css->media, doc);
+				css_cacheable = false;
 			}
-			else
+		}
+
+		// reuse the compiled style sheets if we've seen this text before
+		css::ptr compiled;
+		if (css_cacheable)
+		{
+			compiled = ctx->find_compiled_css(css_key);
+		}
+		if (compiled)
+		{
+			doc->m_styles = compiled;
+		}
+		else
+		{
+			// parse style sheets linked in document
+			media_query_list::ptr media;
+			for (css_text::vector::iterator css = doc->m_css.begin(); css != doc->m_css.end(); css++)
+			{
+				if (!css->media.empty())
+				{
+					media = media_query_list::create_from_string(css->media, doc);
+				}
+				else
+				{
+					media = 0;
+				}
+				doc->m_styles->parse_stylesheet(css->text.c_str(), css->baseurl.c_str(), doc, media);
+			}
+			// Sort css selectors using CSS rules.
+			doc->m_styles->sort_selectors();
+
+			// Add the result to the cache, unless it depends on anything
+			// besides the text: @media rules register media lists with
+			// this document, and @import pulls in external text.
+			if (css_cacheable && doc->m_media_lists.empty() && css_key.find(_t("@import")) == tstring::npos)
 			{
-				media = 0;
+				ctx->add_compiled_css(css_key, doc->m_styles);
+			}
+		}
+
+		// register the user style sheet's media lists, if any
+		if (user_styles)
+		{
+			for (const auto& sel : user_styles->selectors())
+			{
+				sel->add_media_to_doc(doc.get());
 			}
-			doc->m_styles.parse_stylesheet(css->text.c_str(), css->baseurl.c_str(), doc, media);
 		}
-		// Sort css selectors using CSS rules.
-		doc->m_styles.sort_selectors();
 
 		// get current media features
 		if (!doc->m_media_lists.empty())
@@ -104,7 +176,7 @@ litehtml::document::ptr litehtml::document::createFromUTF8(const char* str, std:
 		}
 
 		// Apply parsed styles.
-		doc->m_root->apply_stylesheet(doc->m_styles);
+		doc->m_root->apply_stylesheet(*doc->m_styles);
 
 		// Apply user styles if any
 		if (user_styles)
@@ -267,6 +339,16 @@ int litehtml::document::render( int max_width, render_type rt )
 			m_root->render_positioned(rt);
 		} else
 		{
+			// Viewport-relative sizes depend on the client area, so if
+			// that has changed, none of the saved layouts can be reused.
+			position client;
+			m_container->get_client_rect(client);
+			if (client.width != m_client_rect.width || client.height != m_client_rect.height)
+			{
+				m_client_rect = client;
+				invalidate_layout();
+			}
+
 			ret = m_root->render(0, 0, max_width);
 			if(m_root->fetch_positioned())
 			{
@@ -514,55 +596,55 @@ litehtml::element::ptr litehtml::document::create_element(const tchar_t* tag_nam
 	{
 		if(!t_strcmp(tag_name, _t("br")))
 		{
-			newTag = std::make_shared<litehtml::el_break>(this_doc);
+			newTag = make_element<litehtml::el_break>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("p")))
 		{
-			newTag = std::make_shared<litehtml::el_para>(this_doc);
+			newTag = make_element<litehtml::el_para>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("img")))
 		{
-			newTag = std::make_shared<litehtml::el_image>(this_doc);
+			newTag = make_element<litehtml::el_image>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("table")))
 		{
-			newTag = std::make_shared<litehtml::el_table>(this_doc);
+			newTag = make_element<litehtml::el_table>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("td")) || !t_strcmp(tag_name, _t("th")))
 		{
-			newTag = std::make_shared<litehtml::el_td>(this_doc);
+			newTag = make_element<litehtml::el_td>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("link")))
 		{
-			newTag = std::make_shared<litehtml::el_link>(this_doc);
+			newTag = make_element<litehtml::el_link>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("title")))
 		{
-			newTag = std::make_shared<litehtml::el_title>(this_doc);
+			newTag = make_element<litehtml::el_title>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("a")))
 		{
-			newTag = std::make_shared<litehtml::el_anchor>(this_doc);
+			newTag = make_element<litehtml::el_anchor>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("tr")))
 		{
-			newTag = std::make_shared<litehtml::el_tr>(this_doc);
+			newTag = make_element<litehtml::el_tr>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("style")))
 		{
-			newTag = std::make_shared<litehtml::el_style>(this_doc);
+			newTag = make_element<litehtml::el_style>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("base")))
 		{
-			newTag = std::make_shared<litehtml::el_base>(this_doc);
+			newTag = make_element<litehtml::el_base>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("body")))
 		{
-			newTag = std::make_shared<litehtml::el_body>(this_doc);
+			newTag = make_element<litehtml::el_body>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("div")))
 		{
-			newTag = std::make_shared<litehtml::el_div>(this_doc);
+			newTag = make_element<litehtml::el_div>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("script")))
 		{
-			newTag = std::make_shared<litehtml::el_script>(this_doc);
+			newTag = make_element<litehtml::el_script>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("font")))
 		{
-			newTag = std::make_shared<litehtml::el_font>(this_doc);
+			newTag = make_element<litehtml::el_font>(this_doc);
 		} else if(!t_strcmp(tag_name, _t("li")))
 		{
-			newTag = std::make_shared<litehtml::el_li>(this_doc);
+			newTag = make_element<litehtml::el_li>(this_doc);
 		} else
 		{
-			newTag = std::make_shared<litehtml::html_tag>(this_doc);
+			newTag = make_element<litehtml::html_tag>(this_doc);
 		}
 	}
 
@@ -704,61 +786,25 @@ void litehtml::document::create_node(void* gnode, elements_vector& elements, boo
 		break;
 	case GUMBO_NODE_TEXT:
 		{
-			std::wstring str;
 			std::wstring str_in = (const wchar_t*) (utf8_to_wchar(node->v.text.text));
 			if (!parseTextNode)
 			{
-				elements.push_back(std::make_shared<el_text>(litehtml_from_wchar(str_in.c_str()), shared_from_this()));
+				elements.push_back(make_element<el_text>(litehtml_from_wchar(str_in.c_str()), shared_from_this()));
 				break;
 			}
-			ucode_t c;
-			for (size_t i = 0; i < str_in.length(); i++)
-			{
-				c = (ucode_t) str_in[i];
-				if (c <= ' ' && (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f'))
-				{
-					if (!str.empty())
-					{
-						elements.push_back(std::make_shared<el_text>(litehtml_from_wchar(str.c_str()), shared_from_this()));
-						str.clear();
-					}
-					str += c;
-					elements.push_back(std::make_shared<el_space>(litehtml_from_wchar(str.c_str()), shared_from_this()));
-					str.clear();
-				}
-				// CJK character range
-				else if (c >= 0x4E00 && c <= 0x9FCC)
-				{
-					if (!str.empty())
-					{
-						elements.push_back(std::make_shared<el_text>(litehtml_from_wchar(str.c_str()), shared_from_this()));
-						str.clear();
-					}
-					str += c;
-					elements.push_back(std::make_shared<el_text>(litehtml_from_wchar(str.c_str()), shared_from_this()));
-					str.clear();
-				}
-				else
-				{
-					str += c;
-				}
-			}
-			if (!str.empty())
-			{
-				elements.push_back(std::make_shared<el_text>(litehtml_from_wchar(str.c_str()), shared_from_this()));
-			}
+			create_text_nodes(str_in, elements);
 		}
 		break;
 	case GUMBO_NODE_CDATA:
 		{
-			element::ptr ret = std::make_shared<el_cdata>(shared_from_this());
+			element::ptr ret = make_element<el_cdata>(shared_from_this());
 			ret->set_data(litehtml_from_utf8(node->v.text.text));
 			elements.push_back(ret);
 		}
 		break;
 	case GUMBO_NODE_COMMENT:
 		{
-			element::ptr ret = std::make_shared<el_comment>(shared_from_this());
+			element::ptr ret = make_element<el_comment>(shared_from_this());
 			ret->set_data(litehtml_from_utf8(node->v.text.text));
 			elements.push_back(ret);
 		}
@@ -768,7 +814,7 @@ void litehtml::document::create_node(void* gnode, elements_vector& elements, boo
 			tstring str = litehtml_from_utf8(node->v.text.text);
 			for (size_t i = 0; i < str.length(); i++)
 			{
-				elements.push_back(std::make_shared<el_space>(str.substr(i, 1).c_str(), shared_from_this()));
+				elements.push_back(make_element<el_space>(str.substr(i, 1).c_str(), shared_from_this()));
 			}
 		}
 		break;
@@ -777,6 +823,48 @@ void litehtml::document::create_node(void* gnode, elements_vector& elements, boo
 	}
 }
 
+void litehtml::document::create_text_nodes(const std::wstring& str_in, elements_vector& elements)
+{
+	// split the text into words and spaces
+	std::wstring str;
+	ucode_t c;
+	for (size_t i = 0; i < str_in.length(); i++)
+	{
+		c = (ucode_t) str_in[i];
+		if (c <= ' ' && (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f'))
+		{
+			if (!str.empty())
+			{
+				elements.push_back(make_element<el_text>(litehtml_from_wchar(str.c_str()), shared_from_this()));
+				str.clear();
+			}
+			str += c;
+			elements.push_back(make_element<el_space>(litehtml_from_wchar(str.c_str()), shared_from_this()));
+			str.clear();
+		}
+		// CJK character range
+		else if (c >= 0x4E00 && c <= 0x9FCC)
+		{
+			if (!str.empty())
+			{
+				elements.push_back(make_element<el_text>(litehtml_from_wchar(str.c_str()), shared_from_this()));
+				str.clear();
+			}
+			str += c;
+			elements.push_back(make_element<el_text>(litehtml_from_wchar(str.c_str()), shared_from_this()));
+			str.clear();
+		}
+		else
+		{
+			str += c;
+		}
+	}
+	if (!str.empty())
+	{
+		elements.push_back(make_element<el_text>(litehtml_from_wchar(str.c_str()), shared_from_this()));
+	}
+}
+
 void litehtml::document::fix_tables_layout()
 {
 	size_t i = 0;
@@ -829,7 +917,7 @@ void litehtml::document::fix_table_children(element::ptr& el_ptr, style_display
 
 	auto flush_elements = [&]()
 	{
-		element::ptr annon_tag = std::make_shared<html_tag>(shared_from_this());
+		element::ptr annon_tag = make_element<html_tag>(shared_from_this());
 		style st;
 		st.add_property(_t("display"), disp_str, 0, false);
 		annon_tag->add_style(st);
@@ -936,7 +1024,7 @@ void litehtml::document::fix_table_parent(element::ptr& el_ptr, style_display di
 			}
 
 			// extract elements with the same display and wrap them with anonymous object
-			element::ptr annon_tag = std::make_shared<html_tag>(shared_from_this());
+			element::ptr annon_tag = make_element<html_tag>(shared_from_this());
 			style st;
 			st.add_property(_t("display"), disp_str, 0, false);
 			annon_tag->add_style(st);
@@ -954,6 +1042,77 @@ void litehtml::document::fix_table_parent(element::ptr& el_ptr, style_display di
 	}
 }
 
+void litehtml::document::set_element_text(const element::ptr& el, const tchar_t* text)
+{
+	// element must belong to this document
+	if (!el || el->get_document().get() != this)
+	{
+		return;
+	}
+
+	// keep the ::before and ::after elements, as they're generated from
+	// the style sheets rather than from the document text
+	element::ptr before;
+	element::ptr after;
+	if (!el->m_children.empty() && !t_strcmp(el->m_children.front()->get_tagName(), _t("::before")))
+	{
+		before = el->m_children.front();
+	}
+	if (!el->m_children.empty() && !t_strcmp(el->m_children.back()->get_tagName(), _t("::after")))
+	{
+		after = el->m_children.back();
+	}
+
+	// remove the other children
+	for (const auto& child : el->m_children)
+	{
+		if (child != before && child != after)
+		{
+			child->clearRecursive();
+			child->parent(nullptr);
+		}
+	}
+	el->m_children.clear();
+
+	// replace them with the new text, split into words as the parser
+	// does it
+	if (before)
+	{
+		el->appendChild(before);
+	}
+	elements_vector children;
+	create_text_nodes((const wchar_t*) (utf8_to_wchar(litehtml_to_utf8(text ? text : _t("")))), children);
+	for (const auto& child : children)
+	{
+		el->appendChild(child);
+		child->parse_styles();
+	}
+	if (after)
+	{
+		el->appendChild(after);
+	}
+
+	// only the element and its ancestors have to be laid out again
+	el->invalidate_layout();
+}
+
+void litehtml::document::invalidate_layout()
+{
+	if (m_root)
+	{
+		invalidate_layout(m_root.get());
+	}
+}
+
+void litehtml::document::invalidate_layout(element* el)
+{
+	el->m_layout_dirty = true;
+	for (const auto& child : el->m_children)
+	{
+		invalidate_layout(child.get());
+	}
+}
+
 void litehtml::document::append_children_from_string(element& parent, const tchar_t* str)
 {
 	append_children_from_utf8(parent, litehtml_to_utf8(str));
@@ -968,15 +1127,13 @@ void litehtml::document::append_children_from_utf8(element& parent, const char*
 	}
 
 	// parse document into GumboOutput
-	GumboOutput* output = gumbo_parse((const char*) str);
+	arena parse_arena;
+	GumboOutput* output = gumbo_parse_in_arena((const char*) str, parse_arena);
 
-	// Create litehtml::elements.
+	// Create litehtml::elements.  The GumboOutput goes away with the arena.
 	elements_vector child_elements;
 	create_node(output->root, child_elements, true);
 
-	// Destroy GumboOutput
-	gumbo_destroy_output(&kGumboDefaultOptions, output);
-
 	// Let's process created elements tree
 	for (litehtml::element::ptr child : child_elements)
 	{
@@ -990,7 +1147,7 @@ void litehtml::document::append_children_from_utf8(element& parent, const char*
 		child->parse_attributes();
 
 		// Apply parsed styles.
-		child->apply_stylesheet(m_styles);
+		child->apply_stylesheet(*m_styles);
 
 		// Parse applied styles in the elements
 		child->parse_styles();
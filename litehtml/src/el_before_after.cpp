@@ -24,7 +24,7 @@ void litehtml::el_before_after_base::add_style(const litehtml::style& st)
 {
 	html_tag::add_style(st);
 
-	tstring content = get_style_property(_t("content"), false, _t(""));
+	tstring content = get_style_text(css_property_content, false, _t(""));
 	if(!content.empty())
 	{
 		int idx = value_index(content.c_str(), content_property_string);
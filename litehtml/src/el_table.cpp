@@ -32,12 +32,12 @@ void litehtml::el_table::parse_styles(bool is_reparse)
 {
 	html_tag::parse_styles(is_reparse);
 
-	m_border_collapse = (border_collapse) value_index(get_style_property(_t("border-collapse"), true, _t("separate")), border_collapse_strings, border_collapse_separate);
+	m_border_collapse = (border_collapse) get_style_keyword(css_property_border_collapse, true, border_collapse_separate);
 
 	if(m_border_collapse == border_collapse_separate)
 	{
-		m_css_border_spacing_x.fromString(get_style_property(_t("-litehtml-border-spacing-x"), true, _t("0px")));
-		m_css_border_spacing_y.fromString(get_style_property(_t("-litehtml-border-spacing-y"), true, _t("0px")));
+		get_style_length(m_css_border_spacing_x, css_property_litehtml_border_spacing_x, true);
+		get_style_length(m_css_border_spacing_y, css_property_litehtml_border_spacing_y, true);
 
 		int fntsz = get_font_size();
 		document::ptr doc = get_document();
@@ -41,9 +41,22 @@ const litehtml::tchar_t* litehtml::el_text::get_style_property( const tchar_t* n
 	return def;
 }
 
+const litehtml::property_value* litehtml::el_text::get_style_value( int id, bool inherited )
+{
+	if(inherited)
+	{
+		element::ptr el_parent = parent();
+		if (el_parent)
+		{
+			return el_parent->get_style_value(id, inherited);
+		}
+	}
+	return 0;
+}
+
 void litehtml::el_text::parse_styles(bool is_reparse)
 {
-	m_text_transform	= (text_transform)	value_index(get_style_property(_t("text-transform"), true,	_t("none")),	text_transform_strings,	text_transform_none);
+	m_text_transform	= (text_transform)	get_style_keyword(css_property_text_transform, true, text_transform_none);
 	if(m_text_transform != text_transform_none)
 	{
 		m_transformed_text	= m_text;
@@ -9,6 +9,7 @@ litehtml::element::element(const std::shared_ptr<litehtml::document>& doc) : m_d
 {
 	m_box		= 0;
 	m_skip		= false;
+	m_layout_dirty	= true;
 }
 
 litehtml::element::~element()
@@ -56,6 +57,28 @@ litehtml::web_color litehtml::element::get_color( const tchar_t* prop_name, bool
 	return web_color::from_string(clrstr, get_document()->container());
 }
 
+const litehtml::tchar_t* litehtml::element::get_style_text( int id, bool inherited, const tchar_t* def /*= 0*/ )
+{
+	const property_value* val = get_style_value(id, inherited);
+	return val ? val->m_value.c_str() : def;
+}
+
+int litehtml::element::get_style_keyword( int id, bool inherited, int invalid )
+{
+	const property_value* val = get_style_value(id, inherited);
+	if(!val)
+	{
+		return style::get_property_type(id).initial_keyword;
+	}
+	return val->m_keyword >= 0 ? val->m_keyword : invalid;
+}
+
+void litehtml::element::get_style_length( css_length& len, int id, bool inherited )
+{
+	const property_value* val = get_style_value(id, inherited);
+	len = val ? val->m_length : style::get_property_type(id).initial_length;
+}
+
 litehtml::position litehtml::element::get_placement() const
 {
 	litehtml::position pos = m_pos;
@@ -206,6 +229,19 @@ bool litehtml::element::is_ancestor(const ptr &el) const
 	return false;
 }
 
+void litehtml::element::invalidate_layout()
+{
+	// Always go all the way up.  An element that wasn't rendered last
+	// time (display:none, for example) can be dirty under clean
+	// ancestors, so stopping at the first dirty element isn't safe.
+	for (element* el = this; el; )
+	{
+		el->m_layout_dirty = true;
+		element::ptr el_parent = el->parent();
+		el = el_parent.get();
+	}
+}
+
 int litehtml::element::get_inline_shift_left()
 {
 	int ret = 0;
@@ -360,6 +396,7 @@ int litehtml::element::get_line_right( int y, int def_right )						LITEHTML_RETU
 int litehtml::element::get_left_floats_height() const								LITEHTML_RETURN_FUNC(0)
 int litehtml::element::get_right_floats_height() const								LITEHTML_RETURN_FUNC(0)
 int litehtml::element::get_floats_height(element_float el_float) const				LITEHTML_RETURN_FUNC(0)
+int litehtml::element::get_floats_count() const										LITEHTML_RETURN_FUNC(0)
 bool litehtml::element::is_floats_holder() const									LITEHTML_RETURN_FUNC(false)
 void litehtml::element::get_content_size( size& sz, int max_width )					LITEHTML_EMPTY_FUNC
 void litehtml::element::init()														LITEHTML_EMPTY_FUNC
@@ -398,6 +435,7 @@ int litehtml::element::line_height() const											LITEHTML_RETURN_FUNC(0)
 void litehtml::element::draw( uint_ptr hdc, int x, int y, const position* clip )	LITEHTML_EMPTY_FUNC
 void litehtml::element::draw_background( uint_ptr hdc, int x, int y, const position* clip )	LITEHTML_EMPTY_FUNC
 const litehtml::tchar_t* litehtml::element::get_style_property( const tchar_t* name, bool inherited, const tchar_t* def /*= 0*/ )	LITEHTML_RETURN_FUNC(0)
+const litehtml::property_value* litehtml::element::get_style_value( int id, bool inherited )	LITEHTML_RETURN_FUNC(0)
 litehtml::uint_ptr litehtml::element::get_font( font_metrics* fm /*= 0*/ )			LITEHTML_RETURN_FUNC(0)
 int litehtml::element::get_font_size()	const										LITEHTML_RETURN_FUNC(0)
 void litehtml::element::get_text( tstring& text )									LITEHTML_EMPTY_FUNC
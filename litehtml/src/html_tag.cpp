@@ -32,6 +32,7 @@ litehtml::html_tag::html_tag(const std::shared_ptr<litehtml::document>& doc) : l
 	m_border_spacing_x		= 0;
 	m_border_spacing_y		= 0;
 	m_border_collapse		= border_collapse_separate;
+	m_has_positioned		= false;
 }
 
 litehtml::html_tag::~html_tag()
@@ -165,71 +166,88 @@ void litehtml::html_tag::apply_stylesheet( const litehtml::css& stylesheet )
 {
 	remove_before_after();
 
-	for(const auto& sel : stylesheet.selectors())
+	if(stylesheet.is_indexed())
 	{
-		int apply = select(*sel, false);
+		// only test the selectors whose rightmost key this element has
+		css::index_list candidates;
+		stylesheet.get_candidates(get_attr(_t("id")), m_class_values, m_tag, candidates);
+		for(int i : candidates)
+		{
+			apply_selector(stylesheet.selectors()[i]);
+		}
+	} else
+	{
+		for(const auto& sel : stylesheet.selectors())
+		{
+			apply_selector(sel);
+		}
+	}
 
-		if(apply != select_no_match)
+	for(auto& el : m_children)
+	{
+		if(el->get_display() != display_inline_text)
 		{
-			used_selector::ptr us = std::unique_ptr<used_selector>(new used_selector(sel, false));
+			el->apply_stylesheet(stylesheet);
+		}
+	}
+}
+
+void litehtml::html_tag::apply_selector( const css_selector::ptr& sel )
+{
+	int apply = select(*sel, false);
 
-			if(sel->is_media_valid())
+	if(apply != select_no_match)
+	{
+		used_selector::ptr us = std::unique_ptr<used_selector>(new used_selector(sel, false));
+
+		if(sel->is_media_valid())
+		{
+			if(apply & select_match_pseudo_class)
 			{
-				if(apply & select_match_pseudo_class)
+				if(select(*sel, true))
 				{
-					if(select(*sel, true))
+					if(apply & select_match_with_after)
 					{
-						if(apply & select_match_with_after)
-						{
-							element::ptr el = get_element_after();
-							if(el)
-							{
-								el->add_style(*sel->m_style);
-							}
-						} else if(apply & select_match_with_before)
+						element::ptr el = get_element_after();
+						if(el)
 						{
-							element::ptr el = get_element_before();
-							if(el)
-							{
-								el->add_style(*sel->m_style);
-							}
+							el->add_style(*sel->m_style);
 						}
-						else
+					} else if(apply & select_match_with_before)
+					{
+						element::ptr el = get_element_before();
+						if(el)
 						{
-							add_style(*sel->m_style);
-							us->m_used = true;
+							el->add_style(*sel->m_style);
 						}
 					}
-				} else if(apply & select_match_with_after)
-				{
-					element::ptr el = get_element_after();
-					if(el)
+					else
 					{
-						el->add_style(*sel->m_style);
+						add_style(*sel->m_style);
+						us->m_used = true;
 					}
-				} else if(apply & select_match_with_before)
+				}
+			} else if(apply & select_match_with_after)
+			{
+				element::ptr el = get_element_after();
+				if(el)
 				{
-					element::ptr el = get_element_before();
-					if(el)
-					{
-						el->add_style(*sel->m_style);
-					}
-				} else
+					el->add_style(*sel->m_style);
+				}
+			} else if(apply & select_match_with_before)
+			{
+				element::ptr el = get_element_before();
+				if(el)
 				{
-					add_style(*sel->m_style);
-					us->m_used = true;
+					el->add_style(*sel->m_style);
 				}
+			} else
+			{
+				add_style(*sel->m_style);
+				us->m_used = true;
 			}
-			m_used_styles.push_back(std::move(us));
-		}
-	}
-
-	for(auto& el : m_children)
-	{
-		if(el->get_display() != display_inline_text)
-		{
-			el->apply_stylesheet(stylesheet);
 		}
+		m_used_styles.push_back(std::move(us));
 	}
 }
 
@@ -289,21 +307,26 @@ litehtml::uint_ptr litehtml::html_tag::get_font(font_metrics* fm)
 
 const litehtml::tchar_t* litehtml::html_tag::get_style_property( const tchar_t* name, bool inherited, const tchar_t* def /*= 0*/ )
 {
-	const tchar_t* ret = m_style.get_property(name);
-	element::ptr el_parent = parent();
-	if (el_parent)
+	// a name that was never interned can't be set on any element
+	int id = style::find_property_id(name);
+	if(id < 0)
 	{
-		if ( ( ret && !t_strcasecmp(ret, _t("inherit")) ) || (!ret && inherited) )
-		{
-			ret = el_parent->get_style_property(name, inherited, def);
-		}
+		return def;
 	}
+	return get_style_text(id, inherited, def);
+}
 
-	if(!ret)
+const litehtml::property_value* litehtml::html_tag::get_style_value( int id, bool inherited )
+{
+	const property_value* ret = m_style.get_property_value(id);
+	if ( ( ret && ret->m_inherit ) || (!ret && inherited) )
 	{
-		ret = def;
+		element::ptr el_parent = parent();
+		if (el_parent)
+		{
+			ret = el_parent->get_style_value(id, inherited);
+		}
 	}
-
 	return ret;
 }
 
@@ -319,30 +342,28 @@ void litehtml::html_tag::parse_styles(bool is_reparse)
 	init_font();
 	document::ptr doc = get_document();
 
-	m_el_position	= (element_position)	value_index(get_style_property(_t("position"),		false,	_t("static")),		element_position_strings,	element_position_fixed);
-	m_text_align	= (text_align)			value_index(get_style_property(_t("text-align"),		true,	_t("left")),		text_align_strings,			text_align_left);
-	m_overflow		= (overflow)			value_index(get_style_property(_t("overflow"),		false,	_t("visible")),		overflow_strings,			overflow_visible);
-	m_white_space	= (white_space)			value_index(get_style_property(_t("white-space"),	true,	_t("normal")),		white_space_strings,		white_space_normal);
-	m_display		= (style_display)		value_index(get_style_property(_t("display"),		false,	_t("inline")),		style_display_strings,		display_inline);
-	m_visibility	= (visibility)			value_index(get_style_property(_t("visibility"),	true,	_t("visible")),		visibility_strings,			visibility_visible);
-	m_box_sizing	= (box_sizing)			value_index(get_style_property(_t("box-sizing"),		false,	_t("content-box")),	box_sizing_strings,			box_sizing_content_box);
+	m_el_position	= (element_position)	get_style_keyword(css_property_position, false, element_position_fixed);
+	m_text_align	= (text_align)			get_style_keyword(css_property_text_align, true, text_align_left);
+	m_overflow		= (overflow)			get_style_keyword(css_property_overflow, false, overflow_visible);
+	m_white_space	= (white_space)			get_style_keyword(css_property_white_space, true, white_space_normal);
+	m_display		= (style_display)		get_style_keyword(css_property_display, false, display_inline);
+	m_visibility	= (visibility)			get_style_keyword(css_property_visibility, true, visibility_visible);
+	m_box_sizing	= (box_sizing)			get_style_keyword(css_property_box_sizing, false, box_sizing_content_box);
 
 	if(m_el_position != element_position_static)
 	{
-		const tchar_t* val = get_style_property(_t("z-index"), false, 0);
+		const tchar_t* val = get_style_text(css_property_z_index, false, 0);
 		if(val)
 		{
 			m_z_index = t_atoi(val);
 		}
 	}
 
-	const tchar_t* va	= get_style_property(_t("vertical-align"), true,	_t("baseline"));
-	m_vertical_align = (vertical_align) value_index(va, vertical_align_strings, va_baseline);
+	m_vertical_align = (vertical_align) get_style_keyword(css_property_vertical_align, true, va_baseline);
 
-	const tchar_t* fl	= get_style_property(_t("float"), false,	_t("none"));
-	m_float = (element_float) value_index(fl, element_float_strings, float_none);
+	m_float = (element_float) get_style_keyword(css_property_float, false, float_none);
 
-	m_clear = (element_clear) value_index(get_style_property(_t("clear"), false, _t("none")), element_clear_strings, clear_none);
+	m_clear = (element_clear) get_style_keyword(css_property_clear, false, clear_none);
 
 	if (m_float != float_none)
 	{
@@ -374,71 +395,71 @@ void litehtml::html_tag::parse_styles(bool is_reparse)
 		}
 	}
 
-	m_css_text_indent.fromString(	get_style_property(_t("text-indent"),	true,	_t("0")),	_t("0"));
+	get_style_length(m_css_text_indent, css_property_text_indent, true);
 
-	m_css_width.fromString(			get_style_property(_t("width"),			false,	_t("auto")), _t("auto"));
-	m_css_height.fromString(		get_style_property(_t("height"),		false,	_t("auto")), _t("auto"));
+	get_style_length(m_css_width, css_property_width, false);
+	get_style_length(m_css_height, css_property_height, false);
 
 	doc->cvt_units(m_css_width, m_font_size);
 	doc->cvt_units(m_css_height, m_font_size);
 
-	m_css_min_width.fromString(		get_style_property(_t("min-width"),		false,	_t("0")));
-	m_css_min_height.fromString(	get_style_property(_t("min-height"),		false,	_t("0")));
+	get_style_length(m_css_min_width, css_property_min_width, false);
+	get_style_length(m_css_min_height, css_property_min_height, false);
 
-	m_css_max_width.fromString(		get_style_property(_t("max-width"),		false,	_t("none")),	_t("none"));
-	m_css_max_height.fromString(	get_style_property(_t("max-height"),		false,	_t("none")),	_t("none"));
+	get_style_length(m_css_max_width, css_property_max_width, false);
+	get_style_length(m_css_max_height, css_property_max_height, false);
 	
 	doc->cvt_units(m_css_min_width, m_font_size);
 	doc->cvt_units(m_css_min_height, m_font_size);
 
-	m_css_offsets.left.fromString(		get_style_property(_t("left"),				false,	_t("auto")), _t("auto"));
-	m_css_offsets.right.fromString(		get_style_property(_t("right"),				false,	_t("auto")), _t("auto"));
-	m_css_offsets.top.fromString(		get_style_property(_t("top"),				false,	_t("auto")), _t("auto"));
-	m_css_offsets.bottom.fromString(	get_style_property(_t("bottom"),			false,	_t("auto")), _t("auto"));
+	get_style_length(m_css_offsets.left, css_property_left, false);
+	get_style_length(m_css_offsets.right, css_property_right, false);
+	get_style_length(m_css_offsets.top, css_property_top, false);
+	get_style_length(m_css_offsets.bottom, css_property_bottom, false);
 
 	doc->cvt_units(m_css_offsets.left, m_font_size);
 	doc->cvt_units(m_css_offsets.right, m_font_size);
 	doc->cvt_units(m_css_offsets.top,		m_font_size);
 	doc->cvt_units(m_css_offsets.bottom,	m_font_size);
 
-	m_css_margins.left.fromString(		get_style_property(_t("margin-left"),		false,	_t("0")), _t("auto"));
-	m_css_margins.right.fromString(		get_style_property(_t("margin-right"),		false,	_t("0")), _t("auto"));
-	m_css_margins.top.fromString(		get_style_property(_t("margin-top"),			false,	_t("0")), _t("auto"));
-	m_css_margins.bottom.fromString(	get_style_property(_t("margin-bottom"),		false,	_t("0")), _t("auto"));
+	get_style_length(m_css_margins.left, css_property_margin_left, false);
+	get_style_length(m_css_margins.right, css_property_margin_right, false);
+	get_style_length(m_css_margins.top, css_property_margin_top, false);
+	get_style_length(m_css_margins.bottom, css_property_margin_bottom, false);
 
-	m_css_padding.left.fromString(		get_style_property(_t("padding-left"),		false,	_t("0")), _t(""));
-	m_css_padding.right.fromString(		get_style_property(_t("padding-right"),		false,	_t("0")), _t(""));
-	m_css_padding.top.fromString(		get_style_property(_t("padding-top"),		false,	_t("0")), _t(""));
-	m_css_padding.bottom.fromString(	get_style_property(_t("padding-bottom"),		false,	_t("0")), _t(""));
+	get_style_length(m_css_padding.left, css_property_padding_left, false);
+	get_style_length(m_css_padding.right, css_property_padding_right, false);
+	get_style_length(m_css_padding.top, css_property_padding_top, false);
+	get_style_length(m_css_padding.bottom, css_property_padding_bottom, false);
 
-	m_css_borders.left.width.fromString(	get_style_property(_t("border-left-width"),		false,	_t("medium")), border_width_strings);
-	m_css_borders.right.width.fromString(	get_style_property(_t("border-right-width"),		false,	_t("medium")), border_width_strings);
-	m_css_borders.top.width.fromString(		get_style_property(_t("border-top-width"),		false,	_t("medium")), border_width_strings);
-	m_css_borders.bottom.width.fromString(	get_style_property(_t("border-bottom-width"),	false,	_t("medium")), border_width_strings);
+	get_style_length(m_css_borders.left.width, css_property_border_left_width, false);
+	get_style_length(m_css_borders.right.width, css_property_border_right_width, false);
+	get_style_length(m_css_borders.top.width, css_property_border_top_width, false);
+	get_style_length(m_css_borders.bottom.width, css_property_border_bottom_width, false);
 
-	m_css_borders.left.color = web_color::from_string(get_style_property(_t("border-left-color"),	false,	_t("")), doc->container());
-	m_css_borders.left.style = (border_style) value_index(get_style_property(_t("border-left-style"), false, _t("none")), border_style_strings, border_style_none);
+	m_css_borders.left.color = web_color::from_string(get_style_text(css_property_border_left_color,	false,	_t("")), doc->container());
+	m_css_borders.left.style = (border_style) get_style_keyword(css_property_border_left_style, false, border_style_none);
 
-    m_css_borders.right.color = web_color::from_string(get_style_property(_t("border-right-color"), false, _t("")), doc->container());
-	m_css_borders.right.style = (border_style) value_index(get_style_property(_t("border-right-style"), false, _t("none")), border_style_strings, border_style_none);
+    m_css_borders.right.color = web_color::from_string(get_style_text(css_property_border_right_color, false, _t("")), doc->container());
+	m_css_borders.right.style = (border_style) get_style_keyword(css_property_border_right_style, false, border_style_none);
 
-    m_css_borders.top.color = web_color::from_string(get_style_property(_t("border-top-color"), false, _t("")), doc->container());
-	m_css_borders.top.style = (border_style) value_index(get_style_property(_t("border-top-style"), false, _t("none")), border_style_strings, border_style_none);
+    m_css_borders.top.color = web_color::from_string(get_style_text(css_property_border_top_color, false, _t("")), doc->container());
+	m_css_borders.top.style = (border_style) get_style_keyword(css_property_border_top_style, false, border_style_none);
 
-    m_css_borders.bottom.color = web_color::from_string(get_style_property(_t("border-bottom-color"), false, _t("")), doc->container());
-	m_css_borders.bottom.style = (border_style) value_index(get_style_property(_t("border-bottom-style"), false, _t("none")), border_style_strings, border_style_none);
+    m_css_borders.bottom.color = web_color::from_string(get_style_text(css_property_border_bottom_color, false, _t("")), doc->container());
+	m_css_borders.bottom.style = (border_style) get_style_keyword(css_property_border_bottom_style, false, border_style_none);
 
-	m_css_borders.radius.top_left_x.fromString(get_style_property(_t("border-top-left-radius-x"), false, _t("0")));
-	m_css_borders.radius.top_left_y.fromString(get_style_property(_t("border-top-left-radius-y"), false, _t("0")));
+	get_style_length(m_css_borders.radius.top_left_x, css_property_border_top_left_radius_x, false);
+	get_style_length(m_css_borders.radius.top_left_y, css_property_border_top_left_radius_y, false);
 
-	m_css_borders.radius.top_right_x.fromString(get_style_property(_t("border-top-right-radius-x"), false, _t("0")));
-	m_css_borders.radius.top_right_y.fromString(get_style_property(_t("border-top-right-radius-y"), false, _t("0")));
+	get_style_length(m_css_borders.radius.top_right_x, css_property_border_top_right_radius_x, false);
+	get_style_length(m_css_borders.radius.top_right_y, css_property_border_top_right_radius_y, false);
 
-	m_css_borders.radius.bottom_right_x.fromString(get_style_property(_t("border-bottom-right-radius-x"), false, _t("0")));
-	m_css_borders.radius.bottom_right_y.fromString(get_style_property(_t("border-bottom-right-radius-y"), false, _t("0")));
+	get_style_length(m_css_borders.radius.bottom_right_x, css_property_border_bottom_right_radius_x, false);
+	get_style_length(m_css_borders.radius.bottom_right_y, css_property_border_bottom_right_radius_y, false);
 
-	m_css_borders.radius.bottom_left_x.fromString(get_style_property(_t("border-bottom-left-radius-x"), false, _t("0")));
-	m_css_borders.radius.bottom_left_y.fromString(get_style_property(_t("border-bottom-left-radius-y"), false, _t("0")));
+	get_style_length(m_css_borders.radius.bottom_left_x, css_property_border_bottom_left_radius_x, false);
+	get_style_length(m_css_borders.radius.bottom_left_y, css_property_border_bottom_left_radius_y, false);
 
 	doc->cvt_units(m_css_borders.radius.bottom_left_x,			m_font_size);
 	doc->cvt_units(m_css_borders.radius.bottom_left_y,			m_font_size);
@@ -467,7 +488,7 @@ void litehtml::html_tag::parse_styles(bool is_reparse)
 	m_borders.bottom	= doc->cvt_units(m_css_borders.bottom.width,	m_font_size);
 
 	css_length line_height;
-	line_height.fromString(get_style_property(_t("line-height"),	true,	_t("normal")), _t("normal"));
+	get_style_length(line_height, css_property_line_height, true);
 	if(line_height.is_predefined())
 	{
 		m_line_height = m_font_metrics.height;
@@ -485,19 +506,17 @@ void litehtml::html_tag::parse_styles(bool is_reparse)
 
 	if(m_display == display_list_item)
 	{
-		const tchar_t* list_type = get_style_property(_t("list-style-type"), true, _t("disc"));
-		m_list_style_type = (list_style_type) value_index(list_type, list_style_type_strings, list_style_type_disc);
+		m_list_style_type = (list_style_type) get_style_keyword(css_property_list_style_type, true, list_style_type_disc);
 
-		const tchar_t* list_pos = get_style_property(_t("list-style-position"), true, _t("outside"));
-		m_list_style_position = (list_style_position) value_index(list_pos, list_style_position_strings, list_style_position_outside);
+		m_list_style_position = (list_style_position) get_style_keyword(css_property_list_style_position, true, list_style_position_outside);
 
-		const tchar_t* list_image = get_style_property(_t("list-style-image"), true, 0);
+		const tchar_t* list_image = get_style_text(css_property_list_style_image, true, 0);
 		if(list_image && list_image[0])
 		{
 			tstring url;
 			css::parse_css_url(list_image, url);
 
-			const tchar_t* list_image_baseurl = get_style_property(_t("list-style-image-baseurl"), true, 0);
+			const tchar_t* list_image_baseurl = get_style_text(css_property_list_style_image_baseurl, true, 0);
 			doc->container()->load_image(url.c_str(), list_image_baseurl, true);
 		}
 
@@ -516,12 +535,79 @@ void litehtml::html_tag::parse_styles(bool is_reparse)
 
 int litehtml::html_tag::render( int x, int y, int max_width, bool second_pass )
 {
+	// If nothing in the subtree has changed, and we're rendering with
+	// the same arguments as last time, the last layout still holds, so
+	// we only have to move it to the new position.
+	bool cacheable = is_layout_cacheable();
+	if (cacheable && !m_layout_dirty && m_render_cache.is_valid &&
+		m_render_cache.max_width == max_width && m_render_cache.second_pass == second_pass)
+	{
+		m_pos		= m_render_cache.pos;
+		m_pos.x		+= x;
+		m_pos.y		+= y;
+		m_margins	= m_render_cache.el_margins;
+		m_padding	= m_render_cache.el_padding;
+		m_borders	= m_render_cache.el_borders;
+		return m_render_cache.ret_width;
+	}
+
+	// the children are about to change, so the saved layout no longer
+	// describes them, even for the nested second-pass render
+	m_render_cache.invalidate();
+
+	int ret_width;
 	if (m_display == display_table || m_display == display_inline_table)
 	{
-		return render_table(x, y, max_width, second_pass);
+		ret_width = render_table(x, y, max_width, second_pass);
+	}
+	else
+	{
+		ret_width = render_box(x, y, max_width, second_pass);
+	}
+
+	// Save the results for next time.  A block that isn't a floats
+	// holder adds the floats it contains to its floats holder, so it
+	// can't be cached if it turned out to contain any.
+	m_layout_dirty = false;
+	m_render_cache.is_valid = cacheable && (is_floats_holder() || get_floats_count() == 0);
+	if (m_render_cache.is_valid)
+	{
+		m_render_cache.max_width	= max_width;
+		m_render_cache.second_pass	= second_pass;
+		m_render_cache.ret_width	= ret_width;
+		m_render_cache.pos			= m_pos;
+		m_render_cache.pos.x		-= x;
+		m_render_cache.pos.y		-= y;
+		m_render_cache.el_margins	= m_margins;
+		m_render_cache.el_padding	= m_padding;
+		m_render_cache.el_borders	= m_borders;
 	}
 
-	return render_box(x, y, max_width, second_pass);
+	return ret_width;
+}
+
+bool litehtml::html_tag::is_layout_cacheable() const
+{
+	// Tables adjust their cells after rendering them, and
+	// render_positioned() adjusts positioned elements after the main
+	// layout, so subtrees containing either are always laid out again.
+	if (m_has_positioned ||
+		m_display == display_table ||
+		m_display == display_inline_table ||
+		m_display == display_table_cell)
+	{
+		return false;
+	}
+
+	// A floats holder lays out independently of its surroundings.
+	// Other blocks wrap their lines around the floats in their floats
+	// holder, so they can only be reused when there aren't any.
+	if (is_floats_holder())
+	{
+		return true;
+	}
+	element::ptr el_parent = parent();
+	return el_parent && el_parent->get_floats_count() == 0;
 }
 
 bool litehtml::html_tag::is_white_space() const
@@ -1166,6 +1252,20 @@ int litehtml::html_tag::get_line_right( int y, int def_right )
 }
 
 
+int litehtml::html_tag::get_floats_count() const
+{
+	if(is_floats_holder())
+	{
+		return (int) (m_floats_left.size() + m_floats_right.size());
+	}
+	element::ptr el_parent = parent();
+	if (el_parent)
+	{
+		return el_parent->get_floats_count();
+	}
+	return 0;
+}
+
 void litehtml::html_tag::get_line_left_right( int y, int def_right, int& ln_left, int& ln_right )
 {
 	if(is_floats_holder())
@@ -1436,7 +1536,7 @@ void litehtml::html_tag::parse_background()
 	m_bg.m_color		= get_color(_t("background-color"), false, web_color(0, 0, 0, 0));
 
 	// parse background-position
-	const tchar_t* str = get_style_property(_t("background-position"), false, _t("0% 0%"));
+	const tchar_t* str = get_style_text(css_property_background_position, false, _t("0% 0%"));
 	if(str)
 	{
 		string_vector res;
@@ -1524,7 +1624,7 @@ void litehtml::html_tag::parse_background()
 		m_bg.m_position.x.set_value(0, css_units_percentage);
 	}
 
-	str = get_style_property(_t("background-size"), false, _t("auto"));
+	str = get_style_text(css_property_background_size, false, _t("auto"));
 	if(str)
 	{
 		string_vector res;
@@ -1554,32 +1654,20 @@ void litehtml::html_tag::parse_background()
 	doc->cvt_units(m_bg.m_position.height,	m_font_size);
 
 	// parse background_attachment
-	m_bg.m_attachment = (background_attachment) value_index(
-		get_style_property(_t("background-attachment"), false, _t("scroll")), 
-		background_attachment_strings, 
-		background_attachment_scroll);
+	m_bg.m_attachment = (background_attachment) get_style_keyword(css_property_background_attachment, false, background_attachment_scroll);
 
 	// parse background_attachment
-	m_bg.m_repeat = (background_repeat) value_index(
-		get_style_property(_t("background-repeat"), false, _t("repeat")), 
-		background_repeat_strings, 
-		background_repeat_repeat);
+	m_bg.m_repeat = (background_repeat) get_style_keyword(css_property_background_repeat, false, background_repeat_repeat);
 
 	// parse background_clip
-	m_bg.m_clip = (background_box) value_index(
-		get_style_property(_t("background-clip"), false, _t("border-box")), 
-		background_box_strings, 
-		background_box_border);
+	m_bg.m_clip = (background_box) get_style_keyword(css_property_background_clip, false, background_box_border);
 
 	// parse background_origin
-	m_bg.m_origin = (background_box) value_index(
-		get_style_property(_t("background-origin"), false, _t("padding-box")), 
-		background_box_strings, 
-		background_box_content);
+	m_bg.m_origin = (background_box) get_style_keyword(css_property_background_origin, false, background_box_content);
 
 	// parse background-image
-	css::parse_css_url(get_style_property(_t("background-image"), false, _t("")), m_bg.m_image);
-	m_bg.m_baseurl = get_style_property(_t("background-image-baseurl"), false, _t(""));
+	css::parse_css_url(get_style_text(css_property_background_image, false, _t("")), m_bg.m_image);
+	m_bg.m_baseurl = get_style_text(css_property_background_image_baseurl, false, _t(""));
 
 	if(!m_bg.m_image.empty())
 	{
@@ -1817,6 +1905,7 @@ bool litehtml::html_tag::find_styles_changes( position::vector& redraw_boxes, in
 		ret = true;
 		refresh_styles();
 		parse_styles();
+		invalidate_layout();
 	}
 	for (auto& el : m_children)
 	{
@@ -1911,7 +2000,7 @@ void litehtml::html_tag::on_click()
 
 const litehtml::tchar_t* litehtml::html_tag::get_cursor()
 {
-	return get_style_property(_t("cursor"), true, 0);
+	return get_style_text(css_property_cursor, true, 0);
 }
 
 static const int font_size_table[8][7] =
@@ -1930,7 +2019,7 @@ static const int font_size_table[8][7] =
 void litehtml::html_tag::init_font()
 {
 	// initialize font size
-	const tchar_t* str = get_style_property(_t("font-size"), false, 0);
+	const tchar_t* str = get_style_text(css_property_font_size, false, 0);
 
 	int parent_sz = 0;
 	int doc_font_size = get_document()->container()->get_default_font_size();
@@ -2008,10 +2097,10 @@ void litehtml::html_tag::init_font()
 	}
 
 	// initialize font
-	const tchar_t* name			= get_style_property(_t("font-family"),		true,	_t("inherit"));
-	const tchar_t* weight		= get_style_property(_t("font-weight"),		true,	_t("normal"));
-	const tchar_t* style		= get_style_property(_t("font-style"),		true,	_t("normal"));
-	const tchar_t* decoration	= get_style_property(_t("text-decoration"),	true,	_t("none"));
+	const tchar_t* name			= get_style_text(css_property_font_family,		true,	_t("inherit"));
+	const tchar_t* weight		= get_style_text(css_property_font_weight,		true,	_t("normal"));
+	const tchar_t* style		= get_style_text(css_property_font_style,		true,	_t("normal"));
+	const tchar_t* decoration	= get_style_text(css_property_text_decoration,	true,	_t("none"));
 
 	m_font = get_document()->get_font(name, m_font_size, weight, style, decoration, &m_font_metrics);
 }
@@ -2937,12 +3026,12 @@ void litehtml::html_tag::draw_list_marker( uint_ptr hdc, const position &pos )
 {
 	list_marker lm;
 
-	const tchar_t* list_image = get_style_property(_t("list-style-image"), true, 0);
+	const tchar_t* list_image = get_style_text(css_property_list_style_image, true, 0);
 	size img_size;
 	if(list_image)
 	{
 		css::parse_css_url(list_image, lm.image);
-		lm.baseurl = get_style_property(_t("list-style-image-baseurl"), true, 0);
+		lm.baseurl = get_style_text(css_property_list_style_image_baseurl, true, 0);
 		get_document()->container()->get_image_size(lm.image.c_str(), lm.baseurl, img_size);
 	} else
 	{
@@ -3104,6 +3193,7 @@ bool litehtml::html_tag::fetch_positioned()
 			ret = true;
 		}
 	}
+	m_has_positioned = ret;
 	return ret;
 }
 
@@ -3715,6 +3805,7 @@ bool litehtml::html_tag::have_inline_child() const
 
 void litehtml::html_tag::refresh_styles()
 {
+	m_layout_dirty = true;
 	remove_before_after();
 
 	for (auto& el : m_children)
@@ -4203,14 +4294,14 @@ int litehtml::html_tag::render_box(int x, int y, int max_width, bool second_pass
 
 	if (m_display == display_list_item)
 	{
-		const tchar_t* list_image = get_style_property(_t("list-style-image"), true, 0);
+		const tchar_t* list_image = get_style_text(css_property_list_style_image, true, 0);
 		if (list_image)
 		{
 			tstring url;
 			css::parse_css_url(list_image, url);
 
 			size sz;
-			const tchar_t* list_image_baseurl = get_style_property(_t("list-style-image-baseurl"), true, 0);
+			const tchar_t* list_image_baseurl = get_style_text(css_property_list_style_image_baseurl, true, 0);
 			get_document()->container()->get_image_size(url.c_str(), list_image_baseurl, sz);
 			if (min_height < sz.height)
 			{
@@ -2,6 +2,8 @@
 #include "style.h"
 #include <functional>
 #include <algorithm>
+#include <mutex>
+#include <unordered_map>
 #ifndef WINCE
 #include <locale>
 #endif
@@ -11,6 +13,137 @@ litehtml::string_map litehtml::style::m_valid_values =
 	{ _t("white-space"), white_space_strings }
 };
 
+// Property name registry.  The names in css_property_strings get the
+// matching css_property IDs; other names get new IDs as they're seen.
+struct property_registry
+{
+	std::mutex								lock;
+	std::unordered_map<litehtml::tstring, int>	ids;
+
+	property_registry()
+	{
+		litehtml::string_vector names;
+		litehtml::split_string(css_property_strings, names, _t(";"));
+		for(int i = 0; i < (int) names.size(); i++)
+		{
+			ids[names[i]] = i;
+		}
+	}
+};
+
+static property_registry& get_property_registry()
+{
+	static property_registry registry;
+	return registry;
+}
+
+int litehtml::style::property_id( const tstring& name )
+{
+	property_registry& reg = get_property_registry();
+	std::lock_guard<std::mutex> guard(reg.lock);
+	return reg.ids.emplace(name, (int) reg.ids.size()).first->second;
+}
+
+int litehtml::style::find_property_id( const tchar_t* name )
+{
+	property_registry& reg = get_property_registry();
+	std::lock_guard<std::mutex> guard(reg.lock);
+	std::unordered_map<tstring, int>::const_iterator f = reg.ids.find(name);
+	return f != reg.ids.end() ? f->second : -1;
+}
+
+// Value types of the keyword and length properties, with their initial
+// values.  The keyword lists and predefs must match the ones the
+// elements would otherwise parse the values with.
+static std::vector<litehtml::property_type> make_property_types()
+{
+	using namespace litehtml;
+	struct type_def { int id; const tchar_t* keywords; const tchar_t* predefs; const tchar_t* initial; };
+	static const type_def defs[] =
+	{
+		{ css_property_position,						element_position_strings,		0,						_t("static") },
+		{ css_property_text_align,						text_align_strings,				0,						_t("left") },
+		{ css_property_overflow,						overflow_strings,				0,						_t("visible") },
+		{ css_property_white_space,						white_space_strings,			0,						_t("normal") },
+		{ css_property_display,							style_display_strings,			0,						_t("inline") },
+		{ css_property_visibility,						visibility_strings,				0,						_t("visible") },
+		{ css_property_box_sizing,						box_sizing_strings,				0,						_t("content-box") },
+		{ css_property_vertical_align,					vertical_align_strings,			0,						_t("baseline") },
+		{ css_property_float,							element_float_strings,			0,						_t("none") },
+		{ css_property_clear,							element_clear_strings,			0,						_t("none") },
+		{ css_property_border_left_style,				border_style_strings,			0,						_t("none") },
+		{ css_property_border_right_style,				border_style_strings,			0,						_t("none") },
+		{ css_property_border_top_style,				border_style_strings,			0,						_t("none") },
+		{ css_property_border_bottom_style,				border_style_strings,			0,						_t("none") },
+		{ css_property_list_style_type,					list_style_type_strings,		0,						_t("disc") },
+		{ css_property_list_style_position,				list_style_position_strings,	0,						_t("outside") },
+		{ css_property_text_transform,					text_transform_strings,			0,						_t("none") },
+		{ css_property_border_collapse,					border_collapse_strings,		0,						_t("separate") },
+		{ css_property_background_attachment,			background_attachment_strings,	0,						_t("scroll") },
+		{ css_property_background_repeat,				background_repeat_strings,		0,						_t("repeat") },
+		{ css_property_background_clip,					background_box_strings,			0,						_t("border-box") },
+		{ css_property_background_origin,				background_box_strings,			0,						_t("padding-box") },
+
+		{ css_property_text_indent,						0,	_t("0"),				_t("0") },
+		{ css_property_width,							0,	_t("auto"),				_t("auto") },
+		{ css_property_height,							0,	_t("auto"),				_t("auto") },
+		{ css_property_min_width,						0,	_t(""),					_t("0") },
+		{ css_property_min_height,						0,	_t(""),					_t("0") },
+		{ css_property_max_width,						0,	_t("none"),				_t("none") },
+		{ css_property_max_height,						0,	_t("none"),				_t("none") },
+		{ css_property_left,							0,	_t("auto"),				_t("auto") },
+		{ css_property_right,							0,	_t("auto"),				_t("auto") },
+		{ css_property_top,								0,	_t("auto"),				_t("auto") },
+		{ css_property_bottom,							0,	_t("auto"),				_t("auto") },
+		{ css_property_margin_left,						0,	_t("auto"),				_t("0") },
+		{ css_property_margin_right,					0,	_t("auto"),				_t("0") },
+		{ css_property_margin_top,						0,	_t("auto"),				_t("0") },
+		{ css_property_margin_bottom,					0,	_t("auto"),				_t("0") },
+		{ css_property_padding_left,					0,	_t(""),					_t("0") },
+		{ css_property_padding_right,					0,	_t(""),					_t("0") },
+		{ css_property_padding_top,						0,	_t(""),					_t("0") },
+		{ css_property_padding_bottom,					0,	_t(""),					_t("0") },
+		{ css_property_border_left_width,				0,	border_width_strings,	_t("medium") },
+		{ css_property_border_right_width,				0,	border_width_strings,	_t("medium") },
+		{ css_property_border_top_width,				0,	border_width_strings,	_t("medium") },
+		{ css_property_border_bottom_width,				0,	border_width_strings,	_t("medium") },
+		{ css_property_border_top_left_radius_x,		0,	_t(""),					_t("0") },
+		{ css_property_border_top_left_radius_y,		0,	_t(""),					_t("0") },
+		{ css_property_border_top_right_radius_x,		0,	_t(""),					_t("0") },
+		{ css_property_border_top_right_radius_y,		0,	_t(""),					_t("0") },
+		{ css_property_border_bottom_right_radius_x,	0,	_t(""),					_t("0") },
+		{ css_property_border_bottom_right_radius_y,	0,	_t(""),					_t("0") },
+		{ css_property_border_bottom_left_radius_x,		0,	_t(""),					_t("0") },
+		{ css_property_border_bottom_left_radius_y,		0,	_t(""),					_t("0") },
+		{ css_property_line_height,						0,	_t("normal"),			_t("normal") },
+		{ css_property_litehtml_border_spacing_x,		0,	_t(""),					_t("0px") },
+		{ css_property_litehtml_border_spacing_y,		0,	_t(""),					_t("0px") },
+	};
+
+	std::vector<property_type> types(css_property_count);
+	for(const type_def& def : defs)
+	{
+		property_type& type = types[def.id];
+		type.keywords = def.keywords;
+		type.length_predefs = def.predefs;
+		if(def.keywords)
+		{
+			type.initial_keyword = value_index(def.initial, def.keywords, -1);
+		} else
+		{
+			type.initial_length.fromString(def.initial, def.predefs);
+		}
+	}
+	return types;
+}
+
+const litehtml::property_type& litehtml::style::get_property_type( int id )
+{
+	static const std::vector<property_type> types = make_property_types();
+	static const property_type untyped;
+	return id >= 0 && id < (int) types.size() ? types[id] : untyped;
+}
+
 litehtml::style::style()
 {
 }
@@ -66,9 +199,9 @@ void litehtml::style::parse_property( const tstring& txt, const tchar_t* baseurl
 
 void litehtml::style::combine( const litehtml::style& src )
 {
-	for(props_map::const_iterator i = src.m_properties.begin(); i != src.m_properties.end(); i++)
+	for(props_vector::const_iterator i = src.m_properties.begin(); i != src.m_properties.end(); i++)
 	{
-		add_parsed_property(i->first.c_str(), i->second.m_value.c_str(), i->second.m_important);
+		add_parsed_property(i->first, i->second);
 	}
 }
 
@@ -520,23 +653,12 @@ void litehtml::style::parse_short_background( const tstring& val, const tchar_t*
 			}
 		} else if( value_in_list(tok->c_str(), background_size_strings) )
 		{
-			if(m_properties.find(_t("background-size")) != m_properties.end())
-			{
-				m_properties[_t("background-size")].m_value = m_properties[_t("background-size")].m_value + _t(" ") + *tok;
-			} else
-			{
-				add_parsed_property(_t("background-size"), *tok, important);
-			}
+			append_parsed_property(_t("background-size"), *tok, important);
 		} else if ((*tok)[0] == _t('/')) {
 			found_slash = true;
 			if (*tok != _t("/")) {
 				auto sizTok = tok->substr(1);
-				if (m_properties.find(_t("background-size")) != m_properties.end()) {
-					m_properties[_t("background-size")].m_value = m_properties[_t("background-size")].m_value + _t(" ") + sizTok;
-				} else
-				{
-					add_parsed_property(_t("background-size"), sizTok, important);
-				}
+				append_parsed_property(_t("background-size"), sizTok, important);
 			}
 		} else if(	value_in_list(tok->c_str(), _t("left;right;top;bottom;center")) ||
 					iswdigit((*tok)[0]) ||
@@ -557,21 +679,11 @@ void litehtml::style::parse_short_background( const tstring& val, const tchar_t*
             } 
 			
 			if (sizTok.length() != 0) {
-				if (m_properties.find(_t("background-size")) != m_properties.end()) {
-					m_properties[_t("background-size")].m_value = m_properties[_t("background-size")].m_value + _t(" ") + sizTok;
-				} else {
-					add_parsed_property(_t("background-size"), sizTok, important);
-				}
+				append_parsed_property(_t("background-size"), sizTok, important);
 			}
 
 			if (posTok.length() != 0) {
-				if(m_properties.find(_t("background-position")) != m_properties.end())
-				{
-					m_properties[_t("background-position")].m_value = m_properties[_t("background-position")].m_value + _t(" ") + posTok;
-				} else
-				{
-					add_parsed_property(_t("background-position"), posTok, important);
-				}
+				append_parsed_property(_t("background-position"), posTok, important);
             }
 		} else if (web_color::is_color(tok->c_str()))
 		{
@@ -663,26 +775,59 @@ void litehtml::style::add_parsed_property( const tstring& name, const tstring& v
 
 	if (is_valid)
 	{
-		props_map::iterator prop = m_properties.find(name);
-		if (prop != m_properties.end())
+		// parse the value according to the property's type
+		int id = property_id(name);
+		const property_type& type = get_property_type(id);
+		property_value pv(val.c_str(), important);
+		pv.m_inherit = !t_strcasecmp(val.c_str(), _t("inherit"));
+		if (type.keywords)
+		{
+			pv.m_keyword = value_index(val, type.keywords, -1);
+		}
+		if (type.length_predefs)
 		{
-			if (!prop->second.m_important || (important && prop->second.m_important))
-			{
-				prop->second.m_value = val;
-				prop->second.m_important = important;
-			}
+			pv.m_length.fromString(val, type.length_predefs);
 		}
-		else
+
+		add_parsed_property(id, pv);
+	}
+}
+
+void litehtml::style::add_parsed_property( int id, const property_value& val )
+{
+	props_vector::iterator prop = find(id);
+	if (prop != m_properties.end() && prop->first == id)
+	{
+		if (!prop->second.m_important || (val.m_important && prop->second.m_important))
 		{
-			m_properties[name] = property_value(val.c_str(), important);
+			prop->second = val;
 		}
 	}
+	else
+	{
+		m_properties.insert(prop, props_entry(id, val));
+	}
+}
+
+void litehtml::style::append_parsed_property( const tstring& name, const tstring& val, bool important )
+{
+	int id = property_id(name);
+	props_vector::iterator prop = find(id);
+	if (prop != m_properties.end() && prop->first == id)
+	{
+		prop->second.m_value += _t(" ") + val;
+	}
+	else
+	{
+		add_parsed_property(name, val, important);
+	}
 }
 
 void litehtml::style::remove_property( const tstring& name, bool important )
 {
-	props_map::iterator prop = m_properties.find(name);
-	if(prop != m_properties.end())
+	int id = find_property_id(name.c_str());
+	props_vector::iterator prop = find(id);
+	if(prop != m_properties.end() && prop->first == id)
 	{
 		if( !prop->second.m_important || (important && prop->second.m_important) )
 		{
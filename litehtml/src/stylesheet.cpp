@@ -132,6 +132,101 @@ void litehtml::css::sort_selectors()
 			 return (*v1) < (*v2);
 		 }
 	);
+	build_index();
+}
+
+void litehtml::css::clear_index()
+{
+	m_id_index.clear();
+	m_class_index.clear();
+	m_tag_index.clear();
+	m_universal_index.clear();
+	m_indexed = false;
+}
+
+void litehtml::css::build_index()
+{
+	clear_index();
+
+	for(int i = 0; i < (int) m_selectors.size(); i++)
+	{
+		const css_element_selector& right = m_selectors[i]->m_right;
+
+		// Pick the most selective key the element selector requires.
+		// Ids and classes match case-insensitively, so they're indexed
+		// in lower case.  Class selectors from [class=...] syntax have
+		// no class list and don't require a class, so they can't be
+		// indexed by class.
+		const css_attribute_selector* id_attr = nullptr;
+		const css_attribute_selector* class_attr = nullptr;
+		for(const auto& attr : right.m_attrs)
+		{
+			if(attr.condition == select_equal)
+			{
+				if(attr.attribute == _t("id") && !id_attr)
+				{
+					id_attr = &attr;
+				} else if(attr.attribute == _t("class") && !class_attr && !attr.class_val.empty())
+				{
+					class_attr = &attr;
+				}
+			}
+		}
+
+		if(id_attr)
+		{
+			tstring key = id_attr->val;
+			lcase(key);
+			m_id_index[key].push_back(i);
+		} else if(class_attr)
+		{
+			tstring key = class_attr->class_val.front();
+			lcase(key);
+			m_class_index[key].push_back(i);
+		} else if(!right.m_tag.empty() && right.m_tag != _t("*"))
+		{
+			m_tag_index[right.m_tag].push_back(i);
+		} else
+		{
+			m_universal_index.push_back(i);
+		}
+	}
+
+	m_indexed = true;
+}
+
+void litehtml::css::get_candidates(const tchar_t* id, const string_vector& classes, const tstring& tag, index_list& result) const
+{
+	result.clear();
+
+	auto add = [&result](const selector_index& index, const tstring& key)
+	{
+		auto iter = index.find(key);
+		if(iter != index.end())
+		{
+			result.insert(result.end(), iter->second.begin(), iter->second.end());
+		}
+	};
+
+	if(id && id[0])
+	{
+		tstring key = id;
+		lcase(key);
+		add(m_id_index, key);
+	}
+	for(const auto& cls : classes)
+	{
+		tstring key = cls;
+		lcase(key);
+		add(m_class_index, key);
+	}
+	add(m_tag_index, tag);
+	result.insert(result.end(), m_universal_index.begin(), m_universal_index.end());
+
+	// Restore stylesheet order.  Each selector is in only one bucket,
+	// but an element can list the same class twice.
+	std::sort(result.begin(), result.end());
+	result.erase(std::unique(result.begin(), result.end()), result.end());
 }
 
 void litehtml::css::parse_atrule(const tstring& text, const tchar_t* baseurl, const std::shared_ptr<document>& doc, const media_query_list::ptr& media)
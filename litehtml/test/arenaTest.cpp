@@ -0,0 +1,77 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include "litehtml.h"
+#include "test/container_test.h"
+using namespace litehtml;
+
+extern const litehtml::tchar_t master_css[];
+
+static void AllocateTest() {
+  arena a(1024);
+
+  // allocations are aligned, and don't overlap
+  char* p1 = static_cast<char*>(a.allocate(10));
+  char* p2 = static_cast<char*>(a.allocate(10));
+  assert((uintptr_t)p1 % arena::alignment == 0 && (uintptr_t)p2 % arena::alignment == 0);
+  assert(p2 >= p1 + 10 || p1 >= p2 + 10);
+  assert(a.reserved() == 1024);
+
+  // freed memory is reused for the same size
+  a.deallocate(p1, 10);
+  assert(a.allocate(12) == p1);
+
+  // large requests get their own blocks
+  void* big = a.allocate(4000);
+  assert(big && a.reserved() == 1024 + 4000);
+  a.deallocate(big, 4000);
+}
+
+static void ElementLifetimeTest() {
+  context ctx;
+  auto container = std::make_shared<container_test>();
+  element::ptr el;
+  {
+    litehtml::document::ptr doc = document::createFromString(
+      _t("<html><body><p id=keep>text</p><div>more</div></body></html>"), container, &ctx);
+    el = doc->root()->select_one(_t("#keep"));
+    assert(el);
+  }
+
+  // the element pool lives as long as any element from it
+  assert(!t_strcmp(el->get_tagName(), _t("p")));
+  assert(el->get_children_count() == 1);
+}
+
+static void SmallDocumentBenchmarkTest() {
+  // the kind of small document a status overlay rebuilds over and over
+  const tchar_t* html = _t("<html><head><style>.s { color: red }</style></head><body>")
+    _t("<div class=s>Score: <b>12,345,670</b></div><div>Ball 2 of 3</div>")
+    _t("<ul><li>Extra ball lit</li><li>Jackpot ready</li></ul></body></html>");
+
+  context ctx;
+  ctx.load_master_stylesheet(master_css);
+  auto container = std::make_shared<container_test>();
+
+  // report the best of several runs
+  double best = 0;
+  for (int i = 0; i < 5; i++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int j = 0; j < 1000; j++) {
+      litehtml::document::ptr doc = document::createFromString(html, container, &ctx);
+      assert(doc->root());
+    }
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (i == 0 || elapsed < best)
+      best = elapsed;
+  }
+
+  printf("create and destroy 1000 small documents: %.2f ms\n", best);
+}
+
+void arenaTest() {
+  AllocateTest();
+  ElementLifetimeTest();
+  SmallDocumentBenchmarkTest();
+}
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include "litehtml.h"
+#include "test/container_test.h"
 using namespace litehtml;
 
 extern const tchar_t master_css[];
@@ -10,7 +11,46 @@ static void Test()
     ctx.load_master_stylesheet(master_css);
 }
 
+static bool HasColor(const document::ptr& doc, const tchar_t* selector, const tchar_t* color)
+{
+    element::ptr el = doc->root()->select_one(selector);
+    return el && !t_strcmp(el->get_style_property(_t("color"), false, _t("")), color);
+}
+
+static void CompiledCssTest()
+{
+    context ctx;
+    ctx.load_master_stylesheet(master_css);
+    auto container = std::make_shared<container_test>();
+
+    // documents with the same style text share one compiled style sheet
+    const tchar_t* style = _t("<html><head><style>p { color: red }</style></head>");
+    tstring html1 = tstring(style) + _t("<body><p>one</p></body></html>");
+    tstring html2 = tstring(style) + _t("<body><p>two</p><p>three</p></body></html>");
+    document::ptr doc1 = document::createFromString(html1.c_str(), container, &ctx);
+    document::ptr doc2 = document::createFromString(html2.c_str(), container, &ctx);
+    assert(doc1->styles() == doc2->styles());
+    assert(HasColor(doc2, _t("p:nth-child(2)"), _t("red")));
+
+    // different text compiles a new style sheet
+    document::ptr doc3 = document::createFromString(_t("<style>p { color: blue }</style><p>x</p>"), container, &ctx);
+    assert(doc3->styles() != doc1->styles());
+    assert(HasColor(doc3, _t("p"), _t("blue")));
+
+    // @media rules keep per-document state, so they're never shared
+    const tchar_t* media = _t("<style>@media screen { p { color: green } }</style><p>x</p>");
+    document::ptr doc4 = document::createFromString(media, container, &ctx);
+    document::ptr doc5 = document::createFromString(media, container, &ctx);
+    assert(doc4->styles() != doc5->styles());
+    assert(HasColor(doc5, _t("p"), _t("green")));
+
+    // a compiled style sheet can be applied to new content as user styles
+    document::ptr doc6 = document::createFromString(_t("<p>new</p>"), container, &ctx, doc1->styles().get());
+    assert(HasColor(doc6, _t("p"), _t("red")));
+}
+
 void contextTest()
 {
     Test();
+    CompiledCssTest();
 }
\ No newline at end of file
@@ -4,8 +4,8 @@
 using namespace litehtml;
 
 static void CssParseTest() {
-  container_test container;
-  litehtml::document::ptr doc = std::make_shared<litehtml::document>(&container, nullptr);
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc = std::make_shared<litehtml::document>(container, nullptr);
   media_query_list::ptr media = media_query_list::ptr();
   css c;
   c.parse_stylesheet(_t("/*Comment*/"), nullptr, doc, nullptr);
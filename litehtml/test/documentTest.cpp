@@ -4,8 +4,8 @@
 using namespace litehtml;
 
 static void AddFontTest() {
-  container_test container;
-  litehtml::document::ptr doc = std::make_shared<litehtml::document>(&container, nullptr);
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc = std::make_shared<litehtml::document>(container, nullptr);
   font_metrics fm;
   doc->get_font(nullptr, 0, _t("normal"), _t("normal"), _t(""), &fm);
   doc->get_font(_t("inherit"), 0, _t("normal"), _t("normal"), _t(""), &fm);
@@ -16,8 +16,8 @@ static void AddFontTest() {
 
 static void RenderTest() {
   context ctx;
-  container_test container;
-  litehtml::document::ptr doc = document::createFromString(_t("<html>Body</html>"), &container, &ctx);
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc = document::createFromString(_t("<html>Body</html>"), container, &ctx);
   doc->render(100, render_fixed_only);
   doc->render(100, render_no_fixed);
   doc->render(100, render_all);
@@ -25,15 +25,15 @@ static void RenderTest() {
 
 static void DrawTest() {
   context ctx;
-  container_test container;
-  litehtml::document::ptr doc = document::createFromString(_t("<html>Body</html>"), &container, &ctx);
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc = document::createFromString(_t("<html>Body</html>"), container, &ctx);
   position pos(0, 0, 100, 100);
   doc->draw((uint_ptr)0, 0, 0, &pos);
 }
 
 static void CvtUnitsTest() {
-  container_test container;
-  litehtml::document::ptr doc = std::make_shared<litehtml::document>(&container, nullptr);
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc = std::make_shared<litehtml::document>(container, nullptr);
   bool is_percent;
   doc->cvt_units(_t(""), 10, &is_percent);
   css_length c;
@@ -51,8 +51,8 @@ static void CvtUnitsTest() {
 }
 
 static void MouseEventsTest() {
-  container_test container;
-  litehtml::document::ptr doc = std::make_shared<litehtml::document>(&container, nullptr);
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc = std::make_shared<litehtml::document>(container, nullptr);
   position::vector redraw_boxes;
   doc->on_mouse_over(0, 0, 0, 0, redraw_boxes);
   doc->on_lbutton_down(0, 0, 0, 0, redraw_boxes);
@@ -61,8 +61,8 @@ static void MouseEventsTest() {
 }
 
 static void CreateElementTest() {
-  container_test container;
-  litehtml::document::ptr doc = std::make_shared<litehtml::document>(&container, nullptr);
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc = std::make_shared<litehtml::document>(container, nullptr);
   string_map map;
   doc->create_element(_t("container"), map);
   doc->create_element(_t("br"), map);
@@ -84,16 +84,16 @@ static void CreateElementTest() {
 }
 
 static void DeviceChangeTest() {
-  container_test container;
-  litehtml::document::ptr doc = std::make_shared<litehtml::document>(&container, nullptr);
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc = std::make_shared<litehtml::document>(container, nullptr);
   doc->media_changed();
   doc->lang_changed();
 }
 
 static void ParseTest() {
   context ctx;
-  container_test container;
-  document::createFromString(_t(""), &container, &ctx);
+  auto container = std::make_shared<container_test>();
+  document::createFromString(_t(""), container, &ctx);
 }
 
 void documentTest() {
@@ -5,8 +5,8 @@ using namespace litehtml;
 
 static void Test() {
   context ctx;
-  container_test container;
-  litehtml::document::ptr doc = document::createFromString(_t("<html>Body</html>"), &container, &ctx);
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc = document::createFromString(_t("<html>Body</html>"), container, &ctx);
   doc->render(50, render_all);
 }
 
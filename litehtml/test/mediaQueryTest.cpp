@@ -145,8 +145,8 @@ static void MediaQueryCheckTest() {
 }
 
 static void MediaQueryParseTest() {
-  container_test container;
-  litehtml::document::ptr doc = std::make_shared<litehtml::document>(&container, nullptr);
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc = std::make_shared<litehtml::document>(container, nullptr);
   media_query::ptr q;
   q = media_query::create_from_string(_t(""), doc);
   q = media_query::create_from_string(_t("not"), doc);
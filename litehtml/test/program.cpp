@@ -6,11 +6,15 @@ extern const litehtml::tchar_t master_css[] =
 ,0
 };
 
+void arenaTest();
 void contextTest();
 void cssTest();
 void documentTest();
 void layoutGlobalTest();
 void mediaQueryTest();
+void renderCacheTest();
+void selectorIndexTest();
+void styleTest();
 void webColorTest();
 
 #if _HASPAUSE
@@ -30,6 +34,10 @@ int main(int argc, char **argv) {
 	case 4: layoutGlobalTest(); break;
 	case 5: mediaQueryTest(); break;
 	case 6: webColorTest(); break;
+	case 7: selectorIndexTest(); break;
+	case 8: styleTest(); break;
+	case 9: renderCacheTest(); break;
+	case 10: arenaTest(); break;
 	default: mainPause("Unknown test."); break;
 	}
 	return 0;
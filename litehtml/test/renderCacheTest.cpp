@@ -0,0 +1,131 @@
+#include <assert.h>
+#include <stdio.h>
+#include <chrono>
+#include "litehtml.h"
+#include "test/container_test.h"
+using namespace litehtml;
+
+extern const litehtml::tchar_t master_css[];
+
+// A container with non-zero text widths, so that lines actually wrap
+class measuring_container : public container_test {
+public:
+  virtual int text_width(const tchar_t* text, uint_ptr hFont) override { return (int)t_strlen(text) * 8; }
+  virtual void get_client_rect(position& client) const override { client = position(0, 0, 400, 300); }
+};
+
+static void DumpLayout(const element::ptr& el, tstringstream& out) {
+  position pos = el->get_placement();
+  out << el->get_tagName() << _t(" ") << pos.x << _t(",") << pos.y << _t(",") << pos.width << _t(",") << pos.height << _t("\n");
+  for (size_t i = 0; i < el->get_children_count(); i++)
+    DumpLayout(el->get_child((int)i), out);
+}
+
+static tstring Layout(const document::ptr& doc) {
+  tstringstream out;
+  DumpLayout(doc->root(), out);
+  return out.str();
+}
+
+static tstring MakeHtml(const tchar_t* text) {
+  tstring html = _t("<html><head><style>")
+    _t(".box { margin: 4px; padding: 2px; border: 1px solid black }")
+    _t(".ib { display: inline-block; width: 100px }")
+    _t(".fl { float: left; width: 60px; height: 30px }")
+    _t(".ov { overflow: hidden }")
+    _t("#target::before { content: \"before \" } #target::after { content: \" after\"; display: block }")
+    _t("</style></head><body>")
+    _t("<div class=box><p>Static text before the change, long enough to wrap a few times</p></div>")
+    _t("<div class=fl style='height: 80px'>float</div>")
+    _t("<div class=box id=target>");
+  html += text;
+  html += _t("</div>")
+    _t("<div class=box>text next to the float, unless the changed text pushes it down</div>")
+    _t("<div class=box><span class=ib>inline block</span> and <b>bold</b> text</div>")
+    _t("<div style='position: relative'><p style='position: absolute; right: 0'>absolute</p>static</div>")
+    _t("<div class=ov><p>overflow hidden</p><p>second</p></div>")
+    _t("<div class=fl>float</div><div class=box>text flowing around the float</div>")
+    _t("<ul><li>one</li><li>two <i>three</i></li></ul>")
+    _t("<table><tr><td>cell</td><td>another cell</td></tr></table>")
+    _t("</body></html>");
+  return html;
+}
+
+static void IncrementalMatchTest() {
+  context ctx;
+  ctx.load_master_stylesheet(master_css);
+  auto container = std::make_shared<measuring_container>();
+
+  document::ptr doc = document::createFromString(MakeHtml(_t("short")).c_str(), container, &ctx);
+  doc->render(500);
+  tstring first = Layout(doc);
+
+  // rendering again reuses the saved layouts, and gives the same result
+  doc->render(500);
+  assert(Layout(doc) == first);
+
+  // change the text, and compare against a document built with the new text
+  const tchar_t* text = _t("a much longer text that takes several lines at this width, ")
+    _t("enough of them to push the next block down past the float, ")
+    _t("so that the lines of that block no longer wrap around the float, ")
+    _t("and its saved layout can't be reused");
+  element::ptr target = doc->root()->select_one(_t("#target"));
+  assert(target);
+  doc->set_element_text(target, text);
+  assert(target->is_layout_dirty() && doc->root()->is_layout_dirty());
+  assert(!t_strcmp(target->get_child(0)->get_tagName(), _t("::before")));
+  assert(!t_strcmp(target->get_child((int)target->get_children_count() - 1)->get_tagName(), _t("::after")));
+  doc->render(500);
+  document::ptr fresh = document::createFromString(MakeHtml(text).c_str(), container, &ctx);
+  fresh->render(500);
+  assert(Layout(doc) == Layout(fresh));
+
+  // a different width lays everything out again
+  doc->render(300);
+  fresh->render(300);
+  assert(Layout(doc) == Layout(fresh));
+}
+
+static void IncrementalBenchmarkTest() {
+  tstringstream html;
+  html << _t("<html><body><div id=status>0</div>");
+  for (int i = 0; i < 1000; i++) {
+    html << _t("<div class=row><p>Row ") << i << _t(" with <b>some</b> wrapping <i>text</i> in it</p>")
+      << _t("<ul><li>one</li><li>two</li></ul></div>");
+  }
+  html << _t("</body></html>");
+
+  context ctx;
+  ctx.load_master_stylesheet(master_css);
+  auto container = std::make_shared<measuring_container>();
+  document::ptr doc = document::createFromString(html.str().c_str(), container, &ctx);
+  element::ptr status = doc->root()->select_one(_t("#status"));
+  doc->render(400);
+
+  // report the best of several runs of each
+  double full = 0, incremental = 0;
+  for (int i = 0; i < 5; i++) {
+    auto start = std::chrono::steady_clock::now();
+    doc->invalidate_layout();
+    doc->render(400);
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (i == 0 || elapsed < full)
+      full = elapsed;
+
+    tstringstream text;
+    text << i;
+    start = std::chrono::steady_clock::now();
+    doc->set_element_text(status, text.str().c_str());
+    doc->render(400);
+    elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (i == 0 || elapsed < incremental)
+      incremental = elapsed;
+  }
+
+  printf("render, 1000 blocks: full %.2f ms, incremental %.2f ms\n", full, incremental);
+}
+
+void renderCacheTest() {
+  IncrementalMatchTest();
+  IncrementalBenchmarkTest();
+}
@@ -0,0 +1,97 @@
+#include <assert.h>
+#include <stdio.h>
+#include <chrono>
+#include "litehtml.h"
+#include "test/container_test.h"
+using namespace litehtml;
+
+static bool HasColor(const element::ptr& el, const tchar_t* color) {
+  const tchar_t* val = el->get_style_property(_t("color"), false, _t(""));
+  return !t_strcmp(val, color);
+}
+
+static void IndexMatchTest() {
+  context ctx;
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc = document::createFromString(
+    _t("<html><head><style>")
+    _t("* { color: gray }")
+    _t("p { color: black }")
+    _t(".Note { color: blue }")
+    _t("#Main { color: red }")
+    _t("div p.note { color: green }")
+    _t("[class=plain] { color: purple }")
+    _t(".a.b { color: orange }")
+    _t("</style></head><body>")
+    _t("<div><p id=main class=note>1</p><p class=NOTE>2</p><p>3</p><span>4</span>")
+    _t("<span class=plain>5</span><span class='b a a'>6</span></div>")
+    _t("</body></html>"), container, &ctx);
+
+  // id beats the class and tag rules, in any case
+  element::ptr el = doc->root()->select_one(_t("#main"));
+  assert(el), assert(HasColor(el, _t("red")));
+
+  // descendant class rule beats the bare class rule, classes match in any case
+  el = doc->root()->select_one(_t("p.NOTE:nth-child(2)"));
+  assert(el), assert(HasColor(el, _t("green")));
+
+  // tag and universal buckets
+  el = doc->root()->select_one(_t("p:nth-child(3)"));
+  assert(el), assert(HasColor(el, _t("black")));
+  el = doc->root()->select_one(_t("span:nth-child(4)"));
+  assert(el), assert(HasColor(el, _t("gray")));
+
+  // attribute-syntax class selectors stay in the universal bucket
+  el = doc->root()->select_one(_t("span:nth-child(5)"));
+  assert(el), assert(HasColor(el, _t("purple")));
+
+  // compound class selector, with a repeated class on the element
+  el = doc->root()->select_one(_t("span:nth-child(6)"));
+  assert(el), assert(HasColor(el, _t("orange")));
+}
+
+static void IndexBenchmarkTest() {
+  // a large stylesheet, mostly class and id rules, as generated CSS tends to be
+  tstringstream cssText;
+  for (int i = 0; i < 2000; i++) {
+    cssText << _t(".c") << i << _t(" { color: red }");
+    cssText << _t("#id") << i << _t(" { margin-left: 1px }");
+    cssText << _t("div .c") << i << _t(" .t") << i << _t(" { padding-left: 1px }");
+  }
+  tstringstream html;
+  html << _t("<html><body>");
+  for (int i = 0; i < 500; i++) {
+    html << _t("<div id=id") << i << _t(" class='c") << i << _t("'><span class=t") << i << _t(">x</span></div>");
+  }
+  html << _t("</body></html>");
+
+  context ctx;
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc1 = document::createFromString(html.str().c_str(), container, &ctx);
+  litehtml::document::ptr doc2 = document::createFromString(html.str().c_str(), container, &ctx);
+
+  // without sort_selectors(), the stylesheet isn't indexed, so this
+  // takes the path that tests every selector against every element
+  css sheet;
+  sheet.parse_stylesheet(cssText.str().c_str(), nullptr, doc1, nullptr);
+  assert(!sheet.is_indexed());
+  auto start = std::chrono::steady_clock::now();
+  doc1->root()->apply_stylesheet(sheet);
+  auto linear = std::chrono::steady_clock::now() - start;
+
+  sheet.sort_selectors();
+  assert(sheet.is_indexed());
+  start = std::chrono::steady_clock::now();
+  doc2->root()->apply_stylesheet(sheet);
+  auto indexed = std::chrono::steady_clock::now() - start;
+
+  printf("apply_stylesheet, %d rules: linear %.2f ms, indexed %.2f ms\n",
+    (int)sheet.selectors().size(),
+    std::chrono::duration<double, std::milli>(linear).count(),
+    std::chrono::duration<double, std::milli>(indexed).count());
+}
+
+void selectorIndexTest() {
+  IndexMatchTest();
+  IndexBenchmarkTest();
+}
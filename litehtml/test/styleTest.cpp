@@ -0,0 +1,105 @@
+#include <assert.h>
+#include <stdio.h>
+#include <chrono>
+#include "litehtml.h"
+#include "test/container_test.h"
+using namespace litehtml;
+
+extern const litehtml::tchar_t master_css[];
+
+static void PropertyIdTest() {
+  // fixed IDs for the built-in names, new IDs for others
+  assert(style::property_id(_t("margin-left")) == css_property_margin_left);
+  assert(style::find_property_id(_t("z-index")) == css_property_z_index);
+  assert(style::find_property_id(_t("-test-never-used")) == -1);
+  int id = style::property_id(_t("-test-custom"));
+  assert(id >= css_property_count);
+  assert(style::property_id(_t("-test-custom")) == id);
+  assert(style::find_property_id(_t("-test-custom")) == id);
+}
+
+static void TypedValueTest() {
+  style st;
+  st.add(_t("display: block; margin-left: 10px; padding-top: inherit; -test-other: abc"), nullptr);
+
+  // keyword and length values are parsed as they're added
+  const property_value* val = st.get_property_value(css_property_display);
+  assert(val && val->m_keyword == display_block && !val->m_inherit);
+  val = st.get_property_value(css_property_margin_left);
+  assert(val && val->m_length.val() == 10 && val->m_length.units() == css_units_px);
+  val = st.get_property_value(css_property_padding_top);
+  assert(val && val->m_inherit);
+
+  // the string API still works, including for names without fixed IDs
+  assert(!t_strcmp(st.get_property(_t("margin-left")), _t("10px")));
+  assert(!t_strcmp(st.get_property(_t("-test-other")), _t("abc")));
+  assert(st.get_property(_t("margin-right")) == nullptr);
+
+  // combining keeps the parsed values
+  style st2;
+  st2.combine(st);
+  val = st2.get_property_value(css_property_margin_left);
+  assert(val && val->m_length.val() == 10);
+}
+
+static void InheritTest() {
+  context ctx;
+  auto container = std::make_shared<container_test>();
+  litehtml::document::ptr doc = document::createFromString(
+    _t("<html><body><div style='text-align: center; margin-left: 7px; -test-prop: x'>")
+    _t("<p style='margin-left: inherit; text-align: bogus'>a</p><span>b</span></div></body></html>"),
+    container, &ctx);
+
+  element::ptr p = doc->root()->select_one(_t("p"));
+  element::ptr span = doc->root()->select_one(_t("span"));
+  assert(p && span);
+
+  // explicit inherit, and an invalid keyword
+  assert(p->margin_left() == 7);
+  assert(!t_strcmp(p->get_style_property(_t("text-align"), true, _t("")), _t("bogus")));
+
+  // inherited and initial values through the string API
+  assert(!t_strcmp(span->get_style_property(_t("text-align"), true, _t("")), _t("center")));
+  assert(!t_strcmp(span->get_style_property(_t("-test-prop"), true, _t("")), _t("x")));
+  assert(!t_strcmp(span->get_style_property(_t("-test-prop"), false, _t("none")), _t("none")));
+}
+
+static void DocumentBuildBenchmarkTest() {
+  // a document with a few thousand styled elements under the master
+  // stylesheet, to time the cascade and style parsing
+  tstringstream html;
+  html << _t("<html><head><style>")
+    _t("div { margin: 2px 4px; padding: 1px; border: 1px solid #ccc }")
+    _t(".t { font-weight: bold; text-align: center; line-height: 1.2 }")
+    _t("li { list-style-type: square }")
+    _t("</style></head><body>");
+  for (int i = 0; i < 1000; i++) {
+    html << _t("<div class=t style='width: ") << (i % 50 + 10) << _t("px'><p>Item <b>") << i
+      << _t("</b> <span>text</span></p><ul><li>one</li><li>two</li></ul></div>");
+  }
+  html << _t("</body></html>");
+
+  context ctx;
+  ctx.load_master_stylesheet(master_css);
+  auto container = std::make_shared<container_test>();
+
+  // report the best of several runs
+  double best = 0;
+  for (int i = 0; i < 5; i++) {
+    auto start = std::chrono::steady_clock::now();
+    litehtml::document::ptr doc = document::createFromString(html.str().c_str(), container, &ctx);
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    assert(doc);
+    if (i == 0 || elapsed < best)
+      best = elapsed;
+  }
+
+  printf("document build, 1000 blocks: %.2f ms\n", best);
+}
+
+void styleTest() {
+  PropertyIdTest();
+  TypedValueTest();
+  InheritTest();
+  DocumentBuildBenchmarkTest();
+}